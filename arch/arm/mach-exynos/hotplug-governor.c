@@ -0,0 +1,454 @@
+/* linux/arch/arm/mach-exynos/hotplug-governor.c
+ *
+ * EXYNOS - load based cpu hotplug policy
+ *
+ * Samples the averaged runqueue depth and the scheduler's runnable average
+ * of every online cpu, and brings secondary cores on- or offline once the
+ * load has stayed past a threshold for a hold time.  PM QoS can pin a
+ * minimum and maximum number of online cpus, and a tight cpu_dma_latency
+ * request keeps cores from being taken down.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+*/
+
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/cpu.h>
+#include <linux/cpumask.h>
+#include <linux/jiffies.h>
+#include <linux/kobject.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/mutex.h>
+#include <linux/pm_qos.h>
+#include <linux/sched.h>
+#include <linux/sysfs.h>
+#include <linux/workqueue.h>
+
+#define CREATE_TRACE_POINTS
+#include <trace/events/exynos_hotplug.h>
+
+enum hotplug_decision {
+	HOTPLUG_HOLD = 0,
+	HOTPLUG_UP,
+	HOTPLUG_DOWN,
+};
+
+struct hotplug_cpu_stats {
+	u64 nr_integral;
+	u64 nr_stamp;
+	unsigned long online_since;
+	bool resync;
+};
+
+static DEFINE_PER_CPU(struct hotplug_cpu_stats, hotplug_stats);
+
+static DEFINE_MUTEX(hotplug_gov_lock);
+static struct delayed_work hotplug_work;
+static struct kobject *hotplug_kobj;
+static bool hotplug_enabled;
+
+/* jiffies at which the up/down condition was first seen, 0 if not pending */
+static unsigned long up_pending_since;
+static unsigned long down_pending_since;
+
+/* Sampling period in milliseconds. */
+static unsigned int sample_ms = 50;
+
+/*
+ * Bring a core up when the averaged runqueue depth per online cpu (in
+ * hundredths of a task) or the busiest cpu's runnable ratio (in percent)
+ * reaches these thresholds.
+ */
+static unsigned int up_nr_threshold = 150;
+static unsigned int up_util_threshold = 80;
+
+/*
+ * Take a core down only when the whole load, both in tasks and in runnable
+ * ratio, would fit on one cpu less at these per-cpu levels.
+ */
+static unsigned int down_nr_threshold = 100;
+static unsigned int down_util_threshold = 50;
+
+/* How long a condition must persist before acting on it. */
+static unsigned int up_hold_ms = 100;
+static unsigned int down_hold_ms = 500;
+
+/* A core stays online at least this long once brought up. */
+static unsigned int min_online_ms = 1000;
+
+/* cpu_dma_latency requests below this keep every online core up. */
+static unsigned int latency_floor_us = 500;
+
+/* Upper bound for the sampling period and the hold times. */
+#define HOTPLUG_MAX_MS		60000
+
+static void hotplug_queue_work(unsigned long delay)
+{
+	queue_delayed_work(system_freezable_wq, &hotplug_work, delay);
+}
+
+/*
+ * Average runqueue depth of @cpu since the previous sample, in hundredths
+ * of a task, and its scheduler runnable ratio in percent.
+ */
+static void hotplug_sample_cpu(unsigned int cpu, unsigned int *nr,
+			       unsigned int *util)
+{
+	struct hotplug_cpu_stats *stats = &per_cpu(hotplug_stats, cpu);
+	u64 integral, stamp;
+
+	integral = sched_get_nr_running_integral(cpu, &stamp);
+
+	if (stats->resync || stamp <= stats->nr_stamp)
+		*nr = 0;
+	else
+		*nr = div64_u64((integral - stats->nr_integral) * 100,
+				stamp - stats->nr_stamp);
+
+	stats->nr_integral = integral;
+	stats->nr_stamp = stamp;
+	stats->resync = false;
+
+	*util = sched_get_cpu_util(cpu) * 100 >> SCHED_POWER_SHIFT;
+}
+
+static void hotplug_set_cpu(unsigned int cpu, bool up)
+{
+	ktime_t start = ktime_get();
+	int ret;
+
+	ret = up ? cpu_up(cpu) : cpu_down(cpu);
+
+	trace_exynos_hotplug_cpu(cpu, up, ret,
+			ktime_to_us(ktime_sub(ktime_get(), start)));
+	if (ret)
+		pr_debug("%s: cpu%u %s failed (%d)\n", __func__, cpu,
+			 up ? "up" : "down", ret);
+}
+
+static bool hotplug_held(unsigned long *pending_since, unsigned int hold_ms)
+{
+	unsigned long now = jiffies;
+
+	if (!*pending_since) {
+		*pending_since = now ? now : 1;
+		return hold_ms == 0;
+	}
+
+	return time_after_eq(now, *pending_since + msecs_to_jiffies(hold_ms));
+}
+
+static void hotplug_work_fn(struct work_struct *work)
+{
+	unsigned int cpu, nr, util;
+	unsigned int online = 0, total_nr = 0, total_util = 0, max_util = 0;
+	unsigned int min_cpus, max_cpus, possible = num_possible_cpus();
+	int down_cpu = -1, up_cpu = -1, last_cpu = -1;
+	unsigned int down_util = UINT_MAX;
+	enum hotplug_decision decision = HOTPLUG_HOLD;
+	bool latency_pinned;
+
+	mutex_lock(&hotplug_gov_lock);
+	if (!hotplug_enabled)
+		goto out;
+
+	get_online_cpus();
+	for_each_possible_cpu(cpu) {
+		struct hotplug_cpu_stats *stats = &per_cpu(hotplug_stats, cpu);
+
+		if (!cpu_online(cpu)) {
+			if (up_cpu < 0)
+				up_cpu = cpu;
+			continue;
+		}
+
+		hotplug_sample_cpu(cpu, &nr, &util);
+		online++;
+		total_nr += nr;
+		total_util += util;
+		max_util = max(max_util, util);
+
+		if (cpu == 0)
+			continue;
+		last_cpu = cpu;
+		if (time_before(jiffies, stats->online_since +
+				msecs_to_jiffies(min_online_ms)))
+			continue;
+		if (util < down_util) {
+			down_util = util;
+			down_cpu = cpu;
+		}
+	}
+	put_online_cpus();
+
+	min_cpus = clamp_t(int, pm_qos_request(PM_QOS_MIN_ONLINE_CPUS),
+			   1, possible);
+	max_cpus = clamp_t(int, pm_qos_request(PM_QOS_MAX_ONLINE_CPUS),
+			   min_cpus, possible);
+	latency_pinned = pm_qos_request(PM_QOS_CPU_DMA_LATENCY) <
+			 latency_floor_us;
+
+	if (online < min_cpus) {
+		decision = HOTPLUG_UP;
+	} else if (online > max_cpus) {
+		/* a QoS cap overrides the minimum online time */
+		decision = HOTPLUG_DOWN;
+		if (down_cpu < 0)
+			down_cpu = last_cpu;
+	} else if (online < max_cpus &&
+		   (total_nr >= up_nr_threshold * online ||
+		    max_util >= up_util_threshold)) {
+		down_pending_since = 0;
+		if (hotplug_held(&up_pending_since, up_hold_ms))
+			decision = HOTPLUG_UP;
+	} else if (online > min_cpus && !latency_pinned &&
+		   total_nr <= down_nr_threshold * (online - 1) &&
+		   total_util <= down_util_threshold * (online - 1)) {
+		up_pending_since = 0;
+		if (hotplug_held(&down_pending_since, down_hold_ms))
+			decision = HOTPLUG_DOWN;
+	} else {
+		up_pending_since = 0;
+		down_pending_since = 0;
+	}
+
+	trace_exynos_hotplug_eval(online, total_nr, max_util, total_util,
+				  decision);
+
+	if (decision == HOTPLUG_UP && up_cpu >= 0) {
+		hotplug_set_cpu(up_cpu, true);
+		up_pending_since = 0;
+	} else if (decision == HOTPLUG_DOWN && down_cpu > 0) {
+		hotplug_set_cpu(down_cpu, false);
+		down_pending_since = 0;
+	}
+
+	hotplug_queue_work(msecs_to_jiffies(sample_ms));
+out:
+	mutex_unlock(&hotplug_gov_lock);
+}
+
+static int __cpuinit hotplug_cpu_callback(struct notifier_block *nfb,
+					  unsigned long action, void *hcpu)
+{
+	unsigned int cpu = (unsigned long)hcpu;
+	struct hotplug_cpu_stats *stats = &per_cpu(hotplug_stats, cpu);
+
+	switch (action & ~CPU_TASKS_FROZEN) {
+	case CPU_ONLINE:
+		stats->online_since = jiffies;
+		stats->resync = true;
+		break;
+	}
+
+	return NOTIFY_OK;
+}
+
+static struct notifier_block __refdata hotplug_cpu_notifier = {
+	.notifier_call = hotplug_cpu_callback,
+};
+
+static int hotplug_qos_notify(struct notifier_block *nb, unsigned long val,
+			      void *data)
+{
+	mutex_lock(&hotplug_gov_lock);
+	if (hotplug_enabled) {
+		cancel_delayed_work(&hotplug_work);
+		hotplug_queue_work(0);
+	}
+	mutex_unlock(&hotplug_gov_lock);
+
+	return NOTIFY_OK;
+}
+
+static struct notifier_block hotplug_min_cpus_notifier = {
+	.notifier_call = hotplug_qos_notify,
+};
+
+static struct notifier_block hotplug_max_cpus_notifier = {
+	.notifier_call = hotplug_qos_notify,
+};
+
+static void hotplug_set_enabled(bool enable)
+{
+	unsigned int cpu;
+
+	mutex_lock(&hotplug_gov_lock);
+	if (enable == hotplug_enabled) {
+		mutex_unlock(&hotplug_gov_lock);
+		return;
+	}
+
+	hotplug_enabled = enable;
+	up_pending_since = 0;
+	down_pending_since = 0;
+	for_each_possible_cpu(cpu)
+		per_cpu(hotplug_stats, cpu).resync = true;
+	if (enable)
+		hotplug_queue_work(0);
+	mutex_unlock(&hotplug_gov_lock);
+
+	if (enable)
+		return;
+
+	/* Hand back a fully online system when the policy is turned off. */
+	cancel_delayed_work_sync(&hotplug_work);
+	for_each_present_cpu(cpu)
+		if (!cpu_online(cpu))
+			hotplug_set_cpu(cpu, true);
+}
+
+#define show_one(name)							\
+static ssize_t show_##name(struct kobject *kobj,			\
+			   struct kobj_attribute *attr, char *buf)	\
+{									\
+	return sprintf(buf, "%u\n", name);				\
+}
+
+/*
+ * @valid is checked against the other tunables under hotplug_gov_lock, so
+ * that the work never sees a down threshold above its up threshold.
+ */
+#define store_one(name, valid)						\
+static ssize_t store_##name(struct kobject *kobj,			\
+			    struct kobj_attribute *attr,		\
+			    const char *buf, size_t count)		\
+{									\
+	unsigned long val;						\
+	int ret;							\
+									\
+	ret = kstrtoul(buf, 0, &val);					\
+	if (ret < 0)							\
+		return ret;						\
+									\
+	mutex_lock(&hotplug_gov_lock);					\
+	if (!(valid)) {							\
+		mutex_unlock(&hotplug_gov_lock);			\
+		return -EINVAL;						\
+	}								\
+	name = val;							\
+	mutex_unlock(&hotplug_gov_lock);				\
+	return count;							\
+}
+
+#define hotplug_attr_rw(name, valid)					\
+show_one(name)								\
+store_one(name, valid)							\
+static struct kobj_attribute name##_attr =				\
+	__ATTR(name, 0644, show_##name, store_##name)
+
+hotplug_attr_rw(up_nr_threshold,
+		val && val <= 100 * NR_CPUS && val >= down_nr_threshold);
+hotplug_attr_rw(up_util_threshold,
+		val && val <= 100 && val >= down_util_threshold);
+hotplug_attr_rw(down_nr_threshold, val <= up_nr_threshold);
+hotplug_attr_rw(down_util_threshold, val <= up_util_threshold);
+hotplug_attr_rw(up_hold_ms, val <= HOTPLUG_MAX_MS);
+hotplug_attr_rw(down_hold_ms, val <= HOTPLUG_MAX_MS);
+hotplug_attr_rw(min_online_ms, val <= HOTPLUG_MAX_MS);
+hotplug_attr_rw(latency_floor_us, val <= INT_MAX);
+
+static ssize_t show_sample_ms(struct kobject *kobj,
+			      struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", sample_ms);
+}
+
+static ssize_t store_sample_ms(struct kobject *kobj,
+			       struct kobj_attribute *attr,
+			       const char *buf, size_t count)
+{
+	unsigned long val;
+	int ret;
+
+	ret = kstrtoul(buf, 0, &val);
+	if (ret < 0)
+		return ret;
+	if (!val || val > HOTPLUG_MAX_MS)
+		return -EINVAL;
+
+	mutex_lock(&hotplug_gov_lock);
+	sample_ms = val;
+	mutex_unlock(&hotplug_gov_lock);
+	return count;
+}
+
+static struct kobj_attribute sample_ms_attr =
+	__ATTR(sample_ms, 0644, show_sample_ms, store_sample_ms);
+
+static ssize_t show_enabled(struct kobject *kobj,
+			    struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", hotplug_enabled);
+}
+
+static ssize_t store_enabled(struct kobject *kobj,
+			     struct kobj_attribute *attr,
+			     const char *buf, size_t count)
+{
+	unsigned long val;
+	int ret;
+
+	ret = kstrtoul(buf, 0, &val);
+	if (ret < 0)
+		return ret;
+	hotplug_set_enabled(!!val);
+	return count;
+}
+
+static struct kobj_attribute enabled_attr =
+	__ATTR(enabled, 0644, show_enabled, store_enabled);
+
+static struct attribute *hotplug_attributes[] = {
+	&enabled_attr.attr,
+	&sample_ms_attr.attr,
+	&up_nr_threshold_attr.attr,
+	&up_util_threshold_attr.attr,
+	&down_nr_threshold_attr.attr,
+	&down_util_threshold_attr.attr,
+	&up_hold_ms_attr.attr,
+	&down_hold_ms_attr.attr,
+	&min_online_ms_attr.attr,
+	&latency_floor_us_attr.attr,
+	NULL,
+};
+
+static struct attribute_group hotplug_attr_group = {
+	.attrs = hotplug_attributes,
+};
+
+static int __init exynos_hotplug_governor_init(void)
+{
+	unsigned int cpu;
+	int ret;
+
+	INIT_DELAYED_WORK_DEFERRABLE(&hotplug_work, hotplug_work_fn);
+
+	for_each_online_cpu(cpu) {
+		per_cpu(hotplug_stats, cpu).online_since = jiffies;
+		per_cpu(hotplug_stats, cpu).resync = true;
+	}
+	register_hotcpu_notifier(&hotplug_cpu_notifier);
+
+	pm_qos_add_notifier(PM_QOS_MIN_ONLINE_CPUS, &hotplug_min_cpus_notifier);
+	pm_qos_add_notifier(PM_QOS_MAX_ONLINE_CPUS, &hotplug_max_cpus_notifier);
+
+	hotplug_kobj = kobject_create_and_add("hotplug",
+					      &cpu_subsys.dev_root->kobj);
+	if (!hotplug_kobj)
+		return -ENOMEM;
+
+	ret = sysfs_create_group(hotplug_kobj, &hotplug_attr_group);
+	if (ret) {
+		kobject_put(hotplug_kobj);
+		return ret;
+	}
+
+	hotplug_set_enabled(true);
+
+	return 0;
+}
+late_initcall(exynos_hotplug_governor_init);
@@ -157,6 +157,20 @@ static int T_slow[2];
 static int T_fast[2];
 static int device_speed_thresh[2];
 
+/*
+ * Flash profile. On a non-rotational device there is no seek to save by
+ * idling, and idling only delays the other queues, so the device is idled
+ * only for weight-raised queues, whose service guarantees are the reason
+ * to idle at all. The profile is dropped if the peak rate puts the device
+ * in the slow class (e.g., a cheap SD card), where waiting for the next
+ * sequential request of a queue may still pay off.
+ */
+static inline bool bfq_flash_profile(struct bfq_data *bfqd)
+{
+	return bfqd->bfq_flash_profile && blk_queue_nonrot(bfqd->queue) &&
+	       bfqd->device_speed == BFQ_BFQD_FAST;
+}
+
 #define BFQ_SERVICE_TREE_INIT	((struct bfq_service_tree)		\
 				{ RB_ROOT, RB_ROOT, NULL, NULL, 0, 0 })
 
@@ -1686,21 +1700,14 @@ static inline unsigned long bfq_min_budget(struct bfq_data *bfqd)
 		return bfqd->bfq_max_budget / 32;
 }
 
-static void bfq_arm_slice_timer(struct bfq_data *bfqd)
+/*
+ * Duration of the idle slice granted to the in-service queue @bfqq.
+ */
+static unsigned long bfq_idle_slice(struct bfq_data *bfqd,
+				    struct bfq_queue *bfqq)
 {
-	struct bfq_queue *bfqq = bfqd->in_service_queue;
-	struct bfq_io_cq *bic;
 	unsigned long sl;
 
-	BUG_ON(!RB_EMPTY_ROOT(&bfqq->sort_list));
-
-	/* Processes have exited, don't wait. */
-	bic = bfqd->in_service_bic;
-	if (bic == NULL || atomic_read(&bic->icq.ioc->nr_tasks) == 0)
-		return;
-
-	bfq_mark_bfqq_wait_request(bfqq);
-
 	/*
 	 * We don't want to idle for seeks, but we do want to allow
 	 * fair distribution of slice time for a process doing back-to-back
@@ -1726,6 +1733,26 @@ static void bfq_arm_slice_timer(struct bfq_data *bfqd)
 		sl = min(sl, msecs_to_jiffies(BFQ_MIN_TT));
 	else if (bfqq->wr_coeff > 1)
 		sl = sl * 3;
+
+	return sl;
+}
+
+static void bfq_arm_slice_timer(struct bfq_data *bfqd)
+{
+	struct bfq_queue *bfqq = bfqd->in_service_queue;
+	struct bfq_io_cq *bic;
+	unsigned long sl;
+
+	BUG_ON(!RB_EMPTY_ROOT(&bfqq->sort_list));
+
+	/* Processes have exited, don't wait. */
+	bic = bfqd->in_service_bic;
+	if (bic == NULL || atomic_read(&bic->icq.ioc->nr_tasks) == 0)
+		return;
+
+	bfq_mark_bfqq_wait_request(bfqq);
+
+	sl = bfq_idle_slice(bfqd, bfqq);
 	bfqd->last_idling_start = ktime_get();
 	mod_timer(&bfqd->idle_slice_timer, jiffies + sl);
 	bfq_log(bfqd, "arm idle: %u/%u ms",
@@ -2220,12 +2247,27 @@ static void bfq_bfqq_expire(struct bfq_data *bfqd,
 			    enum bfqq_expiration reason)
 {
 	int slow;
+	bool trivial;
 	BUG_ON(bfqq != bfqd->in_service_queue);
 
+	/*
+	 * With the flash profile, a sync queue that emptied after less
+	 * than the minimum budget of service is trivial: its slice is
+	 * too short to tell the peak rate estimator anything, it cannot
+	 * be slow, and the budget feedback would leave its budget
+	 * unchanged anyway. Skip both.
+	 */
+	trivial = bfq_flash_profile(bfqd) && bfq_bfqq_sync(bfqq) &&
+		  reason == BFQ_BFQQ_NO_MORE_REQUESTS &&
+		  bfqq->entity.service <= bfq_min_budget(bfqd);
+
 	/* Update disk peak rate for autotuning and check whether the
 	 * process is slow (see bfq_update_peak_rate).
 	 */
-	slow = bfq_update_peak_rate(bfqd, bfqq, compensate, reason);
+	if (trivial)
+		slow = 0;
+	else
+		slow = bfq_update_peak_rate(bfqd, bfqq, compensate, reason);
 
 	/*
 	 * As above explained, 'punish' slow (i.e., seeky), timed-out
@@ -2300,14 +2342,16 @@ static void bfq_bfqq_expire(struct bfq_data *bfqd,
 	}
 
 	bfq_log_bfqq(bfqd, bfqq,
-		"expire (%d, slow %d, num_disp %d, idle_win %d)", reason,
-		slow, bfqq->dispatched, bfq_bfqq_idle_window(bfqq));
+		"expire (%d, slow %d, num_disp %d, idle_win %d, trivial %d)",
+		reason, slow, bfqq->dispatched, bfq_bfqq_idle_window(bfqq),
+		trivial);
 
 	/*
 	 * Increase, decrease or leave budget unchanged according to
 	 * reason.
 	 */
-	__bfq_bfqq_recalc_budget(bfqd, bfqq, reason);
+	if (!trivial)
+		__bfq_bfqq_recalc_budget(bfqd, bfqq, reason);
 	__bfq_bfqq_expire(bfqd, bfqq);
 }
 
@@ -2478,7 +2522,7 @@ static inline int bfq_may_expire_for_budg_timeout(struct bfq_queue *bfqq)
  * become impossible to let requests be served in the new desired order
  * until all the requests already queued in the device have been served.
  */
-static inline bool bfq_bfqq_must_not_expire(struct bfq_queue *bfqq)
+static inline bool __bfq_bfqq_must_not_expire(struct bfq_queue *bfqq)
 {
 	struct bfq_data *bfqd = bfqq->bfqd;
 #define cond_for_seeky_on_ncq_hdd (bfq_bfqq_constantly_seeky(bfqq) && \
@@ -2507,6 +2551,18 @@ static inline bool bfq_bfqq_must_not_expire(struct bfq_queue *bfqq)
 	);
 }
 
+/*
+ * With the flash profile, only weight-raised queues may keep the device
+ * idle.
+ */
+static inline bool bfq_bfqq_must_not_expire(struct bfq_queue *bfqq)
+{
+	if (bfq_flash_profile(bfqq->bfqd) && bfqq->wr_coeff == 1)
+		return false;
+
+	return __bfq_bfqq_must_not_expire(bfqq);
+}
+
 /*
  * If the in-service queue is empty but sync, and the function
  * bfq_bfqq_must_not_expire returns true, then:
@@ -2526,6 +2582,27 @@ static inline bool bfq_bfqq_must_idle(struct bfq_queue *bfqq)
 	       bfq_bfqq_must_not_expire(bfqq);
 }
 
+/*
+ * Called when the in-service queue @bfqq is not idled for: account the
+ * idle slice it would have been granted without the flash profile.
+ */
+static void bfq_account_idle_saved(struct bfq_data *bfqd,
+				   struct bfq_queue *bfqq)
+{
+	unsigned long sl;
+
+	if (!RB_EMPTY_ROOT(&bfqq->sort_list) || bfqd->bfq_slice_idle == 0 ||
+	    !bfq_flash_profile(bfqd) || !__bfq_bfqq_must_not_expire(bfqq))
+		return;
+
+	sl = bfq_idle_slice(bfqd, bfqq);
+	bfqq->idle_time_saved += sl;
+	bfqd->idle_time_saved += sl;
+	bfqd->idle_slices_saved++;
+	bfq_log_bfqq(bfqd, bfqq, "idling skipped: %u ms",
+		     jiffies_to_msecs(sl));
+}
+
 /*
  * Select a queue for service.  If we have a current queue in service,
  * check whether to continue servicing it, or retrieve and set a new one.
@@ -3048,6 +3125,7 @@ static void bfq_init_bfqq(struct bfq_data *bfqd, struct bfq_queue *bfqq,
 
 	bfqq->wr_coeff = 1;
 	bfqq->last_wr_start_finish = 0;
+	bfqq->idle_time_saved = 0;
 	/*
 	 * Set to the value for which bfqq will not be deemed as
 	 * soft rt when it becomes backlogged.
@@ -3461,7 +3539,10 @@ static void bfq_completed_request(struct request_queue *q, struct request *rq)
 		if (bfq_bfqq_must_idle(bfqq)) {
 			bfq_arm_slice_timer(bfqd);
 			goto out;
-		} else if (bfq_may_expire_for_budg_timeout(bfqq))
+		}
+
+		bfq_account_idle_saved(bfqd, bfqq);
+		if (bfq_may_expire_for_budg_timeout(bfqq))
 			bfq_bfqq_expire(bfqd, bfqq, 0, BFQ_BFQQ_BUDGET_TIMEOUT);
 		else if (RB_EMPTY_ROOT(&bfqq->sort_list) &&
 			 (bfqq->dispatched == 0 ||
@@ -3854,6 +3935,8 @@ static void *bfq_init_queue(struct request_queue *q)
 	bfqd->bfq_failed_cooperations = 7000;
 	bfqd->bfq_requests_within_timer = 120;
 
+	bfqd->bfq_flash_profile = true;
+
 	bfqd->bfq_large_burst_thresh = 11;
 	bfqd->bfq_burst_interval = msecs_to_jiffies(500);
 
@@ -3939,24 +4022,27 @@ static ssize_t bfq_weights_show(struct elevator_queue *e, char *page)
 	num_char += sprintf(page + num_char, "Active:\n");
 	list_for_each_entry(bfqq, &bfqd->active_list, bfqq_list) {
 	  num_char += sprintf(page + num_char,
-			      "pid%d: weight %hu, nr_queued %d %d, dur %d/%u\n",
+			      "pid%d: weight %hu, nr_queued %d %d, dur %d/%u, "
+			      "idle saved %u\n",
 			      bfqq->pid,
 			      bfqq->entity.weight,
 			      bfqq->queued[0],
 			      bfqq->queued[1],
 			jiffies_to_msecs(jiffies - bfqq->last_wr_start_finish),
-			jiffies_to_msecs(bfqq->wr_cur_max_time));
+			jiffies_to_msecs(bfqq->wr_cur_max_time),
+			jiffies_to_msecs(bfqq->idle_time_saved));
 	}
 
 	num_char += sprintf(page + num_char, "Idle:\n");
 	list_for_each_entry(bfqq, &bfqd->idle_list, bfqq_list) {
 			num_char += sprintf(page + num_char,
-				"pid%d: weight %hu, dur %d/%u\n",
+				"pid%d: weight %hu, dur %d/%u, idle saved %u\n",
 				bfqq->pid,
 				bfqq->entity.weight,
 				jiffies_to_msecs(jiffies -
 					bfqq->last_wr_start_finish),
-				jiffies_to_msecs(bfqq->wr_cur_max_time));
+				jiffies_to_msecs(bfqq->wr_cur_max_time),
+				jiffies_to_msecs(bfqq->idle_time_saved));
 	}
 
 	spin_unlock_irq(bfqd->queue->queue_lock);
@@ -3990,6 +4076,9 @@ SHOW_FUNCTION(bfq_wr_min_idle_time_show, bfqd->bfq_wr_min_idle_time, 1);
 SHOW_FUNCTION(bfq_wr_min_inter_arr_async_show, bfqd->bfq_wr_min_inter_arr_async,
 	1);
 SHOW_FUNCTION(bfq_wr_max_softrt_rate_show, bfqd->bfq_wr_max_softrt_rate, 0);
+SHOW_FUNCTION(bfq_flash_profile_show, bfqd->bfq_flash_profile, 0);
+SHOW_FUNCTION(bfq_idling_time_saved_show, bfqd->idle_time_saved, 1);
+SHOW_FUNCTION(bfq_idle_slices_saved_show, bfqd->idle_slices_saved, 0);
 #undef SHOW_FUNCTION
 
 #define STORE_FUNCTION(__FUNC, __PTR, MIN, MAX, __CONV)			\
@@ -4031,6 +4120,7 @@ STORE_FUNCTION(bfq_wr_min_inter_arr_async_store,
 		&bfqd->bfq_wr_min_inter_arr_async, 0, INT_MAX, 1);
 STORE_FUNCTION(bfq_wr_max_softrt_rate_store, &bfqd->bfq_wr_max_softrt_rate, 0,
 		INT_MAX, 0);
+STORE_FUNCTION(bfq_flash_profile_store, &bfqd->bfq_flash_profile, 0, 1, 0);
 #undef STORE_FUNCTION
 
 /* do nothing for the moment */
@@ -4107,6 +4197,8 @@ static ssize_t bfq_low_latency_store(struct elevator_queue *e,
 
 #define BFQ_ATTR(name) \
 	__ATTR(name, S_IRUGO|S_IWUSR, bfq_##name##_show, bfq_##name##_store)
+#define BFQ_RO_ATTR(name) \
+	__ATTR(name, S_IRUGO, bfq_##name##_show, NULL)
 
 static struct elv_fs_entry bfq_attrs[] = {
 	BFQ_ATTR(fifo_expire_sync),
@@ -4126,6 +4218,9 @@ static struct elv_fs_entry bfq_attrs[] = {
 	BFQ_ATTR(wr_min_inter_arr_async),
 	BFQ_ATTR(wr_max_softrt_rate),
 	BFQ_ATTR(weights),
+	BFQ_ATTR(flash_profile),
+	BFQ_RO_ATTR(idling_time_saved),
+	BFQ_RO_ATTR(idle_slices_saved),
 	__ATTR_NULL
 };
 
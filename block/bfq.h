@@ -226,6 +226,9 @@ struct bfq_group;
  *                           backlogged
  * @bic: pointer to the bfq_io_cq owning the bfq_queue, set to %NULL if the
  *	 queue is shared
+ * @idle_time_saved: idle slices (in jiffies) the queue would have been
+ *                   granted without the flash profile (see
+ *                   bfq_flash_profile())
  *
  * A bfq_queue is a leaf request queue; it can be associated with an
  * io_context or more, if it  is  async or shared  between  cooperating
@@ -281,6 +284,8 @@ struct bfq_queue {
 	unsigned int wr_coeff;
 	unsigned long last_idle_bklogged;
 	unsigned long service_from_backlogged;
+
+	unsigned long idle_time_saved;
 };
 
 /**
@@ -477,6 +482,10 @@ enum bfq_device_speed {
  * @RT_prod: cached value of the product R*T used for computing the maximum
  *	     duration of the weight raising automatically.
  * @device_speed: device-speed class for the low-latency heuristic.
+ * @bfq_flash_profile: if set, use the flash profile on fast non-rotational
+ *                     devices (see bfq_flash_profile()).
+ * @idle_slices_saved: idle slices not armed because of the flash profile.
+ * @idle_time_saved: total duration of those slices (jiffies).
  * @oom_bfqq: fallback dummy bfqq for extreme OOM conditions.
  *
  * All the fields are protected by the @queue lock.
@@ -559,6 +568,10 @@ struct bfq_data {
 	u64 RT_prod;
 	enum bfq_device_speed device_speed;
 
+	bool bfq_flash_profile;
+	unsigned long idle_slices_saved;
+	unsigned long idle_time_saved;
+
 	struct bfq_queue oom_bfqq;
 };
 
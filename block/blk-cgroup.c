@@ -1352,6 +1352,14 @@ static u64 blkiocg_file_read_u64 (struct cgroup *cgrp, struct cftype *cft) {
 			return (u64)blkcg->weight;
 		}
 		break;
+	case BLKIO_POLICY_LATENCY:
+		switch(name) {
+		case BLKIO_LATENCY_read_latency:
+			return (u64)blkcg->read_latency;
+		case BLKIO_LATENCY_write_latency:
+			return (u64)blkcg->write_latency;
+		}
+		break;
 	default:
 		BUG();
 	}
@@ -1374,6 +1382,18 @@ blkiocg_file_write_u64(struct cgroup *cgrp, struct cftype *cft, u64 val)
 			return blkio_weight_write(blkcg, val);
 		}
 		break;
+	case BLKIO_POLICY_LATENCY:
+		if (val > INT_MAX)
+			return -EINVAL;
+		switch(name) {
+		case BLKIO_LATENCY_read_latency:
+			blkcg->read_latency = val;
+			break;
+		case BLKIO_LATENCY_write_latency:
+			blkcg->write_latency = val;
+			break;
+		}
+		break;
 	default:
 		BUG();
 	}
@@ -1449,6 +1469,20 @@ struct cftype blkio_files[] = {
 		.name = "reset_stats",
 		.write_u64 = blkiocg_reset_stats,
 	},
+	{
+		.name = "read_latency",
+		.private = BLKIOFILE_PRIVATE(BLKIO_POLICY_LATENCY,
+				BLKIO_LATENCY_read_latency),
+		.read_u64 = blkiocg_file_read_u64,
+		.write_u64 = blkiocg_file_write_u64,
+	},
+	{
+		.name = "write_latency",
+		.private = BLKIOFILE_PRIVATE(BLKIO_POLICY_LATENCY,
+				BLKIO_LATENCY_write_latency),
+		.read_u64 = blkiocg_file_read_u64,
+		.write_u64 = blkiocg_file_write_u64,
+	},
 #ifdef CONFIG_BLK_DEV_THROTTLING
 	{
 		.name = "throttle.read_bps_device",
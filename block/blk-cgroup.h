@@ -19,6 +19,7 @@
 enum blkio_policy_id {
 	BLKIO_POLICY_PROP = 0,		/* Proportional Bandwidth division */
 	BLKIO_POLICY_THROTL,		/* Throttling */
+	BLKIO_POLICY_LATENCY,		/* Latency targets */
 };
 
 /* Max limits for throttle policy */
@@ -111,9 +112,18 @@ enum blkcg_file_name_throtl {
 	BLKIO_THROTL_io_serviced,
 };
 
+/* cgroup files owned by latency target policy */
+enum blkcg_file_name_latency {
+	BLKIO_LATENCY_read_latency,
+	BLKIO_LATENCY_write_latency,
+};
+
 struct blkio_cgroup {
 	struct cgroup_subsys_state css;
 	unsigned int weight;
+	/* latency targets in msecs, 0 leaves it to the io scheduler */
+	unsigned int read_latency;
+	unsigned int write_latency;
 	spinlock_t lock;
 	struct hlist_head blkg_list;
 	struct list_head policy_list; /* list of blkio_policy_node */
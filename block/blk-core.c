@@ -16,6 +16,7 @@
 #include <linux/backing-dev.h>
 #include <linux/bio.h>
 #include <linux/blkdev.h>
+#include <linux/blk-mq.h>
 #include <linux/highmem.h>
 #include <linux/mm.h>
 #include <linux/kernel_stat.h>
@@ -34,6 +35,7 @@
 #include <trace/events/block.h>
 
 #include "blk.h"
+#include "blk-mq.h"
 
 EXPORT_TRACEPOINT_SYMBOL_GPL(block_bio_remap);
 EXPORT_TRACEPOINT_SYMBOL_GPL(block_rq_remap);
@@ -56,7 +58,7 @@ struct kmem_cache *blk_requestq_cachep;
  */
 static struct workqueue_struct *kblockd_workqueue;
 
-static void drive_stat_acct(struct request *rq, int new_io)
+void drive_stat_acct(struct request *rq, int new_io)
 {
 	struct hd_struct *part;
 	int rw = rq_data_dir(rq);
@@ -287,6 +289,14 @@ void blk_sync_queue(struct request_queue *q)
 {
 	del_timer_sync(&q->timeout);
 	cancel_delayed_work_sync(&q->delay_work);
+
+	if (q->mq_ops) {
+		struct blk_mq_hw_ctx *hctx;
+		unsigned int i;
+
+		queue_for_each_hw_ctx(q, hctx, i)
+			cancel_delayed_work_sync(&hctx->run_work);
+	}
 }
 EXPORT_SYMBOL(blk_sync_queue);
 
@@ -433,7 +443,9 @@ void blk_cleanup_queue(struct request_queue *q)
 	 * be trying to tear down @q before its elevator is initialized, in
 	 * which case we don't want to call into draining.
 	 */
-	if (q->elevator)
+	if (q->mq_ops)
+		blk_mq_drain_queue(q);
+	else if (q->elevator)
 		blk_drain_queue(q, true);
 
 	/* @q won't process any more request, flush async actions */
@@ -498,8 +510,14 @@ struct request_queue *blk_alloc_queue_node(gfp_t gfp_mask, int node_id)
 	if (err)
 		goto fail_id;
 
-	if (blk_throtl_init(q))
+#ifdef CONFIG_BLK_DEV_LATENCY_HIST
+	q->lat_hist = alloc_percpu(struct blk_lat_hist);
+	if (!q->lat_hist)
 		goto fail_bdi;
+#endif
+
+	if (blk_throtl_init(q))
+		goto fail_hist;
 
 	setup_timer(&q->backing_dev_info.laptop_mode_wb_timer,
 		    laptop_mode_timer_fn, (unsigned long) q);
@@ -524,6 +542,10 @@ struct request_queue *blk_alloc_queue_node(gfp_t gfp_mask, int node_id)
 
 	return q;
 
+fail_hist:
+#ifdef CONFIG_BLK_DEV_LATENCY_HIST
+	free_percpu(q->lat_hist);
+#endif
 fail_bdi:
 	bdi_destroy(&q->backing_dev_info);
 fail_id:
@@ -1195,8 +1217,8 @@ void blk_add_request_payload(struct request *rq, struct page *page,
 }
 EXPORT_SYMBOL_GPL(blk_add_request_payload);
 
-static bool bio_attempt_back_merge(struct request_queue *q, struct request *req,
-				   struct bio *bio)
+bool bio_attempt_back_merge(struct request_queue *q, struct request *req,
+			    struct bio *bio)
 {
 	const int ff = bio->bi_rw & REQ_FAILFAST_MASK;
 
@@ -1217,8 +1239,8 @@ static bool bio_attempt_back_merge(struct request_queue *q, struct request *req,
 	return true;
 }
 
-static bool bio_attempt_front_merge(struct request_queue *q,
-				    struct request *req, struct bio *bio)
+bool bio_attempt_front_merge(struct request_queue *q, struct request *req,
+			     struct bio *bio)
 {
 	const int ff = bio->bi_rw & REQ_FAILFAST_MASK;
 
@@ -1311,6 +1333,7 @@ void init_request_from_bio(struct request *req, struct bio *bio)
 	req->errors = 0;
 	req->__sector = bio->bi_sector;
 	req->ioprio = bio_prio(bio);
+	req->write_hint = bio->bi_write_hint;
 	blk_rq_bio_prep(req->q, req, bio);
 }
 
@@ -1596,9 +1619,16 @@ generic_make_request_checks(struct bio *bio)
 		goto end_io;
 	}
 
+	if (unlikely(bio->bi_write_hint >= NR_WRITE_HINTS))
+		bio->bi_write_hint = WRITE_LIFE_NOT_SET;
+
 	if (blk_throtl_bio(q, bio))
 		return false;	/* throttled, will be resubmitted later */
 
+	if (bio_data_dir(bio) == WRITE && bio_has_data(bio))
+		atomic64_add(bio->bi_size,
+			     &q->write_hint_bytes[bio->bi_write_hint]);
+
 	trace_block_bio_queue(q, bio);
 	return true;
 
@@ -1871,7 +1901,59 @@ static void blk_account_io_completion(struct request *req, unsigned int bytes)
 	}
 }
 
-static void blk_account_io_done(struct request *req)
+#ifdef CONFIG_BLK_DEV_LATENCY_HIST
+static int blk_lat_hist_bucket(u64 ns)
+{
+	u64 us = div_u64(ns, NSEC_PER_USEC);
+
+	return min_t(int, fls64(us >> BLK_LAT_HIST_SHIFT),
+		     BLK_LAT_HIST_BUCKETS - 1);
+}
+
+static int blk_lat_hist_size(unsigned int bytes)
+{
+	int i;
+
+	for (i = 0; i < BLK_LAT_HIST_SIZES - 1; i++)
+		if (bytes <= 4096U << (2 * i))
+			break;
+	return i;
+}
+
+/*
+ * Called with preemption disabled from blk_account_io_done(), so the
+ * per-cpu counters can be bumped without further locking, the same way
+ * the partition stats are.
+ */
+static void blk_account_io_latency(struct request *req, int cpu)
+{
+	struct blk_lat_hist *hist;
+	u64 now, queued, serviced;
+	int rw, size;
+
+	if (!req->q->lat_hist || (req->cmd_flags & REQ_DISCARD) ||
+	    !req->io_start_time_ns)
+		return;
+
+	now = sched_clock();
+	queued = 0;
+	if (req->io_start_time_ns > req->start_time_ns)
+		queued = req->io_start_time_ns - req->start_time_ns;
+	serviced = 0;
+	if (now > req->io_start_time_ns)
+		serviced = now - req->io_start_time_ns;
+
+	rw = rq_data_dir(req);
+	size = blk_lat_hist_size(req->io_start_bytes);
+	hist = per_cpu_ptr(req->q->lat_hist, cpu);
+	hist->count[rw][size][BLK_LAT_QUEUE][blk_lat_hist_bucket(queued)]++;
+	hist->count[rw][size][BLK_LAT_DEVICE][blk_lat_hist_bucket(serviced)]++;
+}
+#else
+static inline void blk_account_io_latency(struct request *req, int cpu) { }
+#endif
+
+void blk_account_io_done(struct request *req)
 {
 	/*
 	 * Account IO completion.  flush_rq isn't accounted as a
@@ -1891,6 +1973,7 @@ static void blk_account_io_done(struct request *req)
 		part_stat_add(cpu, part, ticks[rw], duration);
 		part_round_stats(cpu, part);
 		part_dec_in_flight(part, rw);
+		blk_account_io_latency(req, cpu);
 
 		hd_struct_put(part);
 		part_stat_unlock();
@@ -2014,6 +2097,7 @@ void blk_dequeue_request(struct request *rq)
 	if (blk_account_rq(rq)) {
 		q->in_flight[rq_is_sync(rq)]++;
 		set_io_start_time_ns(rq);
+		blk_lat_hist_start(rq);
 	}
 }
 
@@ -2628,6 +2712,7 @@ static void __blk_rq_prep_clone(struct request *dst, struct request *src)
 	dst->__data_len = blk_rq_bytes(src);
 	dst->nr_phys_segments = src->nr_phys_segments;
 	dst->ioprio = src->ioprio;
+	dst->write_hint = src->write_hint;
 	dst->extra_len = src->extra_len;
 }
 
@@ -2791,7 +2876,7 @@ static void queue_unplugged(struct request_queue *q, unsigned int depth,
 
 }
 
-static void flush_plug_callbacks(struct blk_plug *plug)
+static void flush_plug_callbacks(struct blk_plug *plug, bool from_schedule)
 {
 	LIST_HEAD(callbacks);
 
@@ -2805,9 +2890,44 @@ static void flush_plug_callbacks(struct blk_plug *plug)
 							  struct blk_plug_cb,
 							  list);
 		list_del(&cb->list);
-		cb->callback(cb);
+		cb->callback(cb, from_schedule);
+	}
+}
+
+/**
+ * blk_check_plugged - find or add a callback on %current's plug
+ * @unplug: function to call when the plug is flushed
+ * @data: cookie identifying the callback, usually the queue
+ * @size: size of the callback to allocate, at least a struct blk_plug_cb
+ *
+ * Returns the callback registered for @unplug and @data, allocating it
+ * if this is the first time it is asked for in this plug, or %NULL if
+ * %current is not plugged.  @unplug owns the callback and must free it.
+ */
+struct blk_plug_cb *blk_check_plugged(blk_plug_cb_fn unplug, void *data,
+				      int size)
+{
+	struct blk_plug *plug = current->plug;
+	struct blk_plug_cb *cb;
+
+	if (!plug)
+		return NULL;
+
+	list_for_each_entry(cb, &plug->cb_list, list)
+		if (cb->callback == unplug && cb->data == data)
+			return cb;
+
+	/* Not currently on the callback list */
+	BUG_ON(size < sizeof(*cb));
+	cb = kzalloc(size, GFP_ATOMIC);
+	if (cb) {
+		cb->data = data;
+		cb->callback = unplug;
+		list_add(&cb->list, &plug->cb_list);
 	}
+	return cb;
 }
+EXPORT_SYMBOL(blk_check_plugged);
 
 void blk_flush_plug_list(struct blk_plug *plug, bool from_schedule)
 {
@@ -2819,7 +2939,7 @@ void blk_flush_plug_list(struct blk_plug *plug, bool from_schedule)
 
 	BUG_ON(plug->magic != PLUG_MAGIC);
 
-	flush_plug_callbacks(plug);
+	flush_plug_callbacks(plug, from_schedule);
 	if (list_empty(&plug->list))
 		return;
 
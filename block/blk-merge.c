@@ -393,6 +393,12 @@ static int attempt_merge(struct request_queue *q, struct request *req,
 	    || next->special)
 		return 0;
 
+	/*
+	 * Don't merge data expected to live for different times
+	 */
+	if (req->write_hint != next->write_hint)
+		return 0;
+
 	/*
 	 * If we are allowed to merge, then append bio list
 	 * from next to rq and release next. merge_requests_fn
@@ -493,6 +499,10 @@ bool blk_rq_merge_ok(struct request *rq, struct bio *bio)
 	if (rq->rq_disk != bio->bi_bdev->bd_disk || rq->special)
 		return false;
 
+	/* don't merge data expected to live for different times */
+	if (rq->write_hint != bio->bi_write_hint)
+		return false;
+
 	/* only merge integrity protected bio into ditto rq */
 	if (bio_integrity(bio) != blk_integrity_rq(rq))
 		return false;
@@ -0,0 +1,92 @@
+/*
+ * Tag allocation for the multi-queue block layer
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/bitmap.h>
+#include <linux/blkdev.h>
+#include <linux/blk-mq.h>
+#include <linux/slab.h>
+
+#include "blk-mq.h"
+
+struct blk_mq_tags *blk_mq_init_tags(unsigned int nr_tags, int node)
+{
+	struct blk_mq_tags *tags;
+	size_t size;
+
+	size = sizeof(*tags) + BITS_TO_LONGS(nr_tags) * sizeof(unsigned long);
+	tags = kzalloc_node(size, GFP_KERNEL, node);
+	if (!tags)
+		return NULL;
+
+	tags->rqs = kzalloc_node(nr_tags * sizeof(struct request *),
+				 GFP_KERNEL, node);
+	if (!tags->rqs) {
+		kfree(tags);
+		return NULL;
+	}
+
+	tags->nr_tags = nr_tags;
+	init_waitqueue_head(&tags->wait);
+	return tags;
+}
+
+void blk_mq_free_tags(struct blk_mq_tags *tags)
+{
+	kfree(tags->rqs);
+	kfree(tags);
+}
+
+/**
+ * blk_mq_get_tag - grab a free tag without sleeping
+ * @tags:	tag map to allocate from
+ * @last_tag:	per-cpu allocation hint, updated on success
+ *
+ * Description:
+ *    Searching from a per-cpu hint instead of bit zero keeps cpus that
+ *    share a hardware context from all fighting over the first words of
+ *    the bitmap.  Returns %BLK_MQ_TAG_FAIL if every tag is in use.
+ */
+unsigned int blk_mq_get_tag(struct blk_mq_tags *tags, unsigned int *last_tag)
+{
+	unsigned int hint = *last_tag, tag;
+	bool wrapped = false;
+
+	if (hint >= tags->nr_tags)
+		hint = 0;
+
+	tag = hint;
+	for (;;) {
+		tag = find_next_zero_bit(tags->map, tags->nr_tags, tag);
+		if (tag >= tags->nr_tags) {
+			if (wrapped || !hint)
+				return BLK_MQ_TAG_FAIL;
+			wrapped = true;
+			tag = 0;
+			continue;
+		}
+		if (wrapped && tag >= hint)
+			return BLK_MQ_TAG_FAIL;
+		if (!test_and_set_bit_lock(tag, tags->map))
+			break;
+	}
+
+	*last_tag = tag + 1;
+	return tag;
+}
+
+void blk_mq_put_tag(struct blk_mq_tags *tags, unsigned int tag)
+{
+	BUG_ON(tag >= tags->nr_tags);
+
+	clear_bit_unlock(tag, tags->map);
+	smp_mb__after_clear_bit();
+	if (waitqueue_active(&tags->wait))
+		wake_up(&tags->wait);
+}
+
+unsigned int blk_mq_tags_busy(struct blk_mq_tags *tags)
+{
+	return bitmap_weight(tags->map, tags->nr_tags);
+}
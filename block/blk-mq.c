@@ -0,0 +1,644 @@
+/*
+ * Multi-queue request path.  Bios are turned into requests on per-cpu
+ * software queues, without touching q->queue_lock or an elevator, and
+ * handed to the driver through one or more hardware dispatch contexts.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/bio.h>
+#include <linux/blkdev.h>
+#include <linux/blk-mq.h>
+#include <linux/cpu.h>
+#include <linux/delay.h>
+#include <linux/percpu.h>
+#include <linux/slab.h>
+#include <linux/smp.h>
+#include <linux/workqueue.h>
+
+#include <trace/events/block.h>
+
+#include "blk.h"
+#include "blk-mq.h"
+
+/* how far back to look on a software queue for a merge candidate */
+#define BLK_MQ_MERGE_DEPTH	8
+
+static struct blk_mq_ctx *blk_mq_get_ctx(struct request_queue *q)
+{
+	return per_cpu_ptr(q->queue_ctx, get_cpu());
+}
+
+static void blk_mq_put_ctx(struct blk_mq_ctx *ctx)
+{
+	put_cpu();
+}
+
+static bool blk_mq_hctx_has_pending(struct blk_mq_hw_ctx *hctx)
+{
+	return !list_empty_careful(&hctx->dispatch) ||
+		find_first_bit(hctx->ctx_map, hctx->nr_ctx) < hctx->nr_ctx;
+}
+
+static void blk_mq_hctx_mark_pending(struct blk_mq_hw_ctx *hctx,
+				     struct blk_mq_ctx *ctx)
+{
+	if (!test_bit(ctx->index_hw, hctx->ctx_map))
+		set_bit(ctx->index_hw, hctx->ctx_map);
+}
+
+static struct request *__blk_mq_alloc_request(struct blk_mq_hw_ctx *hctx,
+					      struct blk_mq_ctx *ctx,
+					      unsigned int rw_flags)
+{
+	struct request_queue *q = hctx->queue;
+	struct request *rq;
+	unsigned int tag;
+
+	tag = blk_mq_get_tag(hctx->tags, &ctx->last_tag);
+	if (tag == BLK_MQ_TAG_FAIL)
+		return NULL;
+
+	rq = hctx->tags->rqs[tag];
+	blk_rq_init(q, rq);
+	rq->tag = tag;
+	rq->mq_ctx = ctx;
+	rq->cmd_flags = rw_flags;
+	if (blk_queue_io_stat(q))
+		rq->cmd_flags |= REQ_IO_STAT;
+
+	ctx->rq_dispatched[rw_is_sync(rw_flags)]++;
+	return rq;
+}
+
+/*
+ * Get a request for the cpu we are running on, sleeping for a free tag if
+ * the hardware context is saturated.  Called and returns with preemption
+ * disabled through blk_mq_get_ctx(); *ctxp and *hctxp are updated if we
+ * had to sleep and came back on another cpu.
+ */
+static struct request *blk_mq_get_request(struct request_queue *q,
+					  unsigned int rw_flags,
+					  struct blk_mq_ctx **ctxp,
+					  struct blk_mq_hw_ctx **hctxp)
+{
+	struct blk_mq_ctx *ctx = *ctxp;
+	struct blk_mq_hw_ctx *hctx = *hctxp;
+	struct request *rq;
+	DEFINE_WAIT(wait);
+
+	rq = __blk_mq_alloc_request(hctx, ctx, rw_flags);
+	if (likely(rq))
+		return rq;
+
+	do {
+		struct blk_mq_tags *tags = hctx->tags;
+
+		blk_mq_put_ctx(ctx);
+
+		/* make sure what we (or a plug) have queued gets going */
+		blk_mq_run_hw_queue(hctx, false);
+
+		prepare_to_wait_exclusive(&tags->wait, &wait,
+					  TASK_UNINTERRUPTIBLE);
+		if (blk_mq_tags_busy(tags) == tags->nr_tags)
+			io_schedule();
+		finish_wait(&tags->wait, &wait);
+
+		ctx = blk_mq_get_ctx(q);
+		hctx = blk_mq_map_queue(q, ctx->cpu);
+		rq = __blk_mq_alloc_request(hctx, ctx, rw_flags);
+	} while (!rq);
+
+	*ctxp = ctx;
+	*hctxp = hctx;
+	return rq;
+}
+
+static void blk_mq_free_request(struct request *rq)
+{
+	struct blk_mq_hw_ctx *hctx = blk_mq_map_queue(rq->q, rq->mq_ctx->cpu);
+
+	blk_mq_put_tag(hctx->tags, rq->tag);
+}
+
+/**
+ * blk_mq_end_io - end all I/O on a request and free it
+ * @rq:		the request being processed
+ * @error:	%0 for success, < %0 for error
+ *
+ * Description:
+ *     Completes every bio attached to @rq and gives its tag back.  May be
+ *     called from any context.
+ */
+void blk_mq_end_io(struct request *rq, int error)
+{
+	/* the whole request is completed, nothing can be left over */
+	if (blk_update_request(rq, error, blk_rq_bytes(rq)))
+		BUG();
+
+	blk_account_io_done(rq);
+	blk_mq_free_request(rq);
+}
+EXPORT_SYMBOL(blk_mq_end_io);
+
+static void __blk_mq_complete_request(struct request *rq)
+{
+	struct request_queue *q = rq->q;
+
+	if (q->mq_ops->complete)
+		q->mq_ops->complete(rq);
+	else
+		blk_mq_end_io(rq, rq->errors);
+}
+
+#if defined(CONFIG_SMP) && defined(CONFIG_USE_GENERIC_SMP_HELPERS)
+static void blk_mq_complete_request_remote(void *data)
+{
+	__blk_mq_complete_request(data);
+}
+
+static bool blk_mq_complete_on(struct request *rq, int cpu)
+{
+	struct call_single_data *data = &rq->csd;
+
+	if (!cpu_online(cpu))
+		return false;
+
+	data->func = blk_mq_complete_request_remote;
+	data->info = rq;
+	data->flags = 0;
+
+	__smp_call_function_single(cpu, data, 0);
+	return true;
+}
+#else /* CONFIG_SMP && CONFIG_USE_GENERIC_SMP_HELPERS */
+static bool blk_mq_complete_on(struct request *rq, int cpu)
+{
+	return false;
+}
+#endif
+
+/**
+ * blk_mq_complete_request - end I/O on a request from the driver
+ * @rq:		the request being processed
+ *
+ * Description:
+ *     Hands @rq to ->complete, or blk_mq_end_io() if the driver has none.
+ *     With QUEUE_FLAG_SAME_COMP set this happens on the cpu that submitted
+ *     the request, so the completion runs where its data is cache hot.
+ */
+void blk_mq_complete_request(struct request *rq)
+{
+	int cpu;
+
+	if (!test_bit(QUEUE_FLAG_SAME_COMP, &rq->q->queue_flags)) {
+		__blk_mq_complete_request(rq);
+		return;
+	}
+
+	cpu = get_cpu();
+	if (cpu == rq->mq_ctx->cpu ||
+	    !blk_mq_complete_on(rq, rq->mq_ctx->cpu))
+		__blk_mq_complete_request(rq);
+	put_cpu();
+}
+EXPORT_SYMBOL(blk_mq_complete_request);
+
+static void __blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx)
+{
+	struct request_queue *q = hctx->queue;
+	struct request *rq;
+	LIST_HEAD(rq_list);
+	unsigned int bit;
+
+	if (unlikely(test_bit(BLK_MQ_S_STOPPED, &hctx->state)))
+		return;
+
+	hctx->run++;
+
+	/*
+	 * Pull everything off the software queues with work pending.  The
+	 * bit is cleared before the list is taken, so a request added
+	 * behind our back leaves it set for the next run.
+	 */
+	for_each_set_bit(bit, hctx->ctx_map, hctx->nr_ctx) {
+		struct blk_mq_ctx *ctx = hctx->ctxs[bit];
+
+		clear_bit(bit, hctx->ctx_map);
+		spin_lock(&ctx->lock);
+		list_splice_tail_init(&ctx->rq_list, &rq_list);
+		spin_unlock(&ctx->lock);
+	}
+
+	/* requests the driver pushed back last time go first */
+	if (!list_empty_careful(&hctx->dispatch)) {
+		spin_lock(&hctx->lock);
+		list_splice_init(&hctx->dispatch, &rq_list);
+		spin_unlock(&hctx->lock);
+	}
+
+	while (!list_empty(&rq_list)) {
+		int ret;
+
+		rq = list_first_entry(&rq_list, struct request, queuelist);
+		list_del_init(&rq->queuelist);
+
+		trace_block_rq_issue(q, rq);
+		set_io_start_time_ns(rq);
+		blk_lat_hist_start(rq);
+		ret = q->mq_ops->queue_rq(hctx, rq);
+		if (ret == BLK_MQ_RQ_QUEUE_OK)
+			continue;
+
+		if (ret == BLK_MQ_RQ_QUEUE_BUSY) {
+			list_add(&rq->queuelist, &rq_list);
+			break;
+		}
+
+		pr_err("blk-mq: bad return on queue: %d\n", ret);
+		blk_mq_end_io(rq, -EIO);
+	}
+
+	if (!list_empty(&rq_list)) {
+		spin_lock(&hctx->lock);
+		list_splice(&rq_list, &hctx->dispatch);
+		spin_unlock(&hctx->lock);
+	}
+}
+
+static void blk_mq_run_work_fn(struct work_struct *work)
+{
+	struct blk_mq_hw_ctx *hctx;
+
+	hctx = container_of(work, struct blk_mq_hw_ctx, run_work.work);
+	__blk_mq_run_hw_queue(hctx);
+}
+
+/**
+ * blk_mq_run_hw_queue - dispatch pending requests of a hardware context
+ * @hctx:	hardware context to run
+ * @async:	punt the run to kblockd
+ *
+ * Description:
+ *     ->queue_rq may sleep, so the synchronous variant must only be used
+ *     from process context.  Everything else has to pass @async.
+ */
+void blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx, bool async)
+{
+	if (unlikely(test_bit(BLK_MQ_S_STOPPED, &hctx->state)))
+		return;
+
+	if (async)
+		kblockd_schedule_delayed_work(hctx->queue, &hctx->run_work, 0);
+	else
+		__blk_mq_run_hw_queue(hctx);
+}
+EXPORT_SYMBOL(blk_mq_run_hw_queue);
+
+void blk_mq_run_queues(struct request_queue *q, bool async)
+{
+	struct blk_mq_hw_ctx *hctx;
+	unsigned int i;
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		if (!blk_mq_hctx_has_pending(hctx))
+			continue;
+
+		blk_mq_run_hw_queue(hctx, async);
+	}
+}
+EXPORT_SYMBOL(blk_mq_run_queues);
+
+/**
+ * blk_mq_stop_hw_queue - stop dispatching to a hardware context
+ * @hctx:	hardware context to stop
+ *
+ * Description:
+ *     A driver that returns %BLK_MQ_RQ_QUEUE_BUSY from ->queue_rq is
+ *     expected to stop the context first and restart it with
+ *     blk_mq_start_stopped_hw_queues() once it can take requests again,
+ *     which is what gets the requests it bounced dispatched.
+ */
+void blk_mq_stop_hw_queue(struct blk_mq_hw_ctx *hctx)
+{
+	cancel_delayed_work(&hctx->run_work);
+	set_bit(BLK_MQ_S_STOPPED, &hctx->state);
+}
+EXPORT_SYMBOL(blk_mq_stop_hw_queue);
+
+void blk_mq_start_stopped_hw_queues(struct request_queue *q, bool async)
+{
+	struct blk_mq_hw_ctx *hctx;
+	unsigned int i;
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		if (!test_bit(BLK_MQ_S_STOPPED, &hctx->state))
+			continue;
+
+		clear_bit(BLK_MQ_S_STOPPED, &hctx->state);
+		blk_mq_run_hw_queue(hctx, async);
+	}
+}
+EXPORT_SYMBOL(blk_mq_start_stopped_hw_queues);
+
+static void blk_mq_unplug(struct blk_plug_cb *cb, bool from_schedule)
+{
+	struct request_queue *q = cb->data;
+
+	kfree(cb);
+
+	/* we may be called from inside schedule(), don't sleep there */
+	blk_mq_run_queues(q, from_schedule);
+}
+
+static bool blk_mq_attempt_merge(struct request_queue *q,
+				 struct blk_mq_ctx *ctx, struct bio *bio)
+{
+	struct request *rq;
+	int checked = BLK_MQ_MERGE_DEPTH;
+	bool merged = false;
+
+	spin_lock(&ctx->lock);
+	list_for_each_entry_reverse(rq, &ctx->rq_list, queuelist) {
+		int el_ret;
+
+		if (!checked--)
+			break;
+
+		if (!blk_rq_merge_ok(rq, bio))
+			continue;
+
+		el_ret = blk_try_merge(rq, bio);
+		if (el_ret == ELEVATOR_BACK_MERGE)
+			merged = bio_attempt_back_merge(q, rq, bio);
+		else if (el_ret == ELEVATOR_FRONT_MERGE)
+			merged = bio_attempt_front_merge(q, rq, bio);
+
+		if (merged) {
+			ctx->rq_merged++;
+			break;
+		}
+	}
+	spin_unlock(&ctx->lock);
+
+	return merged;
+}
+
+static void blk_mq_make_request(struct request_queue *q, struct bio *bio)
+{
+	const bool sync = !!(bio->bi_rw & REQ_SYNC);
+	struct blk_mq_hw_ctx *hctx;
+	struct blk_mq_ctx *ctx;
+	unsigned int rw_flags;
+	struct request *rq;
+
+	blk_queue_bounce(q, &bio);
+
+	if (unlikely(blk_queue_dead(q))) {
+		bio_endio(bio, -ENODEV);
+		return;
+	}
+
+	ctx = blk_mq_get_ctx(q);
+	hctx = blk_mq_map_queue(q, ctx->cpu);
+
+	if ((hctx->flags & BLK_MQ_F_SHOULD_MERGE) && !blk_queue_nomerges(q) &&
+	    blk_mq_attempt_merge(q, ctx, bio)) {
+		blk_mq_put_ctx(ctx);
+		return;
+	}
+
+	rw_flags = bio_data_dir(bio);
+	if (sync)
+		rw_flags |= REQ_SYNC;
+
+	trace_block_getrq(q, bio, bio_data_dir(bio));
+	rq = blk_mq_get_request(q, rw_flags, &ctx, &hctx);
+
+	init_request_from_bio(rq, bio);
+	drive_stat_acct(rq, 1);
+	hctx->queued++;
+
+	spin_lock(&ctx->lock);
+	trace_block_rq_insert(q, rq);
+	list_add_tail(&rq->queuelist, &ctx->rq_list);
+	blk_mq_hctx_mark_pending(hctx, ctx);
+	spin_unlock(&ctx->lock);
+	blk_mq_put_ctx(ctx);
+
+	/*
+	 * With a plug in place the request waits on the software queue, where
+	 * the following bios of the batch can still merge with it, and the
+	 * hardware queues are run when the plug is flushed.
+	 */
+	if (!blk_check_plugged(blk_mq_unplug, q, sizeof(struct blk_plug_cb)))
+		blk_mq_run_hw_queue(hctx, false);
+}
+
+/*
+ * Wait for every tag to be given back.  The queue is dead, so no new
+ * request can show up while we poll.
+ */
+void blk_mq_drain_queue(struct request_queue *q)
+{
+	while (true) {
+		struct blk_mq_hw_ctx *hctx;
+		unsigned int i, busy = 0;
+
+		queue_for_each_hw_ctx(q, hctx, i) {
+			blk_mq_run_hw_queue(hctx, false);
+			busy += blk_mq_tags_busy(hctx->tags);
+		}
+
+		if (!busy)
+			break;
+		msleep(10);
+	}
+}
+
+static void blk_mq_free_hctx(struct blk_mq_hw_ctx *hctx)
+{
+	unsigned int i;
+
+	if (hctx->tags) {
+		for (i = 0; i < hctx->tags->nr_tags; i++)
+			kfree(hctx->tags->rqs[i]);
+		blk_mq_free_tags(hctx->tags);
+	}
+	kfree(hctx->ctx_map);
+	kfree(hctx->ctxs);
+	kfree(hctx);
+}
+
+static struct blk_mq_hw_ctx *blk_mq_alloc_hctx(struct request_queue *q,
+					       struct blk_mq_reg *reg,
+					       unsigned int index)
+{
+	struct blk_mq_hw_ctx *hctx;
+	int node = reg->numa_node;
+	unsigned int i, rq_size;
+
+	hctx = kzalloc_node(sizeof(*hctx), GFP_KERNEL, node);
+	if (!hctx)
+		return NULL;
+
+	spin_lock_init(&hctx->lock);
+	INIT_LIST_HEAD(&hctx->dispatch);
+	INIT_DELAYED_WORK(&hctx->run_work, blk_mq_run_work_fn);
+	hctx->queue = q;
+	hctx->flags = reg->flags;
+	hctx->queue_num = index;
+	hctx->queue_depth = reg->queue_depth;
+	hctx->numa_node = node;
+
+	hctx->ctxs = kzalloc_node(nr_cpu_ids * sizeof(*hctx->ctxs),
+				  GFP_KERNEL, node);
+	hctx->ctx_map = kzalloc_node(BITS_TO_LONGS(nr_cpu_ids) *
+				     sizeof(unsigned long), GFP_KERNEL, node);
+	hctx->tags = blk_mq_init_tags(reg->queue_depth, node);
+	if (!hctx->ctxs || !hctx->ctx_map || !hctx->tags)
+		goto fail;
+
+	/* driver data sits right behind each request, see blk_mq_rq_to_pdu */
+	rq_size = L1_CACHE_ALIGN(sizeof(struct request) + reg->cmd_size);
+	for (i = 0; i < reg->queue_depth; i++) {
+		hctx->tags->rqs[i] = kzalloc_node(rq_size, GFP_KERNEL, node);
+		if (!hctx->tags->rqs[i])
+			goto fail;
+	}
+
+	return hctx;
+
+fail:
+	blk_mq_free_hctx(hctx);
+	return NULL;
+}
+
+/*
+ * Spread the possible cpus over the hardware contexts, and start each
+ * cpu's tag search at a different offset of its context's tag space.
+ */
+static void blk_mq_map_swqueue(struct request_queue *q)
+{
+	struct blk_mq_hw_ctx *hctx;
+	unsigned int cpu, i, j;
+
+	for_each_possible_cpu(cpu) {
+		struct blk_mq_ctx *ctx = per_cpu_ptr(q->queue_ctx, cpu);
+
+		q->mq_map[cpu] = cpu % q->nr_hw_queues;
+		hctx = blk_mq_map_queue(q, cpu);
+
+		spin_lock_init(&ctx->lock);
+		INIT_LIST_HEAD(&ctx->rq_list);
+		ctx->cpu = cpu;
+		ctx->queue = q;
+		ctx->index_hw = hctx->nr_ctx;
+		hctx->ctxs[hctx->nr_ctx++] = ctx;
+	}
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		for (j = 0; j < hctx->nr_ctx; j++)
+			hctx->ctxs[j]->last_tag =
+				j * hctx->queue_depth / hctx->nr_ctx;
+	}
+}
+
+/**
+ * blk_mq_init_queue - allocate a multi-queue request queue
+ * @reg:	hardware queue layout and driver callbacks
+ * @driver_data: passed to ->init_hctx for every hardware context
+ *
+ * Description:
+ *    Returns a queue that takes bios through per-cpu software queues and
+ *    feeds them to @reg->ops->queue_rq, or %NULL on failure.  There is no
+ *    elevator and no queue_lock in this path.  The queue is torn down
+ *    with blk_cleanup_queue() like any other.
+ */
+struct request_queue *blk_mq_init_queue(struct blk_mq_reg *reg,
+					void *driver_data)
+{
+	struct blk_mq_ctx __percpu *ctx;
+	struct blk_mq_hw_ctx **hctxs;
+	struct request_queue *q;
+	unsigned int *map;
+	unsigned int i;
+
+	if (!reg->nr_hw_queues || !reg->queue_depth || !reg->ops->queue_rq)
+		return NULL;
+
+	if (reg->queue_depth > BLK_MQ_MAX_DEPTH) {
+		pr_info("blk-mq: reduced queue depth to %u\n",
+			BLK_MQ_MAX_DEPTH);
+		reg->queue_depth = BLK_MQ_MAX_DEPTH;
+	}
+	if (reg->nr_hw_queues > nr_cpu_ids)
+		reg->nr_hw_queues = nr_cpu_ids;
+
+	q = blk_alloc_queue_node(GFP_KERNEL, reg->numa_node);
+	if (!q)
+		return NULL;
+
+	ctx = alloc_percpu(struct blk_mq_ctx);
+	hctxs = kzalloc_node(reg->nr_hw_queues * sizeof(*hctxs), GFP_KERNEL,
+			     reg->numa_node);
+	map = kzalloc_node(nr_cpu_ids * sizeof(*map), GFP_KERNEL,
+			   reg->numa_node);
+	if (!ctx || !hctxs || !map)
+		goto err_free;
+
+	for (i = 0; i < reg->nr_hw_queues; i++) {
+		hctxs[i] = blk_mq_alloc_hctx(q, reg, i);
+		if (!hctxs[i])
+			goto err_hctx;
+
+		if (reg->ops->init_hctx &&
+		    reg->ops->init_hctx(hctxs[i], driver_data, i))
+			goto err_hctx;
+	}
+
+	q->queue_ctx = ctx;
+	q->queue_hw_ctx = hctxs;
+	q->nr_hw_queues = reg->nr_hw_queues;
+	q->mq_map = map;
+	blk_mq_map_swqueue(q);
+
+	blk_queue_make_request(q, blk_mq_make_request);
+	q->nr_requests = reg->queue_depth;
+	q->queue_flags |= QUEUE_FLAG_MQ_DEFAULT;
+	q->mq_ops = reg->ops;
+
+	return q;
+
+err_hctx:
+	for (i = 0; i < reg->nr_hw_queues; i++)
+		if (hctxs[i])
+			blk_mq_free_hctx(hctxs[i]);
+err_free:
+	kfree(map);
+	kfree(hctxs);
+	free_percpu(ctx);
+	blk_cleanup_queue(q);
+	return NULL;
+}
+EXPORT_SYMBOL(blk_mq_init_queue);
+
+/*
+ * Called from blk_release_queue() once the last reference is gone.
+ */
+void blk_mq_free_queue(struct request_queue *q)
+{
+	struct blk_mq_hw_ctx *hctx;
+	unsigned int i;
+
+	queue_for_each_hw_ctx(q, hctx, i)
+		blk_mq_free_hctx(hctx);
+
+	kfree(q->queue_hw_ctx);
+	kfree(q->mq_map);
+	free_percpu(q->queue_ctx);
+
+	q->queue_hw_ctx = NULL;
+	q->mq_map = NULL;
+	q->queue_ctx = NULL;
+}
@@ -0,0 +1,50 @@
+#ifndef INT_BLK_MQ_H
+#define INT_BLK_MQ_H
+
+/*
+ * Per-cpu software submission queue
+ */
+struct blk_mq_ctx {
+	struct {
+		spinlock_t		lock;
+		struct list_head	rq_list;
+	} ____cacheline_aligned_in_smp;
+
+	unsigned int		cpu;
+	unsigned int		index_hw;	/* bit in hctx->ctx_map */
+	unsigned int		last_tag;	/* tag allocation hint */
+
+	unsigned long		rq_dispatched[2];
+	unsigned long		rq_merged;
+
+	struct request_queue	*queue;
+};
+
+static inline struct blk_mq_hw_ctx *blk_mq_map_queue(struct request_queue *q,
+						     unsigned int cpu)
+{
+	return q->queue_hw_ctx[q->mq_map[cpu]];
+}
+
+void blk_mq_drain_queue(struct request_queue *q);
+void blk_mq_free_queue(struct request_queue *q);
+
+/*
+ * Tag allocation, see blk-mq-tag.c
+ */
+#define BLK_MQ_TAG_FAIL		-1U
+
+struct blk_mq_tags {
+	unsigned int		nr_tags;
+	wait_queue_head_t	wait;
+	struct request		**rqs;
+	unsigned long		map[];
+};
+
+struct blk_mq_tags *blk_mq_init_tags(unsigned int nr_tags, int node);
+void blk_mq_free_tags(struct blk_mq_tags *tags);
+unsigned int blk_mq_get_tag(struct blk_mq_tags *tags, unsigned int *last_tag);
+void blk_mq_put_tag(struct blk_mq_tags *tags, unsigned int tag);
+unsigned int blk_mq_tags_busy(struct blk_mq_tags *tags);
+
+#endif
@@ -9,6 +9,7 @@
 #include <linux/blktrace_api.h>
 
 #include "blk.h"
+#include "blk-mq.h"
 
 struct queue_sysfs_entry {
 	struct attribute attr;
@@ -275,6 +276,133 @@ queue_rq_affinity_store(struct request_queue *q, const char *page, size_t count)
 	return ret;
 }
 
+static ssize_t queue_write_merge_window_show(struct request_queue *q,
+					     char *page)
+{
+	return queue_var_show(q->write_merge_window, page);
+}
+
+static ssize_t
+queue_write_merge_window_store(struct request_queue *q, const char *page,
+			       size_t count)
+{
+	unsigned long window;
+	ssize_t ret = queue_var_store(&window, page, count);
+
+	if (window > USEC_PER_SEC / 10)
+		window = USEC_PER_SEC / 10;
+
+	spin_lock_irq(q->queue_lock);
+	q->write_merge_window = window;
+	spin_unlock_irq(q->queue_lock);
+
+	return ret;
+}
+
+static ssize_t queue_write_merge_stats_show(struct request_queue *q,
+					    char *page)
+{
+	unsigned long holds, merges;
+	u64 delay;
+
+	spin_lock_irq(q->queue_lock);
+	holds = q->write_merge_holds;
+	merges = q->write_merge_merges;
+	delay = q->write_merge_delay;
+	spin_unlock_irq(q->queue_lock);
+
+	return sprintf(page, "%lu %lu %llu\n", holds, merges,
+		       (unsigned long long)delay);
+}
+
+static const char *write_hint_name[NR_WRITE_HINTS] = {
+	"not_set", "none", "short", "medium", "long", "extreme",
+};
+
+static ssize_t queue_write_hints_show(struct request_queue *q, char *page)
+{
+	ssize_t len = 0;
+	int i;
+
+	for (i = 0; i < NR_WRITE_HINTS; i++)
+		len += sprintf(page + len, "%s %llu\n", write_hint_name[i],
+			(unsigned long long)atomic64_read(&q->write_hint_bytes[i]));
+	return len;
+}
+
+#ifdef CONFIG_BLK_DEV_LATENCY_HIST
+static const char *lat_hist_dir_name[2] = { "read", "write" };
+static const char *lat_hist_size_name[BLK_LAT_HIST_SIZES] = {
+	"4k", "16k", "64k", "max",
+};
+static const char *lat_hist_type_name[BLK_LAT_NR] = { "queue", "device" };
+
+static ssize_t queue_latency_hist_line(struct request_queue *q, char *page,
+				       ssize_t len, int rw, int size, int type)
+{
+	unsigned long sum[BLK_LAT_HIST_BUCKETS];
+	ssize_t start = len;
+	int i, cpu;
+
+	memset(sum, 0, sizeof(sum));
+	for_each_possible_cpu(cpu) {
+		struct blk_lat_hist *hist = per_cpu_ptr(q->lat_hist, cpu);
+
+		for (i = 0; i < BLK_LAT_HIST_BUCKETS; i++)
+			sum[i] += hist->count[rw][size][type][i];
+	}
+
+	len += scnprintf(page + len, PAGE_SIZE - len, "%s %s %s",
+			 lat_hist_dir_name[rw], lat_hist_size_name[size],
+			 lat_hist_type_name[type]);
+	for (i = 0; i < BLK_LAT_HIST_BUCKETS; i++)
+		len += scnprintf(page + len, PAGE_SIZE - len, " %lu", sum[i]);
+	len += scnprintf(page + len, PAGE_SIZE - len, "\n");
+
+	return len - start;
+}
+
+static ssize_t queue_latency_hist_show(struct request_queue *q, char *page)
+{
+	int rw, size, type, i;
+	ssize_t len = 0;
+
+	len += scnprintf(page + len, PAGE_SIZE - len, "usecs");
+	for (i = 0; i < BLK_LAT_HIST_BUCKETS - 1; i++)
+		len += scnprintf(page + len, PAGE_SIZE - len, " %u",
+				 1U << (BLK_LAT_HIST_SHIFT + i));
+	len += scnprintf(page + len, PAGE_SIZE - len, " inf\n");
+
+	for (rw = 0; rw < 2; rw++) {
+		for (size = 0; size < BLK_LAT_HIST_SIZES; size++) {
+			for (type = 0; type < BLK_LAT_NR; type++)
+				len += queue_latency_hist_line(q, page, len,
+							       rw, size, type);
+		}
+	}
+
+	return len;
+}
+
+static ssize_t
+queue_latency_hist_store(struct request_queue *q, const char *page,
+			 size_t count)
+{
+	unsigned long val;
+	ssize_t ret = queue_var_store(&val, page, count);
+	int cpu;
+
+	if (val)
+		return -EINVAL;
+
+	for_each_possible_cpu(cpu)
+		memset(per_cpu_ptr(q->lat_hist, cpu), 0,
+		       sizeof(struct blk_lat_hist));
+
+	return ret;
+}
+#endif
+
 static struct queue_sysfs_entry queue_requests_entry = {
 	.attr = {.name = "nr_requests", .mode = S_IRUGO | S_IWUSR },
 	.show = queue_requests_show,
@@ -383,6 +511,30 @@ static struct queue_sysfs_entry queue_iostats_entry = {
 	.store = queue_store_iostats,
 };
 
+static struct queue_sysfs_entry queue_write_merge_window_entry = {
+	.attr = {.name = "write_merge_window_us", .mode = S_IRUGO | S_IWUSR },
+	.show = queue_write_merge_window_show,
+	.store = queue_write_merge_window_store,
+};
+
+static struct queue_sysfs_entry queue_write_merge_stats_entry = {
+	.attr = {.name = "write_merge_stats", .mode = S_IRUGO },
+	.show = queue_write_merge_stats_show,
+};
+
+static struct queue_sysfs_entry queue_write_hints_entry = {
+	.attr = {.name = "write_hints", .mode = S_IRUGO },
+	.show = queue_write_hints_show,
+};
+
+#ifdef CONFIG_BLK_DEV_LATENCY_HIST
+static struct queue_sysfs_entry queue_latency_hist_entry = {
+	.attr = {.name = "latency_hist", .mode = S_IRUGO | S_IWUSR },
+	.show = queue_latency_hist_show,
+	.store = queue_latency_hist_store,
+};
+#endif
+
 static struct queue_sysfs_entry queue_random_entry = {
 	.attr = {.name = "add_random", .mode = S_IRUGO | S_IWUSR },
 	.show = queue_show_random,
@@ -411,6 +563,12 @@ static struct attribute *default_attrs[] = {
 	&queue_rq_affinity_entry.attr,
 	&queue_iostats_entry.attr,
 	&queue_random_entry.attr,
+	&queue_write_merge_window_entry.attr,
+	&queue_write_merge_stats_entry.attr,
+	&queue_write_hints_entry.attr,
+#ifdef CONFIG_BLK_DEV_LATENCY_HIST
+	&queue_latency_hist_entry.attr,
+#endif
 	NULL,
 };
 
@@ -481,6 +639,9 @@ static void blk_release_queue(struct kobject *kobj)
 
 	blk_sync_queue(q);
 
+	if (q->mq_ops)
+		blk_mq_free_queue(q);
+
 	if (q->elevator) {
 		spin_lock_irq(q->queue_lock);
 		ioc_clear_queue(q);
@@ -499,6 +660,10 @@ static void blk_release_queue(struct kobject *kobj)
 	blk_throtl_release(q);
 	blk_trace_shutdown(q);
 
+#ifdef CONFIG_BLK_DEV_LATENCY_HIST
+	free_percpu(q->lat_hist);
+#endif
+
 	bdi_destroy(&q->backing_dev_info);
 
 	ida_simple_remove(&blk_queue_ida, q->id);
@@ -19,6 +19,12 @@ static inline void __blk_get_queue(struct request_queue *q)
 }
 
 void init_request_from_bio(struct request *req, struct bio *bio);
+void drive_stat_acct(struct request *rq, int new_io);
+void blk_account_io_done(struct request *req);
+bool bio_attempt_back_merge(struct request_queue *q, struct request *req,
+			    struct bio *bio);
+bool bio_attempt_front_merge(struct request_queue *q, struct request *req,
+			     struct bio *bio);
 void blk_rq_bio_prep(struct request_queue *q, struct request *rq,
 			struct bio *bio);
 int blk_rq_append_bio(struct request_queue *q, struct request *rq,
@@ -63,6 +69,8 @@ static inline void blk_clear_rq_complete(struct request *rq)
 void blk_insert_flush(struct request *rq);
 void blk_abort_flushes(struct request_queue *q);
 
+bool elv_write_merge_hold(struct request_queue *q);
+
 static inline struct request *__elv_next_request(struct request_queue *q)
 {
 	struct request *rq;
@@ -94,6 +102,7 @@ static inline struct request *__elv_next_request(struct request_queue *q)
 			return NULL;
 		}
 		if (unlikely(blk_queue_dead(q)) ||
+		    elv_write_merge_hold(q) ||
 		    !q->elevator->type->ops.elevator_dispatch_fn(q, 0))
 			return NULL;
 	}
@@ -181,6 +190,33 @@ static inline int blk_do_io_stat(struct request *rq)
 	        (rq->cmd_flags & REQ_DISCARD));
 }
 
+/*
+ * Request latency histograms.  Latency buckets are powers of two of
+ * microseconds starting at 64us, the last bucket collects everything
+ * from about one second up.  Size buckets split at 4k, 16k and 64k.
+ */
+#define BLK_LAT_HIST_BUCKETS	16
+#define BLK_LAT_HIST_SHIFT	6
+#define BLK_LAT_HIST_SIZES	4
+
+enum {
+	BLK_LAT_QUEUE,		/* allocation to dispatch */
+	BLK_LAT_DEVICE,		/* dispatch to completion */
+	BLK_LAT_NR,
+};
+
+struct blk_lat_hist {
+	unsigned long count[2][BLK_LAT_HIST_SIZES][BLK_LAT_NR]
+			   [BLK_LAT_HIST_BUCKETS];
+};
+
+static inline void blk_lat_hist_start(struct request *rq)
+{
+#ifdef CONFIG_BLK_DEV_LATENCY_HIST
+	rq->io_start_bytes = blk_rq_bytes(rq);
+#endif
+}
+
 /*
  * Internal io_context interface
  */
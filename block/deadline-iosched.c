@@ -13,6 +13,7 @@
 #include <linux/init.h>
 #include <linux/compiler.h>
 #include <linux/rbtree.h>
+#include "blk-cgroup.h"
 
 /*
  * See Documentation/block/deadline-iosched.txt
@@ -92,6 +93,54 @@ deadline_del_rq_rb(struct deadline_data *dd, struct request *rq)
 	elv_rb_del(deadline_rb_root(dd, rq), rq);
 }
 
+#ifdef CONFIG_DEADLINE_GROUP_IOSCHED
+/*
+ * expire time for requests of the current task, from the latency target of
+ * its cgroup if it has one
+ */
+static int deadline_expire(struct deadline_data *dd, int data_dir)
+{
+	struct blkio_cgroup *blkcg;
+	unsigned int target;
+
+	rcu_read_lock();
+	blkcg = task_blkio_cgroup(current);
+	if (data_dir == READ)
+		target = blkcg->read_latency;
+	else
+		target = blkcg->write_latency;
+	rcu_read_unlock();
+
+	if (target)
+		return msecs_to_jiffies(target);
+	return dd->fifo_expire[data_dir];
+}
+#else
+static inline int deadline_expire(struct deadline_data *dd, int data_dir)
+{
+	return dd->fifo_expire[data_dir];
+}
+#endif
+
+/*
+ * add rq to the fifo, keeping it sorted by expire time. Expire times only
+ * differ between cgroups or after a tunable change, so the right spot is
+ * nearly always the tail.
+ */
+static void
+deadline_add_rq_fifo(struct deadline_data *dd, struct request *rq)
+{
+	struct list_head *head = &dd->fifo_list[rq_data_dir(rq)];
+	struct list_head *entry;
+
+	list_for_each_prev(entry, head) {
+		if (!time_before(rq_fifo_time(rq),
+				 rq_fifo_time(rq_entry_fifo(entry))))
+			break;
+	}
+	list_add(&rq->queuelist, entry);
+}
+
 /*
  * add rq to rbtree and fifo
  */
@@ -106,8 +155,8 @@ deadline_add_request(struct request_queue *q, struct request *rq)
 	/*
 	 * set expire time and add to fifo list
 	 */
-	rq_set_fifo_time(rq, jiffies + dd->fifo_expire[data_dir]);
-	list_add_tail(&rq->queuelist, &dd->fifo_list[data_dir]);
+	rq_set_fifo_time(rq, jiffies + deadline_expire(dd, data_dir));
+	deadline_add_rq_fifo(dd, rq);
 }
 
 /*
@@ -155,6 +204,7 @@ static void deadline_merged_request(struct request_queue *q,
 				    struct request *req, int type)
 {
 	struct deadline_data *dd = q->elevator->elevator_data;
+	unsigned long expire;
 
 	/*
 	 * if the merge was a front merge, we need to reposition request
@@ -163,6 +213,17 @@ static void deadline_merged_request(struct request_queue *q,
 		elv_rb_del(deadline_rb_root(dd, req), req);
 		deadline_add_rq_rb(dd, req);
 	}
+
+	/*
+	 * the bio may come from a cgroup with a tighter latency target,
+	 * in which case rq inherits its expire time
+	 */
+	expire = jiffies + deadline_expire(dd, rq_data_dir(req));
+	if (time_before(expire, rq_fifo_time(req))) {
+		rq_set_fifo_time(req, expire);
+		list_del_init(&req->queuelist);
+		deadline_add_rq_fifo(dd, req);
+	}
 }
 
 static void
@@ -491,6 +491,55 @@ static bool elv_attempt_insert_merge(struct request_queue *q,
 	return false;
 }
 
+static inline bool elv_rq_async_write(struct request *rq)
+{
+	return rq_data_dir(rq) == WRITE && !rq_is_sync(rq);
+}
+
+/*
+ * Count merges into async writes while the merge window is open
+ */
+static inline void elv_write_merge_account(struct request_queue *q,
+					   struct request *rq)
+{
+	if (q->write_merge_start.tv64 && elv_rq_async_write(rq))
+		q->write_merge_merges++;
+}
+
+/**
+ * elv_write_merge_hold - hold back dispatch to let async writes merge
+ * @q: request queue
+ *
+ * Small async writes from different tasks (several SQLite databases,
+ * say) can only merge while they sit in the elevator, and an idle
+ * device takes the first one as soon as it is queued.  An async write
+ * entering an empty elevator opens a window during which dispatch is
+ * held, for at most q->write_merge_window usecs and only as long as no
+ * sync request is waiting.  Sync I/O is never delayed by it.
+ *
+ * Called with the queue lock held.
+ */
+bool elv_write_merge_hold(struct request_queue *q)
+{
+	s64 held;
+
+	if (!q->write_merge_start.tv64)
+		return false;
+
+	held = ktime_us_delta(ktime_get(), q->write_merge_start);
+	if (held < q->write_merge_window &&
+	    q->rq.count[BLK_RW_SYNC] == q->in_flight[BLK_RW_SYNC]) {
+		blk_delay_queue(q, DIV_ROUND_UP(q->write_merge_window - held,
+						USEC_PER_MSEC));
+		return true;
+	}
+
+	q->write_merge_start.tv64 = 0;
+	q->write_merge_holds++;
+	q->write_merge_delay += held;
+	return false;
+}
+
 void elv_merged_request(struct request_queue *q, struct request *rq, int type)
 {
 	struct elevator_queue *e = q->elevator;
@@ -520,6 +569,7 @@ void elv_merge_requests(struct request_queue *q, struct request *rq,
 		q->nr_sorted--;
 	}
 
+	elv_write_merge_account(q, rq);
 	q->last_merge = rq;
 }
 
@@ -530,6 +580,8 @@ void elv_bio_merged(struct request_queue *q, struct request *rq,
 
 	if (e->type->ops.elevator_bio_merged_fn)
 		e->type->ops.elevator_bio_merged_fn(q, rq, bio);
+
+	elv_write_merge_account(q, rq);
 }
 
 void elv_requeue_request(struct request_queue *q, struct request *rq)
@@ -638,6 +690,9 @@ void __elv_add_request(struct request_queue *q, struct request *rq, int where)
 		       !(rq->cmd_flags & REQ_DISCARD));
 		rq->cmd_flags |= REQ_SORTED;
 		q->nr_sorted++;
+		if (q->write_merge_window && q->nr_sorted == 1 &&
+		    elv_rq_async_write(rq))
+			q->write_merge_start = ktime_get();
 		if (rq_mergeable(rq)) {
 			elv_rqhash_add(q, rq);
 			if (!q->last_merge)
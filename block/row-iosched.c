@@ -69,10 +69,57 @@ static const int queue_quantum[] = {
 	1	/* ROWQ_PRIO_LOW_SWRITE */
 };
 
+/* Flags indicating whether the queue holds WRITE requests */
+static const bool queue_is_write[] = {
+	false,	/* ROWQ_PRIO_HIGH_READ */
+	false,	/* ROWQ_PRIO_REG_READ */
+	true,	/* ROWQ_PRIO_HIGH_SWRITE */
+	true,	/* ROWQ_PRIO_REG_SWRITE */
+	true,	/* ROWQ_PRIO_REG_WRITE */
+	false,	/* ROWQ_PRIO_LOW_READ */
+	true,	/* ROWQ_PRIO_LOW_SWRITE */
+};
+
 /* Default values for idling on read queues */
 #define ROW_IDLE_TIME_MSEC 5	/* msec */
 #define ROW_READ_FREQ_MSEC 20	/* msec */
 
+/*
+ * Read latency target mode. Writes in flight are limited to wr_depth,
+ * which is halved (at most once per target period) when the read p95
+ * estimate goes over the target and grows by one for every write that
+ * completes while it is under the target, or while no reads are seen.
+ */
+#define ROW_WR_DEPTH_MAX	32
+#define ROW_READ_WINDOW_MSEC	100	/* msec */
+/* p95 estimate moves by 1/256 of itself per sample */
+#define ROW_LAT_P95_SHIFT	8
+
+/*
+ * enum row_lat_class - classes latency is estimated for
+ */
+enum row_lat_class {
+	ROW_LAT_READ = 0,
+	ROW_LAT_SWRITE,
+	ROW_LAT_WRITE,
+	ROW_LAT_MAX,
+};
+
+/**
+ * struct row_lat_est - completion latency estimate of a class
+ * @avg_us:		moving average, new samples weighted 1/8
+ * @p95_us:		running estimate of the 95th percentile
+ * @nr_samples:		number of completions accounted
+ *
+ * Latency is measured from insertion into the scheduler to
+ * completion, which is what the submitting task waits for.
+ */
+struct row_lat_est {
+	u32			avg_us;
+	u32			p95_us;
+	unsigned long		nr_samples;
+};
+
 /**
  * struct rowq_idling_data -  parameters for idling on the queue
  * @last_insert_time:	time the last request was inserted
@@ -136,6 +183,15 @@ struct idling_data {
  *			scheduler, nr_reqs[1] holds the number of all WRITE
  *			requests in scheduler
  * @cycle_flags:	used for marking unserved queueus
+ * @read_lat_target:	read p95 latency target (msec), 0 disables
+ *			write throttling
+ * @lat:		completion latency estimates per class
+ * @wr_depth:		max number of WRITE requests dispatched and
+ *			not yet completed, in latency target mode
+ * @nr_wr_inflight:	WRITE requests dispatched and not yet completed
+ * @wr_depth_stamp:	time wr_depth was last decreased (jiffies)
+ * @last_read_done:	time of the last READ completion (jiffies)
+ * @wr_throttled:	a WRITE dispatch was held back for wr_depth
  *
  */
 struct row_data {
@@ -152,9 +208,21 @@ struct row_data {
 	unsigned int			nr_reqs[2];
 
 	unsigned int			cycle_flags;
+
+	int				read_lat_target;
+	struct row_lat_est		lat[ROW_LAT_MAX];
+	unsigned int			wr_depth;
+	unsigned int			nr_wr_inflight;
+	unsigned long			wr_depth_stamp;
+	unsigned long			last_read_done;
+	bool				wr_throttled;
 };
 
 #define RQ_ROWQ(rq) ((struct row_queue *) ((rq)->elv.priv[0]))
+/* insertion time in usec, truncated to unsigned long */
+#define RQ_ROW_TIME(rq) ((unsigned long) ((rq)->elv.priv[1]))
+#define RQ_SET_ROW_TIME(rq) \
+	((rq)->elv.priv[1] = (void *)(unsigned long)ktime_to_us(ktime_get()))
 
 #define row_log(q, fmt, args...)   \
 	blk_add_trace_msg(q, "%s():" fmt , __func__, ##args)
@@ -237,6 +305,55 @@ static inline void row_get_next_queue(struct row_data *rd)
 		row_restart_disp_cycle(rd);
 }
 
+/*
+ * row_lat_update() - Account a completion latency sample
+ * @est:	pointer to struct row_lat_est of the request class
+ * @lat_us:	insertion to completion time of the request (usec)
+ *
+ * The p95 estimate is moved up by 19 steps when the sample is above
+ * it and down by one step otherwise, so it settles where 5% of the
+ * samples are above it.
+ */
+static void row_lat_update(struct row_lat_est *est, u32 lat_us)
+{
+	u32 step;
+
+	if (!est->nr_samples++) {
+		est->avg_us = est->p95_us = lat_us;
+		return;
+	}
+
+	est->avg_us = est->avg_us - (est->avg_us >> 3) + (lat_us >> 3);
+
+	step = max_t(u32, est->p95_us >> ROW_LAT_P95_SHIFT, 1);
+	if (lat_us > est->p95_us)
+		est->p95_us += min_t(u32, 19 * step, lat_us - est->p95_us);
+	else
+		est->p95_us -= min_t(u32, step, est->p95_us - lat_us);
+}
+
+static inline enum row_lat_class row_lat_class(struct request *rq)
+{
+	if (rq_data_dir(rq) == READ)
+		return ROW_LAT_READ;
+	else if (rq_is_sync(rq))
+		return ROW_LAT_SWRITE;
+	else
+		return ROW_LAT_WRITE;
+}
+
+/*
+ * row_write_throttled() - Check whether WRITE dispatch is held back
+ * @rd:	pointer to struct row_data
+ *
+ * In latency target mode, no more than wr_depth WRITE requests may be
+ * dispatched and not completed.
+ */
+static inline bool row_write_throttled(struct row_data *rd)
+{
+	return rd->read_lat_target && rd->nr_wr_inflight >= rd->wr_depth;
+}
+
 /******************* Elevator callback functions *********************/
 
 /*
@@ -254,6 +371,7 @@ static void row_add_request(struct request_queue *q,
 	list_add_tail(&rq->queuelist, &rqueue->fifo);
 	rd->nr_reqs[rq_data_dir(rq)]++;
 	rq_set_fifo_time(rq, jiffies); /* for statistics*/
+	RQ_SET_ROW_TIME(rq);
 
 	if (queue_idling_enabled[rqueue->prio]) {
 		if (delayed_work_pending(&rd->read_idle.idle_work))
@@ -291,23 +409,52 @@ static void row_remove_request(struct request_queue *q,
 
 /*
  * row_dispatch_insert() - move request to dispatch queue
- * @rd:	pointer to struct row_data
+ * @rd:		pointer to struct row_data
+ * @force:	ignore WRITE throttling
  *
  * This function moves the next request to dispatch from
- * rd->curr_queue to the dispatch queue
+ * rd->curr_queue to the dispatch queue.
+ *
+ * If rd->curr_queue is a WRITE queue and WRITE dispatch is throttled,
+ * the request is taken from the first non empty READ queue instead.
+ * Return 0 if there is no such queue and nothing was dispatched,
+ * 1 otherwise
  *
  */
-static void row_dispatch_insert(struct row_data *rd)
+static int row_dispatch_insert(struct row_data *rd, int force)
 {
 	struct request *rq;
+	int i;
+
+	if (!force && queue_is_write[rd->curr_queue] &&
+	    row_write_throttled(rd)) {
+		for (i = 0; i < ROWQ_MAX_PRIO; i++) {
+			if (!queue_is_write[i] &&
+			    !list_empty(&rd->row_queues[i].rqueue.fifo))
+				break;
+		}
+		if (i == ROWQ_MAX_PRIO) {
+			row_log_rowq(rd, rd->curr_queue,
+				     "Writes throttled, nr_wr_inflight = %d",
+				     rd->nr_wr_inflight);
+			rd->wr_throttled = true;
+			return 0;
+		}
+		row_log_rowq(rd, rd->curr_queue,
+			     "Writes throttled, dispatching from rowq%d", i);
+		rd->curr_queue = i;
+	}
 
 	rq = rq_entry_fifo(rd->row_queues[rd->curr_queue].rqueue.fifo.next);
 	row_remove_request(rd->dispatch_queue, rq);
 	elv_dispatch_add_tail(rd->dispatch_queue, rq);
+	if (rq_data_dir(rq) == WRITE)
+		rd->nr_wr_inflight++;
 	rd->row_queues[rd->curr_queue].rqueue.nr_dispatched++;
 	row_clear_rowq_unserved(rd, rd->curr_queue);
 	row_log_rowq(rd, rd->curr_queue, " Dispatched request nr_disp = %d",
 		     rd->row_queues[rd->curr_queue].rqueue.nr_dispatched);
+	return 1;
 }
 
 /*
@@ -369,8 +516,7 @@ static int row_dispatch_requests(struct request_queue *q, int force)
 			row_log_rowq(rd, currq,
 				" Preemting for unserved rowq%d", i);
 			rd->curr_queue = i;
-			row_dispatch_insert(rd);
-			ret = 1;
+			ret = row_dispatch_insert(rd, force);
 			goto done;
 		}
 	}
@@ -381,7 +527,7 @@ static int row_dispatch_requests(struct request_queue *q, int force)
 		row_log_rowq(rd, currq, "Expiring rqueue");
 		ret = row_choose_queue(rd);
 		if (ret)
-			row_dispatch_insert(rd);
+			ret = row_dispatch_insert(rd, force);
 		goto done;
 	}
 
@@ -422,8 +568,7 @@ static int row_dispatch_requests(struct request_queue *q, int force)
 		}
 	}
 
-	ret = 1;
-	row_dispatch_insert(rd);
+	ret = row_dispatch_insert(rd, force);
 
 done:
 	return ret;
@@ -479,6 +624,8 @@ static void *row_init_queue(struct request_queue *q)
 
 	rdata->nr_reqs[READ] = rdata->nr_reqs[WRITE] = 0;
 
+	rdata->wr_depth = ROW_WR_DEPTH_MAX;
+
 	return rdata;
 }
 
@@ -516,6 +663,54 @@ static void row_merged_requests(struct request_queue *q, struct request *rq,
 	rqueue->rdata->nr_reqs[rq_data_dir(rq)]--;
 }
 
+/*
+ * row_completed_request() - Called when a request is completed
+ * @q:		requests queue
+ * @rq:		request that was completed
+ *
+ * Updates the latency estimate of the request class and, in latency
+ * target mode, adjusts the WRITE dispatch depth.
+ */
+static void row_completed_request(struct request_queue *q,
+				  struct request *rq)
+{
+	struct row_data *rd = (struct row_data *)q->elevator->elevator_data;
+	u32 lat_us = (unsigned long)ktime_to_us(ktime_get()) -
+		RQ_ROW_TIME(rq);
+	u32 target_us = rd->read_lat_target * USEC_PER_MSEC;
+
+	row_lat_update(&rd->lat[row_lat_class(rq)], lat_us);
+
+	if (rq_data_dir(rq) == READ) {
+		rd->last_read_done = jiffies;
+		if (!rd->read_lat_target ||
+		    rd->lat[ROW_LAT_READ].p95_us <= target_us)
+			return;
+		if (time_before(jiffies, rd->wr_depth_stamp +
+				msecs_to_jiffies(rd->read_lat_target)))
+			return;
+		rd->wr_depth = max(rd->wr_depth / 2, 1U);
+		rd->wr_depth_stamp = jiffies;
+		row_log(q, "read p95 %uus over target, wr_depth = %u",
+			rd->lat[ROW_LAT_READ].p95_us, rd->wr_depth);
+		return;
+	}
+
+	if (rd->nr_wr_inflight)
+		rd->nr_wr_inflight--;
+
+	if (rd->read_lat_target && rd->wr_depth < ROW_WR_DEPTH_MAX &&
+	    (rd->lat[ROW_LAT_READ].p95_us <= target_us ||
+	     time_after(jiffies, rd->last_read_done +
+			msecs_to_jiffies(ROW_READ_WINDOW_MSEC))))
+		rd->wr_depth++;
+
+	if (rd->wr_throttled && !row_write_throttled(rd)) {
+		rd->wr_throttled = false;
+		blk_run_queue_async(q);
+	}
+}
+
 /*
  * get_queue_type() - Get queue type for a given request
  *
@@ -599,6 +794,11 @@ SHOW_FUNCTION(row_lp_swrite_quantum_show,
 	rowd->row_queues[ROWQ_PRIO_LOW_SWRITE].disp_quantum, 0);
 SHOW_FUNCTION(row_read_idle_show, rowd->read_idle.idle_time, 1);
 SHOW_FUNCTION(row_read_idle_freq_show, rowd->read_idle.freq, 0);
+SHOW_FUNCTION(row_read_lat_target_show, rowd->read_lat_target, 0);
+SHOW_FUNCTION(row_read_lat_est_show, rowd->lat[ROW_LAT_READ].p95_us, 0);
+SHOW_FUNCTION(row_swrite_lat_est_show, rowd->lat[ROW_LAT_SWRITE].p95_us, 0);
+SHOW_FUNCTION(row_write_lat_est_show, rowd->lat[ROW_LAT_WRITE].p95_us, 0);
+SHOW_FUNCTION(row_write_depth_show, rowd->wr_depth, 0);
 #undef SHOW_FUNCTION
 
 #define STORE_FUNCTION(__FUNC, __PTR, MIN, MAX, __CONV)			\
@@ -639,12 +839,16 @@ STORE_FUNCTION(row_lp_swrite_quantum_store,
 			1, INT_MAX, 1);
 STORE_FUNCTION(row_read_idle_store, &rowd->read_idle.idle_time, 1, INT_MAX, 1);
 STORE_FUNCTION(row_read_idle_freq_store, &rowd->read_idle.freq, 1, INT_MAX, 0);
+STORE_FUNCTION(row_read_lat_target_store, &rowd->read_lat_target,
+			0, INT_MAX, 0);
 
 #undef STORE_FUNCTION
 
 #define ROW_ATTR(name) \
 	__ATTR(name, S_IRUGO|S_IWUSR, row_##name##_show, \
 				      row_##name##_store)
+#define ROW_RO_ATTR(name) \
+	__ATTR(name, S_IRUGO, row_##name##_show, NULL)
 
 static struct elv_fs_entry row_attrs[] = {
 	ROW_ATTR(hp_read_quantum),
@@ -656,6 +860,11 @@ static struct elv_fs_entry row_attrs[] = {
 	ROW_ATTR(lp_swrite_quantum),
 	ROW_ATTR(read_idle),
 	ROW_ATTR(read_idle_freq),
+	ROW_ATTR(read_lat_target),
+	ROW_RO_ATTR(read_lat_est),
+	ROW_RO_ATTR(swrite_lat_est),
+	ROW_RO_ATTR(write_lat_est),
+	ROW_RO_ATTR(write_depth),
 	__ATTR_NULL
 };
 
@@ -664,6 +873,7 @@ static struct elevator_type iosched_row = {
 		.elevator_merge_req_fn		= row_merged_requests,
 		.elevator_dispatch_fn		= row_dispatch_requests,
 		.elevator_add_req_fn		= row_add_request,
+		.elevator_completed_req_fn	= row_completed_request,
 		.elevator_former_req_fn		= elv_rb_former_request,
 		.elevator_latter_req_fn		= elv_rb_latter_request,
 		.elevator_set_req_fn		= row_set_request,
@@ -0,0 +1,266 @@
+/*
+ * drivers/base/sw_sync_bench.c
+ *
+ * Copyright (C) 2012 Google, Inc.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+/*
+ * Measures sync framework throughput on sw_sync timelines.  Writing an
+ * iteration count to /sys/kernel/debug/sw_sync_bench runs the benchmark;
+ * reading it back reports the cost per operation of each phase:
+ *
+ *   create  sw_sync_pt_create() + sync_fence_create()
+ *   merge   sync_fence_merge() of a fence spanning SW_SYNC_BENCH_TIMELINES
+ *           timelines with a single-timeline fence
+ *   signal  sw_sync_timeline_inc() by one, signaling one fence with one
+ *           async waiter attached
+ *   wait    sync_fence_wait() on an already signaled fence
+ */
+
+#include <linux/debugfs.h>
+#include <linux/hrtimer.h>
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/sw_sync.h>
+#include <linux/uaccess.h>
+#include <linux/vmalloc.h>
+
+#define SW_SYNC_BENCH_TIMELINES		16
+#define SW_SYNC_BENCH_MAX_ITERS		10000
+
+struct sw_sync_bench_result {
+	unsigned int	iters;
+	u64		create_ns;
+	u64		merge_ns;
+	u64		signal_ns;
+	u64		wait_ns;
+	unsigned int	callbacks;
+	int		err;
+};
+
+static DEFINE_MUTEX(sw_sync_bench_lock);
+static struct sw_sync_bench_result sw_sync_bench_last;
+static atomic_t sw_sync_bench_callbacks;
+
+static void sw_sync_bench_callback(struct sync_fence *fence,
+				   struct sync_fence_waiter *waiter)
+{
+	atomic_inc(&sw_sync_bench_callbacks);
+}
+
+static struct sync_fence *sw_sync_bench_fence(struct sw_sync_timeline *obj,
+					      u32 value)
+{
+	struct sync_fence *fence;
+	struct sync_pt *pt;
+
+	pt = sw_sync_pt_create(obj, value);
+	if (pt == NULL)
+		return NULL;
+
+	fence = sync_fence_create("bench", pt);
+	if (fence == NULL)
+		sync_pt_free(pt);
+
+	return fence;
+}
+
+static void sw_sync_bench_put_all(struct sync_fence **fences, unsigned int n)
+{
+	unsigned int i;
+
+	for (i = 0; i < n; i++)
+		if (fences[i])
+			sync_fence_put(fences[i]);
+}
+
+static int sw_sync_bench_run(unsigned int iters,
+			     struct sw_sync_bench_result *res)
+{
+	struct sw_sync_timeline *obj[SW_SYNC_BENCH_TIMELINES] = { NULL };
+	struct sync_fence **fences;
+	struct sync_fence_waiter *waiters;
+	struct sync_fence *acc = NULL;
+	ktime_t start;
+	unsigned int i;
+	int err = 0;
+
+	memset(res, 0, sizeof(*res));
+	res->iters = iters;
+
+	fences = vzalloc(iters * sizeof(*fences));
+	waiters = vzalloc(iters * sizeof(*waiters));
+	if (!fences || !waiters) {
+		err = -ENOMEM;
+		goto out_free;
+	}
+
+	for (i = 0; i < SW_SYNC_BENCH_TIMELINES; i++) {
+		obj[i] = sw_sync_timeline_create("bench");
+		if (obj[i] == NULL) {
+			err = -ENOMEM;
+			goto out_destroy;
+		}
+	}
+
+	/* create: one fence per future value of the first timeline */
+	start = ktime_get();
+	for (i = 0; i < iters; i++) {
+		fences[i] = sw_sync_bench_fence(obj[0], i + 1);
+		if (fences[i] == NULL) {
+			err = -ENOMEM;
+			goto out_put;
+		}
+	}
+	res->create_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	/* merge: fold fences of every timeline into one wide fence */
+	acc = sw_sync_bench_fence(obj[0], iters + 1);
+	if (acc == NULL) {
+		err = -ENOMEM;
+		goto out_put;
+	}
+	start = ktime_get();
+	for (i = 0; i < iters; i++) {
+		struct sync_fence *single, *merged;
+
+		single = sw_sync_bench_fence(obj[i % SW_SYNC_BENCH_TIMELINES],
+					     iters + 1 + i);
+		if (single == NULL) {
+			err = -ENOMEM;
+			goto out_put;
+		}
+		merged = sync_fence_merge("bench", acc, single);
+		sync_fence_put(single);
+		if (merged == NULL) {
+			err = -ENOMEM;
+			goto out_put;
+		}
+		sync_fence_put(acc);
+		acc = merged;
+	}
+	res->merge_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	/* signal: release the created fences one timeline step at a time */
+	atomic_set(&sw_sync_bench_callbacks, 0);
+	for (i = 0; i < iters; i++) {
+		sync_fence_waiter_init(&waiters[i], sw_sync_bench_callback);
+		sync_fence_wait_async(fences[i], &waiters[i]);
+	}
+	start = ktime_get();
+	for (i = 0; i < iters; i++)
+		sw_sync_timeline_inc(obj[0], 1);
+	res->signal_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	res->callbacks = atomic_read(&sw_sync_bench_callbacks);
+
+	/* wait: fast path on fences that have already signaled */
+	start = ktime_get();
+	for (i = 0; i < iters; i++) {
+		err = sync_fence_wait(fences[i], 0);
+		if (err)
+			goto out_put;
+	}
+	res->wait_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+out_put:
+	if (acc)
+		sync_fence_put(acc);
+	sw_sync_bench_put_all(fences, iters);
+out_destroy:
+	for (i = 0; i < SW_SYNC_BENCH_TIMELINES; i++)
+		if (obj[i])
+			sync_timeline_destroy(&obj[i]->obj);
+out_free:
+	vfree(waiters);
+	vfree(fences);
+	res->err = err;
+	return err;
+}
+
+static int sw_sync_bench_show(struct seq_file *s, void *unused)
+{
+	struct sw_sync_bench_result *res = &sw_sync_bench_last;
+	unsigned int n;
+
+	mutex_lock(&sw_sync_bench_lock);
+	n = max(res->iters, 1U);
+	seq_printf(s, "iterations: %u\n", res->iters);
+	seq_printf(s, "timelines: %u\n", SW_SYNC_BENCH_TIMELINES);
+	seq_printf(s, "create: %llu ns/op\n", div_u64(res->create_ns, n));
+	seq_printf(s, "merge: %llu ns/op\n", div_u64(res->merge_ns, n));
+	seq_printf(s, "signal: %llu ns/op\n", div_u64(res->signal_ns, n));
+	seq_printf(s, "wait: %llu ns/op\n", div_u64(res->wait_ns, n));
+	seq_printf(s, "callbacks: %u\n", res->callbacks);
+	seq_printf(s, "error: %d\n", res->err);
+	mutex_unlock(&sw_sync_bench_lock);
+
+	return 0;
+}
+
+static int sw_sync_bench_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, sw_sync_bench_show, inode->i_private);
+}
+
+static ssize_t sw_sync_bench_write(struct file *file,
+				   const char __user *ubuf,
+				   size_t count, loff_t *ppos)
+{
+	unsigned int iters;
+	int err;
+
+	err = kstrtouint_from_user(ubuf, count, 0, &iters);
+	if (err)
+		return err;
+
+	if (iters == 0 || iters > SW_SYNC_BENCH_MAX_ITERS)
+		return -EINVAL;
+
+	mutex_lock(&sw_sync_bench_lock);
+	err = sw_sync_bench_run(iters, &sw_sync_bench_last);
+	mutex_unlock(&sw_sync_bench_lock);
+
+	return err ? err : count;
+}
+
+static const struct file_operations sw_sync_bench_fops = {
+	.open           = sw_sync_bench_open,
+	.read           = seq_read,
+	.write          = sw_sync_bench_write,
+	.llseek         = seq_lseek,
+	.release        = single_release,
+};
+
+static struct dentry *sw_sync_bench_dentry;
+
+static int __init sw_sync_bench_init(void)
+{
+	sw_sync_bench_dentry = debugfs_create_file("sw_sync_bench",
+						   S_IRUGO | S_IWUSR, NULL,
+						   NULL, &sw_sync_bench_fops);
+	return 0;
+}
+
+static void __exit sw_sync_bench_exit(void)
+{
+	debugfs_remove(sw_sync_bench_dentry);
+}
+
+module_init(sw_sync_bench_init);
+module_exit(sw_sync_bench_exit);
+
+MODULE_LICENSE("GPL v2");
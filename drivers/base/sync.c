@@ -63,7 +63,6 @@ struct sync_timeline *sync_timeline_create(const struct sync_timeline_ops *ops,
 	spin_lock_init(&obj->child_list_lock);
 
 	INIT_LIST_HEAD(&obj->active_list_head);
-	spin_lock_init(&obj->active_list_lock);
 
 	spin_lock_irqsave(&sync_timeline_list_lock, flags);
 	list_add_tail(&obj->sync_timeline_list, &sync_timeline_list_head);
@@ -119,15 +118,11 @@ static void sync_timeline_remove_pt(struct sync_pt *pt)
 	struct sync_timeline *obj = pt->parent;
 	unsigned long flags;
 
-	spin_lock_irqsave(&obj->active_list_lock, flags);
+	spin_lock_irqsave(&obj->child_list_lock, flags);
 	if (!list_empty(&pt->active_list))
 		list_del_init(&pt->active_list);
-	spin_unlock_irqrestore(&obj->active_list_lock, flags);
-
-	spin_lock_irqsave(&obj->child_list_lock, flags);
-	if (!list_empty(&pt->child_list)) {
+	if (!list_empty(&pt->child_list))
 		list_del_init(&pt->child_list);
-	}
 	spin_unlock_irqrestore(&obj->child_list_lock, flags);
 }
 
@@ -139,7 +134,7 @@ void sync_timeline_signal(struct sync_timeline *obj)
 
 	trace_sync_timeline(obj);
 
-	spin_lock_irqsave(&obj->active_list_lock, flags);
+	spin_lock_irqsave(&obj->child_list_lock, flags);
 
 	list_for_each_safe(pos, n, &obj->active_list_head) {
 		struct sync_pt *pt =
@@ -152,7 +147,7 @@ void sync_timeline_signal(struct sync_timeline *obj)
 		}
 	}
 
-	spin_unlock_irqrestore(&obj->active_list_lock, flags);
+	spin_unlock_irqrestore(&obj->child_list_lock, flags);
 
 	list_for_each_safe(pos, n, &signaled_pts) {
 		struct sync_pt *pt =
@@ -197,7 +192,7 @@ void sync_pt_free(struct sync_pt *pt)
 }
 EXPORT_SYMBOL(sync_pt_free);
 
-/* call with pt->parent->active_list_lock held */
+/* call with pt->parent->child_list_lock held */
 static int _sync_pt_has_signaled(struct sync_pt *pt)
 {
 	int old_status = pt->status;
@@ -219,23 +214,26 @@ static struct sync_pt *sync_pt_dup(struct sync_pt *pt)
 	return pt->parent->ops->dup(pt);
 }
 
-/* Adds a sync pt to the active queue.  Called when added to a fence */
-static void sync_pt_activate(struct sync_pt *pt)
+/*
+ * Adds a sync pt to the active queue.  Called when added to a fence.
+ * Returns the pt's status: non-zero if it had already signaled, in which
+ * case it was not queued and the caller must signal the fence with it.
+ */
+static int sync_pt_activate(struct sync_pt *pt)
 {
 	struct sync_timeline *obj = pt->parent;
 	unsigned long flags;
 	int err;
 
-	spin_lock_irqsave(&obj->active_list_lock, flags);
+	spin_lock_irqsave(&obj->child_list_lock, flags);
 
 	err = _sync_pt_has_signaled(pt);
-	if (err != 0)
-		goto out;
+	if (err == 0)
+		list_add_tail(&pt->active_list, &obj->active_list_head);
 
-	list_add_tail(&pt->active_list, &obj->active_list_head);
+	spin_unlock_irqrestore(&obj->child_list_lock, flags);
 
-out:
-	spin_unlock_irqrestore(&obj->active_list_lock, flags);
+	return err;
 }
 
 static int sync_fence_release(struct inode *inode, struct file *file);
@@ -268,6 +266,7 @@ static struct sync_fence *sync_fence_alloc(const char *name)
 	strlcpy(fence->name, name, sizeof(fence->name));
 
 	INIT_LIST_HEAD(&fence->pt_list_head);
+	atomic_set(&fence->pending, 0);
 	INIT_LIST_HEAD(&fence->waiter_list_head);
 	spin_lock_init(&fence->waiter_list_lock);
 
@@ -298,82 +297,79 @@ struct sync_fence *sync_fence_create(const char *name, struct sync_pt *pt)
 
 	pt->fence = fence;
 	list_add(&pt->pt_list, &fence->pt_list_head);
-	sync_pt_activate(pt);
+	atomic_set(&fence->pending, 1);
 
-	/*
-	 * signal the fence in case pt was activated before
-	 * sync_pt_activate(pt) was called
-	 */
-	sync_fence_signal_pt(pt);
+	/* signal the fence in case pt signaled before it was activated */
+	if (sync_pt_activate(pt))
+		sync_fence_signal_pt(pt);
 
 	return fence;
 }
 EXPORT_SYMBOL(sync_fence_create);
 
-static int sync_fence_copy_pts(struct sync_fence *dst, struct sync_fence *src)
+static int sync_fence_add_dup(struct sync_fence *dst, struct sync_pt *pt)
 {
-	struct list_head *pos;
+	struct sync_pt *new_pt = sync_pt_dup(pt);
 
-	list_for_each(pos, &src->pt_list_head) {
-		struct sync_pt *orig_pt =
-			container_of(pos, struct sync_pt, pt_list);
-		struct sync_pt *new_pt = sync_pt_dup(orig_pt);
-
-		if (new_pt == NULL)
-			return -ENOMEM;
+	if (new_pt == NULL)
+		return -ENOMEM;
 
-		new_pt->fence = dst;
-		list_add(&new_pt->pt_list, &dst->pt_list_head);
-	}
+	new_pt->fence = dst;
+	list_add_tail(&new_pt->pt_list, &dst->pt_list_head);
 
 	return 0;
 }
 
-static int sync_fence_merge_pts(struct sync_fence *dst, struct sync_fence *src)
+/*
+ * Fills @dst with copies of the sync_pts of @a and @b.  Both pt lists are
+ * sorted by parent timeline, so a single pass over the two lists in step
+ * finds the pts sharing a timeline and collapses them to a copy of the one
+ * that will signal last, keeping @dst sorted as well.
+ *
+ * Returns the number of sync_pts in @dst or -ENOMEM.
+ */
+static int sync_fence_merge_pts(struct sync_fence *dst,
+				struct sync_fence *a, struct sync_fence *b)
 {
-	struct list_head *src_pos, *dst_pos, *n;
-
-	list_for_each(src_pos, &src->pt_list_head) {
-		struct sync_pt *src_pt =
-			container_of(src_pos, struct sync_pt, pt_list);
-		bool collapsed = false;
+	struct list_head *pos_a = a->pt_list_head.next;
+	struct list_head *pos_b = b->pt_list_head.next;
+	int count = 0;
+	int err;
 
-		list_for_each_safe(dst_pos, n, &dst->pt_list_head) {
-			struct sync_pt *dst_pt =
-				container_of(dst_pos, struct sync_pt, pt_list);
+	while (pos_a != &a->pt_list_head || pos_b != &b->pt_list_head) {
+		struct sync_pt *pt_a = NULL, *pt_b = NULL, *pt;
+
+		if (pos_a != &a->pt_list_head)
+			pt_a = container_of(pos_a, struct sync_pt, pt_list);
+		if (pos_b != &b->pt_list_head)
+			pt_b = container_of(pos_b, struct sync_pt, pt_list);
+
+		if (!pt_b || (pt_a && pt_a->parent < pt_b->parent)) {
+			pt = pt_a;
+			pos_a = pos_a->next;
+		} else if (!pt_a || pt_b->parent < pt_a->parent) {
+			pt = pt_b;
+			pos_b = pos_b->next;
+		} else {
 			/* collapse two sync_pts on the same timeline
 			 * to a single sync_pt that will signal at
 			 * the later of the two
 			 */
-			if (dst_pt->parent == src_pt->parent) {
-				if (dst_pt->parent->ops->compare(dst_pt, src_pt) == -1) {
-					struct sync_pt *new_pt =
-						sync_pt_dup(src_pt);
-					if (new_pt == NULL)
-						return -ENOMEM;
-
-					new_pt->fence = dst;
-					list_replace(&dst_pt->pt_list,
-						     &new_pt->pt_list);
-					sync_pt_free(dst_pt);
-				}
-				collapsed = true;
-				break;
-			}
+			if (pt_a->parent->ops->compare(pt_a, pt_b) == -1)
+				pt = pt_b;
+			else
+				pt = pt_a;
+			pos_a = pos_a->next;
+			pos_b = pos_b->next;
 		}
 
-		if (!collapsed) {
-			struct sync_pt *new_pt = sync_pt_dup(src_pt);
-
-			if (new_pt == NULL)
-				return -ENOMEM;
-
-			new_pt->fence = dst;
-			list_add(&new_pt->pt_list, &dst->pt_list_head);
-		}
+		err = sync_fence_add_dup(dst, pt);
+		if (err < 0)
+			return err;
+		count++;
 	}
 
-	return 0;
+	return count;
 }
 
 static void sync_fence_detach_pts(struct sync_fence *fence)
@@ -426,26 +422,6 @@ void sync_fence_install(struct sync_fence *fence, int fd)
 }
 EXPORT_SYMBOL(sync_fence_install);
 
-static int sync_fence_get_status(struct sync_fence *fence)
-{
-	struct list_head *pos;
-	int status = 1;
-
-	list_for_each(pos, &fence->pt_list_head) {
-		struct sync_pt *pt = container_of(pos, struct sync_pt, pt_list);
-		int pt_status = pt->status;
-
-		if (pt_status < 0) {
-			status = pt_status;
-			break;
-		} else if (status == 1) {
-			status = pt_status;
-		}
-	}
-
-	return status;
-}
-
 struct sync_fence *sync_fence_merge(const char *name,
 				    struct sync_fence *a, struct sync_fence *b)
 {
@@ -457,27 +433,23 @@ struct sync_fence *sync_fence_merge(const char *name,
 	if (fence == NULL)
 		return NULL;
 
-	err = sync_fence_copy_pts(fence, a);
+	err = sync_fence_merge_pts(fence, a, b);
 	if (err < 0)
 		goto err;
 
-	err = sync_fence_merge_pts(fence, b);
-	if (err < 0)
-		goto err;
+	atomic_set(&fence->pending, err);
 
+	/*
+	 * signal the fence with any of its pts that signaled before they
+	 * were activated
+	 */
 	list_for_each(pos, &fence->pt_list_head) {
 		struct sync_pt *pt =
 			container_of(pos, struct sync_pt, pt_list);
-		sync_pt_activate(pt);
-	}
 
-	/*
-	 * signal the fence in case one of it's pts were activated before
-	 * they were activated
-	 */
-	sync_fence_signal_pt(list_first_entry(&fence->pt_list_head,
-					      struct sync_pt,
-					      pt_list));
+		if (sync_pt_activate(pt))
+			sync_fence_signal_pt(pt);
+	}
 
 	return fence;
 err:
@@ -487,6 +459,12 @@ err:
 }
 EXPORT_SYMBOL(sync_fence_merge);
 
+/*
+ * Called once for every sync_pt of a fence, by whoever saw the pt move away
+ * from the active state.  The fence signals when its last pt does, or with
+ * the first error; the cmpxchg() on fence->status makes that transition
+ * happen exactly once without serializing the pts on a lock.
+ */
 static void sync_fence_signal_pt(struct sync_pt *pt)
 {
 	LIST_HEAD(signaled_waiters);
@@ -494,36 +472,27 @@ static void sync_fence_signal_pt(struct sync_pt *pt)
 	struct list_head *pos;
 	struct list_head *n;
 	unsigned long flags;
-	int status;
+	int status = pt->status;
 
-	status = sync_fence_get_status(fence);
+	if (status > 0 && !atomic_dec_and_test(&fence->pending))
+		return;
 
-	spin_lock_irqsave(&fence->waiter_list_lock, flags);
-	/*
-	 * this should protect against two threads racing on the signaled
-	 * false -> true transition
-	 */
-	if (status && !fence->status) {
-		list_for_each_safe(pos, n, &fence->waiter_list_head)
-			list_move(pos, &signaled_waiters);
+	if (cmpxchg(&fence->status, 0, status) != 0)
+		return;
 
-		fence->status = status;
-	} else {
-		status = 0;
-	}
+	spin_lock_irqsave(&fence->waiter_list_lock, flags);
+	list_splice_init(&fence->waiter_list_head, &signaled_waiters);
 	spin_unlock_irqrestore(&fence->waiter_list_lock, flags);
 
-	if (status) {
-		list_for_each_safe(pos, n, &signaled_waiters) {
-			struct sync_fence_waiter *waiter =
-				container_of(pos, struct sync_fence_waiter,
-					     waiter_list);
+	list_for_each_safe(pos, n, &signaled_waiters) {
+		struct sync_fence_waiter *waiter =
+			container_of(pos, struct sync_fence_waiter,
+				     waiter_list);
 
-			list_del(pos);
-			waiter->callback(fence, waiter);
-		}
-		wake_up(&fence->wq);
+		list_del(pos);
+		waiter->callback(fence, waiter);
 	}
+	wake_up(&fence->wq);
 }
 
 int sync_fence_wait_async(struct sync_fence *fence,
@@ -534,6 +503,11 @@ int sync_fence_wait_async(struct sync_fence *fence,
 
 	spin_lock_irqsave(&fence->waiter_list_lock, flags);
 
+	/*
+	 * sync_fence_signal_pt() sets the status before collecting the
+	 * waiters under the lock, so either it is visible here or this
+	 * waiter gets collected.
+	 */
 	if (fence->status) {
 		err = fence->status;
 		goto out;
@@ -628,6 +602,85 @@ int sync_fence_wait(struct sync_fence *fence, long timeout)
 }
 EXPORT_SYMBOL(sync_fence_wait);
 
+/* count fences done, recording their status; returns the first error */
+static int sync_fence_multi_done(struct sync_fence **fences, int count,
+				 __s32 *status, int *done)
+{
+	int err = 0;
+	int i;
+
+	/* order reads of fence->status with the wait queue wakeup */
+	smp_rmb();
+
+	*done = 0;
+	for (i = 0; i < count; i++) {
+		status[i] = fences[i]->status;
+		if (status[i])
+			(*done)++;
+		if (status[i] < 0 && !err)
+			err = status[i];
+	}
+
+	return err;
+}
+
+int sync_fence_wait_multi(struct sync_fence **fences, int count, bool any,
+			  long timeout, __s32 *status)
+{
+	wait_queue_t *waits;
+	int done, err, i;
+
+	waits = kcalloc(count, sizeof(*waits), GFP_KERNEL);
+	if (waits == NULL)
+		return -ENOMEM;
+
+	for (i = 0; i < count; i++) {
+		trace_sync_wait(fences[i], 1);
+		init_waitqueue_entry(&waits[i], current);
+		add_wait_queue(&fences[i]->wq, &waits[i]);
+	}
+
+	if (timeout > 0)
+		timeout = msecs_to_jiffies(timeout);
+	else if (timeout < 0)
+		timeout = MAX_SCHEDULE_TIMEOUT;
+
+	for (;;) {
+		set_current_state(TASK_INTERRUPTIBLE);
+
+		err = sync_fence_multi_done(fences, count, status, &done);
+		if (err || done == count || (any && done))
+			break;
+
+		if (!timeout) {
+			err = -ETIME;
+			break;
+		}
+
+		if (signal_pending(current)) {
+			err = -ERESTARTSYS;
+			break;
+		}
+
+		timeout = schedule_timeout(timeout);
+	}
+	__set_current_state(TASK_RUNNING);
+
+	for (i = 0; i < count; i++) {
+		remove_wait_queue(&fences[i]->wq, &waits[i]);
+		trace_sync_wait(fences[i], 0);
+	}
+	kfree(waits);
+
+	if (err < 0 && err != -ETIME && err != -ERESTARTSYS) {
+		pr_info("fence error %d in multi wait\n", err);
+		sync_dump();
+	}
+
+	return err;
+}
+EXPORT_SYMBOL(sync_fence_wait_multi);
+
 static void sync_fence_free(struct kref *kref)
 {
 	struct sync_fence *fence = container_of(kref, struct sync_fence, kref);
@@ -742,6 +795,63 @@ err_put_fd:
 	return err;
 }
 
+static long sync_fence_ioctl_wait_multi(struct sync_fence *fence,
+					unsigned long arg)
+{
+	struct sync_wait_multi_data data;
+	struct sync_fence **fences;
+	__s32 *fds, *status;
+	int got = 0;
+	long err;
+
+	if (copy_from_user(&data, (void __user *)arg, sizeof(data)))
+		return -EFAULT;
+
+	if (data.count == 0 || data.count > SYNC_WAIT_MULTI_MAX ||
+	    (data.flags & ~SYNC_WAIT_ANY) || data.pad)
+		return -EINVAL;
+
+	fences = kcalloc(data.count, sizeof(*fences), GFP_KERNEL);
+	fds = kcalloc(data.count, sizeof(*fds), GFP_KERNEL);
+	status = kcalloc(data.count, sizeof(*status), GFP_KERNEL);
+	if (!fences || !fds || !status) {
+		err = -ENOMEM;
+		goto out;
+	}
+
+	if (copy_from_user(fds, (void __user *)(uintptr_t)data.fds,
+			   data.count * sizeof(*fds))) {
+		err = -EFAULT;
+		goto out;
+	}
+
+	for (got = 0; got < data.count; got++) {
+		fences[got] = sync_fence_fdget(fds[got]);
+		if (fences[got] == NULL) {
+			err = -ENOENT;
+			goto out;
+		}
+	}
+
+	err = sync_fence_wait_multi(fences, data.count,
+				    data.flags & SYNC_WAIT_ANY,
+				    data.timeout, status);
+	if (err == -ENOMEM)
+		goto out;
+
+	if (copy_to_user((void __user *)(uintptr_t)data.status, status,
+			 data.count * sizeof(*status)))
+		err = -EFAULT;
+
+out:
+	while (got--)
+		sync_fence_put(fences[got]);
+	kfree(status);
+	kfree(fds);
+	kfree(fences);
+	return err;
+}
+
 static int sync_fill_pt_info(struct sync_pt *pt, void *data, int size)
 {
 	struct sync_pt_info *info = data;
@@ -835,6 +945,9 @@ static long sync_fence_ioctl(struct file *file, unsigned int cmd,
 	case SYNC_IOC_FENCE_INFO:
 		return sync_fence_ioctl_fence_info(fence, arg);
 
+	case SYNC_IOC_WAIT_MULTI:
+		return sync_fence_ioctl_wait_multi(fence, arg);
+
 	default:
 		return -ENOTTY;
 	}
@@ -13,6 +13,7 @@
 #include <linux/moduleparam.h>
 #include <linux/major.h>
 #include <linux/blkdev.h>
+#include <linux/blk-mq.h>
 #include <linux/bio.h>
 #include <linux/highmem.h>
 #include <linux/mutex.h>
@@ -323,32 +324,27 @@ out:
 	return err;
 }
 
-static void brd_make_request(struct request_queue *q, struct bio *bio)
+static int brd_queue_rq(struct blk_mq_hw_ctx *hctx, struct request *rq)
 {
-	struct block_device *bdev = bio->bi_bdev;
-	struct brd_device *brd = bdev->bd_disk->private_data;
-	int rw;
+	struct brd_device *brd = hctx->queue->queuedata;
+	int rw = rq_data_dir(rq);
+	struct req_iterator iter;
 	struct bio_vec *bvec;
 	sector_t sector;
-	int i;
 	int err = -EIO;
 
-	sector = bio->bi_sector;
-	if (sector + (bio->bi_size >> SECTOR_SHIFT) >
-						get_capacity(bdev->bd_disk))
+	sector = blk_rq_pos(rq);
+	if (sector + blk_rq_sectors(rq) > get_capacity(brd->brd_disk))
 		goto out;
 
-	if (unlikely(bio->bi_rw & REQ_DISCARD)) {
+	if (unlikely(rq->cmd_flags & REQ_DISCARD)) {
 		err = 0;
-		discard_from_brd(brd, sector, bio->bi_size);
+		discard_from_brd(brd, sector, blk_rq_bytes(rq));
 		goto out;
 	}
 
-	rw = bio_rw(bio);
-	if (rw == READA)
-		rw = READ;
-
-	bio_for_each_segment(bvec, bio, i) {
+	err = 0;
+	rq_for_each_segment(bvec, rq, iter) {
 		unsigned int len = bvec->bv_len;
 		err = brd_do_bvec(brd, bvec->bv_page, len,
 					bvec->bv_offset, rw, sector);
@@ -358,9 +354,22 @@ static void brd_make_request(struct request_queue *q, struct bio *bio)
 	}
 
 out:
-	bio_endio(bio, err);
+	blk_mq_end_io(rq, err);
+	return BLK_MQ_RQ_QUEUE_OK;
 }
 
+static struct blk_mq_ops brd_mq_ops = {
+	.queue_rq	= brd_queue_rq,
+};
+
+static struct blk_mq_reg brd_mq_reg = {
+	.ops		= &brd_mq_ops,
+	.nr_hw_queues	= 1,
+	.queue_depth	= 64,
+	.numa_node	= NUMA_NO_NODE,
+	.flags		= BLK_MQ_F_SHOULD_MERGE,
+};
+
 #ifdef CONFIG_BLK_DEV_XIP
 static int brd_direct_access(struct block_device *bdev, sector_t sector,
 			void **kaddr, unsigned long *pfn)
@@ -472,10 +481,10 @@ static struct brd_device *brd_alloc(int i)
 	spin_lock_init(&brd->brd_lock);
 	INIT_RADIX_TREE(&brd->brd_pages, GFP_ATOMIC);
 
-	brd->brd_queue = blk_alloc_queue(GFP_KERNEL);
+	brd->brd_queue = blk_mq_init_queue(&brd_mq_reg, brd);
 	if (!brd->brd_queue)
 		goto out_free_dev;
-	blk_queue_make_request(brd->brd_queue, brd_make_request);
+	brd->brd_queue->queuedata = brd;
 	blk_queue_max_hw_sectors(brd->brd_queue, 1024);
 	blk_queue_bounce_limit(brd->brd_queue, BLK_BOUNCE_ANY);
 
@@ -59,6 +59,7 @@
 #include <linux/major.h>
 #include <linux/wait.h>
 #include <linux/blkdev.h>
+#include <linux/blk-mq.h>
 #include <linux/blkpg.h>
 #include <linux/init.h>
 #include <linux/swap.h>
@@ -458,98 +459,118 @@ out:
 	return ret;
 }
 
+struct switch_request {
+	struct file *file;
+	struct completion wait;
+};
+
 /*
- * Add bio to back of pending list
+ * Per-request data, allocated by blk-mq behind every request.  A backing
+ * store switch goes through the same list with no request attached.
  */
-static void loop_add_bio(struct loop_device *lo, struct bio *bio)
-{
-	bio_list_add(&lo->lo_bio_list, bio);
-}
+struct loop_cmd {
+	struct list_head list;
+	struct request *rq;
+	struct switch_request *sw;
+};
 
 /*
- * Grab first pending buffer
+ * Add command to back of pending list
  */
-static struct bio *loop_get_bio(struct loop_device *lo)
+static void loop_add_cmd(struct loop_device *lo, struct loop_cmd *cmd)
 {
-	return bio_list_pop(&lo->lo_bio_list);
+	list_add_tail(&cmd->list, &lo->lo_cmd_list);
 }
 
-static void loop_make_request(struct request_queue *q, struct bio *old_bio)
+/*
+ * Grab first pending command
+ */
+static struct loop_cmd *loop_get_cmd(struct loop_device *lo)
 {
-	struct loop_device *lo = q->queuedata;
-	int rw = bio_rw(old_bio);
+	struct loop_cmd *cmd;
 
-	if (rw == READA)
-		rw = READ;
+	cmd = list_first_entry(&lo->lo_cmd_list, struct loop_cmd, list);
+	list_del_init(&cmd->list);
+	return cmd;
+}
 
-	BUG_ON(!lo || (rw != READ && rw != WRITE));
+static int loop_queue_rq(struct blk_mq_hw_ctx *hctx, struct request *rq)
+{
+	struct loop_device *lo = hctx->queue->queuedata;
+	struct loop_cmd *cmd = blk_mq_rq_to_pdu(rq);
 
 	spin_lock_irq(&lo->lo_lock);
 	if (lo->lo_state != Lo_bound)
 		goto out;
-	if (unlikely(rw == WRITE && (lo->lo_flags & LO_FLAGS_READ_ONLY)))
+	if (unlikely(rq_data_dir(rq) == WRITE &&
+		     (lo->lo_flags & LO_FLAGS_READ_ONLY)))
 		goto out;
-	loop_add_bio(lo, old_bio);
+	cmd->rq = rq;
+	cmd->sw = NULL;
+	loop_add_cmd(lo, cmd);
 	wake_up(&lo->lo_event);
 	spin_unlock_irq(&lo->lo_lock);
-	return;
+	return BLK_MQ_RQ_QUEUE_OK;
 
 out:
 	spin_unlock_irq(&lo->lo_lock);
-	bio_io_error(old_bio);
+	blk_mq_end_io(rq, -EIO);
+	return BLK_MQ_RQ_QUEUE_OK;
 }
 
-struct switch_request {
-	struct file *file;
-	struct completion wait;
-};
-
 static void do_loop_switch(struct loop_device *, struct switch_request *);
 
-static inline void loop_handle_bio(struct loop_device *lo, struct bio *bio)
+static inline void loop_handle_cmd(struct loop_device *lo, struct loop_cmd *cmd)
 {
-	if (unlikely(!bio->bi_bdev)) {
-		do_loop_switch(lo, bio->bi_private);
-		bio_put(bio);
-	} else {
-		int ret = do_bio_filebacked(lo, bio);
-		bio_endio(bio, ret);
+	struct request *rq = cmd->rq;
+	struct bio *bio;
+	int ret = 0;
+
+	if (unlikely(!rq)) {
+		do_loop_switch(lo, cmd->sw);
+		return;
 	}
+
+	__rq_for_each_bio(bio, rq) {
+		ret = do_bio_filebacked(lo, bio);
+		if (ret)
+			break;
+	}
+	blk_mq_end_io(rq, ret);
 }
 
 /*
  * worker thread that handles reads/writes to file backed loop devices,
- * to avoid blocking in our make_request_fn. it also does loop decrypting
+ * to avoid blocking in our queue_rq. it also does loop decrypting
  * on reads for block backed loop, as that is too heavy to do from
  * b_end_io context where irqs may be disabled.
  *
  * Loop explanation:  loop_clr_fd() sets lo_state to Lo_rundown before
  * calling kthread_stop().  Therefore once kthread_should_stop() is
- * true, make_request will not place any more requests.  Therefore
- * once kthread_should_stop() is true and lo_bio is NULL, we are
+ * true, queue_rq will not place any more requests.  Therefore
+ * once kthread_should_stop() is true and lo_cmd_list is empty, we are
  * done with the loop.
  */
 static int loop_thread(void *data)
 {
 	struct loop_device *lo = data;
-	struct bio *bio;
+	struct loop_cmd *cmd;
 
 	set_user_nice(current, -20);
 
-	while (!kthread_should_stop() || !bio_list_empty(&lo->lo_bio_list)) {
+	while (!kthread_should_stop() || !list_empty(&lo->lo_cmd_list)) {
 
 		wait_event_interruptible(lo->lo_event,
-				!bio_list_empty(&lo->lo_bio_list) ||
+				!list_empty(&lo->lo_cmd_list) ||
 				kthread_should_stop());
 
-		if (bio_list_empty(&lo->lo_bio_list))
+		if (list_empty(&lo->lo_cmd_list))
 			continue;
 		spin_lock_irq(&lo->lo_lock);
-		bio = loop_get_bio(lo);
+		cmd = loop_get_cmd(lo);
 		spin_unlock_irq(&lo->lo_lock);
 
-		BUG_ON(!bio);
-		loop_handle_bio(lo, bio);
+		loop_handle_cmd(lo, cmd);
 	}
 
 	return 0;
@@ -557,20 +578,24 @@ static int loop_thread(void *data)
 
 /*
  * loop_switch performs the hard work of switching a backing store.
- * First it needs to flush existing IO, it does this by sending a magic
- * BIO down the pipe. The completion of this BIO does the actual switch.
+ * First it needs to flush existing IO, it does this by queueing a magic
+ * command behind it. Handling that command does the actual switch.
  */
 static int loop_switch(struct loop_device *lo, struct file *file)
 {
 	struct switch_request w;
-	struct bio *bio = bio_alloc(GFP_KERNEL, 0);
-	if (!bio)
-		return -ENOMEM;
+	struct loop_cmd cmd;
+
 	init_completion(&w.wait);
 	w.file = file;
-	bio->bi_private = &w;
-	bio->bi_bdev = NULL;
-	loop_make_request(lo->lo_queue, bio);
+	cmd.rq = NULL;
+	cmd.sw = &w;
+
+	spin_lock_irq(&lo->lo_lock);
+	loop_add_cmd(lo, &cmd);
+	wake_up(&lo->lo_event);
+	spin_unlock_irq(&lo->lo_lock);
+
 	wait_for_completion(&w.wait);
 	return 0;
 }
@@ -588,7 +613,7 @@ static int loop_flush(struct loop_device *lo)
 }
 
 /*
- * Do the actual switch; called from the BIO completion routine
+ * Do the actual switch; called from the loop thread
  */
 static void do_loop_switch(struct loop_device *lo, struct switch_request *p)
 {
@@ -876,14 +901,7 @@ static int loop_set_fd(struct loop_device *lo, fmode_t mode,
 	lo->old_gfp_mask = mapping_gfp_mask(mapping);
 	mapping_set_gfp_mask(mapping, lo->old_gfp_mask & ~(__GFP_IO|__GFP_FS));
 
-	bio_list_init(&lo->lo_bio_list);
-
-	/*
-	 * set queue make_request_fn, and add limits based on lower level
-	 * device
-	 */
-	blk_queue_make_request(lo->lo_queue, loop_make_request);
-	lo->lo_queue->queuedata = lo;
+	INIT_LIST_HEAD(&lo->lo_cmd_list);
 
 	if (!(lo_flags & LO_FLAGS_READ_ONLY) && file->f_op->fsync)
 		blk_queue_flush(lo->lo_queue, REQ_FLUSH);
@@ -1596,6 +1614,19 @@ int loop_unregister_transfer(int number)
 EXPORT_SYMBOL(loop_register_transfer);
 EXPORT_SYMBOL(loop_unregister_transfer);
 
+static struct blk_mq_ops loop_mq_ops = {
+	.queue_rq	= loop_queue_rq,
+};
+
+static struct blk_mq_reg loop_mq_reg = {
+	.ops		= &loop_mq_ops,
+	.nr_hw_queues	= 1,
+	.queue_depth	= 128,
+	.cmd_size	= sizeof(struct loop_cmd),
+	.numa_node	= NUMA_NO_NODE,
+	.flags		= BLK_MQ_F_SHOULD_MERGE,
+};
+
 static int loop_add(struct loop_device **l, int i)
 {
 	struct loop_device *lo;
@@ -1634,9 +1665,11 @@ static int loop_add(struct loop_device **l, int i)
 	if (err < 0)
 		goto out_free_dev;
 
-	lo->lo_queue = blk_alloc_queue(GFP_KERNEL);
+	lo->lo_queue = blk_mq_init_queue(&loop_mq_reg, lo);
 	if (!lo->lo_queue)
 		goto out_free_dev;
+	lo->lo_queue->queuedata = lo;
+	blk_queue_bounce_limit(lo->lo_queue, BLK_BOUNCE_ANY);
 
 	disk = lo->lo_disk = alloc_disk(1 << part_shift);
 	if (!disk)
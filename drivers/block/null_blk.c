@@ -0,0 +1,612 @@
+/*
+ * Null block device
+ *
+ * A block device that completes every request without moving any data.
+ * It is meant for measuring the block layer itself: with no media behind
+ * it, the IOPS it reaches are bounded only by submission and completion
+ * overhead.  The queueing model (bio based, request queue with elevator,
+ * or multi-queue) and the completion path (inline, softirq, or a timer
+ * emulating device latency) can be chosen at load time, so elevators and
+ * block layer paths can be compared on any machine.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ */
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/init.h>
+#include <linux/blkdev.h>
+#include <linux/blk-mq.h>
+#include <linux/bio.h>
+#include <linux/fs.h>
+#include <linux/genhd.h>
+#include <linux/hrtimer.h>
+#include <linux/llist.h>
+#include <linux/log2.h>
+#include <linux/percpu.h>
+#include <linux/slab.h>
+
+struct nullb_cmd {
+	struct llist_node	ll_list;
+	struct request		*rq;
+	struct bio		*bio;
+	unsigned int		tag;
+	struct nullb_queue	*nq;
+};
+
+/*
+ * Command slots for the bio and request modes, blk-mq tags its own
+ */
+struct nullb_queue {
+	unsigned long		*tag_map;
+	wait_queue_head_t	wait;
+	unsigned int		queue_depth;
+	struct nullb_cmd	*cmds;
+};
+
+struct nullb {
+	struct list_head	list;
+	unsigned int		index;
+	struct request_queue	*q;
+	struct gendisk		*disk;
+	spinlock_t		lock;
+
+	struct nullb_queue	*queues;
+	unsigned int		nr_queues;
+};
+
+/*
+ * Per-cpu list of commands waiting for the completion timer
+ */
+struct completion_queue {
+	struct llist_head	list;
+	struct hrtimer		timer;
+};
+
+static DEFINE_PER_CPU(struct completion_queue, completion_queues);
+
+static LIST_HEAD(nullb_list);
+static DEFINE_MUTEX(nullb_lock);
+static int null_major;
+static unsigned int nullb_indexes;
+
+enum {
+	NULL_IRQ_NONE		= 0,
+	NULL_IRQ_SOFTIRQ	= 1,
+	NULL_IRQ_TIMER		= 2,
+};
+
+enum {
+	NULL_Q_BIO		= 0,
+	NULL_Q_RQ		= 1,
+	NULL_Q_MQ		= 2,
+};
+
+static int submit_queues;
+module_param(submit_queues, int, S_IRUGO);
+MODULE_PARM_DESC(submit_queues, "Number of submission queues, 0 for one per cpu");
+
+static int queue_mode = NULL_Q_MQ;
+module_param(queue_mode, int, S_IRUGO);
+MODULE_PARM_DESC(queue_mode, "Block interface to use (0=bio,1=rq,2=multiqueue)");
+
+static int nr_devices = 2;
+module_param(nr_devices, int, S_IRUGO);
+MODULE_PARM_DESC(nr_devices, "Number of devices to register");
+
+static int gb = 250;
+module_param(gb, int, S_IRUGO);
+MODULE_PARM_DESC(gb, "Size in GB");
+
+static int bs = 512;
+module_param(bs, int, S_IRUGO);
+MODULE_PARM_DESC(bs, "Block size (in bytes)");
+
+static int irqmode = NULL_IRQ_SOFTIRQ;
+module_param(irqmode, int, S_IRUGO);
+MODULE_PARM_DESC(irqmode, "IRQ completion handler. 0-none, 1-softirq, 2-timer");
+
+static int completion_nsec = 10000;
+module_param(completion_nsec, int, S_IRUGO);
+MODULE_PARM_DESC(completion_nsec, "Time in ns to complete a request in hardware. Default: 10,000ns");
+
+static int hw_queue_depth = 64;
+module_param(hw_queue_depth, int, S_IRUGO);
+MODULE_PARM_DESC(hw_queue_depth, "Queue depth for each submission queue");
+
+static void put_tag(struct nullb_queue *nq, unsigned int tag)
+{
+	clear_bit_unlock(tag, nq->tag_map);
+	smp_mb__after_clear_bit();
+
+	if (waitqueue_active(&nq->wait))
+		wake_up(&nq->wait);
+}
+
+static unsigned int get_tag(struct nullb_queue *nq)
+{
+	unsigned int tag;
+
+	do {
+		tag = find_first_zero_bit(nq->tag_map, nq->queue_depth);
+		if (tag >= nq->queue_depth)
+			return -1U;
+	} while (test_and_set_bit_lock(tag, nq->tag_map));
+
+	return tag;
+}
+
+static void free_cmd(struct nullb_cmd *cmd)
+{
+	put_tag(cmd->nq, cmd->tag);
+}
+
+static struct nullb_cmd *__alloc_cmd(struct nullb_queue *nq)
+{
+	struct nullb_cmd *cmd;
+	unsigned int tag;
+
+	tag = get_tag(nq);
+	if (tag == -1U)
+		return NULL;
+
+	cmd = &nq->cmds[tag];
+	cmd->tag = tag;
+	cmd->nq = nq;
+	return cmd;
+}
+
+static struct nullb_cmd *alloc_cmd(struct nullb_queue *nq, bool can_wait)
+{
+	struct nullb_cmd *cmd;
+	DEFINE_WAIT(wait);
+
+	cmd = __alloc_cmd(nq);
+	if (cmd || !can_wait)
+		return cmd;
+
+	for (;;) {
+		prepare_to_wait(&nq->wait, &wait, TASK_UNINTERRUPTIBLE);
+		cmd = __alloc_cmd(nq);
+		if (cmd)
+			break;
+		io_schedule();
+	}
+	finish_wait(&nq->wait, &wait);
+
+	return cmd;
+}
+
+static void end_cmd(struct nullb_cmd *cmd)
+{
+	struct request_queue *q;
+	unsigned long flags;
+
+	switch (queue_mode) {
+	case NULL_Q_MQ:
+		blk_mq_end_io(cmd->rq, 0);
+		return;
+	case NULL_Q_RQ:
+		q = cmd->rq->q;
+		blk_end_request_all(cmd->rq, 0);
+		free_cmd(cmd);
+
+		/* a prep that ran out of commands stopped the queue */
+		if (unlikely(blk_queue_stopped(q))) {
+			spin_lock_irqsave(q->queue_lock, flags);
+			if (blk_queue_stopped(q)) {
+				queue_flag_clear(QUEUE_FLAG_STOPPED, q);
+				blk_run_queue_async(q);
+			}
+			spin_unlock_irqrestore(q->queue_lock, flags);
+		}
+		return;
+	case NULL_Q_BIO:
+		bio_endio(cmd->bio, 0);
+		free_cmd(cmd);
+		return;
+	}
+}
+
+static enum hrtimer_restart null_cmd_timer_expired(struct hrtimer *timer)
+{
+	struct completion_queue *cq;
+	struct llist_node *entry;
+	struct nullb_cmd *cmd;
+
+	cq = container_of(timer, struct completion_queue, timer);
+
+	while ((entry = llist_del_all(&cq->list)) != NULL) {
+		do {
+			cmd = container_of(entry, struct nullb_cmd, ll_list);
+			entry = entry->next;
+			end_cmd(cmd);
+		} while (entry);
+	}
+
+	return HRTIMER_NORESTART;
+}
+
+/*
+ * The first command queued on an idle cpu arms the timer, the ones that
+ * follow before it fires complete with it.  This batches completions the
+ * way an interrupt coalescing device would.
+ */
+static void null_cmd_end_timer(struct nullb_cmd *cmd)
+{
+	struct completion_queue *cq = &per_cpu(completion_queues, get_cpu());
+
+	cmd->ll_list.next = NULL;
+	if (llist_add(&cmd->ll_list, &cq->list))
+		hrtimer_start(&cq->timer, ktime_set(0, completion_nsec),
+			      HRTIMER_MODE_REL);
+
+	put_cpu();
+}
+
+static void null_softirq_done_fn(struct request *rq)
+{
+	if (queue_mode == NULL_Q_MQ)
+		end_cmd(blk_mq_rq_to_pdu(rq));
+	else
+		end_cmd(rq->special);
+}
+
+static void null_handle_cmd(struct nullb_cmd *cmd)
+{
+	switch (irqmode) {
+	case NULL_IRQ_SOFTIRQ:
+		/* no submitting cpu to steer a bio to, complete it here */
+		if (queue_mode == NULL_Q_BIO)
+			end_cmd(cmd);
+		else
+			blk_complete_request(cmd->rq);
+		break;
+	case NULL_IRQ_NONE:
+		end_cmd(cmd);
+		break;
+	case NULL_IRQ_TIMER:
+		null_cmd_end_timer(cmd);
+		break;
+	}
+}
+
+static struct nullb_queue *nullb_to_queue(struct nullb *nullb)
+{
+	int index = 0;
+
+	if (nullb->nr_queues != 1)
+		index = raw_smp_processor_id() /
+			((nr_cpu_ids + nullb->nr_queues - 1) / nullb->nr_queues);
+
+	return &nullb->queues[index];
+}
+
+static void null_queue_bio(struct request_queue *q, struct bio *bio)
+{
+	struct nullb *nullb = q->queuedata;
+	struct nullb_queue *nq = nullb_to_queue(nullb);
+	struct nullb_cmd *cmd;
+
+	cmd = alloc_cmd(nq, true);
+	cmd->bio = bio;
+	cmd->rq = NULL;
+
+	null_handle_cmd(cmd);
+}
+
+static int null_rq_prep_fn(struct request_queue *q, struct request *req)
+{
+	struct nullb *nullb = q->queuedata;
+	struct nullb_queue *nq = nullb_to_queue(nullb);
+	struct nullb_cmd *cmd;
+
+	cmd = alloc_cmd(nq, false);
+	if (cmd) {
+		cmd->rq = req;
+		cmd->bio = NULL;
+		req->special = cmd;
+		return BLKPREP_OK;
+	}
+
+	blk_stop_queue(q);
+	return BLKPREP_DEFER;
+}
+
+static void null_request_fn(struct request_queue *q)
+{
+	struct request *rq;
+
+	while ((rq = blk_fetch_request(q)) != NULL) {
+		struct nullb_cmd *cmd = rq->special;
+
+		spin_unlock_irq(q->queue_lock);
+		null_handle_cmd(cmd);
+		spin_lock_irq(q->queue_lock);
+	}
+}
+
+static int null_queue_rq(struct blk_mq_hw_ctx *hctx, struct request *rq)
+{
+	struct nullb_cmd *cmd = blk_mq_rq_to_pdu(rq);
+
+	cmd->rq = rq;
+	cmd->bio = NULL;
+	cmd->nq = hctx->driver_data;
+
+	null_handle_cmd(cmd);
+	return BLK_MQ_RQ_QUEUE_OK;
+}
+
+static int null_init_hctx(struct blk_mq_hw_ctx *hctx, void *data,
+			  unsigned int index)
+{
+	struct nullb *nullb = data;
+
+	hctx->driver_data = &nullb->queues[index];
+	return 0;
+}
+
+static struct blk_mq_ops null_mq_ops = {
+	.queue_rq	= null_queue_rq,
+	.init_hctx	= null_init_hctx,
+};
+
+static const struct block_device_operations null_fops = {
+	.owner		= THIS_MODULE,
+};
+
+static void cleanup_queue(struct nullb_queue *nq)
+{
+	kfree(nq->tag_map);
+	kfree(nq->cmds);
+}
+
+static void cleanup_queues(struct nullb *nullb)
+{
+	unsigned int i;
+
+	for (i = 0; i < nullb->nr_queues; i++)
+		cleanup_queue(&nullb->queues[i]);
+
+	kfree(nullb->queues);
+}
+
+static int setup_commands(struct nullb_queue *nq)
+{
+	nq->cmds = kcalloc(nq->queue_depth, sizeof(*nq->cmds), GFP_KERNEL);
+	if (!nq->cmds)
+		return -ENOMEM;
+
+	nq->tag_map = kcalloc(BITS_TO_LONGS(nq->queue_depth),
+			      sizeof(unsigned long), GFP_KERNEL);
+	if (!nq->tag_map) {
+		kfree(nq->cmds);
+		nq->cmds = NULL;
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+static int setup_queues(struct nullb *nullb)
+{
+	unsigned int i;
+
+	nullb->nr_queues = queue_mode == NULL_Q_RQ ? 1 : submit_queues;
+	nullb->queues = kcalloc(nullb->nr_queues, sizeof(struct nullb_queue),
+				GFP_KERNEL);
+	if (!nullb->queues)
+		return -ENOMEM;
+
+	for (i = 0; i < nullb->nr_queues; i++) {
+		struct nullb_queue *nq = &nullb->queues[i];
+
+		init_waitqueue_head(&nq->wait);
+		nq->queue_depth = hw_queue_depth;
+
+		if (queue_mode != NULL_Q_MQ && setup_commands(nq)) {
+			cleanup_queues(nullb);
+			return -ENOMEM;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * A bio based queue has nobody to drain it, wait for our own commands
+ */
+static void null_wait_idle(struct nullb *nullb)
+{
+	unsigned int i;
+
+	for (i = 0; i < nullb->nr_queues; i++) {
+		struct nullb_queue *nq = &nullb->queues[i];
+
+		wait_event(nq->wait, bitmap_empty(nq->tag_map,
+						  nq->queue_depth));
+	}
+}
+
+static void null_del_dev(struct nullb *nullb)
+{
+	list_del_init(&nullb->list);
+
+	del_gendisk(nullb->disk);
+	blk_cleanup_queue(nullb->q);
+	if (queue_mode == NULL_Q_BIO)
+		null_wait_idle(nullb);
+	put_disk(nullb->disk);
+	cleanup_queues(nullb);
+	kfree(nullb);
+}
+
+static int null_add_dev(void)
+{
+	struct blk_mq_reg reg = {
+		.ops		= &null_mq_ops,
+		.nr_hw_queues	= submit_queues,
+		.queue_depth	= hw_queue_depth,
+		.cmd_size	= sizeof(struct nullb_cmd),
+		.numa_node	= NUMA_NO_NODE,
+		.flags		= BLK_MQ_F_SHOULD_MERGE,
+	};
+	struct gendisk *disk;
+	struct nullb *nullb;
+	sector_t size;
+
+	nullb = kzalloc(sizeof(*nullb), GFP_KERNEL);
+	if (!nullb)
+		return -ENOMEM;
+
+	spin_lock_init(&nullb->lock);
+
+	if (setup_queues(nullb))
+		goto out_free_nullb;
+
+	switch (queue_mode) {
+	case NULL_Q_MQ:
+		nullb->q = blk_mq_init_queue(&reg, nullb);
+		break;
+	case NULL_Q_BIO:
+		nullb->q = blk_alloc_queue(GFP_KERNEL);
+		if (nullb->q)
+			blk_queue_make_request(nullb->q, null_queue_bio);
+		break;
+	case NULL_Q_RQ:
+		nullb->q = blk_init_queue(null_request_fn, &nullb->lock);
+		if (nullb->q)
+			blk_queue_prep_rq(nullb->q, null_rq_prep_fn);
+		break;
+	}
+	if (!nullb->q)
+		goto out_cleanup_queues;
+
+	nullb->q->queuedata = nullb;
+	if (queue_mode != NULL_Q_BIO)
+		blk_queue_softirq_done(nullb->q, null_softirq_done_fn);
+	queue_flag_set_unlocked(QUEUE_FLAG_NONROT, nullb->q);
+	blk_queue_logical_block_size(nullb->q, bs);
+	blk_queue_physical_block_size(nullb->q, bs);
+
+	disk = nullb->disk = alloc_disk(1);
+	if (!disk)
+		goto out_cleanup_blk_queue;
+
+	mutex_lock(&nullb_lock);
+	list_add_tail(&nullb->list, &nullb_list);
+	nullb->index = nullb_indexes++;
+	mutex_unlock(&nullb_lock);
+
+	size = (sector_t)gb * 1024 * 1024 * 1024;
+	set_capacity(disk, size >> 9);
+
+	disk->flags |= GENHD_FL_EXT_DEVT | GENHD_FL_SUPPRESS_PARTITION_INFO;
+	disk->major		= null_major;
+	disk->first_minor	= nullb->index;
+	disk->fops		= &null_fops;
+	disk->private_data	= nullb;
+	disk->queue		= nullb->q;
+	sprintf(disk->disk_name, "nullb%d", nullb->index);
+	add_disk(disk);
+	return 0;
+
+out_cleanup_blk_queue:
+	blk_cleanup_queue(nullb->q);
+out_cleanup_queues:
+	cleanup_queues(nullb);
+out_free_nullb:
+	kfree(nullb);
+	return -ENOMEM;
+}
+
+static void null_del_all(void)
+{
+	struct nullb *nullb;
+
+	mutex_lock(&nullb_lock);
+	while (!list_empty(&nullb_list)) {
+		nullb = list_entry(nullb_list.next, struct nullb, list);
+		null_del_dev(nullb);
+	}
+	mutex_unlock(&nullb_lock);
+}
+
+static void null_cancel_timers(void)
+{
+	unsigned int cpu;
+
+	for_each_possible_cpu(cpu)
+		hrtimer_cancel(&per_cpu(completion_queues, cpu).timer);
+}
+
+static int __init null_init(void)
+{
+	unsigned int i;
+	int ret;
+
+	if (bs > PAGE_SIZE || bs < 512 || !is_power_of_2(bs)) {
+		pr_warn("null_blk: invalid block size %d, using 512\n", bs);
+		bs = 512;
+	}
+
+	if (queue_mode < NULL_Q_BIO || queue_mode > NULL_Q_MQ) {
+		pr_warn("null_blk: invalid queue_mode %d, using multiqueue\n",
+			queue_mode);
+		queue_mode = NULL_Q_MQ;
+	}
+
+	if (irqmode < NULL_IRQ_NONE || irqmode > NULL_IRQ_TIMER) {
+		pr_warn("null_blk: invalid irqmode %d, using softirq\n",
+			irqmode);
+		irqmode = NULL_IRQ_SOFTIRQ;
+	}
+
+	if (completion_nsec < 0)
+		completion_nsec = 0;
+
+	if (submit_queues <= 0 || submit_queues > nr_cpu_ids)
+		submit_queues = nr_cpu_ids;
+
+	if (hw_queue_depth <= 0)
+		hw_queue_depth = 64;
+
+	for_each_possible_cpu(i) {
+		struct completion_queue *cq = &per_cpu(completion_queues, i);
+
+		init_llist_head(&cq->list);
+		hrtimer_init(&cq->timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+		cq->timer.function = null_cmd_timer_expired;
+	}
+
+	null_major = register_blkdev(0, "nullb");
+	if (null_major < 0)
+		return null_major;
+
+	for (i = 0; i < nr_devices; i++) {
+		ret = null_add_dev();
+		if (ret) {
+			null_del_all();
+			unregister_blkdev(null_major, "nullb");
+			null_cancel_timers();
+			return ret;
+		}
+	}
+
+	pr_info("null_blk: module loaded\n");
+	return 0;
+}
+
+static void __exit null_exit(void)
+{
+	null_del_all();
+	unregister_blkdev(null_major, "nullb");
+	null_cancel_timers();
+}
+
+module_init(null_init);
+module_exit(null_exit);
+
+MODULE_LICENSE("GPL");
@@ -518,7 +518,7 @@ struct mm_plug_cb {
 	struct cardinfo *card;
 };
 
-static void mm_unplug(struct blk_plug_cb *cb)
+static void mm_unplug(struct blk_plug_cb *cb, bool from_schedule)
 {
 	struct mm_plug_cb *mmcb = container_of(cb, struct mm_plug_cb, cb);
 
@@ -985,6 +985,7 @@ static void clone_init(struct dm_crypt_io *io, struct bio *clone)
 	clone->bi_end_io  = crypt_endio;
 	clone->bi_bdev    = cc->dev->bdev;
 	clone->bi_rw      = io->base_bio->bi_rw;
+	clone->bi_write_hint = io->base_bio->bi_write_hint;
 	clone->bi_destructor = dm_crypt_bio_destructor;
 }
 
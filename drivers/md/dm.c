@@ -1070,6 +1070,7 @@ static struct bio *split_bvec(struct bio *bio, sector_t sector,
 	clone->bi_sector = sector;
 	clone->bi_bdev = bio->bi_bdev;
 	clone->bi_rw = bio->bi_rw;
+	clone->bi_write_hint = bio->bi_write_hint;
 	clone->bi_vcnt = 1;
 	clone->bi_size = to_bytes(len);
 	clone->bi_io_vec->bv_offset = offset;
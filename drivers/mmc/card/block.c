@@ -61,6 +61,18 @@ MODULE_ALIAS("mmc:block");
 #define INAND_CMD38_ARG_SECTRIM1 0x81
 #define INAND_CMD38_ARG_SECTRIM2 0x88
 
+#define mmc_req_rel_wr(req)	(((req->cmd_flags & REQ_FUA) || \
+				  (req->cmd_flags & REQ_META)) && \
+				  (rq_data_dir(req) == WRITE))
+#define PACKED_CMD_VER	0x01
+#define PACKED_CMD_WR	0x02
+
+/* Entries that fit in a 512 byte packed header after the header word */
+#define MMC_PACKED_MAX_ENTRIES	\
+	(ARRAY_SIZE(((struct mmc_packed *)0)->cmd_hdr) / 2 - 1)
+/* Failed packed groups tolerated before packing is turned off */
+#define MMC_PACKED_MAX_FALLBACKS	3
+
 static DEFINE_MUTEX(block_mutex);
 
 /*
@@ -91,6 +103,7 @@ struct mmc_blk_data {
 	unsigned int	flags;
 #define MMC_BLK_CMD23	(1 << 0)	/* Can do SET_BLOCK_COUNT for multiblock */
 #define MMC_BLK_REL_WR	(1 << 1)	/* MMC Reliable write support */
+#define MMC_BLK_PACKED_CMD	(1 << 2)	/* MMC packed command support */
 
 	unsigned int	usage;
 	unsigned int	read_only;
@@ -110,6 +123,8 @@ struct mmc_blk_data {
 	unsigned int	part_curr;
 	struct device_attribute force_ro;
 	struct device_attribute power_ro_lock;
+	struct device_attribute packed_stats;
+	struct device_attribute bkops_idle_ms;
 	int	area_type;
 };
 
@@ -204,6 +219,7 @@ static ssize_t power_ro_lock_store(struct device *dev,
 	card = md->queue.card;
 
 	mmc_claim_host(card->host);
+	mmc_stop_bkops(card);
 
 	ret = mmc_switch(card, EXT_CSD_CMD_SET_NORMAL, EXT_CSD_BOOT_WP,
 				card->ext_csd.boot_ro_lock |
@@ -264,6 +280,53 @@ out:
 	return ret;
 }
 
+static ssize_t bkops_idle_ms_show(struct device *dev,
+				  struct device_attribute *attr, char *buf)
+{
+	int ret;
+	struct mmc_blk_data *md = mmc_blk_get(dev_to_disk(dev));
+
+	ret = snprintf(buf, PAGE_SIZE, "%u\n", md->queue.bkops_idle_ms);
+	mmc_blk_put(md);
+	return ret;
+}
+
+static ssize_t bkops_idle_ms_store(struct device *dev,
+				   struct device_attribute *attr,
+				   const char *buf, size_t count)
+{
+	int ret;
+	unsigned int idle_ms;
+	struct mmc_blk_data *md = mmc_blk_get(dev_to_disk(dev));
+
+	ret = kstrtouint(buf, 0, &idle_ms);
+	if (ret)
+		goto out;
+
+	md->queue.bkops_idle_ms = idle_ms;
+	if (!idle_ms)
+		mmc_queue_bkops_cancel(&md->queue);
+	ret = count;
+out:
+	mmc_blk_put(md);
+	return ret;
+}
+
+static ssize_t packed_stats_show(struct device *dev,
+				 struct device_attribute *attr, char *buf)
+{
+	int ret;
+	struct mmc_blk_data *md = mmc_blk_get(dev_to_disk(dev));
+	struct mmc_packed_stats *stats = &md->queue.packed_stats;
+
+	ret = snprintf(buf, PAGE_SIZE, "%lu %lu %lu %lu %lu\n",
+		       stats->packed_cmds, stats->packed_reqs,
+		       stats->single_reqs, stats->failures,
+		       stats->fallbacks);
+	mmc_blk_put(md);
+	return ret;
+}
+
 static int mmc_blk_open(struct block_device *bdev, fmode_t mode)
 {
 	struct mmc_blk_data *md = mmc_blk_get(bdev->bd_disk);
@@ -437,6 +500,7 @@ static int mmc_blk_ioctl_cmd(struct block_device *bdev,
 	mrq.cmd = &cmd;
 
 	mmc_claim_host(card->host);
+	mmc_stop_bkops(card);
 
 	if (idata->ic.is_acmd) {
 		err = mmc_app_cmd(card->host, card);
@@ -1000,6 +1064,22 @@ static inline void mmc_apply_rel_rw(struct mmc_blk_request *brq,
 	}
 }
 
+/*
+ * Map the write lifetime hint of a request onto one of the write-only
+ * contexts opened at init, so the card can keep data of different
+ * lifetimes apart.  Returns 0 when no context is to be used.
+ */
+static inline u32 mmc_blk_context_id(struct mmc_card *card,
+				     struct request *req)
+{
+	if (!card->ext_csd.nr_contexts || rq_data_dir(req) != WRITE ||
+	    req->write_hint <= WRITE_LIFE_NONE)
+		return 0;
+
+	return min_t(u32, req->write_hint - WRITE_LIFE_NONE,
+		     card->ext_csd.nr_contexts);
+}
+
 #define CMD_ERRORS							\
 	(R1_OUT_OF_RANGE |	/* Command argument out of range */	\
 	 R1_ADDRESS_ERROR |	/* Misaligned address */		\
@@ -1110,6 +1190,7 @@ static void mmc_blk_rw_rq_prep(struct mmc_queue_req *mqrq,
 	struct request *req = mqrq->req;
 	struct mmc_blk_data *md = mq->data;
 	bool do_data_tag;
+	u32 context_id;
 
 	/*
 	 * Reliable writes are used to implement Forced Unit Access and
@@ -1195,6 +1276,8 @@ static void mmc_blk_rw_rq_prep(struct mmc_queue_req *mqrq,
 		((brq->data.blocks * brq->data.blksz) >=
 		 card->ext_csd.data_tag_unit_size);
 
+	context_id = mmc_blk_context_id(card, req);
+
 	/*
 	 * Pre-defined multi-block transfers are preferable to
 	 * open ended-ones (and necessary for reliable writes).
@@ -1215,11 +1298,12 @@ static void mmc_blk_rw_rq_prep(struct mmc_queue_req *mqrq,
 	 */
 	if ((md->flags & MMC_BLK_CMD23) && mmc_op_multi(brq->cmd.opcode) &&
 	    (do_rel_wr || !(card->quirks & MMC_QUIRK_BLK_NO_CMD23) ||
-	     do_data_tag)) {
+	     do_data_tag || context_id)) {
 		brq->sbc.opcode = MMC_SET_BLOCK_COUNT;
 		brq->sbc.arg = brq->data.blocks |
 			(do_rel_wr ? (1 << 31) : 0) |
-			(do_data_tag ? (1 << 29) : 0);
+			(do_data_tag ? (1 << 29) : 0) |
+			MMC_CMD23_ARG_CONTEXT(context_id);
 		brq->sbc.flags = MMC_RSP_R1 | MMC_CMD_AC;
 		brq->mrq.sbc = &brq->sbc;
 	}
@@ -1254,6 +1338,388 @@ static void mmc_blk_rw_rq_prep(struct mmc_queue_req *mqrq,
 	mmc_queue_bounce_pre(mqrq);
 }
 
+static int mmc_blk_packed_err_check(struct mmc_card *card,
+				    struct mmc_async_req *areq)
+{
+	struct mmc_queue_req *mq_rq = container_of(areq, struct mmc_queue_req,
+			mmc_active);
+	struct request *req = mq_rq->req;
+	struct mmc_queue *mq = req->q->queuedata;
+	struct mmc_packed *packed = mq_rq->packed;
+	int err, check;
+	u32 status;
+	u8 *ext_csd;
+
+	BUG_ON(!packed);
+
+	packed->retries--;
+	check = mmc_blk_err_check(card, areq);
+	err = get_card_status(card, &status, 0);
+	if (err) {
+		pr_err("%s: error %d sending status command\n",
+		       req->rq_disk->disk_name, err);
+		check = MMC_BLK_ABORT;
+		goto out;
+	}
+
+	if (status & R1_EXCEPTION_EVENT) {
+		ext_csd = kzalloc(512, GFP_KERNEL);
+		if (!ext_csd) {
+			pr_err("%s: unable to allocate buffer for ext_csd\n",
+			       req->rq_disk->disk_name);
+			check = MMC_BLK_ABORT;
+			goto out;
+		}
+
+		err = mmc_send_ext_csd(card, ext_csd);
+		if (err) {
+			pr_err("%s: error %d sending ext_csd\n",
+			       req->rq_disk->disk_name, err);
+			check = MMC_BLK_ABORT;
+			goto free;
+		}
+
+		if ((ext_csd[EXT_CSD_EXP_EVENTS_STATUS] &
+		     EXT_CSD_PACKED_FAILURE) &&
+		    (ext_csd[EXT_CSD_PACKED_CMD_STATUS] &
+		     EXT_CSD_PACKED_GENERIC_ERROR)) {
+			if (ext_csd[EXT_CSD_PACKED_CMD_STATUS] &
+			    EXT_CSD_PACKED_INDEXED_ERROR) {
+				packed->idx_failure =
+				  ext_csd[EXT_CSD_PACKED_FAILURE_INDEX] - 1;
+				check = MMC_BLK_PARTIAL;
+			} else {
+				/* no idea which entries made it, resend all */
+				check = MMC_BLK_ABORT;
+			}
+			pr_err("%s: packed cmd failed, nr %u, sectors %u, "
+			       "failure index: %d\n",
+			       req->rq_disk->disk_name, packed->nr_entries,
+			       packed->blocks, packed->idx_failure);
+		}
+free:
+		kfree(ext_csd);
+	}
+
+out:
+	if ((check != MMC_BLK_SUCCESS && check != MMC_BLK_PARTIAL) ||
+	    packed->idx_failure != MMC_PACKED_NR_IDX)
+		mq->packed_stats.failures++;
+	return check;
+}
+
+static inline void mmc_blk_clear_packed(struct mmc_queue_req *mqrq)
+{
+	struct mmc_packed *packed = mqrq->packed;
+
+	mqrq->cmd_type = MMC_PACKED_NONE;
+	if (!packed)
+		return;
+
+	packed->nr_entries = MMC_PACKED_NR_ZERO;
+	packed->idx_failure = MMC_PACKED_NR_IDX;
+	packed->retries = 0;
+	packed->blocks = 0;
+}
+
+static inline u8 mmc_calc_packed_hdr_segs(struct request_queue *q)
+{
+	unsigned int hdr_sz = sizeof(((struct mmc_packed *)0)->cmd_hdr);
+	unsigned int max_seg_sz = queue_max_segment_size(q);
+
+	return (hdr_sz + max_seg_sz - 1) / max_seg_sz;
+}
+
+/*
+ * Pull further writes off the request queue to send together with @req
+ * as one packed write. Returns the number of requests in the group, or
+ * 0 if @req is to be sent on its own.
+ */
+static u8 mmc_blk_prep_packed_list(struct mmc_queue *mq, struct request *req)
+{
+	struct request_queue *q = mq->queue;
+	struct mmc_card *card = mq->card;
+	struct request *cur = req, *next = NULL;
+	struct mmc_blk_data *md = mq->data;
+	struct mmc_queue_req *mqrq = mq->mqrq_cur;
+	bool en_rel_wr = card->ext_csd.rel_param & EXT_CSD_WR_REL_PARAM_EN;
+	unsigned int req_sectors = 0, phys_segments = 0;
+	unsigned int max_blk_count, max_phys_segs;
+	bool put_back = true;
+	u8 max_packed_rw = 0;
+	u8 reqs = 0;
+
+	mqrq->cmd_type = MMC_PACKED_NONE;
+
+	if (!(md->flags & MMC_BLK_PACKED_CMD))
+		goto no_packed;
+
+	if ((rq_data_dir(cur) == WRITE) &&
+	    mmc_host_packed_wr(card->host))
+		max_packed_rw = min_t(unsigned int,
+				      card->ext_csd.max_packed_writes,
+				      MMC_PACKED_MAX_ENTRIES);
+
+	if (max_packed_rw == 0)
+		goto no_packed;
+
+	if (mmc_req_rel_wr(cur) &&
+	    (md->flags & MMC_BLK_REL_WR) && !en_rel_wr)
+		goto no_packed;
+
+	mmc_blk_clear_packed(mqrq);
+
+	max_blk_count = min(card->host->max_blk_count,
+			    queue_max_hw_sectors(q));
+	if (unlikely(max_blk_count > 0xffff))
+		max_blk_count = 0xffff;
+
+	max_phys_segs = queue_max_segments(q);
+	req_sectors += blk_rq_sectors(cur) + 1;
+	phys_segments += cur->nr_phys_segments + mmc_calc_packed_hdr_segs(q);
+
+	do {
+		if (reqs >= max_packed_rw - 1) {
+			put_back = false;
+			break;
+		}
+
+		spin_lock_irq(q->queue_lock);
+		next = blk_fetch_request(q);
+		spin_unlock_irq(q->queue_lock);
+		if (!next) {
+			put_back = false;
+			break;
+		}
+
+		if (next->cmd_flags & REQ_DISCARD ||
+		    next->cmd_flags & REQ_FLUSH)
+			break;
+
+		if (rq_data_dir(cur) != rq_data_dir(next))
+			break;
+
+		if (mmc_req_rel_wr(next) &&
+		    (md->flags & MMC_BLK_REL_WR) && !en_rel_wr)
+			break;
+
+		req_sectors += blk_rq_sectors(next);
+		if (req_sectors > max_blk_count)
+			break;
+
+		phys_segments += next->nr_phys_segments;
+		if (phys_segments > max_phys_segs)
+			break;
+
+		list_add_tail(&next->queuelist, &mqrq->packed->list);
+		cur = next;
+		reqs++;
+	} while (1);
+
+	if (put_back) {
+		spin_lock_irq(q->queue_lock);
+		blk_requeue_request(q, next);
+		spin_unlock_irq(q->queue_lock);
+	}
+
+	if (reqs > 0) {
+		list_add(&req->queuelist, &mqrq->packed->list);
+		mqrq->packed->nr_entries = ++reqs;
+		mqrq->packed->retries = reqs;
+		mq->packed_stats.packed_cmds++;
+		mq->packed_stats.packed_reqs += reqs;
+		return reqs;
+	}
+
+no_packed:
+	if (rq_data_dir(req) == WRITE)
+		mq->packed_stats.single_reqs++;
+	return 0;
+}
+
+static void mmc_blk_packed_hdr_wrq_prep(struct mmc_queue_req *mqrq,
+					struct mmc_card *card,
+					struct mmc_queue *mq)
+{
+	struct mmc_blk_request *brq = &mqrq->brq;
+	struct request *req = mqrq->req;
+	struct request *prq;
+	struct mmc_blk_data *md = mq->data;
+	struct mmc_packed *packed = mqrq->packed;
+	bool do_rel_wr, do_data_tag;
+	u32 *packed_cmd_hdr;
+	u8 hdr_blocks = 1;
+	u8 i = 1;
+
+	BUG_ON(!packed);
+
+	mqrq->cmd_type = MMC_PACKED_WRITE;
+	packed->blocks = 0;
+	packed->idx_failure = MMC_PACKED_NR_IDX;
+
+	packed_cmd_hdr = packed->cmd_hdr;
+	memset(packed_cmd_hdr, 0, sizeof(packed->cmd_hdr));
+	packed_cmd_hdr[0] = (packed->nr_entries << 16) |
+		(PACKED_CMD_WR << 8) | PACKED_CMD_VER;
+
+	/*
+	 * Argument for each entry of packed group
+	 */
+	list_for_each_entry(prq, &packed->list, queuelist) {
+		do_rel_wr = mmc_req_rel_wr(prq) && (md->flags & MMC_BLK_REL_WR);
+		do_data_tag = (card->ext_csd.data_tag_unit_size) &&
+			(prq->cmd_flags & REQ_META) &&
+			(blk_rq_bytes(prq) >= card->ext_csd.data_tag_unit_size);
+		/* Argument of CMD23 */
+		packed_cmd_hdr[(i * 2)] =
+			(do_rel_wr ? MMC_CMD23_ARG_REL_WR : 0) |
+			(do_data_tag ? MMC_CMD23_ARG_TAG_REQ : 0) |
+			MMC_CMD23_ARG_CONTEXT(mmc_blk_context_id(card, prq)) |
+			blk_rq_sectors(prq);
+		/* Argument of CMD25 */
+		packed_cmd_hdr[((i * 2)) + 1] =
+			mmc_card_blockaddr(card) ?
+			blk_rq_pos(prq) : blk_rq_pos(prq) << 9;
+		packed->blocks += blk_rq_sectors(prq);
+		i++;
+	}
+
+	memset(brq, 0, sizeof(struct mmc_blk_request));
+	brq->mrq.cmd = &brq->cmd;
+	brq->mrq.data = &brq->data;
+	brq->mrq.sbc = &brq->sbc;
+	brq->mrq.stop = &brq->stop;
+
+	brq->sbc.opcode = MMC_SET_BLOCK_COUNT;
+	brq->sbc.arg = MMC_CMD23_ARG_PACKED | (packed->blocks + hdr_blocks);
+	brq->sbc.flags = MMC_RSP_R1 | MMC_CMD_AC;
+
+	brq->cmd.opcode = MMC_WRITE_MULTIPLE_BLOCK;
+	brq->cmd.arg = blk_rq_pos(req);
+	if (!mmc_card_blockaddr(card))
+		brq->cmd.arg <<= 9;
+	brq->cmd.flags = MMC_RSP_SPI_R1 | MMC_RSP_R1 | MMC_CMD_ADTC;
+
+	brq->data.blksz = 512;
+	brq->data.blocks = packed->blocks + hdr_blocks;
+	brq->data.flags |= MMC_DATA_WRITE;
+
+	brq->stop.opcode = MMC_STOP_TRANSMISSION;
+	brq->stop.arg = 0;
+	brq->stop.flags = MMC_RSP_SPI_R1B | MMC_RSP_R1B | MMC_CMD_AC;
+
+	mmc_set_data_timeout(&brq->data, card);
+
+	brq->data.sg = mqrq->sg;
+	brq->data.sg_len = mmc_queue_map_sg(mq, mqrq);
+
+	mqrq->mmc_active.mrq = &brq->mrq;
+	mqrq->mmc_active.err_check = mmc_blk_packed_err_check;
+
+	mmc_queue_bounce_pre(mqrq);
+}
+
+/*
+ * Complete the requests of a packed group that made it to the card. If
+ * the card reported the index of a failed entry, the group is trimmed to
+ * start at that entry and 1 is returned so it gets sent again.
+ */
+static int mmc_blk_end_packed_req(struct mmc_queue_req *mq_rq)
+{
+	struct mmc_packed *packed = mq_rq->packed;
+	struct request *prq;
+	int idx = packed->idx_failure, i = 0;
+	int ret = 0;
+
+	BUG_ON(!packed);
+
+	while (!list_empty(&packed->list)) {
+		prq = list_entry_rq(packed->list.next);
+		if (idx == i) {
+			/* retry from error index */
+			packed->nr_entries -= idx;
+			mq_rq->req = prq;
+			ret = 1;
+
+			if (packed->nr_entries == MMC_PACKED_NR_SINGLE) {
+				list_del_init(&prq->queuelist);
+				mmc_blk_clear_packed(mq_rq);
+			}
+			return ret;
+		}
+		list_del_init(&prq->queuelist);
+		blk_end_request(prq, 0, blk_rq_bytes(prq));
+		i++;
+	}
+
+	mmc_blk_clear_packed(mq_rq);
+	return ret;
+}
+
+static void mmc_blk_abort_packed_req(struct mmc_queue_req *mq_rq)
+{
+	struct mmc_packed *packed = mq_rq->packed;
+	struct request *prq;
+
+	BUG_ON(!packed);
+
+	while (!list_empty(&packed->list)) {
+		prq = list_entry_rq(packed->list.next);
+		list_del_init(&prq->queuelist);
+		prq->cmd_flags |= REQ_QUIET;
+		blk_end_request(prq, -EIO, blk_rq_bytes(prq));
+	}
+
+	mmc_blk_clear_packed(mq_rq);
+}
+
+/*
+ * Put the requests of a packed group back on the queue. With @keep_head
+ * the first request stays with @mq_rq to be sent on its own.
+ */
+static void mmc_blk_revert_packed_req(struct mmc_queue *mq,
+				      struct mmc_queue_req *mq_rq,
+				      bool keep_head)
+{
+	struct mmc_packed *packed = mq_rq->packed;
+	struct request_queue *q = mq->queue;
+	struct request *prq;
+
+	BUG_ON(!packed);
+
+	spin_lock_irq(q->queue_lock);
+	while (!list_empty(&packed->list)) {
+		prq = list_entry_rq(packed->list.prev);
+		list_del_init(&prq->queuelist);
+		if (keep_head && list_empty(&packed->list))
+			break;
+		blk_requeue_request(q, prq);
+	}
+	spin_unlock_irq(q->queue_lock);
+
+	mmc_blk_clear_packed(mq_rq);
+}
+
+/*
+ * A packed write failed for good: requeue its requests so they are
+ * retried as ordinary writes, and stop packing on this device once it
+ * has happened MMC_PACKED_MAX_FALLBACKS times.
+ */
+static void mmc_blk_packed_fallback(struct mmc_queue *mq,
+				    struct mmc_queue_req *mq_rq)
+{
+	struct mmc_blk_data *md = mq->data;
+
+	mmc_blk_revert_packed_req(mq, mq_rq, false);
+
+	if (++mq->packed_stats.fallbacks >= MMC_PACKED_MAX_FALLBACKS &&
+	    md->flags & MMC_BLK_PACKED_CMD) {
+		pr_warning("%s: packed writes keep failing, disabling\n",
+			   md->disk->disk_name);
+		md->flags &= ~MMC_BLK_PACKED_CMD;
+	}
+}
+
 static int mmc_blk_cmd_err(struct mmc_blk_data *md, struct mmc_card *card,
 			   struct mmc_blk_request *brq, struct request *req,
 			   int ret)
@@ -1293,13 +1759,22 @@ static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *rqc)
 	struct mmc_queue_req *mq_rq;
 	struct request *req;
 	struct mmc_async_req *areq;
+	const u8 packed_nr = 2;
+	u8 reqs = 0;
 
 	if (!rqc && !mq->mqrq_prev->req)
 		return 0;
 
+	if (rqc)
+		reqs = mmc_blk_prep_packed_list(mq, rqc);
+
 	do {
 		if (rqc) {
-			mmc_blk_rw_rq_prep(mq->mqrq_cur, card, 0, mq);
+			if (reqs >= packed_nr)
+				mmc_blk_packed_hdr_wrq_prep(mq->mqrq_cur,
+							    card, mq);
+			else
+				mmc_blk_rw_rq_prep(mq->mqrq_cur, card, 0, mq);
 			areq = &mq->mqrq_cur->mmc_active;
 		} else
 			areq = NULL;
@@ -1320,6 +1795,12 @@ static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *rqc)
 			 * A block was successfully transferred.
 			 */
 			mmc_blk_reset_success(md, type);
+
+			if (mmc_packed_cmd(mq_rq->cmd_type)) {
+				ret = mmc_blk_end_packed_req(mq_rq);
+				break;
+			}
+
 			spin_lock_irq(&md->lock);
 			ret = __blk_end_request(req, 0,
 						brq->data.bytes_xfered);
@@ -1338,7 +1819,9 @@ static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *rqc)
 			}
 			break;
 		case MMC_BLK_CMD_ERR:
-			ret = mmc_blk_cmd_err(md, card, brq, req, ret);
+			/* a packed group is resent whole or from its index */
+			if (!mmc_packed_cmd(mq_rq->cmd_type))
+				ret = mmc_blk_cmd_err(md, card, brq, req, ret);
 			if (!mmc_blk_reset(md, card->host, type))
 				break;
 			goto cmd_abort;
@@ -1385,27 +1868,51 @@ static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *rqc)
 		}
 
 		if (ret) {
-			/*
-			 * In case of a incomplete request
-			 * prepare it again and resend.
-			 */
-			mmc_blk_rw_rq_prep(mq_rq, card, disable_multi, mq);
-			mmc_start_req(card->host, &mq_rq->mmc_active, NULL);
+			if (mmc_packed_cmd(mq_rq->cmd_type)) {
+				if (!mq_rq->packed->retries)
+					goto cmd_abort;
+				mmc_blk_packed_hdr_wrq_prep(mq_rq, card, mq);
+				mmc_start_req(card->host, &mq_rq->mmc_active,
+					      NULL);
+			} else {
+				/*
+				 * In case of a incomplete request
+				 * prepare it again and resend.
+				 */
+				mmc_blk_rw_rq_prep(mq_rq, card, disable_multi,
+						   mq);
+				mmc_start_req(card->host, &mq_rq->mmc_active,
+					      NULL);
+			}
 		}
 	} while (ret);
 
 	return 1;
 
  cmd_abort:
-	spin_lock_irq(&md->lock);
-	if (mmc_card_removed(card))
-		req->cmd_flags |= REQ_QUIET;
-	while (ret)
-		ret = __blk_end_request(req, -EIO, blk_rq_cur_bytes(req));
-	spin_unlock_irq(&md->lock);
+	if (mmc_packed_cmd(mq_rq->cmd_type)) {
+		if (mmc_card_removed(card))
+			mmc_blk_abort_packed_req(mq_rq);
+		else
+			mmc_blk_packed_fallback(mq, mq_rq);
+	} else {
+		spin_lock_irq(&md->lock);
+		if (mmc_card_removed(card))
+			req->cmd_flags |= REQ_QUIET;
+		while (ret)
+			ret = __blk_end_request(req, -EIO,
+						blk_rq_cur_bytes(req));
+		spin_unlock_irq(&md->lock);
+	}
 
  start_new_req:
 	if (rqc) {
+		/*
+		 * If the current request is packed, put the rest of its
+		 * group back and send only the head after an error.
+		 */
+		if (mmc_packed_cmd(mq->mqrq_cur->cmd_type))
+			mmc_blk_revert_packed_req(mq, mq->mqrq_cur, true);
 		mmc_blk_rw_rq_prep(mq->mqrq_cur, card, 0, mq);
 		mmc_start_req(card->host, &mq->mqrq_cur->mmc_active, NULL);
 	}
@@ -1429,9 +1936,12 @@ static int mmc_blk_issue_rq(struct mmc_queue *mq, struct request *req)
 	}
 #endif
 
-	if (req && !mq->mqrq_prev->req)
+	if (req && !mq->mqrq_prev->req) {
 		/* claim host only for the first request */
 		mmc_claim_host(card->host);
+		/* interrupt idle time BKOPS for the new request */
+		mmc_stop_bkops(card);
+	}
 
 	ret = mmc_blk_part_switch(card, md);
 	if (ret) {
@@ -1576,6 +2086,20 @@ static struct mmc_blk_data *mmc_blk_alloc_req(struct mmc_card *card,
 		blk_queue_flush(md->queue.queue, REQ_FLUSH | REQ_FUA);
 	}
 
+	if (mmc_card_mmc(card) &&
+	    (area_type == MMC_BLK_DATA_AREA_MAIN) &&
+	    (md->flags & MMC_BLK_CMD23) &&
+	    card->ext_csd.packed_event_en) {
+		if (!mmc_packed_init(&md->queue, card))
+			md->flags |= MMC_BLK_PACKED_CMD;
+	}
+
+	/* BKOPS are per card, let the main area queue schedule them */
+	if (mmc_card_mmc(card) &&
+	    (area_type == MMC_BLK_DATA_AREA_MAIN) &&
+	    card->ext_csd.bkops_en)
+		md->queue.bkops_idle_ms = MMC_QUEUE_BKOPS_IDLE_MS;
+
 	return md;
 
  err_putdisk:
@@ -1673,6 +2197,12 @@ static void mmc_blk_remove_req(struct mmc_blk_data *md)
 		card = md->queue.card;
 		if (md->disk->flags & GENHD_FL_UP) {
 			device_remove_file(disk_to_dev(md->disk), &md->force_ro);
+			if (md->packed_stats.attr.name)
+				device_remove_file(disk_to_dev(md->disk),
+					&md->packed_stats);
+			if (md->bkops_idle_ms.attr.name)
+				device_remove_file(disk_to_dev(md->disk),
+					&md->bkops_idle_ms);
 			if ((md->area_type & MMC_BLK_DATA_AREA_BOOT) &&
 					card->ext_csd.boot_ro_lockable)
 				device_remove_file(disk_to_dev(md->disk),
@@ -1684,6 +2214,7 @@ static void mmc_blk_remove_req(struct mmc_blk_data *md)
 
 		/* Then flush out any already in there */
 		mmc_cleanup_queue(&md->queue);
+		mmc_packed_clean(&md->queue);
 		mmc_blk_put(md);
 	}
 }
@@ -1737,8 +2268,40 @@ static int mmc_add_disk(struct mmc_blk_data *md)
 		if (ret)
 			goto power_ro_lock_fail;
 	}
+
+	if (md->flags & MMC_BLK_PACKED_CMD) {
+		md->packed_stats.show = packed_stats_show;
+		sysfs_attr_init(&md->packed_stats.attr);
+		md->packed_stats.attr.name = "packed_stats";
+		md->packed_stats.attr.mode = S_IRUGO;
+		ret = device_create_file(disk_to_dev(md->disk),
+				&md->packed_stats);
+		if (ret)
+			goto packed_stats_fail;
+	}
+
+	if (md->queue.bkops_idle_ms) {
+		md->bkops_idle_ms.show = bkops_idle_ms_show;
+		md->bkops_idle_ms.store = bkops_idle_ms_store;
+		sysfs_attr_init(&md->bkops_idle_ms.attr);
+		md->bkops_idle_ms.attr.name = "bkops_idle_ms";
+		md->bkops_idle_ms.attr.mode = S_IRUGO | S_IWUSR;
+		ret = device_create_file(disk_to_dev(md->disk),
+				&md->bkops_idle_ms);
+		if (ret)
+			goto bkops_idle_ms_fail;
+	}
 	return ret;
 
+bkops_idle_ms_fail:
+	md->bkops_idle_ms.attr.name = NULL;
+	if (md->packed_stats.attr.name)
+		device_remove_file(disk_to_dev(md->disk), &md->packed_stats);
+packed_stats_fail:
+	md->packed_stats.attr.name = NULL;
+	if ((md->area_type & MMC_BLK_DATA_AREA_BOOT) &&
+	    card->ext_csd.boot_ro_lockable)
+		device_remove_file(disk_to_dev(md->disk), &md->power_ro_lock);
 power_ro_lock_fail:
 	device_remove_file(disk_to_dev(md->disk), &md->force_ro);
 force_ro_fail:
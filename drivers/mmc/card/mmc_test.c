@@ -2005,6 +2005,155 @@ static int mmc_test_random_write_perf(struct mmc_test_card *test)
 	return mmc_test_random_perf(test, 1);
 }
 
+#define MMC_TEST_SMALL_WR_SZ	4096
+#define MMC_TEST_PACKED_NR	8
+
+/*
+ * Pick a random 4KiB aligned address inside the test area.
+ */
+static unsigned int mmc_test_small_rnd_addr(struct mmc_test_card *test)
+{
+	struct mmc_test_area *t = &test->area;
+	unsigned int ssz = MMC_TEST_SMALL_WR_SZ >> 9;
+
+	return t->dev_addr +
+	       ssz * mmc_test_rnd_num(t->max_sz / MMC_TEST_SMALL_WR_SZ);
+}
+
+/*
+ * Write @nr 4KiB chunks of the mapped test area to random addresses with
+ * a single eMMC 4.5 packed write command.
+ */
+static int mmc_test_packed_write(struct mmc_test_card *test, u32 *hdr,
+				 struct scatterlist *sg, unsigned int nr)
+{
+	struct mmc_test_area *t = &test->area;
+	struct mmc_request mrq = {0};
+	struct mmc_command sbc = {0};
+	struct mmc_command cmd = {0};
+	struct mmc_command stop = {0};
+	struct mmc_data data = {0};
+	unsigned int ssz = MMC_TEST_SMALL_WR_SZ >> 9;
+	struct scatterlist *s;
+	unsigned int i;
+	int ret;
+
+	/* header: version 1, write, followed by CMD23/CMD25 argument pairs */
+	memset(hdr, 0, 512);
+	hdr[0] = (nr << 16) | (0x02 << 8) | 0x01;
+	for (i = 1; i <= nr; i++) {
+		unsigned int addr = mmc_test_small_rnd_addr(test);
+
+		hdr[i * 2] = ssz;
+		hdr[i * 2 + 1] = mmc_card_blockaddr(test->card) ?
+				 addr : addr << 9;
+	}
+
+	sg_init_table(sg, t->sg_len + 1);
+	sg_set_buf(&sg[0], hdr, 512);
+	for_each_sg(t->sg, s, t->sg_len, i)
+		sg_set_page(&sg[i + 1], sg_page(s), s->length, s->offset);
+
+	mrq.sbc = &sbc;
+	mrq.cmd = &cmd;
+	mrq.data = &data;
+	mrq.stop = &stop;
+
+	sbc.opcode = MMC_SET_BLOCK_COUNT;
+	sbc.arg = MMC_CMD23_ARG_PACKED | (nr * ssz + 1);
+	sbc.flags = MMC_RSP_R1 | MMC_CMD_AC;
+
+	cmd.opcode = MMC_WRITE_MULTIPLE_BLOCK;
+	cmd.arg = hdr[3];
+	cmd.flags = MMC_RSP_R1 | MMC_CMD_ADTC;
+
+	stop.opcode = MMC_STOP_TRANSMISSION;
+	stop.flags = MMC_RSP_R1B | MMC_CMD_AC;
+
+	data.blksz = 512;
+	data.blocks = nr * ssz + 1;
+	data.flags = MMC_DATA_WRITE;
+	data.sg = sg;
+	data.sg_len = t->sg_len + 1;
+	mmc_set_data_timeout(&data, test->card);
+
+	mmc_wait_for_req(test->card->host, &mrq);
+
+	mmc_test_wait_busy(test);
+
+	ret = mmc_test_check_result(test, &mrq);
+	if (!ret && sbc.error)
+		ret = sbc.error;
+	return ret;
+}
+
+/*
+ * Small random write throughput: 4KiB writes to random addresses in the
+ * test area for 10 seconds, first one CMD25 per write and then
+ * MMC_TEST_PACKED_NR writes per packed command.
+ */
+static int mmc_test_small_rnd_write_perf(struct mmc_test_card *test)
+{
+	struct mmc_test_area *t = &test->area;
+	struct mmc_card *card = test->card;
+	struct scatterlist *sg = NULL;
+	struct timespec ts1, ts2, ts;
+	unsigned int nr, cnt;
+	u32 *hdr = NULL;
+	int ret;
+
+	getnstimeofday(&ts1);
+	for (cnt = 0; cnt < UINT_MAX; cnt++) {
+		getnstimeofday(&ts2);
+		ts = timespec_sub(ts2, ts1);
+		if (ts.tv_sec >= 10)
+			break;
+		ret = mmc_test_area_io(test, MMC_TEST_SMALL_WR_SZ,
+				       mmc_test_small_rnd_addr(test), 1, 0, 0);
+		if (ret)
+			return ret;
+	}
+	mmc_test_print_avg_rate(test, MMC_TEST_SMALL_WR_SZ, cnt, &ts1, &ts2);
+
+	if (!mmc_host_cmd23(card->host) || !mmc_host_packed_wr(card->host))
+		return RESULT_UNSUP_HOST;
+	if (!card->ext_csd.packed_event_en)
+		return RESULT_UNSUP_CARD;
+
+	nr = min_t(unsigned int, MMC_TEST_PACKED_NR,
+		   card->ext_csd.max_packed_writes);
+	ret = mmc_test_area_map(test, nr * MMC_TEST_SMALL_WR_SZ, 0, 0);
+	if (ret)
+		return ret;
+	if (t->sg_len + 1 > t->max_segs)
+		return RESULT_UNSUP_HOST;
+
+	hdr = kmalloc(512, GFP_KERNEL);
+	sg = kmalloc((t->sg_len + 1) * sizeof(*sg), GFP_KERNEL);
+	if (!hdr || !sg) {
+		ret = -ENOMEM;
+		goto out_free;
+	}
+
+	getnstimeofday(&ts1);
+	for (cnt = 0; cnt < UINT_MAX / nr; cnt++) {
+		getnstimeofday(&ts2);
+		ts = timespec_sub(ts2, ts1);
+		if (ts.tv_sec >= 10)
+			break;
+		ret = mmc_test_packed_write(test, hdr, sg, nr);
+		if (ret)
+			goto out_free;
+	}
+	mmc_test_print_avg_rate(test, MMC_TEST_SMALL_WR_SZ, cnt * nr,
+				&ts1, &ts2);
+
+out_free:
+	kfree(sg);
+	kfree(hdr);
+	return ret;
+}
+
 static int mmc_test_seq_perf(struct mmc_test_card *test, int write,
 			     unsigned int tot_sz, int max_scatter)
 {
@@ -2682,6 +2831,13 @@ static const struct mmc_test_case mmc_test_cases[] = {
 		.name = "eMMC hardware reset",
 		.run = mmc_test_hw_reset,
 	},
+
+	{
+		.name = "Small random write performance, single and packed",
+		.prepare = mmc_test_area_prepare,
+		.run = mmc_test_small_rnd_write_perf,
+		.cleanup = mmc_test_area_cleanup,
+	},
 };
 
 static DEFINE_MUTEX(mmc_test_lock);
@@ -17,6 +17,7 @@
 #include <linux/scatterlist.h>
 
 #include <linux/mmc/card.h>
+#include <linux/mmc/core.h>
 #include <linux/mmc/host.h>
 #include "queue.h"
 
@@ -47,6 +48,40 @@ static int mmc_prep_request(struct request_queue *q, struct request *req)
 	return BLKPREP_OK;
 }
 
+/*
+ * Runs once the queue has been idle for bkops_idle_ms. BKOPS started
+ * here are interrupted by mmc_blk_issue_rq() when new I/O arrives.
+ */
+static void mmc_queue_bkops_work(struct work_struct *work)
+{
+	struct mmc_queue *mq = container_of(work, struct mmc_queue,
+					    bkops_work.work);
+
+	if (mq->card && !mmc_card_removed(mq->card))
+		mmc_start_bkops(mq->card, false);
+}
+
+static void mmc_queue_bkops_arm(struct mmc_queue *mq)
+{
+	unsigned int idle_ms = ACCESS_ONCE(mq->bkops_idle_ms);
+
+	if (idle_ms)
+		schedule_delayed_work(&mq->bkops_work,
+				      msecs_to_jiffies(idle_ms));
+}
+
+/**
+ * mmc_queue_bkops_cancel - cancel pending idle time BKOPS
+ * @mq: mmc queue
+ *
+ * Only the pending start is cancelled; BKOPS already running on the
+ * card are stopped by the next request.
+ */
+void mmc_queue_bkops_cancel(struct mmc_queue *mq)
+{
+	cancel_delayed_work_sync(&mq->bkops_work);
+}
+
 static int mmc_queue_thread(void *d)
 {
 	struct mmc_queue *mq = d;
@@ -67,12 +102,15 @@ static int mmc_queue_thread(void *d)
 
 		if (req || mq->mqrq_prev->req) {
 			set_current_state(TASK_RUNNING);
+			if (req && !mq->mqrq_prev->req)
+				mmc_queue_bkops_cancel(mq);
 			mq->issue_fn(mq, req);
 		} else {
 			if (kthread_should_stop()) {
 				set_current_state(TASK_RUNNING);
 				break;
 			}
+			mmc_queue_bkops_arm(mq);
 			up(&mq->thread_sem);
 			schedule();
 			down(&mq->thread_sem);
@@ -182,6 +220,7 @@ int mmc_init_queue(struct mmc_queue *mq, struct mmc_card *card,
 	mq->queue->queuedata = mq;
 
 	blk_queue_prep_rq(mq->queue, mmc_prep_request);
+	INIT_DELAYED_WORK(&mq->bkops_work, mmc_queue_bkops_work);
 	queue_flag_set_unlocked(QUEUE_FLAG_NONROT, mq->queue);
 	if (mmc_can_erase(card))
 		mmc_queue_setup_discard(mq->queue, card);
@@ -304,6 +343,7 @@ void mmc_cleanup_queue(struct mmc_queue *mq)
 
 	/* Then terminate our worker thread */
 	kthread_stop(mq->thread);
+	mmc_queue_bkops_cancel(mq);
 
 	/* Empty the queue */
 	spin_lock_irqsave(q->queue_lock, flags);
@@ -333,6 +373,56 @@ void mmc_cleanup_queue(struct mmc_queue *mq)
 }
 EXPORT_SYMBOL(mmc_cleanup_queue);
 
+/**
+ * mmc_packed_init - allocate packed command state for a queue
+ * @mq: mmc queue
+ * @card: mmc card the queue belongs to
+ *
+ * Both request slots get their own packed header so that one packed
+ * command can be prepared while the other is in flight.
+ */
+int mmc_packed_init(struct mmc_queue *mq, struct mmc_card *card)
+{
+	struct mmc_queue_req *mqrq_cur = &mq->mqrq[0];
+	struct mmc_queue_req *mqrq_prev = &mq->mqrq[1];
+	int ret = 0;
+
+	mqrq_cur->packed = kzalloc(sizeof(struct mmc_packed), GFP_KERNEL);
+	if (!mqrq_cur->packed) {
+		pr_warning("%s: unable to allocate packed cmd for mqrq_cur\n",
+			   mmc_card_name(card));
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	mqrq_prev->packed = kzalloc(sizeof(struct mmc_packed), GFP_KERNEL);
+	if (!mqrq_prev->packed) {
+		pr_warning("%s: unable to allocate packed cmd for mqrq_prev\n",
+			   mmc_card_name(card));
+		kfree(mqrq_cur->packed);
+		mqrq_cur->packed = NULL;
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	INIT_LIST_HEAD(&mqrq_cur->packed->list);
+	INIT_LIST_HEAD(&mqrq_prev->packed->list);
+
+out:
+	return ret;
+}
+
+void mmc_packed_clean(struct mmc_queue *mq)
+{
+	struct mmc_queue_req *mqrq_cur = &mq->mqrq[0];
+	struct mmc_queue_req *mqrq_prev = &mq->mqrq[1];
+
+	kfree(mqrq_cur->packed);
+	mqrq_cur->packed = NULL;
+	kfree(mqrq_prev->packed);
+	mqrq_prev->packed = NULL;
+}
+
 /**
  * mmc_queue_suspend - suspend a MMC request queue
  * @mq: MMC queue to suspend
@@ -354,6 +444,7 @@ void mmc_queue_suspend(struct mmc_queue *mq)
 		spin_unlock_irqrestore(q->queue_lock, flags);
 
 		down(&mq->thread_sem);
+		mmc_queue_bkops_cancel(mq);
 	}
 }
 
@@ -377,6 +468,45 @@ void mmc_queue_resume(struct mmc_queue *mq)
 	}
 }
 
+/*
+ * Map a packed group: the packed header block first, then the data of
+ * every request in the group back to back.
+ */
+static unsigned int mmc_queue_packed_map_sg(struct mmc_queue *mq,
+					    struct mmc_packed *packed,
+					    struct scatterlist *sg,
+					    enum mmc_packed_type cmd_type)
+{
+	struct scatterlist *__sg = sg;
+	unsigned int sg_len = 0;
+	struct request *req;
+
+	if (mmc_packed_wr(cmd_type)) {
+		unsigned int hdr_sz = sizeof(packed->cmd_hdr);
+		unsigned int max_seg_sz = queue_max_segment_size(mq->queue);
+		unsigned int len, remain, offset = 0;
+		u8 *buf = (u8 *)packed->cmd_hdr;
+
+		remain = hdr_sz;
+		do {
+			len = min(remain, max_seg_sz);
+			sg_set_buf(__sg, buf + offset, len);
+			offset += len;
+			remain -= len;
+			(__sg++)->page_link &= ~0x02;
+			sg_len++;
+		} while (remain);
+	}
+
+	list_for_each_entry(req, &packed->list, queuelist) {
+		sg_len += blk_rq_map_sg(mq->queue, req, __sg);
+		__sg = sg + (sg_len - 1);
+		(__sg++)->page_link &= ~0x02;
+	}
+	sg_mark_end(sg + (sg_len - 1));
+	return sg_len;
+}
+
 /*
  * Prepare the sg list(s) to be handed of to the host driver
  */
@@ -385,14 +515,23 @@ unsigned int mmc_queue_map_sg(struct mmc_queue *mq, struct mmc_queue_req *mqrq)
 	unsigned int sg_len;
 	size_t buflen;
 	struct scatterlist *sg;
+	enum mmc_packed_type cmd_type = mqrq->cmd_type;
 	int i;
 
-	if (!mqrq->bounce_buf)
+	if (!mqrq->bounce_buf) {
+		if (mmc_packed_cmd(cmd_type))
+			return mmc_queue_packed_map_sg(mq, mqrq->packed,
+						       mqrq->sg, cmd_type);
 		return blk_rq_map_sg(mq->queue, mqrq->req, mqrq->sg);
+	}
 
 	BUG_ON(!mqrq->bounce_sg);
 
-	sg_len = blk_rq_map_sg(mq->queue, mqrq->req, mqrq->bounce_sg);
+	if (mmc_packed_cmd(cmd_type))
+		sg_len = mmc_queue_packed_map_sg(mq, mqrq->packed,
+						 mqrq->bounce_sg, cmd_type);
+	else
+		sg_len = blk_rq_map_sg(mq->queue, mqrq->req, mqrq->bounce_sg);
 
 	mqrq->bounce_sg_len = sg_len;
 
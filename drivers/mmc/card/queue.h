@@ -1,9 +1,14 @@
 #ifndef MMC_QUEUE_H
 #define MMC_QUEUE_H
 
+#include <linux/workqueue.h>
+
 struct request;
 struct task_struct;
 
+/* Default time the queue must be idle before BKOPS are started */
+#define MMC_QUEUE_BKOPS_IDLE_MS	2000
+
 struct mmc_blk_request {
 	struct mmc_request	mrq;
 	struct mmc_command	sbc;
@@ -12,6 +17,35 @@ struct mmc_blk_request {
 	struct mmc_data		data;
 };
 
+enum mmc_packed_type {
+	MMC_PACKED_NONE = 0,
+	MMC_PACKED_WRITE,
+};
+
+#define mmc_packed_cmd(type)	((type) != MMC_PACKED_NONE)
+#define mmc_packed_wr(type)	((type) == MMC_PACKED_WRITE)
+
+#define MMC_PACKED_NR_IDX	-1
+#define MMC_PACKED_NR_ZERO	0
+#define MMC_PACKED_NR_SINGLE	1
+
+struct mmc_packed {
+	struct list_head	list;
+	u32			cmd_hdr[128];	/* one 512 byte header block */
+	unsigned int		blocks;
+	u8			nr_entries;
+	u8			retries;
+	s16			idx_failure;
+};
+
+struct mmc_packed_stats {
+	unsigned long		packed_cmds;	/* packed commands issued */
+	unsigned long		packed_reqs;	/* requests sent packed */
+	unsigned long		single_reqs;	/* writes sent on their own */
+	unsigned long		failures;	/* packed commands that failed */
+	unsigned long		fallbacks;	/* groups split after failure */
+};
+
 struct mmc_queue_req {
 	struct request		*req;
 	struct mmc_blk_request	brq;
@@ -20,6 +54,8 @@ struct mmc_queue_req {
 	struct scatterlist	*bounce_sg;
 	unsigned int		bounce_sg_len;
 	struct mmc_async_req	mmc_active;
+	enum mmc_packed_type	cmd_type;
+	struct mmc_packed	*packed;
 };
 
 struct mmc_queue {
@@ -33,6 +69,9 @@ struct mmc_queue {
 	struct mmc_queue_req	mqrq[2];
 	struct mmc_queue_req	*mqrq_cur;
 	struct mmc_queue_req	*mqrq_prev;
+	struct mmc_packed_stats	packed_stats;
+	struct delayed_work	bkops_work;	/* idle time BKOPS */
+	unsigned int		bkops_idle_ms;	/* 0 disables idle BKOPS */
 };
 
 extern int mmc_init_queue(struct mmc_queue *, struct mmc_card *, spinlock_t *,
@@ -40,6 +79,9 @@ extern int mmc_init_queue(struct mmc_queue *, struct mmc_card *, spinlock_t *,
 extern void mmc_cleanup_queue(struct mmc_queue *);
 extern void mmc_queue_suspend(struct mmc_queue *);
 extern void mmc_queue_resume(struct mmc_queue *);
+extern void mmc_queue_bkops_cancel(struct mmc_queue *);
+extern int mmc_packed_init(struct mmc_queue *, struct mmc_card *);
+extern void mmc_packed_clean(struct mmc_queue *);
 
 extern unsigned int mmc_queue_map_sg(struct mmc_queue *,
 				     struct mmc_queue_req *);
@@ -20,6 +20,7 @@
 #include <linux/err.h>
 #include <linux/leds.h>
 #include <linux/scatterlist.h>
+#include <linux/slab.h>
 #include <linux/log2.h>
 #include <linux/regulator/consumer.h>
 #include <linux/pm_runtime.h>
@@ -357,6 +358,15 @@ struct mmc_async_req *mmc_start_req(struct mmc_host *host,
 	if (host->areq) {
 		mmc_wait_for_req_done(host, host->areq->mrq);
 		err = host->areq->err_check(host->card, host->areq);
+		/*
+		 * The card flags urgent BKOPS in the R1 response; deal with
+		 * it now rather than stalling on the next write.
+		 */
+		if (host->card && mmc_card_mmc(host->card) &&
+		    (mmc_resp_type(host->areq->mrq->cmd) == MMC_RSP_R1 ||
+		     mmc_resp_type(host->areq->mrq->cmd) == MMC_RSP_R1B) &&
+		    (host->areq->mrq->cmd->resp[0] & R1_EXCEPTION_EVENT))
+			mmc_start_bkops(host->card, true);
 	}
 
 	if (!err && areq) {
@@ -457,6 +467,130 @@ out:
 }
 EXPORT_SYMBOL(mmc_interrupt_hpi);
 
+/* Longest we are prepared to wait for urgent BKOPS to complete */
+#define MMC_BKOPS_MAX_TIMEOUT	(4 * 60 * 1000)
+
+/**
+ *	mmc_read_bkops_status - refresh the card's BKOPS urgency level
+ *	@card: the MMC card to query
+ *
+ *	Reads EXT_CSD and updates card->ext_csd.raw_bkops_status.
+ *	Must be called with the host claimed.
+ */
+int mmc_read_bkops_status(struct mmc_card *card)
+{
+	int err;
+	u8 *ext_csd;
+
+	ext_csd = kmalloc(512, GFP_KERNEL);
+	if (!ext_csd)
+		return -ENOMEM;
+
+	err = mmc_send_ext_csd(card, ext_csd);
+	if (!err)
+		card->ext_csd.raw_bkops_status =
+			ext_csd[EXT_CSD_BKOPS_STATUS] &
+			EXT_CSD_BKOPS_LEVEL_MASK;
+
+	kfree(ext_csd);
+	return err;
+}
+EXPORT_SYMBOL(mmc_read_bkops_status);
+
+/**
+ *	mmc_start_bkops - start background operations on the card
+ *	@card: the MMC card to start BKOPS on
+ *	@from_exception: called because the card raised an urgent BKOPS
+ *			 exception in a command response
+ *
+ *	On an exception, BKOPS are started only for urgent levels (2 and
+ *	above) and waited for, since the card will stall foreground I/O
+ *	until it has caught up anyway. Otherwise, from the idle path, any
+ *	outstanding level is started without waiting for completion; the
+ *	card then stays busy until mmc_stop_bkops() interrupts it with HPI.
+ */
+void mmc_start_bkops(struct mmc_card *card, bool from_exception)
+{
+	int err;
+
+	BUG_ON(!card);
+
+	if (!card->ext_csd.bkops_en || mmc_card_doing_bkops(card))
+		return;
+
+	/* Without HPI there would be no way to interrupt it again */
+	if (!from_exception && !card->ext_csd.hpi_en)
+		return;
+
+	mmc_claim_host(card->host);
+
+	err = mmc_read_bkops_status(card);
+	if (err) {
+		pr_err("%s: Failed to read bkops status: %d\n",
+		       mmc_hostname(card->host), err);
+		goto out;
+	}
+
+	if (!card->ext_csd.raw_bkops_status)
+		goto out;
+
+	if (from_exception &&
+	    card->ext_csd.raw_bkops_status < EXT_CSD_BKOPS_LEVEL_2)
+		goto out;
+
+	err = __mmc_switch(card, EXT_CSD_CMD_SET_NORMAL, EXT_CSD_BKOPS_START,
+			   1, from_exception ? MMC_BKOPS_MAX_TIMEOUT : 0,
+			   from_exception);
+	if (err) {
+		pr_warning("%s: Error %d starting bkops\n",
+			   mmc_hostname(card->host), err);
+		goto out;
+	}
+
+	card->bkops_started++;
+	if (from_exception)
+		card->bkops_urgent++;
+	else
+		mmc_card_set_doing_bkops(card);
+out:
+	mmc_release_host(card->host);
+}
+EXPORT_SYMBOL(mmc_start_bkops);
+
+/**
+ *	mmc_stop_bkops - stop ongoing background operations
+ *	@card: the MMC card doing BKOPS
+ *
+ *	Interrupt BKOPS started by mmc_start_bkops() with HPI so that
+ *	foreground requests can be serviced, and wait until the card has
+ *	left the programming state. Must be called with the host claimed.
+ */
+int mmc_stop_bkops(struct mmc_card *card)
+{
+	int err;
+	u32 status;
+
+	BUG_ON(!card);
+
+	if (!mmc_card_doing_bkops(card))
+		return 0;
+
+	err = mmc_send_status(card, &status);
+	if (err)
+		return err;
+
+	if (R1_CURRENT_STATE(status) == R1_STATE_PRG) {
+		err = mmc_interrupt_hpi(card);
+		if (err)
+			return err;
+		card->bkops_interrupted++;
+	}
+
+	mmc_card_clr_doing_bkops(card);
+	return 0;
+}
+EXPORT_SYMBOL(mmc_stop_bkops);
+
 /**
  *	mmc_wait_for_cmd - start a command and wait for completion
  *	@host: MMC host to start command
@@ -2349,6 +2483,14 @@ int mmc_suspend_host(struct mmc_host *host)
 		wake_unlock(&host->detect_wake_lock);
 	mmc_flush_scheduled_work();
 
+	if (host->card && mmc_card_doing_bkops(host->card)) {
+		mmc_claim_host(host);
+		err = mmc_stop_bkops(host->card);
+		mmc_release_host(host);
+		if (err)
+			goto out;
+	}
+
 	err = mmc_cache_ctrl(host, 0);
 	if (err)
 		goto out;
@@ -478,6 +478,14 @@ static int mmc_read_ext_csd(struct mmc_card *card, u8 *ext_csd)
 				ext_csd[EXT_CSD_OUT_OF_INTERRUPT_TIME] * 10;
 		}
 
+		/* check whether the eMMC card supports BKOPS */
+		if (ext_csd[EXT_CSD_BKOPS_SUPPORT] & 0x1) {
+			card->ext_csd.bkops = 1;
+			card->ext_csd.bkops_en = ext_csd[EXT_CSD_BKOPS_EN];
+			card->ext_csd.raw_bkops_status =
+				ext_csd[EXT_CSD_BKOPS_STATUS];
+		}
+
 		card->ext_csd.rel_param = ext_csd[EXT_CSD_WR_REL_PARAM];
 		card->ext_csd.rst_n_function = ext_csd[EXT_CSD_RST_N_FUNCTION];
 	}
@@ -516,12 +524,49 @@ static int mmc_read_ext_csd(struct mmc_card *card, u8 *ext_csd)
 		} else {
 			card->ext_csd.data_tag_unit_size = 0;
 		}
+
+		card->ext_csd.max_packed_writes =
+			ext_csd[EXT_CSD_MAX_PACKED_WRITES];
+		card->ext_csd.max_packed_reads =
+			ext_csd[EXT_CSD_MAX_PACKED_READS];
+		card->ext_csd.max_context_id = ext_csd[EXT_CSD_CONTEXT_CAPS] &
+			EXT_CSD_MAX_CONTEXT_ID_MASK;
 	}
 
 out:
 	return err;
 }
 
+/*
+ * A context has to be closed before it is configured again, which is
+ * the case after a resume that kept the card powered.
+ */
+static int mmc_open_contexts(struct mmc_card *card)
+{
+	unsigned int nr, id;
+	int err;
+
+	card->ext_csd.nr_contexts = 0;
+	nr = min_t(unsigned int, card->ext_csd.max_context_id,
+		   MMC_NR_WRITE_CONTEXTS);
+
+	for (id = 1; id <= nr; id++) {
+		err = mmc_switch(card, EXT_CSD_CMD_SET_NORMAL,
+				 EXT_CSD_CONTEXT_CONF + id - 1,
+				 EXT_CSD_CONTEXT_CLOSED,
+				 card->ext_csd.generic_cmd6_time);
+		if (!err)
+			err = mmc_switch(card, EXT_CSD_CMD_SET_NORMAL,
+					 EXT_CSD_CONTEXT_CONF + id - 1,
+					 EXT_CSD_CONTEXT_WRITE,
+					 card->ext_csd.generic_cmd6_time);
+		if (err)
+			return err;
+		card->ext_csd.nr_contexts = id;
+	}
+	return 0;
+}
+
 static inline void mmc_free_ext_csd(u8 *ext_csd)
 {
 	kfree(ext_csd);
@@ -606,6 +651,9 @@ MMC_DEV_ATTR(serial, "0x%08x\n", card->cid.serial);
 MMC_DEV_ATTR(enhanced_area_offset, "%llu\n",
 		card->ext_csd.enhanced_area_offset);
 MMC_DEV_ATTR(enhanced_area_size, "%u\n", card->ext_csd.enhanced_area_size);
+MMC_DEV_ATTR(bkops_stats, "%lu %lu %lu\n", card->bkops_started,
+	card->bkops_urgent, card->bkops_interrupted);
+MMC_DEV_ATTR(contexts, "%u\n", card->ext_csd.nr_contexts);
 
 static struct attribute *mmc_std_attrs[] = {
 	&dev_attr_cid.attr,
@@ -621,6 +669,8 @@ static struct attribute *mmc_std_attrs[] = {
 	&dev_attr_serial.attr,
 	&dev_attr_enhanced_area_offset.attr,
 	&dev_attr_enhanced_area_size.attr,
+	&dev_attr_bkops_stats.attr,
+	&dev_attr_contexts.attr,
 	NULL,
 };
 
@@ -1226,6 +1276,26 @@ static int mmc_init_card(struct mmc_host *host, u32 ocr,
 			card->ext_csd.hpi_en = 1;
 	}
 
+	/*
+	 * Enable manual BKOPS if the card supports it and the host takes
+	 * care of scheduling it. BKOPS_EN can only be set once, so this
+	 * is left to hosts that opt in with MMC_CAP2_INIT_BKOPS.
+	 */
+	if (card->ext_csd.bkops && !card->ext_csd.bkops_en &&
+	    (host->caps2 & MMC_CAP2_INIT_BKOPS)) {
+		err = mmc_switch(card, EXT_CSD_CMD_SET_NORMAL,
+				EXT_CSD_BKOPS_EN, 1,
+				card->ext_csd.generic_cmd6_time);
+		if (err && err != -EBADMSG)
+			goto free_card;
+		if (err) {
+			pr_warning("%s: Enabling BKOPS failed\n",
+				   mmc_hostname(card->host));
+			err = 0;
+		} else
+			card->ext_csd.bkops_en = 1;
+	}
+
 	/*
 	 * If cache size is higher than 0, this indicates
 	 * the existence of cache and it can be turned on.
@@ -1252,6 +1322,45 @@ static int mmc_init_card(struct mmc_host *host, u32 ocr,
 		}
 	}
 
+	/*
+	 * The mandatory minimum values are defined for packed command.
+	 * read: 5, write: 3
+	 */
+	if (card->ext_csd.max_packed_writes >= 3 &&
+	    card->ext_csd.max_packed_reads >= 5 &&
+	    mmc_host_packed_wr(host)) {
+		err = mmc_switch(card, EXT_CSD_CMD_SET_NORMAL,
+				EXT_CSD_EXP_EVENTS_CTRL,
+				EXT_CSD_PACKED_EVENT_EN,
+				card->ext_csd.generic_cmd6_time);
+		if (err && err != -EBADMSG)
+			goto free_card;
+		if (err) {
+			pr_warning("%s: Enabling packed event failed\n",
+				   mmc_hostname(card->host));
+			card->ext_csd.packed_event_en = 0;
+			err = 0;
+		} else {
+			card->ext_csd.packed_event_en = 1;
+		}
+	}
+
+	/*
+	 * Open a write-only context per write lifetime hint, see
+	 * mmc_blk_context_id().  Contexts are tagged through CMD23.
+	 */
+	if (card->ext_csd.max_context_id && mmc_host_context(host) &&
+	    mmc_host_cmd23(host)) {
+		err = mmc_open_contexts(card);
+		if (err && err != -EBADMSG)
+			goto free_card;
+		if (err) {
+			pr_warning("%s: Opening contexts failed\n",
+				   mmc_hostname(card->host));
+			err = 0;
+		}
+	}
+
 	if (!oldcard)
 		host->card = card;
 
@@ -497,6 +497,9 @@ static bool dw_mci_wait_fifo_reset(struct device *dev, struct dw_mci *host)
 
 
 #ifdef CONFIG_MMC_DW_IDMAC
+/* One descriptor ring for the running request, one to stage the next */
+#define DW_MCI_IDMAC_RINGS	2
+
 static int dw_mci_get_dma_dir(struct mmc_data *data)
 {
 	if (data->flags & MMC_DATA_WRITE)
@@ -563,11 +566,23 @@ static void dw_mci_idmac_complete_dma(struct dw_mci *host)
 	}
 }
 
+static struct idmac_desc *dw_mci_ring_desc(struct dw_mci *host,
+					   unsigned int ring)
+{
+	return (struct idmac_desc *)host->sg_cpu + ring * host->ring_size;
+}
+
+static dma_addr_t dw_mci_ring_dma(struct dw_mci *host, unsigned int ring)
+{
+	return host->sg_dma + ring * host->ring_size * sizeof(struct idmac_desc);
+}
+
 static void dw_mci_translate_sglist(struct dw_mci *host, struct mmc_data *data,
-				    unsigned int sg_len)
+				    unsigned int sg_len, unsigned int ring)
 {
 	int i;
-	struct idmac_desc *desc = host->sg_cpu;
+	struct idmac_desc *first = dw_mci_ring_desc(host, ring);
+	struct idmac_desc *desc = first;
 
 	for (i = 0; i < sg_len; i++, desc++) {
 		unsigned int length = sg_dma_len(&data->sg[i]);
@@ -584,22 +599,59 @@ static void dw_mci_translate_sglist(struct dw_mci *host, struct mmc_data *data,
 	}
 
 	/* Set first descriptor */
-	desc = host->sg_cpu;
+	desc = first;
 	desc->des0 |= IDMAC_DES0_FD;
 
 	/* Set last descriptor */
-	desc = host->sg_cpu + (i - 1) * sizeof(struct idmac_desc);
+	desc = first + i - 1;
 	desc->des0 &= ~(IDMAC_DES0_CH | IDMAC_DES0_DIC);
 	desc->des0 |= IDMAC_DES0_LD;
 
 	wmb();
 }
 
+/*
+ * Find the ring to run @data from. Requests staged by pre_req already
+ * have their descriptors in place; anything else is translated now into
+ * a ring no staged request is waiting in, or ring 0 if there is none.
+ */
+static unsigned int dw_mci_idmac_get_ring(struct dw_mci *host,
+					  struct mmc_data *data, bool *staged)
+{
+	unsigned int ring;
+
+	for (ring = 0; ring < ARRAY_SIZE(host->ring_data); ring++) {
+		if (host->ring_data[ring] == data) {
+			*staged = true;
+			return ring;
+		}
+	}
+
+	*staged = false;
+	for (ring = 0; ring < ARRAY_SIZE(host->ring_data); ring++)
+		if (!host->ring_data[ring])
+			return ring;
+
+	return 0;
+}
+
 static void dw_mci_idmac_start_dma(struct dw_mci *host, unsigned int sg_len)
 {
+	unsigned int ring;
+	bool staged;
 	u32 temp;
 
-	dw_mci_translate_sglist(host, host->data, sg_len);
+	ring = dw_mci_idmac_get_ring(host, host->data, &staged);
+	host->ring_data[ring] = NULL;
+	if (!staged)
+		dw_mci_translate_sglist(host, host->data, sg_len, ring);
+
+	/* The IDMAC restarts from DBADDR after a reset */
+	if (ring != host->cur_ring) {
+		dw_mci_idma_reset_dma(host);
+		mci_writel(host, DBADDR, dw_mci_ring_dma(host, ring));
+		host->cur_ring = ring;
+	}
 
 	/* Select IDMAC interface */
 	temp = mci_readl(host, CTRL);
@@ -620,18 +672,27 @@ static void dw_mci_idmac_start_dma(struct dw_mci *host, unsigned int sg_len)
 static int dw_mci_idmac_init(struct dw_mci *host)
 {
 	struct idmac_desc *p;
+	unsigned int ring;
 	int i;
 
-	/* Number of descriptors in the ring buffer */
+	/* Number of descriptors in each ring buffer */
 	host->ring_size = host->desc_sz * PAGE_SIZE / sizeof(struct idmac_desc);
 
-	/* Forward link the descriptor list */
-	for (i = 0, p = host->sg_cpu; i < host->ring_size - 1; i++, p++)
-		p->des3 = host->sg_dma + (sizeof(struct idmac_desc) * (i + 1));
+	for (ring = 0; ring < DW_MCI_IDMAC_RINGS; ring++) {
+		dma_addr_t base = dw_mci_ring_dma(host, ring);
 
-	/* Set the last descriptor as the end-of-ring descriptor */
-	p->des3 = host->sg_dma;
-	p->des0 = IDMAC_DES0_ER;
+		/* Forward link the descriptor list */
+		for (i = 0, p = dw_mci_ring_desc(host, ring);
+		     i < host->ring_size - 1; i++, p++)
+			p->des3 = base + (sizeof(struct idmac_desc) * (i + 1));
+
+		/* Set the last descriptor as the end-of-ring descriptor */
+		p->des3 = base;
+		p->des0 = IDMAC_DES0_ER;
+
+		host->ring_data[ring] = NULL;
+	}
+	host->cur_ring = 0;
 
 	mci_writel(host, BMOD, SDMMC_IDMAC_SWRESET);
 
@@ -683,6 +744,35 @@ static int dw_mci_pre_dma_transfer(struct dw_mci *host,
 	return sg_len;
 }
 
+/*
+ * Build the descriptors of a request prepared by pre_req in the ring the
+ * current transfer is not using, so it can be started as soon as the
+ * controller is free.
+ */
+static void dw_mci_idmac_stage(struct dw_mci *host, struct mmc_data *data)
+{
+	unsigned int ring;
+
+	spin_lock_bh(&host->lock);
+	ring = !host->cur_ring;
+	if (!host->ring_data[ring]) {
+		dw_mci_translate_sglist(host, data, data->host_cookie, ring);
+		host->ring_data[ring] = data;
+	}
+	spin_unlock_bh(&host->lock);
+}
+
+static void dw_mci_idmac_unstage(struct dw_mci *host, struct mmc_data *data)
+{
+	unsigned int ring;
+
+	spin_lock_bh(&host->lock);
+	for (ring = 0; ring < ARRAY_SIZE(host->ring_data); ring++)
+		if (host->ring_data[ring] == data)
+			host->ring_data[ring] = NULL;
+	spin_unlock_bh(&host->lock);
+}
+
 static void dw_mci_pre_req(struct mmc_host *mmc,
 			   struct mmc_request *mrq,
 			   bool is_first_req)
@@ -694,12 +784,15 @@ static void dw_mci_pre_req(struct mmc_host *mmc,
 		return;
 
 	if (data->host_cookie) {
+		dw_mci_idmac_unstage(slot->host, data);
 		data->host_cookie = 0;
 		return;
 	}
 
 	if (dw_mci_pre_dma_transfer(slot->host, mrq->data, 1) < 0)
 		data->host_cookie = 0;
+	else
+		dw_mci_idmac_stage(slot->host, data);
 }
 
 static void dw_mci_post_req(struct mmc_host *mmc,
@@ -712,6 +805,7 @@ static void dw_mci_post_req(struct mmc_host *mmc,
 	if (!slot->host->use_dma || !data)
 		return;
 
+	dw_mci_idmac_unstage(slot->host, data);
 	if (data->host_cookie)
 		dma_unmap_sg(&slot->host->dev,
 			     data->sg,
@@ -737,6 +831,7 @@ static int dw_mci_pre_dma_transfer(struct dw_mci *host,
 }
 #define dw_mci_pre_req		NULL
 #define dw_mci_post_req		NULL
+#define DW_MCI_IDMAC_RINGS	1
 #endif /* CONFIG_MMC_DW_IDMAC */
 
 static int dw_mci_submit_data_dma(struct dw_mci *host, struct mmc_data *data)
@@ -2477,7 +2572,9 @@ static void dw_mci_init_dma(struct dw_mci *host)
 		host->desc_sz = 1;
 
 	/* Alloc memory for sg translation */
-	host->sg_cpu = dma_alloc_coherent(&host->dev, host->desc_sz * PAGE_SIZE,
+	host->sg_cpu = dma_alloc_coherent(&host->dev,
+					  host->desc_sz * PAGE_SIZE *
+					  DW_MCI_IDMAC_RINGS,
 					  &host->sg_dma, GFP_KERNEL);
 	if (!host->sg_cpu) {
 		dev_err(&host->dev, "%s: could not alloc DMA memory\n",
@@ -2783,7 +2880,8 @@ err_workqueue:
 err_dmaunmap:
 	if (host->use_dma && host->dma_ops->exit)
 		host->dma_ops->exit(host);
-	dma_free_coherent(&host->dev, host->desc_sz * PAGE_SIZE,
+	dma_free_coherent(&host->dev,
+			  host->desc_sz * PAGE_SIZE * DW_MCI_IDMAC_RINGS,
 			  host->sg_cpu, host->sg_dma);
 
 	if (host->vmmc) {
@@ -2829,7 +2927,8 @@ void dw_mci_remove(struct dw_mci *host)
 	del_timer_sync(&host->timer);
 
 	destroy_workqueue(dw_mci_card_workqueue);
-	dma_free_coherent(&host->dev, host->desc_sz * PAGE_SIZE,
+	dma_free_coherent(&host->dev,
+			host->desc_sz * PAGE_SIZE * DW_MCI_IDMAC_RINGS,
 			host->sg_cpu, host->sg_dma);
 
 	if (host->use_dma && host->dma_ops->exit)
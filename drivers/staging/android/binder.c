@@ -168,6 +168,36 @@ static inline void binder_stats_created(enum binder_stat_types type)
 	binder_stats.obj_created[type]++;
 }
 
+/*
+ * Transaction latency histograms, kept per process:
+ *
+ * queue     transaction sent -> picked up by a thread of the target
+ * handling  picked up by the target -> BC_REPLY from the target
+ * reply     reply sent -> picked up by the caller
+ *
+ * Queue and handling time are charged to the process serving the call,
+ * reply time to the process that made it. Handling time is also broken
+ * down by transaction code for the first BINDER_LAT_CODES codes a process
+ * serves; later codes share the last slot. Bucket i counts samples below
+ * BINDER_LAT_MIN_US << i microseconds, the last bucket everything above.
+ */
+enum binder_lat_phase {
+	BINDER_LAT_QUEUE,
+	BINDER_LAT_HANDLING,
+	BINDER_LAT_REPLY,
+	BINDER_LAT_PHASE_COUNT
+};
+
+#define BINDER_LAT_BUCKETS	14
+#define BINDER_LAT_MIN_SHIFT	5
+#define BINDER_LAT_MIN_US	(1 << BINDER_LAT_MIN_SHIFT)
+#define BINDER_LAT_CODES	16
+
+struct binder_lat_stats {
+	u32 phase[BINDER_LAT_PHASE_COUNT][BINDER_LAT_BUCKETS];
+	u32 code[BINDER_LAT_CODES + 1][BINDER_LAT_BUCKETS];
+};
+
 struct binder_transaction_log_entry {
 	int debug_id;
 	int call_type;
@@ -316,6 +346,11 @@ struct binder_proc {
 	int requested_threads_started;
 	int ready_threads;
 	long default_priority;
+	unsigned int default_sched_policy;
+	int default_rt_priority;
+	struct binder_lat_stats __percpu *lat;
+	u32 lat_codes[BINDER_LAT_CODES];
+	int lat_nr_codes;
 	struct dentry *debugfs_entry;
 };
 
@@ -359,9 +394,52 @@ struct binder_transaction {
 	unsigned int	flags;
 	long	priority;
 	long	saved_priority;
+	unsigned int	sched_policy;
+	int	rt_priority;
+	unsigned int	saved_sched_policy;
+	int	saved_rt_priority;
 	uid_t	sender_euid;
+	ktime_t	queued_time;
+	ktime_t	start_time;
 };
 
+static inline int binder_lat_bucket(ktime_t start, ktime_t now)
+{
+	s64 us = ktime_us_delta(now, start);
+
+	if (us < BINDER_LAT_MIN_US)
+		return 0;
+	return min_t(int, fls64((u64)us >> BINDER_LAT_MIN_SHIFT),
+		     BINDER_LAT_BUCKETS - 1);
+}
+
+static void binder_lat_add(struct binder_proc *proc,
+			   enum binder_lat_phase phase, ktime_t start,
+			   ktime_t now)
+{
+	this_cpu_inc(proc->lat->phase[phase][binder_lat_bucket(start, now)]);
+}
+
+static void binder_lat_add_handling(struct binder_proc *proc, u32 code,
+				    ktime_t start, ktime_t now)
+{
+	int bucket = binder_lat_bucket(start, now);
+	int slot;
+
+	for (slot = 0; slot < proc->lat_nr_codes; slot++)
+		if (proc->lat_codes[slot] == code)
+			break;
+	if (slot == proc->lat_nr_codes) {
+		if (slot < BINDER_LAT_CODES)
+			proc->lat_codes[proc->lat_nr_codes++] = code;
+		else
+			slot = BINDER_LAT_CODES;
+	}
+
+	this_cpu_inc(proc->lat->phase[BINDER_LAT_HANDLING][bucket]);
+	this_cpu_inc(proc->lat->code[slot][bucket]);
+}
+
 static void
 binder_defer_work(struct binder_proc *proc, enum binder_deferred_state defer);
 
@@ -532,6 +610,41 @@ static void binder_set_nice(long nice)
 	binder_user_error("binder: %d RLIMIT_NICE not set\n", current->pid);
 }
 
+static inline bool binder_rt_policy(unsigned int policy)
+{
+	policy &= ~SCHED_RESET_ON_FORK;
+	return policy == SCHED_FIFO || policy == SCHED_RR;
+}
+
+static unsigned int binder_get_sched_policy(struct task_struct *task)
+{
+	return task->policy |
+		(task->sched_reset_on_fork ? SCHED_RESET_ON_FORK : 0);
+}
+
+/*
+ * Switch the current thread to the given scheduling class. Used to let
+ * the thread handling a synchronous transaction inherit the real-time
+ * priority of its caller, and to drop it again once the reply is sent.
+ * Inherited real-time classes are set with SCHED_RESET_ON_FORK so that
+ * threads forked while handling the call do not keep them.
+ */
+static void binder_set_sched(unsigned int policy, int rt_priority)
+{
+	struct sched_param param = { .sched_priority = rt_priority };
+	int ret;
+
+	if (binder_get_sched_policy(current) == policy &&
+	    current->rt_priority == rt_priority)
+		return;
+
+	ret = sched_setscheduler_nocheck(current, policy, &param);
+	if (ret)
+		binder_debug(BINDER_DEBUG_PRIORITY_CAP,
+			     "binder: %d: failed to set policy %u prio %d, "
+			     "%d\n", current->pid, policy, rt_priority, ret);
+}
+
 static size_t binder_buffer_size(struct binder_proc *proc,
 				 struct binder_buffer *buffer)
 {
@@ -1432,6 +1545,8 @@ static void binder_transaction(struct binder_proc *proc,
 			return_error = BR_FAILED_REPLY;
 			goto err_empty_call_stack;
 		}
+		binder_set_sched(in_reply_to->saved_sched_policy,
+				 in_reply_to->saved_rt_priority);
 		binder_set_nice(in_reply_to->saved_priority);
 		if (in_reply_to->to_thread != thread) {
 			binder_user_error("binder: %d:%d got reply transaction "
@@ -1447,6 +1562,8 @@ static void binder_transaction(struct binder_proc *proc,
 			goto err_bad_call_stack;
 		}
 		thread->transaction_stack = in_reply_to->to_parent;
+		binder_lat_add_handling(proc, in_reply_to->code,
+					in_reply_to->start_time, ktime_get());
 		target_thread = in_reply_to->from;
 		if (target_thread == NULL) {
 			return_error = BR_DEAD_REPLY;
@@ -1571,6 +1688,8 @@ static void binder_transaction(struct binder_proc *proc,
 	t->code = tr->code;
 	t->flags = tr->flags;
 	t->priority = task_nice(current);
+	t->sched_policy = current->policy;
+	t->rt_priority = current->rt_priority;
 
 	trace_binder_transaction(reply, t, target_node);
 
@@ -1783,6 +1902,7 @@ static void binder_transaction(struct binder_proc *proc,
 			target_node->has_async_transaction = 1;
 	}
 	t->work.type = BINDER_WORK_TRANSACTION;
+	t->queued_time = ktime_get();
 	list_add_tail(&t->work.entry, target_list);
 	tcomplete->type = BINDER_WORK_TRANSACTION_COMPLETE;
 	list_add_tail(&tcomplete->entry, &thread->todo);
@@ -2304,6 +2424,8 @@ retry:
 			wait_event_interruptible(binder_user_error_wait,
 						 binder_stop_on_user_error < 2);
 		}
+		binder_set_sched(proc->default_sched_policy,
+				 proc->default_rt_priority);
 		binder_set_nice(proc->default_priority);
 		if (non_block) {
 			if (!binder_has_proc_work(proc, thread))
@@ -2466,11 +2588,23 @@ retry:
 			continue;
 
 		BUG_ON(t->buffer == NULL);
+		t->start_time = ktime_get();
 		if (t->buffer->target_node) {
 			struct binder_node *target_node = t->buffer->target_node;
+			binder_lat_add(proc, BINDER_LAT_QUEUE, t->queued_time,
+				       t->start_time);
 			tr.target.ptr = target_node->ptr;
 			tr.cookie =  target_node->cookie;
 			t->saved_priority = task_nice(current);
+			t->saved_sched_policy = binder_get_sched_policy(current);
+			t->saved_rt_priority = current->rt_priority;
+			if (binder_rt_policy(t->sched_policy) &&
+			    !(t->flags & TF_ONE_WAY) &&
+			    (!rt_task(current) ||
+			     t->rt_priority > current->rt_priority))
+				binder_set_sched(t->sched_policy |
+						 SCHED_RESET_ON_FORK,
+						 t->rt_priority);
 			if (t->priority < target_node->min_priority &&
 			    !(t->flags & TF_ONE_WAY))
 				binder_set_nice(t->priority);
@@ -2481,6 +2615,8 @@ retry:
 		} else {
 			tr.target.ptr = NULL;
 			tr.cookie = NULL;
+			binder_lat_add(proc, BINDER_LAT_REPLY, t->queued_time,
+				       t->start_time);
 			cmd = BR_REPLY;
 		}
 		tr.code = t->code;
@@ -2986,11 +3122,18 @@ static int binder_open(struct inode *nodp, struct file *filp)
 	proc = kzalloc(sizeof(*proc), GFP_KERNEL);
 	if (proc == NULL)
 		return -ENOMEM;
+	proc->lat = alloc_percpu(struct binder_lat_stats);
+	if (proc->lat == NULL) {
+		kfree(proc);
+		return -ENOMEM;
+	}
 	get_task_struct(current);
 	proc->tsk = current;
 	INIT_LIST_HEAD(&proc->todo);
 	init_waitqueue_head(&proc->wait);
 	proc->default_priority = task_nice(current);
+	proc->default_sched_policy = binder_get_sched_policy(current);
+	proc->default_rt_priority = current->rt_priority;
 
 	binder_lock(__func__);
 
@@ -3172,6 +3315,7 @@ static void binder_deferred_release(struct binder_proc *proc)
 		     proc->pid, threads, nodes, incoming_refs, outgoing_refs,
 		     active_transactions, buffers, page_count);
 
+	free_percpu(proc->lat);
 	kfree(proc);
 }
 
@@ -3586,6 +3730,91 @@ static int binder_stats_show(struct seq_file *m, void *unused)
 	return 0;
 }
 
+static const char * const binder_lat_phase_strings[] = {
+	"queue",
+	"handling",
+	"reply"
+};
+
+static void print_binder_lat_hist(struct seq_file *m, const char *name,
+				  u32 code, bool has_code,
+				  const u32 *hist)
+{
+	int i;
+
+	if (has_code)
+		seq_printf(m, "  code %x %s:", code, name);
+	else
+		seq_printf(m, "  %s:", name);
+	for (i = 0; i < BINDER_LAT_BUCKETS; i++)
+		seq_printf(m, " %u", hist[i]);
+	seq_putc(m, '\n');
+}
+
+static void print_binder_proc_latency(struct seq_file *m,
+				      struct binder_proc *proc)
+{
+	struct binder_lat_stats *sum;
+	u32 total = 0;
+	int cpu, i, j;
+
+	sum = kzalloc(sizeof(*sum), GFP_KERNEL);
+	if (sum == NULL)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		struct binder_lat_stats *lat = per_cpu_ptr(proc->lat, cpu);
+
+		for (i = 0; i < BINDER_LAT_PHASE_COUNT; i++)
+			for (j = 0; j < BINDER_LAT_BUCKETS; j++)
+				sum->phase[i][j] += lat->phase[i][j];
+		for (i = 0; i <= BINDER_LAT_CODES; i++)
+			for (j = 0; j < BINDER_LAT_BUCKETS; j++)
+				sum->code[i][j] += lat->code[i][j];
+	}
+	for (i = 0; i < BINDER_LAT_PHASE_COUNT; i++)
+		for (j = 0; j < BINDER_LAT_BUCKETS; j++)
+			total += sum->phase[i][j];
+	if (total == 0)
+		goto out;
+
+	seq_printf(m, "proc %d\n", proc->pid);
+	for (i = 0; i < BINDER_LAT_PHASE_COUNT; i++)
+		print_binder_lat_hist(m, binder_lat_phase_strings[i], 0, false,
+				      sum->phase[i]);
+	for (i = 0; i < proc->lat_nr_codes; i++)
+		print_binder_lat_hist(m, "handling", proc->lat_codes[i], true,
+				      sum->code[i]);
+	if (proc->lat_nr_codes == BINDER_LAT_CODES)
+		print_binder_lat_hist(m, "other codes handling", 0, false,
+				      sum->code[BINDER_LAT_CODES]);
+out:
+	kfree(sum);
+}
+
+static int binder_latency_show(struct seq_file *m, void *unused)
+{
+	struct binder_proc *proc;
+	struct hlist_node *pos;
+	int do_lock = !binder_debug_no_lock;
+	int i;
+
+	if (do_lock)
+		binder_lock(__func__);
+
+	seq_puts(m, "binder latency:\n");
+	seq_puts(m, "buckets (usecs):");
+	for (i = 0; i < BINDER_LAT_BUCKETS - 1; i++)
+		seq_printf(m, " <%d", BINDER_LAT_MIN_US << i);
+	seq_puts(m, " more\n");
+
+	hlist_for_each_entry(proc, pos, &binder_procs, proc_node)
+		print_binder_proc_latency(m, proc);
+	if (do_lock)
+		binder_unlock(__func__);
+	return 0;
+}
+
 static int binder_transactions_show(struct seq_file *m, void *unused)
 {
 	struct binder_proc *proc;
@@ -3672,6 +3901,7 @@ static struct miscdevice binder_miscdev = {
 
 BINDER_DEBUG_ENTRY(state);
 BINDER_DEBUG_ENTRY(stats);
+BINDER_DEBUG_ENTRY(latency);
 BINDER_DEBUG_ENTRY(transactions);
 BINDER_DEBUG_ENTRY(transaction_log);
 
@@ -3699,6 +3929,11 @@ static int __init binder_init(void)
 				    binder_debugfs_dir_entry_root,
 				    NULL,
 				    &binder_stats_fops);
+		debugfs_create_file("latency",
+				    S_IRUGO,
+				    binder_debugfs_dir_entry_root,
+				    NULL,
+				    &binder_latency_fops);
 		debugfs_create_file("transactions",
 				    S_IRUGO,
 				    binder_debugfs_dir_entry_root,
@@ -858,10 +858,33 @@ retry:
 	goto retry;
 }
 
+/*
+ * Write back dirty dentry and node pages while FS-operations still run,
+ * so that block_operations() only has to catch up on the pages dirtied
+ * in the meantime.  Errors are left for block_operations() to report.
+ */
+static void prepare_checkpoint(struct f2fs_sb_info *sbi)
+{
+	struct writeback_control wbc = {
+		.sync_mode = WB_SYNC_NONE,
+		.nr_to_write = LONG_MAX,
+		.for_reclaim = 0,
+	};
+	struct blk_plug plug;
+
+	blk_start_plug(&plug);
+	if (get_pages(sbi, F2FS_DIRTY_DENTS))
+		sync_dirty_inodes(sbi, DIR_INODE);
+	if (get_pages(sbi, F2FS_DIRTY_NODES))
+		sync_node_pages(sbi, 0, &wbc);
+	blk_finish_plug(&plug);
+}
+
 /*
  * Freeze all the FS-operations for checkpoint.
+ * @blocked is set to the time the operations were last frozen.
  */
-static int block_operations(struct f2fs_sb_info *sbi)
+static int block_operations(struct f2fs_sb_info *sbi, ktime_t *blocked)
 {
 	struct writeback_control wbc = {
 		.sync_mode = WB_SYNC_ALL,
@@ -875,6 +898,7 @@ static int block_operations(struct f2fs_sb_info *sbi)
 
 retry_flush_dents:
 	f2fs_lock_all(sbi);
+	*blocked = ktime_get();
 	/* write all the dirty dentry pages */
 	if (get_pages(sbi, F2FS_DIRTY_DENTS)) {
 		f2fs_unlock_all(sbi);
@@ -1117,6 +1141,8 @@ int write_checkpoint(struct f2fs_sb_info *sbi, struct cp_control *cpc)
 {
 	struct f2fs_checkpoint *ckpt = F2FS_CKPT(sbi);
 	unsigned long long ckpt_ver;
+	ktime_t blocked;
+	u64 blocked_ns;
 	int err = 0;
 
 	mutex_lock(&sbi->cp_mutex);
@@ -1134,9 +1160,13 @@ int write_checkpoint(struct f2fs_sb_info *sbi, struct cp_control *cpc)
 		goto out;
 	}
 
+	trace_f2fs_write_checkpoint(sbi->sb, cpc->reason, "start prepare");
+
+	prepare_checkpoint(sbi);
+
 	trace_f2fs_write_checkpoint(sbi->sb, cpc->reason, "start block_ops");
 
-	err = block_operations(sbi);
+	err = block_operations(sbi, &blocked);
 	if (err)
 		goto out;
 
@@ -1160,6 +1190,8 @@ int write_checkpoint(struct f2fs_sb_info *sbi, struct cp_control *cpc)
 	err = do_checkpoint(sbi, cpc);
 
 	unblock_operations(sbi);
+	blocked_ns = ktime_to_ns(ktime_sub(ktime_get(), blocked));
+	stat_inc_cp_blocked_time(sbi, blocked_ns);
 	stat_inc_cp_count(sbi->stat_info);
 
 	if (cpc->reason == CP_RECOVERY)
@@ -0,0 +1,614 @@
+/*
+ * fs/f2fs/compress.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <linux/fs.h>
+#include <linux/f2fs_fs.h>
+#include <linux/pagemap.h>
+#include <linux/highmem.h>
+#include <linux/writeback.h>
+#include <linux/lz4.h>
+
+#include "f2fs.h"
+#include "node.h"
+#include "segment.h"
+
+#define CLUSTER_BYTES		(F2FS_CLUSTER_SIZE << PAGE_CACHE_SHIFT)
+#define CLUSTER_HDR_SIZE	sizeof(struct f2fs_cluster_header)
+#define CLUSTER_CBUF_SIZE	(lz4_compressbound(CLUSTER_BYTES) + \
+							CLUSTER_HDR_SIZE)
+
+/* tags the bounce pages of a cluster write, never a valid kernel pointer */
+#define CLUSTER_IO_MAGIC	0xf2c1
+
+/*
+ * A cluster is written from private bounce pages.  The page cache pages it
+ * was built from stay under writeback until the last bounce page completes.
+ */
+struct cluster_io {
+	unsigned int magic;
+	atomic_t pending;			/* bounce pages under I/O */
+	struct page *owner;			/* page that started the write */
+	struct page *rpages[F2FS_CLUSTER_SIZE];	/* pages under writeback */
+};
+
+static inline bool cluster_blkaddr_used(block_t blkaddr)
+{
+	return blkaddr != NULL_ADDR && blkaddr != NEW_ADDR &&
+					blkaddr != COMPRESS_ADDR;
+}
+
+/* number of blocks holding the compressed stream of a cluster */
+static unsigned int cluster_nr_blocks(block_t *addrs)
+{
+	unsigned int i;
+
+	for (i = 1; i < F2FS_CLUSTER_SIZE; i++)
+		if (!cluster_blkaddr_used(addrs[i]))
+			break;
+	return i - 1;
+}
+
+bool f2fs_is_compressed_page(struct page *page)
+{
+	struct cluster_io *cio;
+
+	if (page->mapping || !PagePrivate(page))
+		return false;
+
+	cio = (struct cluster_io *)page_private(page);
+	return cio->magic == CLUSTER_IO_MAGIC;
+}
+
+bool f2fs_compressed_page_match(struct page *page, struct inode *inode,
+							struct page *target)
+{
+	struct cluster_io *cio = (struct cluster_io *)page_private(page);
+	int i;
+
+	if (inode && cio->owner->mapping->host == inode)
+		return true;
+
+	for (i = 0; target && i < F2FS_CLUSTER_SIZE; i++)
+		if (cio->rpages[i] == target)
+			return true;
+	return false;
+}
+
+void f2fs_end_compressed_write(struct page *page, int err)
+{
+	struct cluster_io *cio = (struct cluster_io *)page_private(page);
+	int i;
+
+	if (unlikely(err))
+		set_bit(AS_EIO, &cio->owner->mapping->flags);
+
+	set_page_private(page, 0);
+	ClearPagePrivate(page);
+	__free_page(page);
+
+	if (!atomic_dec_and_test(&cio->pending))
+		return;
+
+	for (i = 0; i < F2FS_CLUSTER_SIZE; i++)
+		if (cio->rpages[i])
+			end_page_writeback(cio->rpages[i]);
+	kfree(cio);
+}
+
+static void free_cluster_pages(struct page **pages, int nr)
+{
+	int i;
+
+	for (i = 0; i < nr; i++) {
+		if (pages[i])
+			__free_page(pages[i]);
+		pages[i] = NULL;
+	}
+}
+
+static void copy_to_cluster(void *dst, struct page *page)
+{
+	void *src = kmap_atomic(page);
+
+	memcpy(dst, src, PAGE_CACHE_SIZE);
+	kunmap_atomic(src);
+}
+
+static void copy_from_cluster(struct page *page, void *src)
+{
+	void *dst = kmap_atomic(page);
+
+	memcpy(dst, src, PAGE_CACHE_SIZE);
+	kunmap_atomic(dst);
+	flush_dcache_page(page);
+}
+
+/*
+ * Look up the block addresses of the cluster starting at @start.  Returns
+ * -EAGAIN if the cluster straddles two dnodes; such clusters are never
+ * compressed.
+ */
+static int get_cluster_addrs(struct inode *inode, pgoff_t start,
+							block_t *addrs)
+{
+	struct dnode_of_data dn;
+	int i, err;
+
+	set_new_dnode(&dn, inode, NULL, NULL, 0);
+	err = get_dnode_of_data(&dn, start, LOOKUP_NODE);
+	if (err)
+		return err;
+
+	if (dn.ofs_in_node + F2FS_CLUSTER_SIZE >
+				ADDRS_PER_PAGE(dn.node_page, inode)) {
+		err = -EAGAIN;
+		goto out;
+	}
+
+	for (i = 0; i < F2FS_CLUSTER_SIZE; i++)
+		addrs[i] = datablock_addr(dn.node_page, dn.ofs_in_node + i);
+out:
+	f2fs_put_dnode(&dn);
+	return err;
+}
+
+/* Read @nr compressed blocks into freshly allocated pages. */
+static int read_cluster_blocks(struct f2fs_sb_info *sbi, struct page *page,
+			block_t *addrs, int nr, struct page **cpages)
+{
+	struct f2fs_io_info fio = {
+		.sbi = sbi,
+		.type = DATA,
+		.rw = READ_SYNC,
+		.page = page,
+	};
+	int i, submitted = 0, err = 0;
+
+	for (i = 0; i < nr; i++) {
+		cpages[i] = alloc_page(GFP_NOFS);
+		if (!cpages[i]) {
+			err = -ENOMEM;
+			break;
+		}
+		lock_page(cpages[i]);
+
+		fio.old_blkaddr = fio.new_blkaddr = addrs[i];
+		fio.encrypted_page = cpages[i];
+		err = f2fs_submit_page_bio(&fio);
+		if (err) {
+			unlock_page(cpages[i]);
+			break;
+		}
+		submitted++;
+	}
+
+	/* the read end_io unlocks each page */
+	for (i = 0; i < submitted; i++) {
+		lock_page(cpages[i]);
+		if (unlikely(!PageUptodate(cpages[i])))
+			err = -EIO;
+		unlock_page(cpages[i]);
+	}
+
+	if (err)
+		free_cluster_pages(cpages, nr);
+	return err;
+}
+
+/* Decompress @nr blocks into sbi->cluster_buf, under compress_mutex. */
+static int decompress_cluster(struct f2fs_sb_info *sbi,
+					struct page **cpages, int nr)
+{
+	struct f2fs_cluster_header *hdr = sbi->cluster_cbuf;
+	size_t clen, dlen = CLUSTER_BYTES;
+	int i;
+
+	for (i = 0; i < nr; i++)
+		memcpy(sbi->cluster_cbuf + (i << PAGE_CACHE_SHIFT),
+				page_address(cpages[i]), PAGE_CACHE_SIZE);
+
+	clen = le32_to_cpu(hdr->clen);
+	if (le32_to_cpu(hdr->magic) != F2FS_COMPRESS_MAGIC ||
+			clen > (nr << PAGE_CACHE_SHIFT) - CLUSTER_HDR_SIZE)
+		goto corrupted;
+
+	if (lz4_decompress_unknownoutputsize(sbi->cluster_cbuf +
+			CLUSTER_HDR_SIZE, clen, sbi->cluster_buf, &dlen) ||
+			dlen != CLUSTER_BYTES)
+		goto corrupted;
+
+	stat_inc_decompr_cluster(sbi);
+	return 0;
+
+corrupted:
+	f2fs_msg(sbi->sb, KERN_ERR, "corrupted compressed cluster");
+	return -EIO;
+}
+
+/*
+ * ->readpage for compressed files.  Decompresses the cluster of @page and
+ * fills the other pages of the cluster as well, if they can be grabbed
+ * without blocking.  Returns -EAGAIN if the cluster is not compressed and
+ * has to be read as usual; otherwise @page is unlocked.
+ */
+int f2fs_read_cluster_page(struct page *page)
+{
+	struct address_space *mapping = page->mapping;
+	struct f2fs_sb_info *sbi = F2FS_M_SB(mapping);
+	pgoff_t start = cluster_start(page->index);
+	struct page *cpages[F2FS_CLUSTER_SIZE] = { NULL, };
+	block_t addrs[F2FS_CLUSTER_SIZE];
+	int i, nr, err;
+
+	err = get_cluster_addrs(mapping->host, start, addrs);
+	if (err == -ENOENT || err == -EAGAIN ||
+			(!err && addrs[0] != COMPRESS_ADDR))
+		return -EAGAIN;
+	if (err)
+		goto out;
+
+	nr = cluster_nr_blocks(addrs);
+	if (unlikely(!nr)) {
+		err = -EIO;
+		goto out;
+	}
+
+	err = read_cluster_blocks(sbi, page, addrs + 1, nr, cpages);
+	if (err)
+		goto out;
+
+	mutex_lock(&sbi->compress_mutex);
+	err = decompress_cluster(sbi, cpages, nr);
+	for (i = 0; !err && i < F2FS_CLUSTER_SIZE; i++) {
+		void *src = sbi->cluster_buf + (i << PAGE_CACHE_SHIFT);
+		struct page *p;
+
+		if (start + i == page->index) {
+			copy_from_cluster(page, src);
+			continue;
+		}
+
+		p = grab_cache_page_nowait(mapping, start + i);
+		if (!p)
+			continue;
+		if (!PageUptodate(p)) {
+			copy_from_cluster(p, src);
+			SetPageUptodate(p);
+		}
+		f2fs_put_page(p, 1);
+	}
+	mutex_unlock(&sbi->compress_mutex);
+	free_cluster_pages(cpages, nr);
+out:
+	if (err) {
+		SetPageError(page);
+		zero_user_segment(page, 0, PAGE_CACHE_SIZE);
+	} else {
+		SetPageUptodate(page);
+	}
+	unlock_page(page);
+	return err;
+}
+
+/*
+ * Fill sbi->cluster_buf with the on-disk contents of a compressed cluster,
+ * under compress_mutex.  Any earlier write of the cluster still in flight
+ * is waited for first, since it may own the blocks we are about to read.
+ */
+static int read_old_cluster(struct f2fs_sb_info *sbi, struct page *page,
+				pgoff_t start, block_t *addrs)
+{
+	struct page *cpages[F2FS_CLUSTER_SIZE] = { NULL, };
+	int i, nr = cluster_nr_blocks(addrs);
+	int err;
+
+	if (unlikely(!nr))
+		return -EIO;
+
+	f2fs_submit_merged_bio(sbi, DATA, WRITE);
+	for (i = 0; i < F2FS_CLUSTER_SIZE; i++) {
+		struct page *p = find_get_page(page->mapping, start + i);
+
+		if (p) {
+			wait_on_page_writeback(p);
+			page_cache_release(p);
+		}
+	}
+
+	err = read_cluster_blocks(sbi, page, addrs + 1, nr, cpages);
+	if (err)
+		return err;
+	err = decompress_cluster(sbi, cpages, nr);
+	free_cluster_pages(cpages, nr);
+	return err;
+}
+
+/*
+ * Write out the cluster holding fio->page.  Called from do_write_data_page()
+ * with the page locked and its dirty bit cleared.  The other pages of the
+ * cluster are only trylocked, so two writers never wait on each other's
+ * pages; whatever is not cached comes from the old compressed cluster.
+ *
+ * Returns -EAGAIN when the page should just be written on its own, which is
+ * the case for uncompressed clusters that are not fully cached.
+ */
+int f2fs_write_cluster(struct f2fs_io_info *fio)
+{
+	struct page *page = fio->page;
+	struct address_space *mapping = page->mapping;
+	struct inode *inode = mapping->host;
+	struct f2fs_sb_info *sbi = F2FS_I_SB(inode);
+	pgoff_t start = cluster_start(page->index);
+	pgoff_t last = (i_size_read(inode) + PAGE_CACHE_SIZE - 1) >>
+							PAGE_CACHE_SHIFT;
+	struct page *rpages[F2FS_CLUSTER_SIZE] = { NULL, };
+	struct page *cpages[F2FS_CLUSTER_SIZE] = { NULL, };
+	block_t old[F2FS_CLUSTER_SIZE];
+	struct cluster_io *cio;
+	struct dnode_of_data dn;
+	unsigned int i, ofs, nr, nr_blocks, nr_valid = 0;
+	bool compressed, compress = false, missing = false;
+	void *src;
+	int err;
+
+	if (page->index >= last)
+		return -EAGAIN;
+	nr = min_t(pgoff_t, F2FS_CLUSTER_SIZE, last - start);
+
+	set_new_dnode(&dn, inode, NULL, NULL, 0);
+	err = get_dnode_of_data(&dn, start, LOOKUP_NODE);
+	if (err)
+		return err == -ENOENT ? -EAGAIN : err;
+
+	ofs = dn.ofs_in_node;
+	if (ofs + F2FS_CLUSTER_SIZE > ADDRS_PER_PAGE(dn.node_page, inode)) {
+		err = -EAGAIN;
+		goto out_dnode;
+	}
+
+	for (i = 0; i < F2FS_CLUSTER_SIZE; i++) {
+		old[i] = datablock_addr(dn.node_page, ofs + i);
+		if (old[i] != NULL_ADDR && old[i] != COMPRESS_ADDR)
+			nr_valid++;
+	}
+	compressed = (old[0] == COMPRESS_ADDR);
+
+	/* only whole clusters are compressed */
+	if (!compressed && nr < F2FS_CLUSTER_SIZE) {
+		err = -EAGAIN;
+		goto out_dnode;
+	}
+
+	for (i = 0; i < nr; i++) {
+		struct page *p;
+
+		if (start + i == page->index) {
+			rpages[i] = page;
+			continue;
+		}
+
+		p = find_get_page(mapping, start + i);
+		if (p && trylock_page(p)) {
+			if (p->mapping == mapping && PageUptodate(p) &&
+							!PageWriteback(p)) {
+				rpages[i] = p;
+				continue;
+			}
+			unlock_page(p);
+		}
+		if (p)
+			page_cache_release(p);
+		missing = true;
+	}
+
+	if (missing && !compressed) {
+		err = -EAGAIN;
+		goto out_pages;
+	}
+
+	mutex_lock(&sbi->compress_mutex);
+	if (missing) {
+		err = read_old_cluster(sbi, page, start, old);
+		if (err)
+			goto out_unlock;
+	}
+
+	for (i = 0; i < nr; i++)
+		if (rpages[i])
+			copy_to_cluster(sbi->cluster_buf +
+					(i << PAGE_CACHE_SHIFT), rpages[i]);
+
+	src = sbi->cluster_buf;
+	nr_blocks = nr;
+	if (nr == F2FS_CLUSTER_SIZE) {
+		struct f2fs_cluster_header *hdr = sbi->cluster_cbuf;
+		size_t clen = CLUSTER_CBUF_SIZE - CLUSTER_HDR_SIZE;
+		unsigned int len;
+
+		if (!lz4_compress(sbi->cluster_buf, CLUSTER_BYTES,
+				sbi->cluster_cbuf + CLUSTER_HDR_SIZE, &clen,
+				sbi->cluster_wrkmem)) {
+			len = CLUSTER_HDR_SIZE + clen;
+			if (DIV_ROUND_UP(len, PAGE_CACHE_SIZE) <
+							F2FS_CLUSTER_SIZE) {
+				compress = true;
+				nr_blocks = DIV_ROUND_UP(len, PAGE_CACHE_SIZE);
+				hdr->magic = cpu_to_le32(F2FS_COMPRESS_MAGIC);
+				hdr->clen = cpu_to_le32(clen);
+				/* don't leak stale buffer contents to disk */
+				memset(sbi->cluster_cbuf + len, 0,
+				(nr_blocks << PAGE_CACHE_SHIFT) - len);
+				src = sbi->cluster_cbuf;
+			}
+		}
+	}
+
+	for (i = 0; i < nr_blocks; i++) {
+		cpages[i] = alloc_page(GFP_NOFS);
+		if (!cpages[i]) {
+			err = -ENOMEM;
+			goto out_unlock;
+		}
+		memcpy(page_address(cpages[i]), src + (i << PAGE_CACHE_SHIFT),
+							PAGE_CACHE_SIZE);
+	}
+	mutex_unlock(&sbi->compress_mutex);
+
+	cio = kzalloc(sizeof(struct cluster_io), GFP_NOFS);
+	if (!cio) {
+		err = -ENOMEM;
+		goto out_free;
+	}
+
+	if (nr_blocks > nr_valid &&
+		!inc_valid_block_count(sbi, inode, nr_blocks - nr_valid)) {
+		kfree(cio);
+		err = -ENOSPC;
+		goto out_free;
+	}
+
+	cio->magic = CLUSTER_IO_MAGIC;
+	cio->owner = page;
+	atomic_set(&cio->pending, nr_blocks);
+	for (i = 0; i < nr; i++) {
+		if (!rpages[i])
+			continue;
+		if (rpages[i] != page && clear_page_dirty_for_io(rpages[i]))
+			inode_dec_dirty_pages(inode);
+		set_page_writeback(rpages[i]);
+		cio->rpages[i] = rpages[i];
+	}
+	for (i = 0; i < nr_blocks; i++) {
+		set_page_private(cpages[i], (unsigned long)cio);
+		SetPagePrivate(cpages[i]);
+	}
+
+	for (i = 0; i < F2FS_CLUSTER_SIZE; i++) {
+		unsigned int blk = compress ? i - 1 : i;
+		block_t new_addr = NULL_ADDR;
+
+		dn.ofs_in_node = ofs + i;
+
+		if (compress ? (i >= 1 && i <= nr_blocks) : i < nr_blocks) {
+			struct f2fs_io_info bfio = *fio;
+
+			bfio.encrypted_page = cpages[blk];
+			bfio.old_blkaddr = cluster_blkaddr_used(old[i]) ?
+							old[i] : NEW_ADDR;
+			dn.data_blkaddr = bfio.old_blkaddr;
+			write_data_page(&dn, &bfio);
+			continue;
+		}
+
+		if (compress && i == 0)
+			new_addr = COMPRESS_ADDR;
+		if (cluster_blkaddr_used(old[i]))
+			invalidate_blocks(sbi, old[i]);
+		if (old[i] != new_addr) {
+			dn.data_blkaddr = new_addr;
+			set_data_blkaddr(&dn);
+		}
+	}
+
+	if (nr_valid > nr_blocks)
+		dec_valid_block_count(sbi, inode, nr_valid - nr_blocks);
+	if (nr_valid != nr_blocks)
+		sync_inode_page(&dn);
+
+	set_inode_flag(F2FS_I(inode), FI_APPEND_WRITE);
+	if (start == 0)
+		set_inode_flag(F2FS_I(inode), FI_FIRST_BLOCK_WRITTEN);
+	if (compress)
+		stat_inc_compr_cluster(sbi, F2FS_CLUSTER_SIZE - nr_blocks);
+
+	/*
+	 * Pages that were not cached are read from the new blocks as soon as
+	 * the dnode is unlocked, so their data must be on disk by then.
+	 */
+	if (missing)
+		f2fs_wait_on_page_writeback(page, DATA, true);
+	goto out_pages;
+
+out_unlock:
+	mutex_unlock(&sbi->compress_mutex);
+out_free:
+	free_cluster_pages(cpages, F2FS_CLUSTER_SIZE);
+out_pages:
+	for (i = 0; i < nr; i++)
+		if (rpages[i] && rpages[i] != page)
+			f2fs_put_page(rpages[i], 1);
+out_dnode:
+	f2fs_put_dnode(&dn);
+	return err;
+}
+
+/*
+ * Truncation inside a compressed cluster would free blocks that the
+ * surviving pages still decompress from, so rewrite those pages
+ * uncompressed first.  Called after i_size has been reduced to @from.
+ */
+int f2fs_truncate_cluster(struct inode *inode, u64 from)
+{
+	pgoff_t index = (from + PAGE_CACHE_SIZE - 1) >> PAGE_CACHE_SHIFT;
+	pgoff_t start = cluster_start(index);
+	block_t addrs[F2FS_CLUSTER_SIZE];
+	struct page *page;
+	pgoff_t i;
+	int err;
+
+	if (index == start)
+		return 0;
+
+	err = get_cluster_addrs(inode, start, addrs);
+	if (err == -ENOENT || err == -EAGAIN)
+		return 0;
+	if (err || addrs[0] != COMPRESS_ADDR)
+		return err;
+
+	for (i = start; i < index; i++) {
+		page = get_lock_data_page(inode, i, true);
+		if (IS_ERR(page))
+			return PTR_ERR(page);
+		set_page_dirty(page);
+		f2fs_put_page(page, 1);
+	}
+
+	err = filemap_write_and_wait_range(inode->i_mapping,
+				(loff_t)start << PAGE_CACHE_SHIFT,
+				((loff_t)index << PAGE_CACHE_SHIFT) - 1);
+	if (err)
+		return err;
+
+	err = get_cluster_addrs(inode, start, addrs);
+	if (!err && addrs[0] == COMPRESS_ADDR)
+		err = -EIO;
+	return err;
+}
+
+int f2fs_init_compress_ctx(struct f2fs_sb_info *sbi)
+{
+	mutex_init(&sbi->compress_mutex);
+
+	sbi->cluster_buf = vmalloc(CLUSTER_BYTES);
+	sbi->cluster_cbuf = vmalloc(CLUSTER_CBUF_SIZE);
+	sbi->cluster_wrkmem = vmalloc(LZ4_MEM_COMPRESS);
+	if (!sbi->cluster_buf || !sbi->cluster_cbuf || !sbi->cluster_wrkmem) {
+		f2fs_destroy_compress_ctx(sbi);
+		return -ENOMEM;
+	}
+	return 0;
+}
+
+void f2fs_destroy_compress_ctx(struct f2fs_sb_info *sbi)
+{
+	vfree(sbi->cluster_buf);
+	vfree(sbi->cluster_cbuf);
+	vfree(sbi->cluster_wrkmem);
+	sbi->cluster_buf = NULL;
+	sbi->cluster_cbuf = NULL;
+	sbi->cluster_wrkmem = NULL;
+}
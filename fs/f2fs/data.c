@@ -65,6 +65,14 @@ static void f2fs_write_end_io(struct bio *bio, int err)
 	__bio_for_each_segment(bvec, bio, i, 0) {
 		struct page *page = bvec->bv_page;
 
+		if (f2fs_is_compressed_page(page)) {
+			if (unlikely(err))
+				f2fs_stop_checkpoint(sbi);
+			f2fs_end_compressed_write(page, err);
+			dec_page_count(sbi, F2FS_WRITEBACK);
+			continue;
+		}
+
 		f2fs_restore_and_release_control_page(&page);
 
 		if (unlikely(err)) {
@@ -130,6 +138,13 @@ static bool __has_merged_page(struct f2fs_bio_info *io, struct inode *inode,
 
 	__bio_for_each_segment(bvec, io->bio, i, 0) {
 
+		if (f2fs_is_compressed_page(bvec->bv_page)) {
+			if (f2fs_compressed_page_match(bvec->bv_page,
+							inode, page))
+				return true;
+			continue;
+		}
+
 		if (bvec->bv_page->mapping) {
 			target = bvec->bv_page;
 		} else {
@@ -223,7 +238,7 @@ int f2fs_submit_page_bio(struct f2fs_io_info *fio)
 	struct bio *bio;
 	struct page *page = fio->encrypted_page ? fio->encrypted_page : fio->page;
 
-	trace_f2fs_submit_page_bio(page, fio);
+	trace_f2fs_submit_page_bio(fio->page, fio);
 	f2fs_trace_ios(fio, 0);
 
 	/* Allocate a new bio */
@@ -258,7 +273,7 @@ void f2fs_submit_page_mbio(struct f2fs_io_info *fio)
 		inc_page_count(sbi, F2FS_WRITEBACK);
 
 	if (io->bio && (io->last_block_in_bio != fio->new_blkaddr - 1 ||
-						io->fio.rw != fio->rw))
+			io->fio.rw != fio->rw || io->fio.hint != fio->hint))
 		__submit_merged_bio(io);
 alloc_new:
 	if (io->bio == NULL) {
@@ -266,6 +281,7 @@ alloc_new:
 
 		io->bio = __bio_alloc(sbi, fio->new_blkaddr,
 						bio_blocks, is_read);
+		io->bio->bi_write_hint = fio->hint;
 		io->fio = *fio;
 	}
 
@@ -377,13 +393,21 @@ struct page *get_read_data_page(struct inode *inode, pgoff_t index,
 		.encrypted_page = NULL,
 	};
 
-	if (f2fs_encrypted_inode(inode) && S_ISREG(inode->i_mode))
+	if ((f2fs_encrypted_inode(inode) && S_ISREG(inode->i_mode)) ||
+					f2fs_compressed_inode(inode))
 		return read_mapping_page(mapping, index, NULL);
 
 	page = f2fs_grab_cache_page(mapping, index, for_write);
 	if (!page)
 		return ERR_PTR(-ENOMEM);
 
+	/* an uptodate page may be registered as an inmem page */
+	if (!PageUptodate(page)) {
+		dn.data_blkaddr = lookup_spilled_block(inode, index);
+		if (dn.data_blkaddr != NULL_ADDR)
+			goto got_it;
+	}
+
 	if (f2fs_lookup_extent_cache(inode, index, &ei)) {
 		dn.data_blkaddr = ei.blk + index - ei.fofs;
 		goto got_it;
@@ -591,7 +615,7 @@ ssize_t f2fs_preallocate_blocks(struct inode *inode, loff_t pos, size_t count, b
 	map.m_len = F2FS_BLK_ALIGN(count);
 	map.m_next_pgofs = NULL;
 
-	if (f2fs_encrypted_inode(inode))
+	if (f2fs_encrypted_inode(inode) || f2fs_compressed_inode(inode))
 		return 0;
 
 	if (dio) {
@@ -638,6 +662,18 @@ int f2fs_map_blocks(struct inode *inode, struct f2fs_map_blocks *map,
 	/* it only supports block size == page size */
 	pgofs =	(pgoff_t)map->m_lblk;
 
+	/* spilled atomic-write pages are mapped one by one */
+	if (!create && F2FS_I(inode)->cow_inode) {
+		blkaddr = lookup_spilled_block(inode, pgofs);
+		if (blkaddr != NULL_ADDR) {
+			map->m_pblk = blkaddr;
+			map->m_len = 1;
+			map->m_flags = F2FS_MAP_MAPPED;
+			goto out;
+		}
+		maxblocks = 1;
+	}
+
 	if (!create && f2fs_lookup_extent_cache(inode, pgofs, &ei)) {
 		map->m_pblk = ei.blk + pgofs - ei.fofs;
 		map->m_len = min((pgoff_t)maxblocks, ei.fofs + ei.len - pgofs);
@@ -667,6 +703,13 @@ next_dnode:
 next_block:
 	blkaddr = datablock_addr(dn.node_page, dn.ofs_in_node);
 
+	/* pages of a compressed cluster have no block of their own */
+	if (blkaddr == COMPRESS_ADDR && !create) {
+		if (flag == F2FS_GET_BLOCK_BMAP)
+			err = -ENOENT;
+		goto sync_out;
+	}
+
 	if (blkaddr == NEW_ADDR || blkaddr == NULL_ADDR) {
 		if (create) {
 			if (unlikely(f2fs_cp_error(sbi))) {
@@ -868,6 +911,8 @@ next:
 	if (size) {
 		if (f2fs_encrypted_inode(inode))
 			flags |= FIEMAP_EXTENT_DATA_ENCRYPTED;
+		if (f2fs_compressed_inode(inode))
+			flags |= FIEMAP_EXTENT_ENCODED;
 
 		ret = fiemap_fill_next_extent(fieinfo, logical,
 				phys, size, flags);
@@ -1055,6 +1100,8 @@ static int f2fs_read_data_page(struct file *file, struct page *page)
 	/* If the file has inline data, try to read it directly */
 	if (f2fs_has_inline_data(inode))
 		ret = f2fs_read_inline_data(inode, page);
+	else if (f2fs_compressed_inode(inode))
+		ret = f2fs_read_cluster_page(page);
 	if (ret == -EAGAIN)
 		ret = f2fs_mpage_readpages(page->mapping, NULL, page, 1);
 	return ret;
@@ -1073,6 +1120,19 @@ static int f2fs_read_data_pages(struct file *file,
 	if (f2fs_has_inline_data(inode))
 		return 0;
 
+	/* compressed clusters are read a cluster at a time */
+	if (f2fs_compressed_inode(inode)) {
+		for (; nr_pages; nr_pages--) {
+			page = list_entry(pages->prev, struct page, lru);
+			list_del(&page->lru);
+			if (!add_to_page_cache_lru(page, mapping,
+						page->index, GFP_KERNEL))
+				f2fs_read_data_page(file, page);
+			page_cache_release(page);
+		}
+		return 0;
+	}
+
 	return f2fs_mpage_readpages(mapping, pages, NULL, nr_pages);
 }
 
@@ -1083,6 +1143,12 @@ int do_write_data_page(struct f2fs_io_info *fio)
 	struct dnode_of_data dn;
 	int err = 0;
 
+	if (f2fs_compressed_inode(inode)) {
+		err = f2fs_write_cluster(fio);
+		if (err != -EAGAIN)
+			return err;
+	}
+
 	set_new_dnode(&dn, inode, NULL, NULL, 0);
 	err = get_dnode_of_data(&dn, page->index, LOOKUP_NODE);
 	if (err)
@@ -1453,7 +1519,7 @@ static int prepare_write_begin(struct f2fs_sb_info *sbi,
 	 * the block addresses when there is no need to fill the page.
 	 */
 	if (!f2fs_has_inline_data(inode) && !f2fs_encrypted_inode(inode) &&
-					len == PAGE_CACHE_SIZE)
+			!f2fs_compressed_inode(inode) && len == PAGE_CACHE_SIZE)
 		return 0;
 
 	if (f2fs_has_inline_data(inode) ||
@@ -1580,7 +1646,28 @@ repeat:
 		goto out_update;
 	}
 
-	if (blkaddr == NEW_ADDR) {
+	/* the latest copy of a spilled atomic-write page is in its cow inode */
+	if (F2FS_I(inode)->cow_inode) {
+		block_t spilled = lookup_spilled_block(inode, index);
+
+		if (spilled != NULL_ADDR)
+			blkaddr = spilled;
+	}
+
+	if (f2fs_compressed_inode(inode)) {
+		/* the block address says nothing about compressed clusters */
+		f2fs_read_data_page(file, page);
+
+		lock_page(page);
+		if (unlikely(!PageUptodate(page))) {
+			err = -EIO;
+			goto fail;
+		}
+		if (unlikely(page->mapping != mapping)) {
+			f2fs_put_page(page, 1);
+			goto repeat;
+		}
+	} else if (blkaddr == NEW_ADDR) {
 		zero_user_segment(page, 0, PAGE_CACHE_SIZE);
 	} else {
 		struct f2fs_io_info fio = {
@@ -1699,7 +1786,8 @@ static ssize_t f2fs_direct_IO(int rw, struct kiocb *iocb,
 	if (err)
 		return err;
 
-	if (f2fs_encrypted_inode(inode) && S_ISREG(inode->i_mode))
+	if ((f2fs_encrypted_inode(inode) && S_ISREG(inode->i_mode)) ||
+					f2fs_compressed_inode(inode))
 		return 0;
 
 	err = blockdev_direct_IO(rw, iocb, inode, iov, offset, nr_segs,
@@ -1786,6 +1874,10 @@ static sector_t f2fs_bmap(struct address_space *mapping, sector_t block)
 	if (f2fs_has_inline_data(inode))
 		return 0;
 
+	/* the blocks of a compressed cluster hold no page of their own */
+	if (f2fs_compressed_inode(inode))
+		return 0;
+
 	/* make sure allocating whole blocks */
 	if (mapping_tagged(mapping, PAGECACHE_TAG_DIRTY))
 		filemap_write_and_wait(mapping);
@@ -38,9 +38,16 @@ static void update_general_status(struct f2fs_sb_info *sbi)
 	si->hit_rbtree = atomic64_read(&sbi->read_hit_rbtree);
 	si->hit_total = si->hit_largest + si->hit_cached + si->hit_rbtree;
 	si->total_ext = atomic64_read(&sbi->total_hit_ext);
+	si->nat_hit = atomic64_read(&sbi->nat_hit);
+	si->total_nat = atomic64_read(&sbi->total_nat_lookup);
+	si->fnid_hit = atomic64_read(&sbi->fnid_hit);
+	si->total_fnid = atomic64_read(&sbi->total_fnid_lookup);
 	si->ext_tree = atomic_read(&sbi->total_ext_tree);
 	si->zombie_tree = atomic_read(&sbi->total_zombie_tree);
 	si->ext_node = atomic_read(&sbi->total_ext_node);
+	si->dir_index_lookup = atomic64_read(&sbi->dir_index_lookup);
+	si->dir_index = atomic_read(&sbi->total_dir_index);
+	si->dir_index_entry = atomic_read(&sbi->total_dir_index_entry);
 	si->ndirty_node = get_pages(sbi, F2FS_DIRTY_NODES);
 	si->ndirty_dent = get_pages(sbi, F2FS_DIRTY_DENTS);
 	si->ndirty_meta = get_pages(sbi, F2FS_DIRTY_META);
@@ -48,6 +55,7 @@ static void update_general_status(struct f2fs_sb_info *sbi)
 	si->ndirty_dirs = sbi->ndirty_inode[DIR_INODE];
 	si->ndirty_files = sbi->ndirty_inode[FILE_INODE];
 	si->inmem_pages = get_pages(sbi, F2FS_INMEM_PAGES);
+	si->spilled_pages = get_pages(sbi, F2FS_INMEM_SPILLED);
 	si->wb_pages = get_pages(sbi, F2FS_WRITEBACK);
 	si->total_count = (int)sbi->user_block_count / sbi->blocks_per_seg;
 	si->rsvd_segs = reserved_segments(sbi);
@@ -72,6 +80,15 @@ static void update_general_status(struct f2fs_sb_info *sbi)
 	si->dirty_sits = SIT_I(sbi)->dirty_sentries;
 	si->fnids = NM_I(sbi)->fcnt;
 	si->bg_gc = sbi->bg_gc;
+	si->victim_count = sbi->victim_count;
+	si->victim_avg_us = sbi->victim_count ? div_u64(div_u64(
+		sbi->victim_time, sbi->victim_count), NSEC_PER_USEC) : 0;
+	si->victim_max_us = div_u64(sbi->victim_max_time, NSEC_PER_USEC);
+	si->cp_blocked_avg_us = sbi->cp_blocked_count ? div_u64(div_u64(
+		sbi->cp_blocked_time, sbi->cp_blocked_count),
+		NSEC_PER_USEC) : 0;
+	si->cp_blocked_max_us = div_u64(sbi->cp_blocked_max_time,
+						NSEC_PER_USEC);
 	si->util_free = (int)(free_user_blocks(sbi) >> sbi->log_blocks_per_seg)
 		* 100 / (int)(sbi->user_block_count >> sbi->log_blocks_per_seg)
 		/ 2;
@@ -93,6 +110,9 @@ static void update_general_status(struct f2fs_sb_info *sbi)
 	}
 
 	si->inplace_count = atomic_read(&sbi->inplace_count);
+	si->compr_clusters = atomic_read(&sbi->compr_clusters);
+	si->compr_saved_blocks = atomic_read(&sbi->compr_saved_blocks);
+	si->decompr_clusters = atomic_read(&sbi->decompr_clusters);
 }
 
 /*
@@ -170,6 +190,10 @@ static void update_mem_info(struct f2fs_sb_info *sbi)
 	si->base_mem += sizeof(struct dirty_seglist_info);
 	si->base_mem += NR_DIRTY_TYPE * f2fs_bitmap_size(MAIN_SEGS(sbi));
 	si->base_mem += f2fs_bitmap_size(MAIN_SECS(sbi));
+	si->base_mem += DIRTY_I(sbi)->victim_index.nr_buckets *
+					sizeof(struct list_head);
+	si->base_mem += f2fs_bitmap_size(DIRTY_I(sbi)->victim_index.nr_buckets);
+	si->base_mem += MAIN_SECS(sbi) * sizeof(struct list_head);
 
 	/* build nm */
 	si->base_mem += sizeof(struct f2fs_nm_info);
@@ -191,13 +215,20 @@ get_cache:
 	si->cache_mem += NM_I(sbi)->nat_cnt * sizeof(struct nat_entry);
 	si->cache_mem += NM_I(sbi)->dirty_nat_cnt *
 					sizeof(struct nat_entry_set);
-	si->cache_mem += si->inmem_pages * sizeof(struct inmem_pages);
+	si->cache_mem += (si->inmem_pages + si->spilled_pages) *
+					sizeof(struct inmem_pages);
 	for (i = 0; i <= UPDATE_INO; i++)
 		si->cache_mem += sbi->im[i].ino_num * sizeof(struct ino_entry);
 	si->cache_mem += atomic_read(&sbi->total_ext_tree) *
 						sizeof(struct extent_tree);
 	si->cache_mem += atomic_read(&sbi->total_ext_node) *
 						sizeof(struct extent_node);
+	si->cache_mem += atomic_read(&sbi->total_dir_index) *
+						sizeof(struct dir_index);
+	si->cache_mem += atomic_read(&sbi->total_dir_index_bucket) *
+						sizeof(struct hlist_head);
+	si->cache_mem += atomic_read(&sbi->total_dir_index_entry) *
+						sizeof(struct dir_index_entry);
 
 	si->page_mem = 0;
 	npages = NODE_MAPPING(sbi)->nrpages;
@@ -215,9 +246,16 @@ static int stat_show(struct seq_file *s, void *v)
 	mutex_lock(&f2fs_stat_mutex);
 	list_for_each_entry(si, &f2fs_stat_list, stat_list) {
 		char devname[BDEVNAME_SIZE];
+		unsigned int written, gc_wa = 100;
 
 		update_general_status(si->sbi);
 
+		/* all blocks allocated over the blocks users asked for */
+		written = si->block_count[LFS] + si->block_count[SSR];
+		if (written > si->tot_blks)
+			gc_wa = div_u64((u64)written * 100,
+					written - si->tot_blks);
+
 		seq_printf(s, "\n=====[ partition info(%s). #%d ]=====\n",
 			bdevname(si->sbi->sb->s_bdev, devname), i++);
 		seq_printf(s, "[SB: 1] [CP: 2] [SIT: %d] [NAT: %d] ",
@@ -274,8 +312,13 @@ static int stat_show(struct seq_file *s, void *v)
 			   si->prefree_count, si->free_segs, si->free_secs);
 		seq_printf(s, "CP calls: %d (BG: %d)\n",
 				si->cp_count, si->bg_cp_count);
+		seq_printf(s, "  - blocked ops : avg: %llu us, max: %llu us\n",
+			   si->cp_blocked_avg_us, si->cp_blocked_max_us);
 		seq_printf(s, "GC calls: %d (BG: %d)\n",
 			   si->call_count, si->bg_gc);
+		seq_printf(s, "  - victim selection : %u (avg: %llu us, max: %llu us)\n",
+			   si->victim_count, si->victim_avg_us,
+			   si->victim_max_us);
 		seq_printf(s, "  - data segments : %d (%d)\n",
 				si->data_segs, si->bg_data_segs);
 		seq_printf(s, "  - node segments : %d (%d)\n",
@@ -284,8 +327,12 @@ static int stat_show(struct seq_file *s, void *v)
 				si->bg_data_blks + si->bg_node_blks);
 		seq_printf(s, "  - data blocks : %d (%d)\n", si->data_blks,
 				si->bg_data_blks);
+		seq_printf(s, "  - data age : young %d, old %d\n",
+				si->young_data_blks, si->old_data_blks);
 		seq_printf(s, "  - node blocks : %d (%d)\n", si->node_blks,
 				si->bg_node_blks);
+		seq_printf(s, "GC write amplification: %u.%02u\n",
+				gc_wa / 100, gc_wa % 100);
 		seq_puts(s, "\nExtent Cache:\n");
 		seq_printf(s, "  - Hit Count: L1-1:%llu L1-2:%llu L2:%llu\n",
 				si->hit_largest, si->hit_cached,
@@ -296,9 +343,23 @@ static int stat_show(struct seq_file *s, void *v)
 				si->hit_total, si->total_ext);
 		seq_printf(s, "  - Inner Struct Count: tree: %d(%d), node: %d\n",
 				si->ext_tree, si->zombie_tree, si->ext_node);
+		seq_puts(s, "\nNAT Cache:\n");
+		seq_printf(s, "  - Hit Ratio: %llu%% (%llu / %llu)\n",
+				!si->total_nat ? 0 :
+				div64_u64(si->nat_hit * 100, si->total_nat),
+				si->nat_hit, si->total_nat);
+		seq_puts(s, "\nFree nid Cache:\n");
+		seq_printf(s, "  - Hit Ratio: %llu%% (%llu / %llu)\n",
+				!si->total_fnid ? 0 :
+				div64_u64(si->fnid_hit * 100, si->total_fnid),
+				si->fnid_hit, si->total_fnid);
+		seq_puts(s, "\nDir Index:\n");
+		seq_printf(s, "  - Lookups: %llu\n", si->dir_index_lookup);
+		seq_printf(s, "  - Inner Struct Count: dir: %d, entry: %d\n",
+				si->dir_index, si->dir_index_entry);
 		seq_puts(s, "\nBalancing F2FS Async:\n");
-		seq_printf(s, "  - inmem: %4d, wb: %4d\n",
-			   si->inmem_pages, si->wb_pages);
+		seq_printf(s, "  - inmem: %4d (spilled: %4d), wb: %4d\n",
+			   si->inmem_pages, si->spilled_pages, si->wb_pages);
 		seq_printf(s, "  - nodes: %4d in %4d\n",
 			   si->ndirty_node, si->node_pages);
 		seq_printf(s, "  - dents: %4d in dirs:%4d\n",
@@ -327,6 +388,10 @@ static int stat_show(struct seq_file *s, void *v)
 			seq_putc(s, '-');
 		seq_puts(s, "]\n\n");
 		seq_printf(s, "IPU: %u blocks\n", si->inplace_count);
+		seq_printf(s, "Compressed: %u clusters (saved %u blocks), "
+			   "decompressed: %u clusters\n",
+			   si->compr_clusters, si->compr_saved_blocks,
+			   si->decompr_clusters);
 		seq_printf(s, "SSR: %u blocks in %u segments\n",
 			   si->block_count[SSR], si->segment_count[SSR]);
 		seq_printf(s, "LFS: %u blocks in %u segments\n",
@@ -388,11 +453,19 @@ int f2fs_build_stats(struct f2fs_sb_info *sbi)
 	atomic64_set(&sbi->read_hit_rbtree, 0);
 	atomic64_set(&sbi->read_hit_largest, 0);
 	atomic64_set(&sbi->read_hit_cached, 0);
+	atomic64_set(&sbi->total_nat_lookup, 0);
+	atomic64_set(&sbi->nat_hit, 0);
+	atomic64_set(&sbi->total_fnid_lookup, 0);
+	atomic64_set(&sbi->fnid_hit, 0);
+	atomic64_set(&sbi->dir_index_lookup, 0);
 
 	atomic_set(&sbi->inline_xattr, 0);
 	atomic_set(&sbi->inline_inode, 0);
 	atomic_set(&sbi->inline_dir, 0);
 	atomic_set(&sbi->inplace_count, 0);
+	atomic_set(&sbi->compr_clusters, 0);
+	atomic_set(&sbi->compr_saved_blocks, 0);
+	atomic_set(&sbi->decompr_clusters, 0);
 
 	mutex_lock(&f2fs_stat_mutex);
 	list_add_tail(&si->stat_list, &f2fs_stat_list);
@@ -205,6 +205,335 @@ static struct f2fs_dir_entry *find_in_level(struct inode *dir,
 	return de;
 }
 
+/*
+ * A miss in find_in_level() reads every block of one bucket per level, so a
+ * negative lookup in a directory holding tens of thousands of entries costs
+ * dozens of dentry block reads.  Once a directory spans dir_index_blocks
+ * blocks, its first lookup builds an in-memory index from each dentry's hash
+ * code to the block holding it, and later lookups only read those blocks.
+ * Adding and deleting dentries keep the index up to date, and the shrinker
+ * frees whole indices in LRU order.
+ */
+#define DIR_INDEX_BUCKETS_PER_BLOCK	16
+#define DIR_INDEX_MAX_BLOCKS		4	/* candidate blocks per lookup */
+
+static struct kmem_cache *dir_index_entry_slab;
+
+static bool __insert_dir_index(struct f2fs_sb_info *sbi, struct dir_index *di,
+			f2fs_hash_t hash, unsigned int bidx, gfp_t gfp_mask)
+{
+	struct dir_index_entry *ie;
+
+	ie = kmem_cache_alloc(dir_index_entry_slab, gfp_mask);
+	if (!ie)
+		return false;
+
+	ie->hash = hash;
+	ie->bidx = bidx;
+	hlist_add_head(&ie->hnode, &di->buckets[le32_to_cpu(hash) &
+						(di->nr_buckets - 1)]);
+	di->nr_entries++;
+	atomic_inc(&sbi->total_dir_index_entry);
+	return true;
+}
+
+static void __remove_dir_index(struct f2fs_sb_info *sbi, struct dir_index *di,
+					f2fs_hash_t hash, unsigned int bidx)
+{
+	struct hlist_head *head;
+	struct hlist_node *pos;
+	struct dir_index_entry *ie;
+
+	head = &di->buckets[le32_to_cpu(hash) & (di->nr_buckets - 1)];
+	hlist_for_each_entry(ie, pos, head, hnode) {
+		if (ie->hash == hash && ie->bidx == bidx) {
+			hlist_del(&ie->hnode);
+			kmem_cache_free(dir_index_entry_slab, ie);
+			di->nr_entries--;
+			atomic_dec(&sbi->total_dir_index_entry);
+			return;
+		}
+	}
+}
+
+static unsigned int __free_dir_index(struct f2fs_sb_info *sbi,
+						struct dir_index *di)
+{
+	struct hlist_node *pos, *n;
+	struct dir_index_entry *ie;
+	unsigned int count = di->nr_entries;
+	unsigned int i;
+
+	for (i = 0; i < di->nr_buckets; i++)
+		hlist_for_each_entry_safe(ie, pos, n, &di->buckets[i], hnode)
+			kmem_cache_free(dir_index_entry_slab, ie);
+
+	atomic_sub(count, &sbi->total_dir_index_entry);
+	atomic_sub(di->nr_buckets, &sbi->total_dir_index_bucket);
+	atomic_dec(&sbi->total_dir_index);
+	f2fs_kvfree(di->buckets);
+	kfree(di);
+	return count;
+}
+
+/* should be called with dir_index_lock */
+static struct dir_index *__detach_dir_index(struct f2fs_sb_info *sbi,
+							struct inode *dir)
+{
+	struct dir_index *di = F2FS_I(dir)->dir_index;
+
+	if (di) {
+		list_del(&di->list);
+		F2FS_I(dir)->dir_index = NULL;
+	}
+	return di;
+}
+
+static struct dir_index *build_dir_index(struct inode *dir,
+						unsigned long npages)
+{
+	struct f2fs_sb_info *sbi = F2FS_I_SB(dir);
+	struct dir_index *di;
+	struct f2fs_dentry_ptr d;
+	struct f2fs_dir_entry *de;
+	struct page *dentry_page;
+	unsigned long bidx, bit_pos;
+
+	di = kzalloc(sizeof(struct dir_index), GFP_NOFS);
+	if (!di)
+		return NULL;
+
+	di->nr_buckets = roundup_pow_of_two(npages) *
+					DIR_INDEX_BUCKETS_PER_BLOCK;
+	di->buckets = f2fs_kvzalloc(di->nr_buckets * sizeof(struct hlist_head),
+								GFP_NOFS);
+	if (!di->buckets) {
+		kfree(di);
+		return NULL;
+	}
+	INIT_LIST_HEAD(&di->list);
+	di->inode = dir;
+	atomic_inc(&sbi->total_dir_index);
+	atomic_add(di->nr_buckets, &sbi->total_dir_index_bucket);
+
+	for (bidx = 0; bidx < npages; bidx++) {
+		dentry_page = find_data_page(dir, bidx);
+		if (IS_ERR(dentry_page)) {
+			if (PTR_ERR(dentry_page) == -ENOENT)
+				continue;
+			goto fail;
+		}
+
+		make_dentry_ptr(NULL, &d, kmap(dentry_page), 1);
+		bit_pos = find_next_bit_le(d.bitmap, d.max, 0);
+		while (bit_pos < d.max) {
+			de = &d.dentry[bit_pos];
+			if (unlikely(!de->name_len) ||
+					!__insert_dir_index(sbi, di,
+					de->hash_code, bidx, GFP_NOFS)) {
+				kunmap(dentry_page);
+				f2fs_put_page(dentry_page, 0);
+				goto fail;
+			}
+			bit_pos += GET_DENTRY_SLOTS(le16_to_cpu(de->name_len));
+			bit_pos = find_next_bit_le(d.bitmap, d.max, bit_pos);
+		}
+		kunmap(dentry_page);
+		f2fs_put_page(dentry_page, 0);
+		cond_resched();
+	}
+	return di;
+fail:
+	__free_dir_index(sbi, di);
+	return NULL;
+}
+
+/*
+ * Collect the blocks which may hold a dentry with @hash into @blocks.
+ * It returns the number of blocks, or -1 if the index can't be used and
+ * the caller should walk the hash levels.
+ */
+static int lookup_dir_index(struct inode *dir, unsigned long npages,
+				f2fs_hash_t hash, unsigned int *blocks)
+{
+	struct f2fs_sb_info *sbi = F2FS_I_SB(dir);
+	struct f2fs_inode_info *fi = F2FS_I(dir);
+	struct dir_index *di;
+	struct dir_index_entry *ie;
+	struct hlist_node *pos;
+	unsigned int gen;
+	bool built = false;
+	int i, count;
+
+	if (!sbi->dir_index_blocks || npages < sbi->dir_index_blocks)
+		return -1;
+retry:
+	count = 0;
+	spin_lock(&sbi->dir_index_lock);
+	di = fi->dir_index;
+	if (!di) {
+		gen = fi->dir_index_gen;
+		spin_unlock(&sbi->dir_index_lock);
+		goto build;
+	}
+
+	hlist_for_each_entry(ie, pos, &di->buckets[le32_to_cpu(hash) &
+					(di->nr_buckets - 1)], hnode) {
+		if (ie->hash != hash)
+			continue;
+		for (i = 0; i < count; i++)
+			if (blocks[i] == ie->bidx)
+				break;
+		if (i < count)
+			continue;
+		if (count == DIR_INDEX_MAX_BLOCKS) {
+			count = -1;
+			break;
+		}
+		blocks[count++] = ie->bidx;
+	}
+	list_move_tail(&di->list, &sbi->dir_index_list);
+	spin_unlock(&sbi->dir_index_lock);
+	return count;
+build:
+	if (built || !available_free_memory(sbi, DIR_INDEX))
+		return -1;
+
+	di = build_dir_index(dir, npages);
+	if (!di)
+		return -1;
+	built = true;
+
+	spin_lock(&sbi->dir_index_lock);
+	/* drop it if any dentry was changed during the build */
+	if (fi->dir_index || fi->dir_index_gen != gen) {
+		spin_unlock(&sbi->dir_index_lock);
+		__free_dir_index(sbi, di);
+		return -1;
+	}
+	fi->dir_index = di;
+	list_add_tail(&di->list, &sbi->dir_index_list);
+	spin_unlock(&sbi->dir_index_lock);
+	goto retry;
+}
+
+static void update_dir_index(struct inode *dir, f2fs_hash_t hash,
+					unsigned int bidx, bool add)
+{
+	struct f2fs_sb_info *sbi = F2FS_I_SB(dir);
+	struct f2fs_inode_info *fi = F2FS_I(dir);
+	struct dir_index *di;
+
+	spin_lock(&sbi->dir_index_lock);
+	fi->dir_index_gen++;
+	di = fi->dir_index;
+	if (!di)
+		goto unlock;
+
+	if (!add) {
+		__remove_dir_index(sbi, di, hash, bidx);
+		goto unlock;
+	}
+	if (__insert_dir_index(sbi, di, hash, bidx, GFP_ATOMIC))
+		goto unlock;
+
+	/* an incomplete index would hide the new dentry */
+	__detach_dir_index(sbi, dir);
+	spin_unlock(&sbi->dir_index_lock);
+	__free_dir_index(sbi, di);
+	return;
+unlock:
+	spin_unlock(&sbi->dir_index_lock);
+}
+
+void f2fs_drop_dir_index(struct inode *dir)
+{
+	struct f2fs_sb_info *sbi = F2FS_I_SB(dir);
+	struct dir_index *di;
+
+	if (!F2FS_I(dir)->dir_index)
+		return;
+
+	spin_lock(&sbi->dir_index_lock);
+	di = __detach_dir_index(sbi, dir);
+	spin_unlock(&sbi->dir_index_lock);
+
+	if (di)
+		__free_dir_index(sbi, di);
+}
+
+unsigned int f2fs_shrink_dir_index(struct f2fs_sb_info *sbi, int nr_shrink)
+{
+	struct dir_index *di;
+	unsigned int freed = 0;
+
+	while (freed < nr_shrink) {
+		spin_lock(&sbi->dir_index_lock);
+		if (list_empty(&sbi->dir_index_list)) {
+			spin_unlock(&sbi->dir_index_lock);
+			break;
+		}
+		di = list_first_entry(&sbi->dir_index_list,
+					struct dir_index, list);
+		__detach_dir_index(sbi, di->inode);
+		spin_unlock(&sbi->dir_index_lock);
+
+		freed += __free_dir_index(sbi, di);
+		cond_resched();
+	}
+	return freed;
+}
+
+void init_dir_index_info(struct f2fs_sb_info *sbi)
+{
+	INIT_LIST_HEAD(&sbi->dir_index_list);
+	spin_lock_init(&sbi->dir_index_lock);
+	atomic_set(&sbi->total_dir_index, 0);
+	atomic_set(&sbi->total_dir_index_bucket, 0);
+	atomic_set(&sbi->total_dir_index_entry, 0);
+}
+
+int __init create_dir_index_cache(void)
+{
+	dir_index_entry_slab = f2fs_kmem_cache_create("f2fs_dir_index_entry",
+			sizeof(struct dir_index_entry));
+	if (!dir_index_entry_slab)
+		return -ENOMEM;
+	return 0;
+}
+
+void destroy_dir_index_cache(void)
+{
+	kmem_cache_destroy(dir_index_entry_slab);
+}
+
+static struct f2fs_dir_entry *find_in_dir_index(struct inode *dir,
+				struct f2fs_filename *fname,
+				unsigned int *blocks, int nblock,
+				struct page **res_page)
+{
+	struct qstr name = FSTR_TO_QSTR(&fname->disk_name);
+	struct f2fs_dir_entry *de = NULL;
+	struct page *dentry_page;
+	f2fs_hash_t namehash;
+	int i;
+
+	namehash = f2fs_dentry_hash(&name);
+
+	for (i = 0; i < nblock; i++) {
+		dentry_page = find_data_page(dir, blocks[i]);
+		if (IS_ERR(dentry_page))
+			continue;
+
+		de = find_in_block(dentry_page, fname, namehash, NULL,
+								res_page);
+		if (de)
+			break;
+		f2fs_put_page(dentry_page, 0);
+	}
+	return de;
+}
+
 /*
  * Find an entry in the specified directory with the wanted name.
  * It returns the page where the entry was found (as a parameter - res_page),
@@ -216,9 +545,11 @@ struct f2fs_dir_entry *f2fs_find_entry(struct inode *dir,
 {
 	unsigned long npages = dir_blocks(dir);
 	struct f2fs_dir_entry *de = NULL;
+	unsigned int blocks[DIR_INDEX_MAX_BLOCKS];
 	unsigned int max_depth;
 	unsigned int level;
 	struct f2fs_filename fname;
+	int nblock;
 	int err;
 
 	*res_page = NULL;
@@ -245,6 +576,20 @@ struct f2fs_dir_entry *f2fs_find_entry(struct inode *dir,
 		mark_inode_dirty(dir);
 	}
 
+	/* the index keeps hashes of disk names only */
+	if (!fname.hash) {
+		struct qstr name = FSTR_TO_QSTR(&fname.disk_name);
+
+		nblock = lookup_dir_index(dir, npages,
+					f2fs_dentry_hash(&name), blocks);
+		if (nblock >= 0) {
+			stat_inc_dir_index_lookup(F2FS_I_SB(dir));
+			de = find_in_dir_index(dir, &fname, blocks, nblock,
+								res_page);
+			goto out;
+		}
+	}
+
 	for (level = 0; level < max_depth; level++) {
 		de = find_in_level(dir, level, &fname, res_page);
 		if (de)
@@ -617,6 +962,7 @@ add_dentry:
 
 	make_dentry_ptr(NULL, &d, (void *)dentry_blk, 1);
 	f2fs_update_dentry(ino, mode, &d, &new_name, dentry_hash, bit_pos);
+	update_dir_index(dir, dentry_hash, block, true);
 
 	set_page_dirty(dentry_page);
 
@@ -719,6 +1065,7 @@ void f2fs_delete_entry(struct f2fs_dir_entry *dentry, struct page *page,
 	bit_pos = dentry - dentry_blk->dentry;
 	for (i = 0; i < slots; i++)
 		test_and_clear_bit_le(bit_pos + i, &dentry_blk->dentry_bitmap);
+	update_dir_index(dir, dentry->hash_code, page->index, false);
 
 	/* Let's check and deallocate this dentry page */
 	bit_pos = find_next_bit_le(&dentry_blk->dentry_bitmap,
@@ -77,6 +77,7 @@ struct f2fs_mount_info {
 };
 
 #define F2FS_FEATURE_ENCRYPT	0x0001
+#define F2FS_FEATURE_COMPRESSION	0x2000
 
 #define F2FS_HAS_FEATURE(sb, mask)					\
 	((F2FS_SB(sb)->raw_super->feature & cpu_to_le32(mask)) != 0)
@@ -319,6 +320,21 @@ struct f2fs_filename {
 #define fname_name(p)		((p)->disk_name.name)
 #define fname_len(p)		((p)->disk_name.len)
 
+/* in-memory hash index of a large directory, see dir.c */
+struct dir_index_entry {
+	struct hlist_node hnode;	/* linked in dir_index buckets */
+	f2fs_hash_t hash;		/* hash code of the dentry */
+	unsigned int bidx;		/* dentry block holding the dentry */
+};
+
+struct dir_index {
+	struct list_head list;		/* lru list for shrinker */
+	struct inode *inode;		/* directory owning this index */
+	unsigned int nr_entries;	/* # of dir_index_entry */
+	unsigned int nr_buckets;	/* power of two */
+	struct hlist_head *buckets;	/* dir_index_entry hashed by hash */
+};
+
 struct f2fs_dentry_ptr {
 	struct inode *inode;
 	const void *bitmap;
@@ -456,6 +472,7 @@ struct f2fs_map_blocks {
 #include "f2fs_crypto.h"
 
 #define DEF_DIR_LEVEL		0
+#define DEF_DIR_INDEX_BLOCKS	64	/* dir size to build a hash index */
 
 struct f2fs_inode_info {
 	struct inode vfs_inode;		/* serve a vfs inode */
@@ -477,10 +494,15 @@ struct f2fs_inode_info {
 
 	struct list_head dirty_list;	/* linked in global dirty list */
 	struct list_head inmem_pages;	/* inmemory pages managed by f2fs */
+	struct list_head inmem_spilled;	/* inmemory pages spilled to disk */
+	struct inode *cow_inode;	/* orphan inode holding spilled pages */
 	struct mutex inmem_lock;	/* lock for inmemory pages */
 
 	struct extent_tree *extent_tree;	/* cached extent_tree entry */
 
+	struct dir_index *dir_index;	/* hash index of a large directory */
+	unsigned int dir_index_gen;	/* bumped on every dentry change */
+
 #ifdef CONFIG_F2FS_FS_ENCRYPTION
 	/* Encryption params */
 	struct f2fs_crypt_info *i_crypt_info;
@@ -550,7 +572,9 @@ struct f2fs_nm_info {
 	nid_t available_nids;		/* maximum available node ids */
 	nid_t next_scan_nid;		/* the next nid to be scanned */
 	unsigned int ram_thresh;	/* control the memory footprint */
+	unsigned int ram_budget;	/* KB for nat and free nid caches */
 	unsigned int ra_nid_pages;	/* # of nid pages to be readaheaded */
+	unsigned int ra_nat_pages;	/* # of nat pages read on a miss */
 	unsigned int dirty_nats_ratio;	/* control dirty nats ratio threshold */
 
 	/* NAT cache management */
@@ -558,6 +582,7 @@ struct f2fs_nm_info {
 	struct radix_tree_root nat_set_root;/* root of the nat set cache */
 	struct rw_semaphore nat_tree_lock;	/* protect nat_tree_lock */
 	struct list_head nat_entries;	/* cached nat entry list (clean) */
+	spinlock_t nat_list_lock;	/* protect lru moves under read lock */
 	unsigned int nat_cnt;		/* the # of cached nat entries */
 	unsigned int dirty_nat_cnt;	/* total num of nat entries in set */
 
@@ -642,6 +667,33 @@ struct flush_cmd_control {
 	struct llist_node *dispatch_list;	/* list for command dispatch */
 };
 
+/* for the background discard thread, see issue_discard_thread() */
+#define DEF_MAX_DISCARD_REQUEST		8	/* ranges issued per round */
+#define DEF_MIN_DISCARD_ISSUE_TIME	50	/* ms, device busy or more to do */
+#define DEF_MAX_DISCARD_ISSUE_TIME	60000	/* ms, nothing left to issue */
+
+struct discard_cmd {
+	struct rb_node rb_node;		/* in discard_cmd_control's rb-tree */
+	block_t lstart;			/* start block address */
+	block_t len;			/* # of blocks */
+};
+
+struct discard_cmd_control {
+	struct task_struct *f2fs_issue_discard;	/* discard thread */
+	wait_queue_head_t discard_wait_queue;	/* waiting queue for wake-up */
+	wait_queue_head_t discard_done_queue;	/* waiting for issue_* range */
+	struct mutex issue_mutex;		/* one issuer at a time */
+	spinlock_t discard_lock;		/* protects ranges below */
+	struct rb_root root;			/* pending ranges by address */
+	block_t issue_start;			/* range being issued now */
+	block_t issue_len;
+	int discard_wake;			/* new ranges were queued */
+	unsigned int nr_pending;		/* # of pending ranges */
+	unsigned int nr_issued;			/* # of ranges issued by thread */
+	unsigned int discard_granularity;	/* min. blocks thread issues */
+	unsigned int max_discard_request;	/* max. ranges per round */
+};
+
 struct f2fs_sm_info {
 	struct sit_info *sit_info;		/* whole segment information */
 	struct free_segmap_info *free_info;	/* free segment information */
@@ -677,6 +729,9 @@ struct f2fs_sm_info {
 	/* for flush command control */
 	struct flush_cmd_control *cmd_control_info;
 
+	/* for discard command control */
+	struct discard_cmd_control *dcc_info;
+
 };
 
 /*
@@ -695,6 +750,7 @@ enum count_type {
 	F2FS_DIRTY_NODES,
 	F2FS_DIRTY_META,
 	F2FS_INMEM_PAGES,
+	F2FS_INMEM_SPILLED,
 	NR_COUNT_TYPE,
 };
 
@@ -719,6 +775,7 @@ enum page_type {
 	INMEM,		/* the below types are used by tracepoints only. */
 	INMEM_DROP,
 	INMEM_REVOKE,
+	INMEM_SPILL,
 	IPU,
 	OPU,
 };
@@ -731,6 +788,8 @@ struct f2fs_io_info {
 	block_t old_blkaddr;	/* old block address before Cow */
 	struct page *page;	/* page to be written */
 	struct page *encrypted_page;	/* encrypted page */
+	enum rw_hint hint;	/* lifetime hint from the log written to */
+	bool young;		/* GC-moved block of a young section */
 };
 
 #define is_read_io(rw)	(((rw) & 1) == READ)
@@ -797,6 +856,12 @@ struct f2fs_sb_info {
 	struct rw_semaphore node_write;		/* locking node writes */
 	struct mutex writepages;		/* mutex for writepages() */
 	wait_queue_head_t cp_wait;
+#ifdef CONFIG_F2FS_FS_COMPRESSION
+	struct mutex compress_mutex;		/* protects the buffers below */
+	void *cluster_buf;			/* one uncompressed cluster */
+	void *cluster_cbuf;			/* one compressed cluster */
+	void *cluster_wrkmem;			/* lz4 work memory */
+#endif
 	unsigned long last_time[MAX_TIME];	/* to store time in jiffies */
 	long interval_time[MAX_TIME];		/* to store thresholds */
 
@@ -819,6 +884,14 @@ struct f2fs_sb_info {
 	atomic_t total_zombie_tree;		/* extent zombie tree count */
 	atomic_t total_ext_node;		/* extent info count */
 
+	/* for large directory hash index */
+	struct list_head dir_index_list;	/* lru list for shrinker */
+	spinlock_t dir_index_lock;		/* protect dir indices */
+	atomic_t total_dir_index;		/* dir index count */
+	atomic_t total_dir_index_bucket;	/* dir index bucket count */
+	atomic_t total_dir_index_entry;		/* dir index entry count */
+	unsigned int dir_index_blocks;		/* threshold to build index */
+
 	/* basic filesystem units */
 	unsigned int log_sectors_per_block;	/* log2 sectors per block */
 	unsigned int log_blocksize;		/* log2 block size */
@@ -856,6 +929,12 @@ struct f2fs_sb_info {
 	/* maximum # of trials to find a victim segment for SSR and GC */
 	unsigned int max_victim_search;
 
+	/* sections modified within this many seconds are young for GC */
+	unsigned int gc_age_threshold;
+
+	/* atomic-write pages in memory before spilling to a cow inode */
+	unsigned int inmem_budget;
+
 	/*
 	 * for stat information.
 	 * one is for the LFS mode, and the other is for the SSR mode.
@@ -869,11 +948,25 @@ struct f2fs_sb_info {
 	atomic64_t read_hit_rbtree;		/* # of hit rbtree extent node */
 	atomic64_t read_hit_largest;		/* # of hit largest extent node */
 	atomic64_t read_hit_cached;		/* # of hit cached extent node */
+	atomic64_t total_nat_lookup;		/* # of lookup nat cache */
+	atomic64_t nat_hit;			/* # of hit nat cache */
+	atomic64_t total_fnid_lookup;		/* # of lookup free nid cache */
+	atomic64_t fnid_hit;			/* # of hit free nid cache */
+	atomic64_t dir_index_lookup;		/* # of lookups using dir index */
 	atomic_t inline_xattr;			/* # of inline_xattr inodes */
 	atomic_t inline_inode;			/* # of inline_data inodes */
 	atomic_t inline_dir;			/* # of inline_dentry inodes */
 	int bg_gc;				/* background gc calls */
 	unsigned int ndirty_inode[NR_INODE_TYPE];	/* # of dirty inodes */
+	unsigned int victim_count;		/* # of victim selections */
+	unsigned long long victim_time;		/* time spent selecting (ns) */
+	unsigned long long victim_max_time;	/* longest selection (ns) */
+	unsigned int cp_blocked_count;		/* # of blocking cp phases */
+	unsigned long long cp_blocked_time;	/* time fs ops were blocked (ns) */
+	unsigned long long cp_blocked_max_time;	/* longest blocking phase (ns) */
+	atomic_t compr_clusters;		/* # of compressed clusters */
+	atomic_t compr_saved_blocks;		/* # of blocks saved by them */
+	atomic_t decompr_clusters;		/* # of decompressed clusters */
 #endif
 	unsigned int last_victim[2];		/* last victim segment # */
 	spinlock_t stat_lock;			/* lock for stat operations */
@@ -1641,6 +1734,11 @@ static inline bool f2fs_is_drop_cache(struct inode *inode)
 	return is_inode_flag_set(F2FS_I(inode), FI_DROP_CACHE);
 }
 
+static inline pgoff_t cluster_start(pgoff_t index)
+{
+	return index & ~((pgoff_t)F2FS_CLUSTER_SIZE - 1);
+}
+
 static inline void *inline_data_addr(struct page *page)
 {
 	struct f2fs_inode *ri = F2FS_INODE(page);
@@ -1673,6 +1771,23 @@ static inline void clear_file(struct inode *inode, int type)
 	F2FS_I(inode)->i_advise &= ~type;
 }
 
+/*
+ * FS_COMPR_FL could be set on any file before compression existed, so the
+ * flag alone does not make a file compressed: the image has to carry the
+ * compression feature, and encrypted files are never compressed.
+ */
+static inline bool f2fs_compressed_inode(struct inode *inode)
+{
+#ifdef CONFIG_F2FS_FS_COMPRESSION
+	return S_ISREG(inode->i_mode) &&
+			(F2FS_I(inode)->i_flags & FS_COMPR_FL) &&
+			F2FS_HAS_FEATURE(inode->i_sb, F2FS_FEATURE_COMPRESSION) &&
+			!file_is_encrypt(inode);
+#else
+	return false;
+#endif
+}
+
 static inline int f2fs_readonly(struct super_block *sb)
 {
 	return sb->s_flags & MS_RDONLY;
@@ -1713,6 +1828,10 @@ static inline bool f2fs_may_extent_tree(struct inode *inode)
 			is_inode_flag_set(F2FS_I(inode), FI_NO_EXTENT))
 		return false;
 
+	/* compressed clusters have no linear block mapping */
+	if (f2fs_compressed_inode(inode))
+		return false;
+
 	return S_ISREG(mode);
 }
 
@@ -1784,6 +1903,7 @@ void handle_failed_inode(struct inode *);
  * namei.c
  */
 struct dentry *f2fs_get_parent(struct dentry *child);
+struct inode *f2fs_new_cow_inode(struct inode *);
 
 /*
  * dir.c
@@ -1816,6 +1936,11 @@ void f2fs_delete_entry(struct f2fs_dir_entry *, struct page *, struct inode *,
 							struct inode *);
 int f2fs_do_tmpfile(struct inode *, struct inode *);
 bool f2fs_empty_dir(struct inode *);
+void f2fs_drop_dir_index(struct inode *);
+unsigned int f2fs_shrink_dir_index(struct f2fs_sb_info *, int);
+void init_dir_index_info(struct f2fs_sb_info *);
+int __init create_dir_index_cache(void);
+void destroy_dir_index_cache(void);
 
 static inline int f2fs_add_link(struct dentry *dentry, struct inode *inode)
 {
@@ -1856,7 +1981,7 @@ int wait_on_node_pages_writeback(struct f2fs_sb_info *, nid_t);
 int remove_inode_page(struct inode *);
 struct page *new_inode_page(struct inode *);
 struct page *new_node_page(struct dnode_of_data *, unsigned int, struct page *);
-void ra_node_page(struct f2fs_sb_info *, nid_t);
+void ra_node_page(struct f2fs_sb_info *, nid_t, bool);
 struct page *get_node_page(struct f2fs_sb_info *, pgoff_t);
 struct page *get_node_page_ra(struct page *, int);
 void sync_inode_page(struct dnode_of_data *);
@@ -1882,6 +2007,9 @@ void destroy_node_manager_caches(void);
 void register_inmem_page(struct inode *, struct page *);
 void drop_inmem_pages(struct inode *);
 int commit_inmem_pages(struct inode *);
+void spill_inmem_pages(struct inode *, struct inode *);
+block_t lookup_spilled_block(struct inode *, pgoff_t);
+int truncate_spilled_pages(struct inode *, u64);
 void f2fs_balance_fs(struct f2fs_sb_info *, bool);
 void f2fs_balance_fs_bg(struct f2fs_sb_info *);
 int f2fs_issue_flush(struct f2fs_sb_info *);
@@ -1902,6 +2030,7 @@ void write_meta_page(struct f2fs_sb_info *, struct page *);
 void write_node_page(unsigned int, struct f2fs_io_info *);
 void write_data_page(struct dnode_of_data *, struct f2fs_io_info *);
 void rewrite_data_page(struct f2fs_io_info *);
+enum rw_hint f2fs_rw_hint(int);
 void __f2fs_replace_block(struct f2fs_sb_info *, struct f2fs_summary *,
 					block_t, block_t, bool, bool);
 void f2fs_replace_block(struct f2fs_sb_info *, struct dnode_of_data *,
@@ -1999,12 +2128,18 @@ struct f2fs_stat_info {
 	int main_area_segs, main_area_sections, main_area_zones;
 	unsigned long long hit_largest, hit_cached, hit_rbtree;
 	unsigned long long hit_total, total_ext;
+	unsigned long long nat_hit, total_nat, fnid_hit, total_fnid;
+	unsigned long long dir_index_lookup;
+	int dir_index, dir_index_entry;
 	int ext_tree, zombie_tree, ext_node;
 	int ndirty_node, ndirty_meta;
 	int ndirty_dent, ndirty_dirs, ndirty_data, ndirty_files;
 	int nats, dirty_nats, sits, dirty_sits, fnids;
 	int total_count, utilization;
-	int bg_gc, inmem_pages, wb_pages;
+	int bg_gc, inmem_pages, spilled_pages, wb_pages;
+	unsigned int victim_count;
+	unsigned long long victim_avg_us, victim_max_us;
+	unsigned long long cp_blocked_avg_us, cp_blocked_max_us;
 	int inline_xattr, inline_inode, inline_dir;
 	unsigned int valid_count, valid_node_count, valid_inode_count;
 	unsigned int bimodal, avg_vblocks;
@@ -2015,6 +2150,7 @@ struct f2fs_stat_info {
 	int tot_segs, node_segs, data_segs, free_segs, free_secs;
 	int bg_node_segs, bg_data_segs;
 	int tot_blks, data_blks, node_blks;
+	int young_data_blks, old_data_blks;
 	int bg_data_blks, bg_node_blks;
 	int curseg[NR_CURSEG_TYPE];
 	int cursec[NR_CURSEG_TYPE];
@@ -2023,6 +2159,7 @@ struct f2fs_stat_info {
 	unsigned int segment_count[2];
 	unsigned int block_count[2];
 	unsigned int inplace_count;
+	unsigned int compr_clusters, compr_saved_blocks, decompr_clusters;
 	unsigned long long base_mem, cache_mem, page_mem;
 };
 
@@ -2041,6 +2178,20 @@ static inline struct f2fs_stat_info *F2FS_STAT(struct f2fs_sb_info *sbi)
 #define stat_inc_rbtree_node_hit(sbi)	(atomic64_inc(&(sbi)->read_hit_rbtree))
 #define stat_inc_largest_node_hit(sbi)	(atomic64_inc(&(sbi)->read_hit_largest))
 #define stat_inc_cached_node_hit(sbi)	(atomic64_inc(&(sbi)->read_hit_cached))
+#define stat_inc_nat_lookup(sbi, hit)					\
+	do {								\
+		atomic64_inc(&(sbi)->total_nat_lookup);			\
+		if (hit)						\
+			atomic64_inc(&(sbi)->nat_hit);			\
+	} while (0)
+#define stat_inc_dir_index_lookup(sbi)				\
+			(atomic64_inc(&(sbi)->dir_index_lookup))
+#define stat_inc_fnid_lookup(sbi, hit)					\
+	do {								\
+		atomic64_inc(&(sbi)->total_fnid_lookup);		\
+		if (hit)						\
+			atomic64_inc(&(sbi)->fnid_hit);			\
+	} while (0)
 #define stat_inc_inline_xattr(inode)					\
 	do {								\
 		if (f2fs_has_inline_xattr(inode))			\
@@ -2077,6 +2228,13 @@ static inline struct f2fs_stat_info *F2FS_STAT(struct f2fs_sb_info *sbi)
 		((sbi)->block_count[(curseg)->alloc_type]++)
 #define stat_inc_inplace_blocks(sbi)					\
 		(atomic_inc(&(sbi)->inplace_count))
+#define stat_inc_compr_cluster(sbi, saved)				\
+	do {								\
+		atomic_inc(&(sbi)->compr_clusters);			\
+		atomic_add((saved), &(sbi)->compr_saved_blocks);	\
+	} while (0)
+#define stat_inc_decompr_cluster(sbi)					\
+		(atomic_inc(&(sbi)->decompr_clusters))
 #define stat_inc_seg_count(sbi, type, gc_type)				\
 	do {								\
 		struct f2fs_stat_info *si = F2FS_STAT(sbi);		\
@@ -2093,6 +2251,33 @@ static inline struct f2fs_stat_info *F2FS_STAT(struct f2fs_sb_info *sbi)
 #define stat_inc_tot_blk_count(si, blks)				\
 	(si->tot_blks += (blks))
 
+#define stat_inc_data_age_count(sbi, young)				\
+	do {								\
+		struct f2fs_stat_info *si = F2FS_STAT(sbi);		\
+		if (young)						\
+			si->young_data_blks++;				\
+		else							\
+			si->old_data_blks++;				\
+	} while (0)
+
+#define stat_inc_victim_time(sbi, ns)					\
+	do {								\
+		u64 __ns = (ns);					\
+		(sbi)->victim_count++;					\
+		(sbi)->victim_time += __ns;				\
+		if ((sbi)->victim_max_time < __ns)			\
+			(sbi)->victim_max_time = __ns;			\
+	} while (0)
+
+#define stat_inc_cp_blocked_time(sbi, ns)				\
+	do {								\
+		u64 __ns = (ns);					\
+		(sbi)->cp_blocked_count++;				\
+		(sbi)->cp_blocked_time += __ns;				\
+		if ((sbi)->cp_blocked_max_time < __ns)			\
+			(sbi)->cp_blocked_max_time = __ns;		\
+	} while (0)
+
 #define stat_inc_data_blk_count(sbi, blks, gc_type)			\
 	do {								\
 		struct f2fs_stat_info *si = F2FS_STAT(sbi);		\
@@ -2124,6 +2309,9 @@ void f2fs_destroy_root_stats(void);
 #define stat_inc_rbtree_node_hit(sb)
 #define stat_inc_largest_node_hit(sbi)
 #define stat_inc_cached_node_hit(sbi)
+#define stat_inc_nat_lookup(sbi, hit)
+#define stat_inc_fnid_lookup(sbi, hit)
+#define stat_inc_dir_index_lookup(sbi)
 #define stat_inc_inline_xattr(inode)
 #define stat_dec_inline_xattr(inode)
 #define stat_inc_inline_inode(inode)
@@ -2133,8 +2321,13 @@ void f2fs_destroy_root_stats(void);
 #define stat_inc_seg_type(sbi, curseg)
 #define stat_inc_block_count(sbi, curseg)
 #define stat_inc_inplace_blocks(sbi)
+#define stat_inc_compr_cluster(sbi, saved)
+#define stat_inc_decompr_cluster(sbi)
 #define stat_inc_seg_count(sbi, type, gc_type)
 #define stat_inc_tot_blk_count(si, blks)
+#define stat_inc_data_age_count(sbi, young)
+#define stat_inc_victim_time(sbi, ns)
+#define stat_inc_cp_blocked_time(sbi, ns)
 #define stat_inc_data_blk_count(sbi, blks, gc_type)
 #define stat_inc_node_blk_count(sbi, blks, gc_type)
 
@@ -2204,6 +2397,34 @@ void init_extent_cache_info(struct f2fs_sb_info *);
 int __init create_extent_cache(void);
 void destroy_extent_cache(void);
 
+/*
+ * compress.c
+ */
+#ifdef CONFIG_F2FS_FS_COMPRESSION
+bool f2fs_is_compressed_page(struct page *);
+bool f2fs_compressed_page_match(struct page *, struct inode *,
+							struct page *);
+void f2fs_end_compressed_write(struct page *, int);
+int f2fs_read_cluster_page(struct page *);
+int f2fs_write_cluster(struct f2fs_io_info *);
+int f2fs_truncate_cluster(struct inode *, u64);
+int f2fs_init_compress_ctx(struct f2fs_sb_info *);
+void f2fs_destroy_compress_ctx(struct f2fs_sb_info *);
+#else
+static inline bool f2fs_is_compressed_page(struct page *p) { return false; }
+static inline bool f2fs_compressed_page_match(struct page *p,
+			struct inode *i, struct page *t) { return false; }
+static inline void f2fs_end_compressed_write(struct page *p, int e) { }
+static inline int f2fs_read_cluster_page(struct page *p) { return -EAGAIN; }
+static inline int f2fs_write_cluster(struct f2fs_io_info *f)
+{
+	return -EAGAIN;
+}
+static inline int f2fs_truncate_cluster(struct inode *i, u64 f) { return 0; }
+static inline int f2fs_init_compress_ctx(struct f2fs_sb_info *s) { return 0; }
+static inline void f2fs_destroy_compress_ctx(struct f2fs_sb_info *s) { }
+#endif
+
 /*
  * crypto support
  */
@@ -2241,6 +2462,15 @@ static inline int f2fs_sb_has_crypto(struct super_block *sb)
 #endif
 }
 
+static inline int f2fs_sb_has_compression(struct super_block *sb)
+{
+#ifdef CONFIG_F2FS_FS_COMPRESSION
+	return F2FS_HAS_FEATURE(sb, F2FS_FEATURE_COMPRESSION);
+#else
+	return 0;
+#endif
+}
+
 static inline bool f2fs_may_encrypt(struct inode *inode)
 {
 #ifdef CONFIG_F2FS_FS_ENCRYPTION
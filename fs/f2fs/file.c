@@ -427,6 +427,10 @@ static loff_t f2fs_llseek(struct file *file, loff_t offset, int whence)
 	case SEEK_HOLE:
 		if (offset < 0)
 			return -ENXIO;
+		/* holes inside compressed clusters are not visible */
+		if (f2fs_compressed_inode(inode))
+			return generic_file_llseek_size(file, offset, whence,
+							maxbytes);
 		return f2fs_seek_block(file, offset, whence);
 	}
 
@@ -487,6 +491,11 @@ int truncate_data_blocks_range(struct dnode_of_data *dn, int count)
 
 		dn->data_blkaddr = NULL_ADDR;
 		set_data_blkaddr(dn);
+
+		/* the marker of a compressed cluster is not a block */
+		if (blkaddr == COMPRESS_ADDR)
+			continue;
+
 		invalidate_blocks(sbi, blkaddr);
 		if (dn->ofs_in_node == 0 && IS_INODE(dn->node_page))
 			clear_inode_flag(F2FS_I(dn->inode),
@@ -631,6 +640,12 @@ int f2fs_truncate(struct inode *inode, bool lock)
 			return err;
 	}
 
+	if (f2fs_compressed_inode(inode)) {
+		err = f2fs_truncate_cluster(inode, i_size_read(inode));
+		if (err)
+			return err;
+	}
+
 	err = truncate_blocks(inode, i_size_read(inode), lock);
 	if (err)
 		return err;
@@ -698,6 +713,9 @@ int f2fs_setattr(struct dentry *dentry, struct iattr *attr)
 		if (attr->ia_size <= i_size_read(inode)) {
 			truncate_setsize(inode, attr->ia_size);
 			err = f2fs_truncate(inode, true);
+			if (!err)
+				err = truncate_spilled_pages(inode,
+							attr->ia_size);
 			if (err)
 				return err;
 			f2fs_balance_fs(F2FS_I_SB(inode), true);
@@ -1229,6 +1247,9 @@ static long f2fs_fallocate(struct file *file, int mode,
 		(mode & (FALLOC_FL_COLLAPSE_RANGE | FALLOC_FL_INSERT_RANGE)))
 		return -EOPNOTSUPP;
 
+	if (f2fs_compressed_inode(inode) && (mode & ~FALLOC_FL_KEEP_SIZE))
+		return -EOPNOTSUPP;
+
 	if (mode & ~(FALLOC_FL_KEEP_SIZE | FALLOC_FL_PUNCH_HOLE |
 			FALLOC_FL_COLLAPSE_RANGE | FALLOC_FL_ZERO_RANGE |
 			FALLOC_FL_INSERT_RANGE))
@@ -1298,6 +1319,37 @@ static int f2fs_ioc_getflags(struct file *filp, unsigned long arg)
 	return put_user(flags, (int __user *)arg);
 }
 
+#ifdef CONFIG_F2FS_FS_COMPRESSION
+/*
+ * The cluster layout of a file is fixed by the flag, so it may only change
+ * while the file is empty.  Kernels without compression support cannot read
+ * compressed files, so the flag is only set on images carrying the feature.
+ */
+static int f2fs_ioc_set_compression(struct inode *inode, bool set)
+{
+	if (set && !f2fs_sb_has_compression(inode->i_sb))
+		return -EOPNOTSUPP;
+
+	if (!S_ISREG(inode->i_mode))
+		return -EINVAL;
+
+	if (i_size_read(inode) || F2FS_HAS_BLOCKS(inode))
+		return -EBUSY;
+
+	if (set && (f2fs_encrypted_inode(inode) ||
+			f2fs_is_atomic_file(inode) ||
+			f2fs_is_volatile_file(inode)))
+		return -EINVAL;
+
+	return set ? f2fs_convert_inline_inode(inode) : 0;
+}
+#else
+static int f2fs_ioc_set_compression(struct inode *inode, bool set)
+{
+	return set ? -EOPNOTSUPP : 0;
+}
+#endif
+
 static int f2fs_ioc_setflags(struct file *filp, unsigned long arg)
 {
 	struct inode *inode = file_inode(filp);
@@ -1334,6 +1386,14 @@ static int f2fs_ioc_setflags(struct file *filp, unsigned long arg)
 		}
 	}
 
+	if ((flags ^ oldflags) & FS_COMPR_FL) {
+		ret = f2fs_ioc_set_compression(inode, flags & FS_COMPR_FL);
+		if (ret) {
+			mutex_unlock(&inode->i_mutex);
+			goto out;
+		}
+	}
+
 	flags = flags & FS_FL_USER_MODIFIABLE;
 	flags |= oldflags & ~FS_FL_USER_MODIFIABLE;
 	fi->i_flags = flags;
@@ -1365,6 +1425,9 @@ static int f2fs_ioc_start_atomic_write(struct file *filp)
 	if (f2fs_is_atomic_file(inode))
 		return 0;
 
+	if (f2fs_compressed_inode(inode))
+		return -EINVAL;
+
 	ret = f2fs_convert_inline_inode(inode);
 	if (ret)
 		return ret;
@@ -1416,6 +1479,9 @@ static int f2fs_ioc_start_volatile_write(struct file *filp)
 	if (f2fs_is_volatile_file(inode))
 		return 0;
 
+	if (f2fs_compressed_inode(inode))
+		return -EINVAL;
+
 	ret = f2fs_convert_inline_inode(inode);
 	if (ret)
 		return ret;
@@ -1809,7 +1875,7 @@ static int f2fs_ioc_defragment(struct file *filp, unsigned long arg)
 	if (!capable(CAP_SYS_ADMIN))
 		return -EPERM;
 
-	if (!S_ISREG(inode->i_mode))
+	if (!S_ISREG(inode->i_mode) || f2fs_compressed_inode(inode))
 		return -EINVAL;
 
 	err = mnt_want_write_file(filp);
@@ -1913,6 +1979,12 @@ static ssize_t f2fs_file_aio_write(struct kiocb *iocb, const struct iovec *iov,
 			ret = __generic_file_aio_write(iocb, iov, nr_segs,
 								&iocb->ki_pos);
 	}
+	if (ret > 0 && f2fs_is_atomic_file(inode)) {
+		struct dentry *parent = dget_parent(file->f_path.dentry);
+
+		spill_inmem_pages(inode, parent->d_inode);
+		dput(parent);
+	}
 	inode_unlock(inode);
 
 	if (ret > 0 || ret == -EIOCBQUEUED) {
@@ -203,19 +203,14 @@ static unsigned int check_bg_victims(struct f2fs_sb_info *sbi)
 static unsigned int get_cb_cost(struct f2fs_sb_info *sbi, unsigned int segno)
 {
 	struct sit_info *sit_i = SIT_I(sbi);
-	unsigned int secno = GET_SECNO(sbi, segno);
-	unsigned int start = secno * sbi->segs_per_sec;
-	unsigned long long mtime = 0;
+	unsigned long long mtime;
 	unsigned int vblocks;
 	unsigned char age = 0;
 	unsigned char u;
-	unsigned int i;
 
-	for (i = 0; i < sbi->segs_per_sec; i++)
-		mtime += get_seg_entry(sbi, start + i)->mtime;
+	mtime = get_sec_mtime(sbi, segno);
 	vblocks = get_valid_blocks(sbi, segno, sbi->segs_per_sec);
 
-	mtime = div_u64(mtime, sbi->segs_per_sec);
 	vblocks = div_u64(vblocks, sbi->segs_per_sec);
 
 	u = (vblocks * 100) >> sbi->log_blocks_per_seg;
@@ -245,6 +240,85 @@ static inline unsigned int get_gc_cost(struct f2fs_sb_info *sbi,
 		return get_cb_cost(sbi, segno);
 }
 
+/*
+ * The lowest cost-benefit cost any section with @vblocks valid blocks can
+ * have, i.e. that of the oldest one.
+ */
+static unsigned int get_cb_min_cost(struct f2fs_sb_info *sbi,
+						unsigned int vblocks)
+{
+	unsigned char u;
+
+	vblocks = div_u64(vblocks, sbi->segs_per_sec);
+	u = (vblocks * 100) >> sbi->log_blocks_per_seg;
+
+	return UINT_MAX - ((100 * (100 - u) * 100) / (100 + u));
+}
+
+/*
+ * Pick an LFS victim from the victim index instead of scanning the dirty
+ * segmap.  Buckets are visited from the fewest valid blocks up and only
+ * the oldest usable section of each is costed, so greedy stops at the
+ * first one found, and cost-benefit stops once no section with more valid
+ * blocks could beat the best cost so far, however old it is.  Background
+ * GC leaves young sections alone when age separation is enabled, since
+ * their remaining blocks are likely to be invalidated by the user anyway.
+ */
+static void get_victim_from_index(struct f2fs_sb_info *sbi, int gc_type,
+						struct victim_sel_policy *p)
+{
+	struct dirty_seglist_info *dirty_i = DIRTY_I(sbi);
+	struct victim_index *vi = &dirty_i->victim_index;
+	unsigned int bucket, nsearched = 0;
+
+	spin_lock(&vi->lock);
+	for_each_set_bit(bucket, vi->bucket_map, vi->nr_buckets) {
+		struct list_head *pos;
+
+		if (list_empty(&vi->buckets[bucket])) {
+			__clear_bit(bucket, vi->bucket_map);
+			continue;
+		}
+
+		if (p->gc_mode == GC_CB &&
+				p->min_cost <= get_cb_min_cost(sbi, bucket))
+			break;
+
+		list_for_each(pos, &vi->buckets[bucket]) {
+			unsigned int secno = pos - vi->sec_list;
+			unsigned int segno = secno * sbi->segs_per_sec;
+			unsigned int cost;
+
+			if (nsearched++ >= p->max_search)
+				goto out;
+			if (sec_usage_check(sbi, secno))
+				continue;
+			if (gc_type == BG_GC &&
+					test_bit(secno, dirty_i->victim_secmap))
+				continue;
+			if (find_next_bit(p->dirty_segmap, segno + p->ofs_unit,
+						segno) >= segno + p->ofs_unit)
+				continue;
+
+			/* the rest of this bucket is younger still */
+			if (gc_type == BG_GC && is_young_section(sbi, segno))
+				break;
+
+			cost = get_gc_cost(sbi, segno, p);
+			if (p->min_cost > cost) {
+				p->min_segno = segno;
+				p->min_cost = cost;
+			}
+			break;
+		}
+
+		if (p->gc_mode == GC_GREEDY && p->min_segno != NULL_SEGNO)
+			break;
+	}
+out:
+	spin_unlock(&vi->lock);
+}
+
 static unsigned int count_bits(const unsigned long *addr,
 				unsigned int offset, unsigned int len)
 {
@@ -273,6 +347,7 @@ static int get_victim_by_default(struct f2fs_sb_info *sbi,
 	unsigned int secno, max_cost, last_victim;
 	unsigned int last_segment = MAIN_SEGS(sbi);
 	unsigned int nsearched = 0;
+	ktime_t start = ktime_get();
 
 	mutex_lock(&dirty_i->seglist_lock);
 
@@ -292,6 +367,11 @@ static int get_victim_by_default(struct f2fs_sb_info *sbi,
 			goto got_it;
 	}
 
+	if (p.alloc_mode == LFS) {
+		get_victim_from_index(sbi, gc_type, &p);
+		goto found;
+	}
+
 	while (1) {
 		unsigned long cost;
 		unsigned int segno;
@@ -340,6 +420,7 @@ next:
 			break;
 		}
 	}
+found:
 	if (p.min_segno != NULL_SEGNO) {
 got_it:
 		if (p.alloc_mode == LFS) {
@@ -356,6 +437,7 @@ got_it:
 				prefree_segments(sbi), free_segments(sbi));
 	}
 out:
+	stat_inc_victim_time(sbi, ktime_to_ns(ktime_sub(ktime_get(), start)));
 	mutex_unlock(&dirty_i->seglist_lock);
 
 	return (p.min_segno == NULL_SEGNO) ? 0 : 1;
@@ -440,13 +522,14 @@ next_step:
 
 		/* stop BG_GC if there is not enough free sections. */
 		if (gc_type == BG_GC && has_not_enough_free_secs(sbi, 0))
-			return;
+			goto out;
 
 		if (check_valid_map(sbi, segno, off) == 0)
 			continue;
 
+		/* the valid node blocks of the segment go out as merged bios */
 		if (initial) {
-			ra_node_page(sbi, nid);
+			ra_node_page(sbi, nid, true);
 			continue;
 		}
 		node_page = get_node_page(sbi, nid);
@@ -479,8 +562,13 @@ next_step:
 
 	if (initial) {
 		initial = false;
+		f2fs_submit_merged_bio(sbi, NODE, READ);
 		goto next_step;
 	}
+	return;
+out:
+	if (initial)
+		f2fs_submit_merged_bio(sbi, NODE, READ);
 }
 
 /*
@@ -541,7 +629,8 @@ static bool is_alive(struct f2fs_sb_info *sbi, struct f2fs_summary *sum,
 	return true;
 }
 
-static void move_encrypted_block(struct inode *inode, block_t bidx)
+static void move_encrypted_block(struct inode *inode, block_t bidx,
+								bool young)
 {
 	struct f2fs_io_info fio = {
 		.sbi = F2FS_I_SB(inode),
@@ -554,6 +643,7 @@ static void move_encrypted_block(struct inode *inode, block_t bidx)
 	struct node_info ni;
 	struct page *page;
 	block_t newaddr;
+	int seg_type;
 	int err;
 
 	/* do not read out */
@@ -584,8 +674,9 @@ static void move_encrypted_block(struct inode *inode, block_t bidx)
 	fio.page = page;
 	fio.new_blkaddr = fio.old_blkaddr = dn.data_blkaddr;
 
-	allocate_data_block(fio.sbi, NULL, fio.old_blkaddr, &newaddr,
-							&sum, CURSEG_COLD_DATA);
+	seg_type = young ? CURSEG_WARM_DATA : CURSEG_COLD_DATA;
+	allocate_data_block(fio.sbi, NULL, fio.old_blkaddr, &newaddr, &sum,
+								seg_type);
 
 	fio.encrypted_page = f2fs_grab_cache_page(META_MAPPING(fio.sbi),
 							newaddr, true);
@@ -622,6 +713,7 @@ static void move_encrypted_block(struct inode *inode, block_t bidx)
 
 	fio.rw = WRITE_SYNC;
 	fio.new_blkaddr = newaddr;
+	fio.hint = f2fs_rw_hint(seg_type);
 	f2fs_submit_page_mbio(&fio);
 
 	f2fs_update_data_blkaddr(&dn, newaddr);
@@ -640,7 +732,8 @@ out:
 	f2fs_put_page(page, 1);
 }
 
-static void move_data_page(struct inode *inode, block_t bidx, int gc_type)
+static void move_data_page(struct inode *inode, block_t bidx, int gc_type,
+								bool young)
 {
 	struct page *page;
 
@@ -648,7 +741,12 @@ static void move_data_page(struct inode *inode, block_t bidx, int gc_type)
 	if (IS_ERR(page))
 		return;
 
-	if (gc_type == BG_GC) {
+	/*
+	 * The cold flag is what keeps writeback from updating a moved block
+	 * in place, but it also selects the cold log, so young blocks cannot
+	 * be left to writeback and are written here with fio.young instead.
+	 */
+	if (gc_type == BG_GC && !young) {
 		if (PageWriteback(page))
 			goto out;
 		set_page_dirty(page);
@@ -660,6 +758,7 @@ static void move_data_page(struct inode *inode, block_t bidx, int gc_type)
 			.rw = WRITE_SYNC,
 			.page = page,
 			.encrypted_page = NULL,
+			.young = young,
 		};
 		set_page_dirty(page);
 		f2fs_wait_on_page_writeback(page, DATA, true);
@@ -676,7 +775,8 @@ out:
 /*
  * This function tries to get parent node of victim data block, and identifies
  * data block validity. If the block is valid, copy that with cold status and
- * modify parent node.
+ * modify parent node. Blocks of a young segment are copied to the warm log
+ * instead, see is_young_section().
  * If the parent node is not valid or the data block address is different,
  * the victim data block is ignored.
  */
@@ -688,6 +788,7 @@ static void gc_data_segment(struct f2fs_sb_info *sbi, struct f2fs_summary *sum,
 	block_t start_addr;
 	int off;
 	int phase = 0;
+	bool young = is_young_section(sbi, segno);
 
 	start_addr = START_BLOCK(sbi, segno);
 
@@ -703,13 +804,13 @@ next_step:
 
 		/* stop BG_GC if there is not enough free sections. */
 		if (gc_type == BG_GC && has_not_enough_free_secs(sbi, 0))
-			return;
+			goto out;
 
 		if (check_valid_map(sbi, segno, off) == 0)
 			continue;
 
 		if (phase == 0) {
-			ra_node_page(sbi, le32_to_cpu(entry->nid));
+			ra_node_page(sbi, le32_to_cpu(entry->nid), true);
 			continue;
 		}
 
@@ -717,8 +818,9 @@ next_step:
 		if (!is_alive(sbi, entry, &dni, start_addr + off, &nofs))
 			continue;
 
+		/* is_alive() reads node pages, so no merging here */
 		if (phase == 1) {
-			ra_node_page(sbi, dni.ino);
+			ra_node_page(sbi, dni.ino, false);
 			continue;
 		}
 
@@ -755,15 +857,23 @@ next_step:
 			start_bidx = start_bidx_of_node(nofs, inode)
 								+ ofs_in_node;
 			if (f2fs_encrypted_inode(inode) && S_ISREG(inode->i_mode))
-				move_encrypted_block(inode, start_bidx);
+				move_encrypted_block(inode, start_bidx, young);
 			else
-				move_data_page(inode, start_bidx, gc_type);
+				move_data_page(inode, start_bidx, gc_type,
+								young);
 			stat_inc_data_blk_count(sbi, 1, gc_type);
+			stat_inc_data_age_count(sbi, young);
 		}
 	}
 
+	if (phase == 0)
+		f2fs_submit_merged_bio(sbi, NODE, READ);
 	if (++phase < 4)
 		goto next_step;
+	return;
+out:
+	if (phase == 0)
+		f2fs_submit_merged_bio(sbi, NODE, READ);
 }
 
 static int __get_victim(struct f2fs_sb_info *sbi, unsigned int *victim,
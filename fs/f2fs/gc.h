@@ -22,6 +22,9 @@
 /* Search max. number of dirty segments to select a victim segment */
 #define DEF_MAX_VICTIM_SEARCH 4096 /* covers 8GB */
 
+/* age separation of GC migrated data, in seconds, 0 is off */
+#define DEF_GC_AGE_THRESHOLD	0
+
 struct f2fs_gc_kthread {
 	struct task_struct *f2fs_gc_task;
 	wait_queue_head_t gc_wait_queue_head;
@@ -86,6 +89,20 @@ static inline void decrease_sleep_time(struct f2fs_gc_kthread *gc_th,
 		*wait = gc_th->min_sleep_time;
 }
 
+/*
+ * Age separation needs the warm and cold data logs of the six log layout,
+ * young data is migrated to the warm log along with fresh user writes and
+ * only old data goes to the cold log.
+ */
+static inline bool is_young_section(struct f2fs_sb_info *sbi,
+						unsigned int segno)
+{
+	if (!sbi->gc_age_threshold || sbi->active_logs != NR_CURSEG_TYPE)
+		return false;
+	return get_sec_mtime(sbi, segno) + sbi->gc_age_threshold >
+							get_mtime(sbi);
+}
+
 static inline bool has_enough_invalid_blocks(struct f2fs_sb_info *sbi)
 {
 	block_t invalid_user_blocks = sbi->user_block_count -
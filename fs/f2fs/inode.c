@@ -336,6 +336,7 @@ void f2fs_evict_inode(struct inode *inode)
 	remove_dirty_inode(inode);
 
 	f2fs_destroy_extent_tree(inode);
+	f2fs_drop_dir_index(inode);
 
 	if (inode->i_nlink || is_bad_inode(inode))
 		goto no_delete;
@@ -84,6 +84,55 @@ fail:
 	return ERR_PTR(err);
 }
 
+/*
+ * Create an unlinked regular file to hold the spilled pages of an atomic
+ * write.  It is put on the orphan list right away, so orphan recovery frees
+ * its blocks if we crash before the transaction is committed.
+ */
+struct inode *f2fs_new_cow_inode(struct inode *dir)
+{
+	struct f2fs_sb_info *sbi = F2FS_I_SB(dir);
+	struct inode *inode;
+	int err;
+
+	inode = f2fs_new_inode(dir, S_IFREG);
+	if (IS_ERR(inode))
+		return inode;
+
+	inode->i_op = &f2fs_file_inode_operations;
+	inode->i_fop = &f2fs_file_operations;
+	inode->i_mapping->a_ops = &f2fs_dblock_aops;
+
+	/* spilled pages are addressed by their index in the atomic file */
+	if (f2fs_has_inline_data(inode)) {
+		stat_dec_inline_inode(inode);
+		clear_inode_flag(F2FS_I(inode), FI_INLINE_DATA);
+	}
+
+	f2fs_lock_op(sbi);
+	err = acquire_orphan_inode(sbi);
+	if (err)
+		goto out;
+
+	err = f2fs_do_tmpfile(inode, dir);
+	if (err) {
+		release_orphan_inode(sbi);
+		goto out;
+	}
+	add_orphan_inode(sbi, inode->i_ino);
+	f2fs_unlock_op(sbi);
+
+	alloc_nid_done(sbi, inode->i_ino);
+
+	clear_nlink(inode);
+	mark_inode_dirty(inode);
+	unlock_new_inode(inode);
+	return inode;
+out:
+	handle_failed_inode(inode);
+	return ERR_PTR(err);
+}
+
 static int is_multimedia_file(const unsigned char *s, const char *sub)
 {
 	size_t slen = strlen(s);
@@ -28,6 +28,12 @@ static struct kmem_cache *nat_entry_slab;
 static struct kmem_cache *free_nid_slab;
 static struct kmem_cache *nat_entry_set_slab;
 
+/* a fixed ram_budget is split evenly between nat and free nid caches */
+static unsigned long ram_budget_bytes(struct f2fs_nm_info *nm_i)
+{
+	return ((unsigned long)nm_i->ram_budget << 10) >> 1;
+}
+
 bool available_free_memory(struct f2fs_sb_info *sbi, int type)
 {
 	struct f2fs_nm_info *nm_i = NM_I(sbi);
@@ -42,8 +48,16 @@ bool available_free_memory(struct f2fs_sb_info *sbi, int type)
 	avail_ram = val.totalram - val.totalhigh;
 
 	/*
-	 * give 25%, 25%, 50%, 50%, 50% memory for each components respectively
+	 * give 25%, 25%, 50%, 50%, 50%, 25% memory for each components
+	 * respectively
 	 */
+	if (nm_i->ram_budget && type == FREE_NIDS)
+		return nm_i->fcnt * sizeof(struct free_nid) <
+						ram_budget_bytes(nm_i);
+	if (nm_i->ram_budget && type == NAT_ENTRIES)
+		return nm_i->nat_cnt * sizeof(struct nat_entry) <
+						ram_budget_bytes(nm_i);
+
 	if (type == FREE_NIDS) {
 		mem_size = (nm_i->fcnt * sizeof(struct free_nid)) >>
 							PAGE_CACHE_SHIFT;
@@ -70,6 +84,14 @@ bool available_free_memory(struct f2fs_sb_info *sbi, int type)
 				atomic_read(&sbi->total_ext_node) *
 				sizeof(struct extent_node)) >> PAGE_CACHE_SHIFT;
 		res = mem_size < ((avail_ram * nm_i->ram_thresh / 100) >> 1);
+	} else if (type == DIR_INDEX) {
+		mem_size = (atomic_read(&sbi->total_dir_index) *
+				sizeof(struct dir_index) +
+				atomic_read(&sbi->total_dir_index_bucket) *
+				sizeof(struct hlist_head) +
+				atomic_read(&sbi->total_dir_index_entry) *
+				sizeof(struct dir_index_entry)) >> PAGE_CACHE_SHIFT;
+		res = mem_size < ((avail_ram * nm_i->ram_thresh / 100) >> 2);
 	} else {
 		if (!sbi->sb->s_bdi->dirty_exceeded)
 			return true;
@@ -333,14 +355,14 @@ static void set_node_addr(struct f2fs_sb_info *sbi, struct node_info *ni,
 	up_write(&nm_i->nat_tree_lock);
 }
 
-int try_to_free_nats(struct f2fs_sb_info *sbi, int nr_shrink)
+/*
+ * Clean nat entries are kept in lru order, the least recently used one at
+ * the head of nat_entries.
+ */
+static int __free_nat_entries(struct f2fs_nm_info *nm_i, int nr_shrink)
 {
-	struct f2fs_nm_info *nm_i = NM_I(sbi);
 	int nr = nr_shrink;
 
-	if (!down_write_trylock(&nm_i->nat_tree_lock))
-		return 0;
-
 	while (nr_shrink && !list_empty(&nm_i->nat_entries)) {
 		struct nat_entry *ne;
 		ne = list_first_entry(&nm_i->nat_entries,
@@ -348,10 +370,57 @@ int try_to_free_nats(struct f2fs_sb_info *sbi, int nr_shrink)
 		__del_from_nat_cache(nm_i, ne);
 		nr_shrink--;
 	}
-	up_write(&nm_i->nat_tree_lock);
 	return nr - nr_shrink;
 }
 
+int try_to_free_nats(struct f2fs_sb_info *sbi, int nr_shrink)
+{
+	struct f2fs_nm_info *nm_i = NM_I(sbi);
+	int nr;
+
+	if (!down_write_trylock(&nm_i->nat_tree_lock))
+		return 0;
+
+	nr = __free_nat_entries(nm_i, nr_shrink);
+	up_write(&nm_i->nat_tree_lock);
+	return nr;
+}
+
+/* evict clean nat entries beyond ram_budget, caller holds nat_tree_lock */
+static void __balance_nat_cache(struct f2fs_nm_info *nm_i)
+{
+	unsigned int max_cnt;
+
+	if (!nm_i->ram_budget)
+		return;
+
+	max_cnt = ram_budget_bytes(nm_i) / sizeof(struct nat_entry);
+	if (nm_i->nat_cnt > max_cnt)
+		__free_nat_entries(nm_i, nm_i->nat_cnt - max_cnt);
+}
+
+/*
+ * On a nat cache miss, read the neighbouring nat blocks as well, since
+ * nids allocated together tend to be looked up together.
+ */
+static void ra_nat_pages(struct f2fs_sb_info *sbi, nid_t nid)
+{
+	struct f2fs_nm_info *nm_i = NM_I(sbi);
+	struct page *page;
+	bool readahead;
+
+	if (nm_i->ra_nat_pages <= 1)
+		return;
+
+	page = find_get_page(META_MAPPING(sbi), current_nat_addr(sbi, nid));
+	readahead = !page || !PageUptodate(page);
+	f2fs_put_page(page, 0);
+
+	if (readahead)
+		ra_meta_pages(sbi, NAT_BLOCK_OFFSET(nid), nm_i->ra_nat_pages,
+							META_NAT, true);
+}
+
 /*
  * This function always returns success
  */
@@ -372,10 +441,21 @@ void get_node_info(struct f2fs_sb_info *sbi, nid_t nid, struct node_info *ni)
 	/* Check nat cache */
 	down_read(&nm_i->nat_tree_lock);
 	e = __lookup_nat_cache(nm_i, nid);
+	stat_inc_nat_lookup(sbi, e);
 	if (e) {
 		ni->ino = nat_get_ino(e);
 		ni->blk_addr = nat_get_blkaddr(e);
 		ni->version = nat_get_version(e);
+
+		/*
+		 * Writers hold nat_tree_lock exclusively, so nat_list_lock
+		 * only has to serialize readers moving entries here.
+		 */
+		if (!get_nat_flag(e, IS_DIRTY)) {
+			spin_lock(&nm_i->nat_list_lock);
+			list_move_tail(&e->list, &nm_i->nat_entries);
+			spin_unlock(&nm_i->nat_list_lock);
+		}
 		up_read(&nm_i->nat_tree_lock);
 		return;
 	}
@@ -394,6 +474,7 @@ void get_node_info(struct f2fs_sb_info *sbi, nid_t nid, struct node_info *ni)
 		goto cache;
 
 	/* Fill node_info from nat page */
+	ra_nat_pages(sbi, start_nid);
 	page = get_current_nat_page(sbi, start_nid);
 	nat_blk = (struct f2fs_nat_block *)page_address(page);
 	ne = nat_blk->entries[nid - start_nid];
@@ -404,6 +485,7 @@ cache:
 	/* cache nat entry */
 	down_write(&nm_i->nat_tree_lock);
 	cache_nat_entry(sbi, nid, &ne);
+	__balance_nat_cache(nm_i);
 	up_write(&nm_i->nat_tree_lock);
 }
 
@@ -579,7 +661,7 @@ int get_dnode_of_data(struct dnode_of_data *dn, pgoff_t index, int mode)
 			set_nid(parent, offset[i - 1], nids[i], i == 1);
 			alloc_nid_done(sbi, nids[i]);
 			done = true;
-		} else if (mode == LOOKUP_NODE_RA && i == level && level > 1) {
+		} else if (mode == LOOKUP_NODE_RA && i == level) {
 			npage[i] = get_node_page_ra(parent, offset[i - 1]);
 			if (IS_ERR(npage[i])) {
 				err = PTR_ERR(npage[i]);
@@ -1069,13 +1151,22 @@ static int read_node_page(struct page *page, int rw)
 		return LOCKED_PAGE;
 
 	fio.new_blkaddr = fio.old_blkaddr = ni.blk_addr;
+
+	/* readahead goes through the merged read bio */
+	if (rw == READA) {
+		f2fs_submit_page_mbio(&fio);
+		return 0;
+	}
 	return f2fs_submit_page_bio(&fio);
 }
 
 /*
- * Readahead a node page
+ * Readahead a node page.  With @merge, the read is left in the merged read
+ * bio so that neighbouring node blocks go out as one bio; the caller has to
+ * call f2fs_submit_merged_bio(sbi, NODE, READ) before it waits on any node
+ * page.
  */
-void ra_node_page(struct f2fs_sb_info *sbi, nid_t nid)
+void ra_node_page(struct f2fs_sb_info *sbi, nid_t nid, bool merge)
 {
 	struct page *apage;
 	int err;
@@ -1091,12 +1182,16 @@ void ra_node_page(struct f2fs_sb_info *sbi, nid_t nid)
 	}
 	f2fs_put_page(apage, 0);
 
-	apage = grab_cache_page(NODE_MAPPING(sbi), nid);
+	/* a locked page is being read or written already */
+	apage = grab_cache_page_nowait(NODE_MAPPING(sbi), nid);
 	if (!apage)
 		return;
 
 	err = read_node_page(apage, READA);
 	f2fs_put_page(apage, err ? 1 : 0);
+
+	if (!merge)
+		f2fs_submit_merged_bio(sbi, NODE, READ);
 }
 
 /*
@@ -1106,18 +1201,23 @@ void ra_node_pages(struct page *parent, int start)
 {
 	struct f2fs_sb_info *sbi = F2FS_P_SB(parent);
 	struct blk_plug plug;
+	bool inode = IS_INODE(parent);
 	int i, end;
 	nid_t nid;
 
 	blk_start_plug(&plug);
 
-	/* Then, try readahead for siblings of the desired node */
+	/*
+	 * Then, try readahead for siblings of the desired node.  For the
+	 * direct nodes of an inode, this picks up the indirect nodes too.
+	 */
 	end = start + MAX_RA_NODE;
-	end = min(end, NIDS_PER_BLOCK);
+	end = min(end, inode ? NODE_DIND_BLOCK + 1 : NIDS_PER_BLOCK);
 	for (i = start; i < end; i++) {
-		nid = get_nid(parent, i, false);
-		ra_node_page(sbi, nid);
+		nid = get_nid(parent, i, inode);
+		ra_node_page(sbi, nid, true);
 	}
+	f2fs_submit_merged_bio(sbi, NODE, READ);
 	blk_finish_plug(&plug);
 }
 
@@ -1170,7 +1270,7 @@ struct page *get_node_page(struct f2fs_sb_info *sbi, pgoff_t nid)
 struct page *get_node_page_ra(struct page *parent, int start)
 {
 	struct f2fs_sb_info *sbi = F2FS_P_SB(parent);
-	nid_t nid = get_nid(parent, start, false);
+	nid_t nid = get_nid(parent, start, IS_INODE(parent));
 
 	return __get_node_page(sbi, nid, parent, start);
 }
@@ -1700,9 +1800,11 @@ retry:
 		i->state = NID_ALLOC;
 		nm_i->fcnt--;
 		spin_unlock(&nm_i->free_nid_list_lock);
+		stat_inc_fnid_lookup(sbi, true);
 		return true;
 	}
 	spin_unlock(&nm_i->free_nid_list_lock);
+	stat_inc_fnid_lookup(sbi, false);
 
 	/* Let's scan nat pages and its caches to get free nids */
 	mutex_lock(&nm_i->build_lock);
@@ -2098,7 +2200,9 @@ static int init_node_manager(struct f2fs_sb_info *sbi)
 	nm_i->fcnt = 0;
 	nm_i->nat_cnt = 0;
 	nm_i->ram_thresh = DEF_RAM_THRESHOLD;
+	nm_i->ram_budget = DEF_RAM_BUDGET;
 	nm_i->ra_nid_pages = DEF_RA_NID_PAGES;
+	nm_i->ra_nat_pages = DEF_RA_NAT_PAGES;
 	nm_i->dirty_nats_ratio = DEF_DIRTY_NAT_RATIO_THRESHOLD;
 
 	INIT_RADIX_TREE(&nm_i->free_nid_root, GFP_ATOMIC);
@@ -2109,6 +2213,7 @@ static int init_node_manager(struct f2fs_sb_info *sbi)
 
 	mutex_init(&nm_i->build_lock);
 	spin_lock_init(&nm_i->free_nid_list_lock);
+	spin_lock_init(&nm_i->nat_list_lock);
 	init_rwsem(&nm_i->nat_tree_lock);
 
 	nm_i->next_scan_nid = le32_to_cpu(sbi->ckpt->next_free_nid);
@@ -25,6 +25,11 @@
 /* control the memory footprint threshold (10MB per 1GB ram) */
 #define DEF_RAM_THRESHOLD	10
 
+/* fixed memory budget in KB for nat and free nid caches (0: ram_thresh) */
+#define DEF_RAM_BUDGET		0
+
+#define DEF_RA_NAT_PAGES	4	/* # of nat pages readaheaded on a miss */
+
 /* control dirty nats ratio threshold (default: 10% over max nid count) */
 #define DEF_DIRTY_NAT_RATIO_THRESHOLD		10
 
@@ -132,6 +137,7 @@ enum mem_type {
 	DIRTY_DENTS,	/* indicates dirty dentry pages */
 	INO_ENTRIES,	/* indicates inode entries */
 	EXTENT_CACHE,	/* indicates extent cache */
+	DIR_INDEX,	/* indicates directory hash index */
 	BASE_CHECK,	/* check kernel status */
 };
 
@@ -432,6 +432,20 @@ static int do_recover_data(struct f2fs_sb_info *sbi, struct inode *inode,
 		if (src == dest)
 			continue;
 
+		/* the marker of a compressed cluster owns no block */
+		if (src == COMPRESS_ADDR) {
+			dn.data_blkaddr = NULL_ADDR;
+			set_data_blkaddr(&dn);
+			src = NULL_ADDR;
+		}
+
+		if (dest == COMPRESS_ADDR) {
+			truncate_data_blocks_range(&dn, 1);
+			dn.data_blkaddr = COMPRESS_ADDR;
+			set_data_blkaddr(&dn);
+			continue;
+		}
+
 		/* dest is invalid, just invalidate src block */
 		if (dest == NULL_ADDR) {
 			truncate_data_blocks_range(&dn, 1);
@@ -14,8 +14,10 @@
 #include <linux/blkdev.h>
 #include <linux/prefetch.h>
 #include <linux/kthread.h>
+#include <linux/freezer.h>
 #include <linux/swap.h>
 #include <linux/timer.h>
+#include <linux/sort.h>
 
 #include "f2fs.h"
 #include "segment.h"
@@ -26,6 +28,7 @@
 #define __reverse_ffz(x) __reverse_ffs(~(x))
 
 static struct kmem_cache *discard_entry_slab;
+static struct kmem_cache *discard_cmd_slab;
 static struct kmem_cache *sit_entry_set_slab;
 static struct kmem_cache *inmem_entry_slab;
 
@@ -238,6 +241,7 @@ void register_inmem_page(struct inode *inode, struct page *page)
 
 	/* add atomic page indices to the list */
 	new->page = page;
+	new->index = page->index;
 	INIT_LIST_HEAD(&new->list);
 
 	/* increase reference count with clean state */
@@ -294,13 +298,348 @@ next:
 	return err;
 }
 
+/*
+ * Forget the spilled pages.  Returns the cow inode, which the caller has
+ * to iput() without holding f2fs_lock_op(); being an orphan, it frees the
+ * blocks that still belong to it on eviction.
+ */
+static struct inode *__drop_spilled_pages(struct inode *inode)
+{
+	struct f2fs_inode_info *fi = F2FS_I(inode);
+	struct inode *cow = fi->cow_inode;
+	struct inmem_pages *cur, *tmp;
+
+	list_for_each_entry_safe(cur, tmp, &fi->inmem_spilled, list) {
+		list_del(&cur->list);
+		kmem_cache_free(inmem_entry_slab, cur);
+		dec_page_count(F2FS_I_SB(inode), F2FS_INMEM_SPILLED);
+	}
+	fi->cow_inode = NULL;
+	return cow;
+}
+
 void drop_inmem_pages(struct inode *inode)
 {
 	struct f2fs_inode_info *fi = F2FS_I(inode);
+	struct inode *cow;
 
 	mutex_lock(&fi->inmem_lock);
 	__revoke_inmem_pages(inode, &fi->inmem_pages, true, false);
+	cow = __drop_spilled_pages(inode);
+	mutex_unlock(&fi->inmem_lock);
+
+	if (cow)
+		iput(cow);
+}
+
+/*
+ * Once the in-memory pages of all atomic files go over inmem_budget, write
+ * the oldest ones of @inode to its cow inode so that they can be reclaimed.
+ * The block pointers of @inode stay untouched until commit_inmem_pages()
+ * switches them to the spilled blocks.
+ */
+void spill_inmem_pages(struct inode *inode, struct inode *dir)
+{
+	struct f2fs_sb_info *sbi = F2FS_I_SB(inode);
+	struct f2fs_inode_info *fi = F2FS_I(inode);
+	struct inmem_pages *cur, *tmp;
+	struct f2fs_io_info fio = {
+		.sbi = sbi,
+		.type = DATA,
+		.rw = WRITE,
+		.encrypted_page = NULL,
+	};
+	bool submit_bio = false;
+
+	if (!sbi->inmem_budget ||
+			get_pages(sbi, F2FS_INMEM_PAGES) <= sbi->inmem_budget)
+		return;
+
+	/* spilled blocks would have to be encrypted as well */
+	if (f2fs_encrypted_inode(inode))
+		return;
+
+	if (!fi->cow_inode) {
+		struct inode *cow = f2fs_new_cow_inode(dir);
+
+		/* keep the pages in memory then */
+		if (IS_ERR(cow))
+			return;
+
+		mutex_lock(&fi->inmem_lock);
+		fi->cow_inode = cow;
+		mutex_unlock(&fi->inmem_lock);
+	}
+
+	f2fs_balance_fs(sbi, true);
+	f2fs_lock_op(sbi);
+
+	mutex_lock(&fi->inmem_lock);
+	list_for_each_entry_safe(cur, tmp, &fi->inmem_pages, list) {
+		struct page *page = cur->page;
+		struct page *cpage;
+		struct dnode_of_data dn;
+		int err;
+
+		if (get_pages(sbi, F2FS_INMEM_PAGES) <= sbi->inmem_budget)
+			break;
+
+		/* register_inmem_page() locks the page before inmem_lock */
+		if (!trylock_page(page))
+			continue;
+
+		/* truncated pages are dropped at commit */
+		if (page->mapping != inode->i_mapping) {
+			unlock_page(page);
+			continue;
+		}
+
+		/*
+		 * Write through the page cache of the cow inode.  GC may have
+		 * read an older spilled copy of this index in there, and left
+		 * alone, that copy would later be written back over this one.
+		 */
+		cpage = f2fs_grab_cache_page(fi->cow_inode->i_mapping,
+							page->index, false);
+		if (!cpage) {
+			unlock_page(page);
+			break;
+		}
+		f2fs_wait_on_page_writeback(cpage, DATA, true);
+		if (clear_page_dirty_for_io(cpage))
+			inode_dec_dirty_pages(fi->cow_inode);
+		copy_highpage(cpage, page);
+		SetPageUptodate(cpage);
+
+		set_new_dnode(&dn, fi->cow_inode, NULL, NULL, 0);
+		err = get_dnode_of_data(&dn, page->index, ALLOC_NODE);
+		if (!err && dn.data_blkaddr == NULL_ADDR) {
+			err = reserve_new_block(&dn);
+			if (err)
+				f2fs_put_dnode(&dn);
+		}
+		if (err) {
+			f2fs_put_page(cpage, 1);
+			unlock_page(page);
+			break;
+		}
+
+		trace_f2fs_commit_inmem_page(page, INMEM_SPILL);
+
+		fio.page = cpage;
+		fio.old_blkaddr = dn.data_blkaddr;
+		set_page_writeback(cpage);
+		write_data_page(&dn, &fio);
+		f2fs_put_dnode(&dn);
+		f2fs_put_page(cpage, 1);
+		submit_bio = true;
+
+		/* writeback skips cow pages beyond i_size, e.g. moved by GC */
+		if (i_size_read(fi->cow_inode) <= page_offset(page)) {
+			i_size_write(fi->cow_inode,
+				page_offset(page) + PAGE_CACHE_SIZE);
+			mark_inode_dirty(fi->cow_inode);
+		}
+
+		/* the page is clean now and may be reclaimed */
+		set_page_private(page, 0);
+		ClearPagePrivate(page);
+		f2fs_put_page(page, 1);
+
+		cur->page = NULL;
+		list_move_tail(&cur->list, &fi->inmem_spilled);
+		dec_page_count(sbi, F2FS_INMEM_PAGES);
+		inc_page_count(sbi, F2FS_INMEM_SPILLED);
+	}
+	mutex_unlock(&fi->inmem_lock);
+
+	f2fs_unlock_op(sbi);
+
+	if (submit_bio)
+		f2fs_submit_merged_bio_cond(sbi, fi->cow_inode, NULL, 0,
+								DATA, WRITE);
+}
+
+/*
+ * Returns the block a spilled page of @inode was written to, or NULL_ADDR.
+ * Reads have to prefer it over the block in the dnode of @inode until the
+ * transaction is committed.  The caller must not hold the lock of a page
+ * registered by register_inmem_page().
+ */
+block_t lookup_spilled_block(struct inode *inode, pgoff_t index)
+{
+	struct f2fs_inode_info *fi = F2FS_I(inode);
+	struct dnode_of_data dn;
+	block_t blkaddr = NULL_ADDR;
+
+	if (!fi->cow_inode)
+		return NULL_ADDR;
+
+	mutex_lock(&fi->inmem_lock);
+	if (fi->cow_inode) {
+		set_new_dnode(&dn, fi->cow_inode, NULL, NULL, 0);
+		if (!get_dnode_of_data(&dn, index, LOOKUP_NODE)) {
+			blkaddr = dn.data_blkaddr;
+			f2fs_put_dnode(&dn);
+		}
+	}
+	mutex_unlock(&fi->inmem_lock);
+
+	return blkaddr == NEW_ADDR ? NULL_ADDR : blkaddr;
+}
+
+/* Drop the spilled pages beyond @from when the atomic file shrinks. */
+int truncate_spilled_pages(struct inode *inode, u64 from)
+{
+	struct f2fs_inode_info *fi = F2FS_I(inode);
+	struct inode *cow;
+	int err = 0;
+
+	mutex_lock(&fi->inmem_lock);
+	cow = fi->cow_inode;
+	if (cow)
+		ihold(cow);
 	mutex_unlock(&fi->inmem_lock);
+
+	if (!cow)
+		return 0;
+
+	if (i_size_read(cow) > from) {
+		truncate_setsize(cow, from);
+		err = truncate_blocks(cow, from, true);
+	}
+	iput(cow);
+	return err;
+}
+
+/* Put back the block pointer of @inode that __commit_spilled_pages() moved. */
+static int __revert_spilled_page(struct inode *inode, struct inmem_pages *cur)
+{
+	struct f2fs_sb_info *sbi = F2FS_I_SB(inode);
+	struct dnode_of_data dn;
+	struct node_info ni;
+
+	set_new_dnode(&dn, inode, NULL, NULL, 0);
+	if (get_dnode_of_data(&dn, cur->index, LOOKUP_NODE))
+		return -EAGAIN;
+
+	if (cur->old_addr == NULL_ADDR || cur->old_addr == NEW_ADDR) {
+		invalidate_blocks(sbi, cur->new_addr);
+		f2fs_update_data_blkaddr(&dn, cur->old_addr);
+		if (cur->old_addr == NULL_ADDR) {
+			dec_valid_block_count(sbi, inode, 1);
+			mark_inode_dirty(inode);
+		}
+	} else {
+		get_node_info(sbi, dn.nid, &ni);
+		f2fs_replace_block(sbi, &dn, cur->new_addr, cur->old_addr,
+						ni.version, true, true);
+	}
+	f2fs_put_dnode(&dn);
+	return 0;
+}
+
+/*
+ * Move the spilled blocks from the cow inode over to @inode.  The dnodes of
+ * @inode are allocated and its new blocks reserved before any pointer is
+ * switched, and the switched ones are put back if a later one fails, so
+ * that either all spilled blocks are committed or none of them.  -EAGAIN
+ * means that putting them back failed as well.
+ *
+ * The cow dnode stays locked while the block pointer of @inode is switched,
+ * so that GC cannot move the block in between.
+ */
+static int __commit_spilled_pages(struct inode *inode)
+{
+	struct f2fs_sb_info *sbi = F2FS_I_SB(inode);
+	struct f2fs_inode_info *fi = F2FS_I(inode);
+	pgoff_t end = DIV_ROUND_UP(i_size_read(inode), PAGE_CACHE_SIZE);
+	struct inmem_pages *cur;
+	blkcnt_t reserved = 0;
+	int err = 0;
+
+	list_for_each_entry(cur, &fi->inmem_spilled, list) {
+		struct dnode_of_data dn;
+
+		cur->new_addr = NULL_ADDR;
+
+		/* truncated in the meantime, the cow inode frees it */
+		if (cur->index >= end)
+			continue;
+
+		set_new_dnode(&dn, inode, NULL, NULL, 0);
+		err = get_dnode_of_data(&dn, cur->index, ALLOC_NODE);
+		if (err)
+			return err;
+		if (dn.data_blkaddr == NULL_ADDR)
+			reserved++;
+		f2fs_put_dnode(&dn);
+	}
+
+	if (reserved) {
+		if (!inc_valid_block_count(sbi, inode, reserved))
+			return -ENOSPC;
+		mark_inode_dirty(inode);
+	}
+
+	list_for_each_entry(cur, &fi->inmem_spilled, list) {
+		struct dnode_of_data dn, cow_dn;
+		struct node_info ni;
+		block_t new_addr;
+
+		if (cur->index >= end)
+			continue;
+
+		set_new_dnode(&cow_dn, fi->cow_inode, NULL, NULL, 0);
+		err = get_dnode_of_data(&cow_dn, cur->index, LOOKUP_NODE);
+		if (err)
+			goto revert;
+
+		/* the same index may have been spilled twice */
+		new_addr = cow_dn.data_blkaddr;
+		if (new_addr == NULL_ADDR || new_addr == NEW_ADDR) {
+			f2fs_put_dnode(&cow_dn);
+			continue;
+		}
+
+		set_new_dnode(&dn, inode, NULL, NULL, 0);
+		err = get_dnode_of_data(&dn, cur->index, LOOKUP_NODE);
+		if (err) {
+			f2fs_put_dnode(&cow_dn);
+			goto revert;
+		}
+
+		/* the block is counted once, by @inode now */
+		dec_valid_block_count(sbi, fi->cow_inode, 1);
+		if (dn.data_blkaddr == NULL_ADDR)
+			reserved--;
+
+		cur->old_addr = dn.data_blkaddr;
+		cur->new_addr = new_addr;
+
+		get_node_info(sbi, dn.nid, &ni);
+		f2fs_replace_block(sbi, &dn, dn.data_blkaddr, new_addr,
+						ni.version, true, false);
+		f2fs_update_data_blkaddr(&cow_dn, NULL_ADDR);
+
+		f2fs_put_dnode(&dn);
+		f2fs_put_dnode(&cow_dn);
+	}
+	goto out;
+revert:
+	list_for_each_entry(cur, &fi->inmem_spilled, list) {
+		if (cur->new_addr == NULL_ADDR)
+			continue;
+		if (__revert_spilled_page(inode, cur))
+			err = -EAGAIN;
+	}
+out:
+	/* duplicates reserved a block twice */
+	if (reserved) {
+		dec_valid_block_count(sbi, inode, reserved);
+		mark_inode_dirty(inode);
+	}
+	return err;
 }
 
 static int __commit_inmem_pages(struct inode *inode,
@@ -361,6 +700,7 @@ int commit_inmem_pages(struct inode *inode)
 	struct f2fs_sb_info *sbi = F2FS_I_SB(inode);
 	struct f2fs_inode_info *fi = F2FS_I(inode);
 	struct list_head revoke_list;
+	struct inode *cow = NULL;
 	int err;
 
 	INIT_LIST_HEAD(&revoke_list);
@@ -368,6 +708,18 @@ int commit_inmem_pages(struct inode *inode)
 	f2fs_lock_op(sbi);
 
 	mutex_lock(&fi->inmem_lock);
+
+	/* spilled pages go first, in-memory pages may be newer copies */
+	if (fi->cow_inode) {
+		err = __commit_spilled_pages(inode);
+		cow = __drop_spilled_pages(inode);
+		if (err) {
+			__revoke_inmem_pages(inode, &fi->inmem_pages,
+								true, false);
+			goto out;
+		}
+	}
+
 	err = __commit_inmem_pages(inode, &revoke_list);
 	if (err) {
 		int ret;
@@ -386,9 +738,13 @@ int commit_inmem_pages(struct inode *inode)
 		/* drop all uncommitted pages */
 		__revoke_inmem_pages(inode, &fi->inmem_pages, true, false);
 	}
+out:
 	mutex_unlock(&fi->inmem_lock);
 
 	f2fs_unlock_op(sbi);
+
+	if (cow)
+		iput(cow);
 	return err;
 }
 
@@ -647,11 +1003,9 @@ static void locate_dirty_segment(struct f2fs_sb_info *sbi, unsigned int segno)
 	mutex_unlock(&dirty_i->seglist_lock);
 }
 
-static int f2fs_issue_discard(struct f2fs_sb_info *sbi,
+static void __mark_discarded(struct f2fs_sb_info *sbi,
 				block_t blkstart, block_t blklen)
 {
-	sector_t start = SECTOR_FROM_BLOCK(blkstart);
-	sector_t len = SECTOR_FROM_BLOCK(blklen);
 	struct seg_entry *se;
 	unsigned int offset;
 	block_t i;
@@ -663,10 +1017,329 @@ static int f2fs_issue_discard(struct f2fs_sb_info *sbi,
 		if (!f2fs_test_and_set_bit(offset, se->discard_map))
 			sbi->discard_blks--;
 	}
+}
+
+static int __issue_discard(struct f2fs_sb_info *sbi,
+				block_t blkstart, block_t blklen)
+{
+	sector_t start = SECTOR_FROM_BLOCK(blkstart);
+	sector_t len = SECTOR_FROM_BLOCK(blklen);
+
 	trace_f2fs_issue_discard(sbi->sb, blkstart, blklen);
 	return blkdev_issue_discard(sbi->sb->s_bdev, start, len, GFP_NOFS, 0);
 }
 
+static int f2fs_issue_discard(struct f2fs_sb_info *sbi,
+				block_t blkstart, block_t blklen)
+{
+	__mark_discarded(sbi, blkstart, blklen);
+	return __issue_discard(sbi, blkstart, blklen);
+}
+
+/*
+ * Find a pending range overlapping [start, end).  Ranges in the tree never
+ * overlap each other, so they are ordered by their end as well.
+ */
+static struct discard_cmd *__lookup_discard_cmd(
+			struct discard_cmd_control *dcc,
+			block_t start, block_t end)
+{
+	struct rb_node *node = dcc->root.rb_node;
+
+	while (node) {
+		struct discard_cmd *dc = rb_entry(node, struct discard_cmd,
+								rb_node);
+
+		if (dc->lstart + dc->len <= start)
+			node = node->rb_right;
+		else if (dc->lstart >= end)
+			node = node->rb_left;
+		else
+			return dc;
+	}
+	return NULL;
+}
+
+static void __insert_discard_cmd(struct discard_cmd_control *dcc,
+						struct discard_cmd *new)
+{
+	struct rb_node **p = &dcc->root.rb_node;
+	struct rb_node *parent = NULL;
+
+	while (*p) {
+		struct discard_cmd *dc;
+
+		parent = *p;
+		dc = rb_entry(parent, struct discard_cmd, rb_node);
+		if (new->lstart < dc->lstart)
+			p = &(*p)->rb_left;
+		else
+			p = &(*p)->rb_right;
+	}
+	rb_link_node(&new->rb_node, parent, p);
+	rb_insert_color(&new->rb_node, &dcc->root);
+	dcc->nr_pending++;
+}
+
+static void __remove_discard_cmd(struct discard_cmd_control *dcc,
+						struct discard_cmd *dc)
+{
+	rb_erase(&dc->rb_node, &dcc->root);
+	dcc->nr_pending--;
+}
+
+/*
+ * Queue blocks freed by a checkpoint for the discard thread.  The range is
+ * merged with any pending range it touches, so runs of prefree segments
+ * and small discards end up as single commands.
+ */
+static void f2fs_queue_discard(struct f2fs_sb_info *sbi,
+				block_t blkstart, block_t blklen)
+{
+	struct discard_cmd_control *dcc = SM_I(sbi)->dcc_info;
+	struct discard_cmd *new, *dc;
+	block_t end = blkstart + blklen;
+
+	if (!dcc) {
+		f2fs_issue_discard(sbi, blkstart, blklen);
+		return;
+	}
+
+	__mark_discarded(sbi, blkstart, blklen);
+
+	new = f2fs_kmem_cache_alloc(discard_cmd_slab, GFP_NOFS);
+
+	spin_lock(&dcc->discard_lock);
+	while ((dc = __lookup_discard_cmd(dcc, blkstart - 1, end + 1))) {
+		blkstart = min(blkstart, dc->lstart);
+		end = max(end, dc->lstart + dc->len);
+		__remove_discard_cmd(dcc, dc);
+		kmem_cache_free(discard_cmd_slab, dc);
+	}
+	new->lstart = blkstart;
+	new->len = end - blkstart;
+	__insert_discard_cmd(dcc, new);
+	dcc->discard_wake = 1;
+	spin_unlock(&dcc->discard_lock);
+
+	wake_up(&dcc->discard_wait_queue);
+}
+
+/*
+ * A block is about to be written at @blkaddr, which may have been freed by
+ * the last checkpoint with its discard still pending.  Drop the block from
+ * its pending range, or wait for the thread if it is discarding it now.
+ */
+static void f2fs_wait_discard(struct f2fs_sb_info *sbi, block_t blkaddr)
+{
+	struct discard_cmd_control *dcc = SM_I(sbi)->dcc_info;
+	struct discard_cmd *dc, *tail = NULL;
+
+	if (!dcc)
+		return;
+retry:
+	spin_lock(&dcc->discard_lock);
+	if (blkaddr >= dcc->issue_start &&
+			blkaddr < dcc->issue_start + dcc->issue_len) {
+		spin_unlock(&dcc->discard_lock);
+		wait_event(dcc->discard_done_queue,
+			blkaddr < dcc->issue_start ||
+			blkaddr >= dcc->issue_start + dcc->issue_len);
+		goto retry;
+	}
+
+	dc = __lookup_discard_cmd(dcc, blkaddr, blkaddr + 1);
+	if (!dc)
+		goto out;
+
+	if (dc->len == 1) {
+		__remove_discard_cmd(dcc, dc);
+		kmem_cache_free(discard_cmd_slab, dc);
+	} else if (blkaddr == dc->lstart) {
+		dc->lstart++;
+		dc->len--;
+	} else if (blkaddr == dc->lstart + dc->len - 1) {
+		dc->len--;
+	} else {
+		/* split, which needs a new command for the tail */
+		if (!tail) {
+			spin_unlock(&dcc->discard_lock);
+			tail = f2fs_kmem_cache_alloc(discard_cmd_slab, GFP_NOFS);
+			goto retry;
+		}
+		tail->lstart = blkaddr + 1;
+		tail->len = dc->lstart + dc->len - tail->lstart;
+		dc->len = blkaddr - dc->lstart;
+		__insert_discard_cmd(dcc, tail);
+		tail = NULL;
+	}
+out:
+	spin_unlock(&dcc->discard_lock);
+	if (tail)
+		kmem_cache_free(discard_cmd_slab, tail);
+}
+
+/*
+ * Take the next range for the thread off the tree, the lowest addressed one
+ * of at least @granularity blocks, and mark it as being issued.  At most
+ * about @max_len blocks are taken at once and the rest stays queued, so a
+ * writer waiting in f2fs_wait_discard() never waits for more than that.
+ * Called with issue_mutex held until __finish_discard_cmd().
+ */
+static bool __pick_discard_cmd(struct discard_cmd_control *dcc,
+				unsigned int granularity, unsigned int max_len)
+{
+	struct rb_node *node;
+	bool picked = false;
+
+	spin_lock(&dcc->discard_lock);
+	for (node = rb_first(&dcc->root); node; node = rb_next(node)) {
+		struct discard_cmd *dc = rb_entry(node, struct discard_cmd,
+								rb_node);
+
+		if (dc->len < granularity)
+			continue;
+
+		dcc->issue_start = dc->lstart;
+		if (dc->len - granularity > max_len) {
+			dcc->issue_len = max_len;
+			dc->lstart += max_len;
+			dc->len -= max_len;
+		} else {
+			dcc->issue_len = dc->len;
+			__remove_discard_cmd(dcc, dc);
+			kmem_cache_free(discard_cmd_slab, dc);
+		}
+		picked = true;
+		break;
+	}
+	spin_unlock(&dcc->discard_lock);
+	return picked;
+}
+
+static void __finish_discard_cmd(struct discard_cmd_control *dcc)
+{
+	spin_lock(&dcc->discard_lock);
+	dcc->issue_len = 0;
+	spin_unlock(&dcc->discard_lock);
+	wake_up_all(&dcc->discard_done_queue);
+}
+
+/*
+ * Issue every pending range now, regardless of its length.  Returns the
+ * number of blocks covered by ranges of at least @minlen blocks.
+ */
+static block_t f2fs_flush_discards(struct f2fs_sb_info *sbi, block_t minlen)
+{
+	struct discard_cmd_control *dcc = SM_I(sbi)->dcc_info;
+	block_t trimmed = 0;
+
+	if (!dcc)
+		return 0;
+
+	mutex_lock(&dcc->issue_mutex);
+	while (__pick_discard_cmd(dcc, 0, UINT_MAX)) {
+		__issue_discard(sbi, dcc->issue_start, dcc->issue_len);
+		if (dcc->issue_len >= minlen)
+			trimmed += dcc->issue_len;
+		__finish_discard_cmd(dcc);
+	}
+	mutex_unlock(&dcc->issue_mutex);
+	return trimmed;
+}
+
+static bool is_discard_idle(struct f2fs_sb_info *sbi)
+{
+	struct request_queue *q = bdev_get_queue(sbi->sb->s_bdev);
+
+	return !q->rq.count[BLK_RW_SYNC] && !q->rq.count[BLK_RW_ASYNC];
+}
+
+static int issue_discard_thread(void *data)
+{
+	struct f2fs_sb_info *sbi = data;
+	struct discard_cmd_control *dcc = SM_I(sbi)->dcc_info;
+	wait_queue_head_t *q = &dcc->discard_wait_queue;
+	long wait_ms = DEF_MAX_DISCARD_ISSUE_TIME;
+	unsigned int issued;
+
+	set_freezable();
+
+	do {
+		wait_event_interruptible_timeout(*q,
+				kthread_should_stop() || dcc->discard_wake,
+				msecs_to_jiffies(wait_ms));
+		dcc->discard_wake = 0;
+		if (try_to_freeze())
+			continue;
+		if (kthread_should_stop())
+			break;
+
+		wait_ms = DEF_MIN_DISCARD_ISSUE_TIME;
+		if (!is_discard_idle(sbi))
+			continue;
+
+		mutex_lock(&dcc->issue_mutex);
+		for (issued = 0; issued < dcc->max_discard_request; issued++) {
+			if (!is_discard_idle(sbi))
+				break;
+			if (!__pick_discard_cmd(dcc, dcc->discard_granularity,
+							sbi->blocks_per_seg)) {
+				wait_ms = DEF_MAX_DISCARD_ISSUE_TIME;
+				break;
+			}
+			__issue_discard(sbi, dcc->issue_start, dcc->issue_len);
+			dcc->nr_issued++;
+			__finish_discard_cmd(dcc);
+		}
+		mutex_unlock(&dcc->issue_mutex);
+	} while (!kthread_should_stop());
+	return 0;
+}
+
+static int create_discard_cmd_control(struct f2fs_sb_info *sbi)
+{
+	dev_t dev = sbi->sb->s_bdev->bd_dev;
+	struct discard_cmd_control *dcc;
+	int err;
+
+	dcc = kzalloc(sizeof(struct discard_cmd_control), GFP_KERNEL);
+	if (!dcc)
+		return -ENOMEM;
+
+	init_waitqueue_head(&dcc->discard_wait_queue);
+	init_waitqueue_head(&dcc->discard_done_queue);
+	mutex_init(&dcc->issue_mutex);
+	spin_lock_init(&dcc->discard_lock);
+	dcc->root = RB_ROOT;
+	dcc->discard_granularity = 1;
+	dcc->max_discard_request = DEF_MAX_DISCARD_REQUEST;
+	SM_I(sbi)->dcc_info = dcc;
+
+	dcc->f2fs_issue_discard = kthread_run(issue_discard_thread, sbi,
+				"f2fs_discard-%u:%u", MAJOR(dev), MINOR(dev));
+	if (IS_ERR(dcc->f2fs_issue_discard)) {
+		err = PTR_ERR(dcc->f2fs_issue_discard);
+		kfree(dcc);
+		SM_I(sbi)->dcc_info = NULL;
+		return err;
+	}
+	return 0;
+}
+
+static void destroy_discard_cmd_control(struct f2fs_sb_info *sbi)
+{
+	struct discard_cmd_control *dcc = SM_I(sbi)->dcc_info;
+
+	if (!dcc)
+		return;
+
+	kthread_stop(dcc->f2fs_issue_discard);
+	f2fs_flush_discards(sbi, 0);
+	kfree(dcc);
+	SM_I(sbi)->dcc_info = NULL;
+}
+
 bool discard_next_dnode(struct f2fs_sb_info *sbi, block_t blkaddr)
 {
 	int err = -EOPNOTSUPP;
@@ -803,7 +1476,7 @@ void clear_prefree_segments(struct f2fs_sb_info *sbi, struct cp_control *cpc)
 		if (!test_opt(sbi, DISCARD))
 			continue;
 
-		f2fs_issue_discard(sbi, START_BLOCK(sbi, start),
+		f2fs_queue_discard(sbi, START_BLOCK(sbi, start),
 				(end - start) << sbi->log_blocks_per_seg);
 	}
 	mutex_unlock(&dirty_i->seglist_lock);
@@ -812,13 +1485,20 @@ void clear_prefree_segments(struct f2fs_sb_info *sbi, struct cp_control *cpc)
 	list_for_each_entry_safe(entry, this, head, list) {
 		if (cpc->reason == CP_DISCARD && entry->len < cpc->trim_minlen)
 			goto skip;
-		f2fs_issue_discard(sbi, entry->blkaddr, entry->len);
+		if (cpc->reason == CP_DISCARD)
+			f2fs_issue_discard(sbi, entry->blkaddr, entry->len);
+		else
+			f2fs_queue_discard(sbi, entry->blkaddr, entry->len);
 		cpc->trimmed += entry->len;
 skip:
 		list_del(&entry->list);
 		SM_I(sbi)->nr_discards -= entry->len;
 		kmem_cache_free(discard_entry_slab, entry);
 	}
+
+	/* FITRIM wants everything freed so far discarded on return */
+	if (cpc->reason == CP_DISCARD)
+		cpc->trimmed += f2fs_flush_discards(sbi, cpc->trim_minlen);
 }
 
 static bool __mark_sit_entry_dirty(struct f2fs_sb_info *sbi, unsigned int segno)
@@ -842,6 +1522,27 @@ static void __set_sit_entry_type(struct f2fs_sb_info *sbi, int type,
 		__mark_sit_entry_dirty(sbi, segno);
 }
 
+/*
+ * Move the section of @segno to the tail of the bucket matching its current
+ * number of valid blocks.  Free and fully valid sections are not GC victims
+ * and are kept out of the index.  Buckets left empty are only cleared from
+ * bucket_map lazily by the victim search.
+ */
+static void update_victim_index(struct f2fs_sb_info *sbi, unsigned int segno)
+{
+	struct victim_index *vi = &DIRTY_I(sbi)->victim_index;
+	unsigned int secno = GET_SECNO(sbi, segno);
+	unsigned int vblocks = get_valid_blocks(sbi, segno, sbi->segs_per_sec);
+
+	spin_lock(&vi->lock);
+	list_del_init(&vi->sec_list[secno]);
+	if (vblocks && vblocks < vi->nr_buckets - 1) {
+		list_add_tail(&vi->sec_list[secno], &vi->buckets[vblocks]);
+		__set_bit(vblocks, vi->bucket_map);
+	}
+	spin_unlock(&vi->lock);
+}
+
 static void update_sit_entry(struct f2fs_sb_info *sbi, block_t blkaddr, int del)
 {
 	struct seg_entry *se;
@@ -883,6 +1584,8 @@ static void update_sit_entry(struct f2fs_sb_info *sbi, block_t blkaddr, int del)
 
 	if (sbi->segs_per_sec > 1)
 		get_sec_entry(sbi, segno)->valid_blocks += del;
+
+	update_victim_index(sbi, segno);
 }
 
 void refresh_sit_entry(struct f2fs_sb_info *sbi, block_t old, block_t new)
@@ -1418,6 +2121,28 @@ static int __get_segment_type(struct page *page, enum page_type p_type)
 	return __get_segment_type_6(page, p_type);
 }
 
+/*
+ * Pass the hot/warm/cold separation of the logs down to the block layer,
+ * so that devices grouping data by lifetime can keep the logs apart too.
+ */
+enum rw_hint f2fs_rw_hint(int seg_type)
+{
+	switch (seg_type) {
+	case CURSEG_HOT_DATA:
+	case CURSEG_HOT_NODE:
+		return WRITE_LIFE_SHORT;
+	case CURSEG_WARM_DATA:
+	case CURSEG_WARM_NODE:
+	case CURSEG_DIRECT_IO:
+		return WRITE_LIFE_MEDIUM;
+	case CURSEG_COLD_NODE:
+		return WRITE_LIFE_LONG;
+	case CURSEG_COLD_DATA:
+		return WRITE_LIFE_EXTREME;
+	}
+	return WRITE_LIFE_NOT_SET;
+}
+
 void allocate_data_block(struct f2fs_sb_info *sbi, struct page *page,
 		block_t old_blkaddr, block_t *new_blkaddr,
 		struct f2fs_summary *sum, int type)
@@ -1465,14 +2190,21 @@ void allocate_data_block(struct f2fs_sb_info *sbi, struct page *page,
 		fill_node_footer_blkaddr(page, NEXT_FREE_BLKADDR(sbi, curseg));
 
 	mutex_unlock(&curseg->curseg_mutex);
+
+	f2fs_wait_discard(sbi, *new_blkaddr);
 }
 
 static void do_write_page(struct f2fs_summary *sum, struct f2fs_io_info *fio)
 {
 	int type = __get_segment_type(fio->page, fio->type);
 
+	/* GC moves blocks of young sections next to fresh user writes */
+	if (fio->young && type == CURSEG_COLD_DATA)
+		type = CURSEG_WARM_DATA;
+
 	allocate_data_block(fio->sbi, fio->page, fio->old_blkaddr,
 					&fio->new_blkaddr, sum, type);
+	fio->hint = f2fs_rw_hint(type);
 
 	/* writeout dirty page into bdev */
 	f2fs_submit_page_mbio(fio);
@@ -1521,6 +2253,7 @@ void write_data_page(struct dnode_of_data *dn, struct f2fs_io_info *fio)
 void rewrite_data_page(struct f2fs_io_info *fio)
 {
 	fio->new_blkaddr = fio->old_blkaddr;
+	fio->hint = f2fs_rw_hint(__get_segment_type(fio->page, DATA));
 	stat_inc_inplace_blocks(fio->sbi);
 	f2fs_submit_page_mbio(fio);
 }
@@ -2381,10 +3114,85 @@ static int init_victim_secmap(struct f2fs_sb_info *sbi)
 	return 0;
 }
 
+struct victim_sec_age {
+	unsigned long long mtime;
+	unsigned int secno;
+};
+
+static int cmp_victim_sec_age(const void *a, const void *b)
+{
+	const struct victim_sec_age *sa = a, *sb = b;
+
+	if (sa->mtime != sb->mtime)
+		return sa->mtime < sb->mtime ? -1 : 1;
+	return sa->secno < sb->secno ? -1 : sa->secno > sb->secno;
+}
+
+/*
+ * Unlike update_victim_index(), sections are sorted by mtime here, since
+ * the order they were last written in is not known at mount time.  They
+ * are sorted once and then appended to their buckets oldest first.
+ */
+static int build_victim_index(struct f2fs_sb_info *sbi)
+{
+	struct victim_index *vi = &DIRTY_I(sbi)->victim_index;
+	struct victim_sec_age *ages;
+	unsigned int secno, vblocks, i, nr_ages = 0;
+
+	spin_lock_init(&vi->lock);
+	vi->nr_buckets = sbi->segs_per_sec * sbi->blocks_per_seg + 1;
+
+	vi->buckets = f2fs_kvzalloc(vi->nr_buckets * sizeof(struct list_head),
+								GFP_KERNEL);
+	vi->bucket_map = f2fs_kvzalloc(f2fs_bitmap_size(vi->nr_buckets),
+								GFP_KERNEL);
+	vi->sec_list = f2fs_kvzalloc(MAIN_SECS(sbi) * sizeof(struct list_head),
+								GFP_KERNEL);
+	if (!vi->buckets || !vi->bucket_map || !vi->sec_list)
+		return -ENOMEM;
+
+	ages = f2fs_kvzalloc(MAIN_SECS(sbi) * sizeof(struct victim_sec_age),
+								GFP_KERNEL);
+	if (!ages)
+		return -ENOMEM;
+
+	for (i = 0; i < vi->nr_buckets; i++)
+		INIT_LIST_HEAD(&vi->buckets[i]);
+
+	for (secno = 0; secno < MAIN_SECS(sbi); secno++) {
+		unsigned int segno = secno * sbi->segs_per_sec;
+
+		INIT_LIST_HEAD(&vi->sec_list[secno]);
+
+		vblocks = get_valid_blocks(sbi, segno, sbi->segs_per_sec);
+		if (!vblocks || vblocks >= vi->nr_buckets - 1)
+			continue;
+
+		ages[nr_ages].mtime = get_sec_mtime(sbi, segno);
+		ages[nr_ages].secno = secno;
+		nr_ages++;
+	}
+
+	sort(ages, nr_ages, sizeof(struct victim_sec_age),
+					cmp_victim_sec_age, NULL);
+
+	for (i = 0; i < nr_ages; i++) {
+		secno = ages[i].secno;
+		vblocks = get_valid_blocks(sbi, secno * sbi->segs_per_sec,
+							sbi->segs_per_sec);
+		list_add_tail(&vi->sec_list[secno], &vi->buckets[vblocks]);
+		__set_bit(vblocks, vi->bucket_map);
+	}
+
+	f2fs_kvfree(ages);
+	return 0;
+}
+
 static int build_dirty_segmap(struct f2fs_sb_info *sbi)
 {
 	struct dirty_seglist_info *dirty_i;
 	unsigned int bitmap_size, i;
+	int err;
 
 	/* allocate memory for dirty segments list information */
 	dirty_i = kzalloc(sizeof(struct dirty_seglist_info), GFP_KERNEL);
@@ -2403,6 +3211,9 @@ static int build_dirty_segmap(struct f2fs_sb_info *sbi)
 	}
 
 	init_dirty_segmap(sbi);
+	err = build_victim_index(sbi);
+	if (err)
+		return err;
 	return init_victim_secmap(sbi);
 }
 
@@ -2474,6 +3285,12 @@ int build_segment_manager(struct f2fs_sb_info *sbi)
 			return err;
 	}
 
+	if (test_opt(sbi, DISCARD) && !f2fs_readonly(sbi->sb)) {
+		err = create_discard_cmd_control(sbi);
+		if (err)
+			return err;
+	}
+
 	err = build_sit_info(sbi);
 	if (err)
 		return err;
@@ -2513,6 +3330,15 @@ static void destroy_victim_secmap(struct f2fs_sb_info *sbi)
 	f2fs_kvfree(dirty_i->victim_secmap);
 }
 
+static void destroy_victim_index(struct f2fs_sb_info *sbi)
+{
+	struct victim_index *vi = &DIRTY_I(sbi)->victim_index;
+
+	f2fs_kvfree(vi->buckets);
+	f2fs_kvfree(vi->bucket_map);
+	f2fs_kvfree(vi->sec_list);
+}
+
 static void destroy_dirty_segmap(struct f2fs_sb_info *sbi)
 {
 	struct dirty_seglist_info *dirty_i = DIRTY_I(sbi);
@@ -2526,6 +3352,7 @@ static void destroy_dirty_segmap(struct f2fs_sb_info *sbi)
 		discard_dirty_segmap(sbi, i);
 
 	destroy_victim_secmap(sbi);
+	destroy_victim_index(sbi);
 	SM_I(sbi)->dirty_info = NULL;
 	kfree(dirty_i);
 }
@@ -2589,6 +3416,7 @@ void destroy_segment_manager(struct f2fs_sb_info *sbi)
 	if (!sm_info)
 		return;
 	destroy_flush_cmd_control(sbi);
+	destroy_discard_cmd_control(sbi);
 	destroy_dirty_segmap(sbi);
 	destroy_curseg(sbi);
 	destroy_free_segmap(sbi);
@@ -2613,8 +3441,15 @@ int __init create_segment_manager_caches(void)
 			sizeof(struct inmem_pages));
 	if (!inmem_entry_slab)
 		goto destroy_sit_entry_set;
+
+	discard_cmd_slab = f2fs_kmem_cache_create("discard_cmd",
+			sizeof(struct discard_cmd));
+	if (!discard_cmd_slab)
+		goto destroy_inmem_entry;
 	return 0;
 
+destroy_inmem_entry:
+	kmem_cache_destroy(inmem_entry_slab);
 destroy_sit_entry_set:
 	kmem_cache_destroy(sit_entry_set_slab);
 destory_discard_entry:
@@ -2628,4 +3463,5 @@ void destroy_segment_manager_caches(void)
 	kmem_cache_destroy(sit_entry_set_slab);
 	kmem_cache_destroy(discard_entry_slab);
 	kmem_cache_destroy(inmem_entry_slab);
+	kmem_cache_destroy(discard_cmd_slab);
 }
@@ -191,8 +191,13 @@ struct inmem_pages {
 	struct list_head list;
 	struct page *page;
 	block_t old_addr;		/* for revoking when fail to commit */
+	block_t new_addr;		/* spilled block switched in at commit */
+	pgoff_t index;			/* page index, kept once spilled */
 };
 
+/* atomic-write pages in memory before they are spilled (0: no limit) */
+#define DEF_INMEM_BUDGET	0
+
 struct sit_info {
 	const struct segment_allocation *s_ops;
 
@@ -239,12 +244,27 @@ enum dirty_type {
 	NR_DIRTY_TYPE
 };
 
+/*
+ * Sections holding both valid and invalid blocks, bucketed by their number
+ * of valid blocks.  A section is moved to the tail of its bucket whenever
+ * its valid block count changes, which also refreshes its mtime, so each
+ * bucket stays ordered from the oldest to the youngest section.
+ */
+struct victim_index {
+	spinlock_t lock;			/* protects buckets */
+	unsigned int nr_buckets;		/* # of blocks per section + 1 */
+	struct list_head *buckets;		/* sections by valid blocks */
+	unsigned long *bucket_map;		/* possibly non-empty buckets */
+	struct list_head *sec_list;		/* bucket entry per section */
+};
+
 struct dirty_seglist_info {
 	const struct victim_selection *v_ops;	/* victim selction operation */
 	unsigned long *dirty_segmap[NR_DIRTY_TYPE];
 	struct mutex seglist_lock;		/* lock for segment bitmaps */
 	int nr_dirty[NR_DIRTY_TYPE];		/* # of dirty segments */
 	unsigned long *victim_secmap;		/* background GC victims */
+	struct victim_index victim_index;	/* GC victim candidates */
 };
 
 /* victim selection function for cleaning and SSR */
@@ -307,6 +327,18 @@ static inline unsigned int get_valid_blocks(struct f2fs_sb_info *sbi,
 		return get_seg_entry(sbi, segno)->valid_blocks;
 }
 
+static inline unsigned long long get_sec_mtime(struct f2fs_sb_info *sbi,
+						unsigned int segno)
+{
+	unsigned int start = GET_SECNO(sbi, segno) * sbi->segs_per_sec;
+	unsigned long long mtime = 0;
+	unsigned int i;
+
+	for (i = 0; i < sbi->segs_per_sec; i++)
+		mtime += get_seg_entry(sbi, start + i)->mtime;
+	return div_u64(mtime, sbi->segs_per_sec);
+}
+
 static inline void seg_info_from_raw_sit(struct seg_entry *se,
 					struct f2fs_sit_entry *rs)
 {
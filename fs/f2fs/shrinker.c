@@ -36,6 +36,11 @@ static unsigned long __count_extent_cache(struct f2fs_sb_info *sbi)
 				atomic_read(&sbi->total_ext_node);
 }
 
+static unsigned long __count_dir_index(struct f2fs_sb_info *sbi)
+{
+	return atomic_read(&sbi->total_dir_index_entry);
+}
+
 int f2fs_shrink_count(struct shrinker *shrink,
 				struct shrink_control *sc)
 {
@@ -64,6 +69,9 @@ int f2fs_shrink_count(struct shrinker *shrink,
 		/* count free nids cache entries */
 		count += __count_free_nids(sbi);
 
+		/* count dir index entries */
+		count += __count_dir_index(sbi);
+
 		spin_lock(&f2fs_list_lock);
 		p = p->next;
 		mutex_unlock(&sbi->umount_mutex);
@@ -112,6 +120,10 @@ int f2fs_shrink_scan(struct shrinker *shrink,
 		if (freed < nr)
 			freed += try_to_free_nids(sbi, nr - freed);
 
+		/* shrink dir index entries */
+		if (freed < nr)
+			freed += f2fs_shrink_dir_index(sbi, nr - freed);
+
 		spin_lock(&f2fs_list_lock);
 		p = p->next;
 		list_move_tail(&sbi->s_list, &f2fs_list);
@@ -133,6 +145,7 @@ void f2fs_join_shrinker(struct f2fs_sb_info *sbi)
 void f2fs_leave_shrinker(struct f2fs_sb_info *sbi)
 {
 	f2fs_shrink_extent_tree(sbi, __count_extent_cache(sbi));
+	f2fs_shrink_dir_index(sbi, __count_dir_index(sbi));
 
 	spin_lock(&f2fs_list_lock);
 	list_del(&sbi->s_list);
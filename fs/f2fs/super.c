@@ -99,6 +99,7 @@ static match_table_t f2fs_tokens = {
 enum {
 	GC_THREAD,	/* struct f2fs_gc_thread */
 	SM_INFO,	/* struct f2fs_sm_info */
+	DCC_INFO,	/* struct discard_cmd_control */
 	NM_INFO,	/* struct f2fs_nm_info */
 	F2FS_SBI,	/* struct f2fs_sb_info */
 };
@@ -118,6 +119,8 @@ static unsigned char *__struct_ptr(struct f2fs_sb_info *sbi, int struct_type)
 		return (unsigned char *)sbi->gc_thread;
 	else if (struct_type == SM_INFO)
 		return (unsigned char *)SM_I(sbi);
+	else if (struct_type == DCC_INFO)
+		return (unsigned char *)SM_I(sbi)->dcc_info;
 	else if (struct_type == NM_INFO)
 		return (unsigned char *)NM_I(sbi);
 	else if (struct_type == F2FS_SBI)
@@ -216,6 +219,11 @@ static struct f2fs_attr f2fs_attr_##_name = {			\
 		f2fs_sbi_show, f2fs_sbi_store,			\
 		offsetof(struct struct_name, elname))
 
+#define F2FS_RO_ATTR(struct_type, struct_name, name, elname)	\
+	F2FS_ATTR_OFFSET(struct_type, name, 0444,		\
+		f2fs_sbi_show, NULL,				\
+		offsetof(struct struct_name, elname))
+
 #define F2FS_GENERAL_RO_ATTR(name) \
 static struct f2fs_attr f2fs_attr_##name = __ATTR(name, 0444, name##_show, NULL)
 
@@ -229,11 +237,22 @@ F2FS_RW_ATTR(SM_INFO, f2fs_sm_info, batched_trim_sections, trim_sections);
 F2FS_RW_ATTR(SM_INFO, f2fs_sm_info, ipu_policy, ipu_policy);
 F2FS_RW_ATTR(SM_INFO, f2fs_sm_info, min_ipu_util, min_ipu_util);
 F2FS_RW_ATTR(SM_INFO, f2fs_sm_info, min_fsync_blocks, min_fsync_blocks);
+F2FS_RW_ATTR(DCC_INFO, discard_cmd_control, discard_granularity,
+						discard_granularity);
+F2FS_RW_ATTR(DCC_INFO, discard_cmd_control, max_discard_request,
+						max_discard_request);
+F2FS_RO_ATTR(DCC_INFO, discard_cmd_control, pending_discard, nr_pending);
+F2FS_RO_ATTR(DCC_INFO, discard_cmd_control, issued_discard, nr_issued);
 F2FS_RW_ATTR(NM_INFO, f2fs_nm_info, ram_thresh, ram_thresh);
+F2FS_RW_ATTR(NM_INFO, f2fs_nm_info, ram_budget, ram_budget);
 F2FS_RW_ATTR(NM_INFO, f2fs_nm_info, ra_nid_pages, ra_nid_pages);
+F2FS_RW_ATTR(NM_INFO, f2fs_nm_info, ra_nat_pages, ra_nat_pages);
 F2FS_RW_ATTR(NM_INFO, f2fs_nm_info, dirty_nats_ratio, dirty_nats_ratio);
 F2FS_RW_ATTR(F2FS_SBI, f2fs_sb_info, max_victim_search, max_victim_search);
+F2FS_RW_ATTR(F2FS_SBI, f2fs_sb_info, gc_age_threshold, gc_age_threshold);
+F2FS_RW_ATTR(F2FS_SBI, f2fs_sb_info, inmem_budget, inmem_budget);
 F2FS_RW_ATTR(F2FS_SBI, f2fs_sb_info, dir_level, dir_level);
+F2FS_RW_ATTR(F2FS_SBI, f2fs_sb_info, dir_index_blocks, dir_index_blocks);
 F2FS_RW_ATTR(F2FS_SBI, f2fs_sb_info, cp_interval, interval_time[CP_TIME]);
 F2FS_RW_ATTR(F2FS_SBI, f2fs_sb_info, idle_interval, interval_time[REQ_TIME]);
 F2FS_GENERAL_RO_ATTR(lifetime_write_kbytes);
@@ -250,10 +269,19 @@ static struct attribute *f2fs_attrs[] = {
 	ATTR_LIST(ipu_policy),
 	ATTR_LIST(min_ipu_util),
 	ATTR_LIST(min_fsync_blocks),
+	ATTR_LIST(discard_granularity),
+	ATTR_LIST(max_discard_request),
+	ATTR_LIST(pending_discard),
+	ATTR_LIST(issued_discard),
 	ATTR_LIST(max_victim_search),
+	ATTR_LIST(gc_age_threshold),
+	ATTR_LIST(inmem_budget),
 	ATTR_LIST(dir_level),
+	ATTR_LIST(dir_index_blocks),
 	ATTR_LIST(ram_thresh),
+	ATTR_LIST(ram_budget),
 	ATTR_LIST(ra_nid_pages),
+	ATTR_LIST(ra_nat_pages),
 	ATTR_LIST(dirty_nats_ratio),
 	ATTR_LIST(cp_interval),
 	ATTR_LIST(idle_interval),
@@ -460,7 +488,11 @@ static struct inode *f2fs_alloc_inode(struct super_block *sb)
 	init_rwsem(&fi->i_sem);
 	INIT_LIST_HEAD(&fi->dirty_list);
 	INIT_LIST_HEAD(&fi->inmem_pages);
+	INIT_LIST_HEAD(&fi->inmem_spilled);
+	fi->cow_inode = NULL;
 	mutex_init(&fi->inmem_lock);
+	fi->dir_index = NULL;
+	fi->dir_index_gen = 0;
 
 	set_inode_flag(fi, FI_NEW_INODE);
 
@@ -585,6 +617,7 @@ static void f2fs_put_super(struct super_block *sb)
 	/* destroy f2fs internal modules */
 	destroy_node_manager(sbi);
 	destroy_segment_manager(sbi);
+	f2fs_destroy_compress_ctx(sbi);
 
 	kfree(sbi->ckpt);
 	kobject_put(&sbi->s_kobj);
@@ -1141,11 +1174,14 @@ static void init_sb_info(struct f2fs_sb_info *sbi)
 	sbi->meta_ino_num = le32_to_cpu(raw_super->meta_ino);
 	sbi->cur_victim_sec = NULL_SECNO;
 	sbi->max_victim_search = DEF_MAX_VICTIM_SEARCH;
+	sbi->gc_age_threshold = DEF_GC_AGE_THRESHOLD;
+	sbi->inmem_budget = DEF_INMEM_BUDGET;
 
 	for (i = 0; i < NR_COUNT_TYPE; i++)
 		atomic_set(&sbi->nr_pages[i], 0);
 
 	sbi->dir_level = DEF_DIR_LEVEL;
+	sbi->dir_index_blocks = DEF_DIR_INDEX_BLOCKS;
 	sbi->interval_time[CP_TIME] = DEF_CP_INTERVAL;
 	sbi->interval_time[REQ_TIME] = DEF_IDLE_INTERVAL;
 	clear_sbi_flag(sbi, SBI_NEED_FSCK);
@@ -1370,6 +1406,7 @@ try_onemore:
 	}
 
 	init_extent_cache_info(sbi);
+	init_dir_index_info(sbi);
 
 	init_ino_entry_info(sbi);
 
@@ -1387,6 +1424,13 @@ try_onemore:
 		goto free_nm;
 	}
 
+	err = f2fs_init_compress_ctx(sbi);
+	if (err) {
+		f2fs_msg(sb, KERN_ERR,
+			"Failed to allocate F2FS compression buffers");
+		goto free_nm;
+	}
+
 	/* For write statistics */
 	if (sb->s_bdev->bd_part)
 		sbi->sectors_written_start =
@@ -1405,7 +1449,7 @@ try_onemore:
 	if (IS_ERR(sbi->node_inode)) {
 		f2fs_msg(sb, KERN_ERR, "Failed to read node inode");
 		err = PTR_ERR(sbi->node_inode);
-		goto free_nm;
+		goto free_compress;
 	}
 
 	f2fs_join_shrinker(sbi);
@@ -1520,6 +1564,8 @@ free_node_inode:
 	f2fs_leave_shrinker(sbi);
 	iput(sbi->node_inode);
 	mutex_unlock(&sbi->umount_mutex);
+free_compress:
+	f2fs_destroy_compress_ctx(sbi);
 free_nm:
 	destroy_node_manager(sbi);
 free_sm:
@@ -1605,10 +1651,13 @@ static int __init init_f2fs_fs(void)
 	err = create_extent_cache();
 	if (err)
 		goto free_checkpoint_caches;
+	err = create_dir_index_cache();
+	if (err)
+		goto free_extent_cache;
 	f2fs_kset = kset_create_and_add("f2fs", NULL, fs_kobj);
 	if (!f2fs_kset) {
 		err = -ENOMEM;
-		goto free_extent_cache;
+		goto free_dir_index_cache;
 	}
 	err = f2fs_init_crypto();
 	if (err)
@@ -1632,6 +1681,8 @@ free_shrinker:
 	f2fs_exit_crypto();
 free_kset:
 	kset_unregister(f2fs_kset);
+free_dir_index_cache:
+	destroy_dir_index_cache();
 free_extent_cache:
 	destroy_extent_cache();
 free_checkpoint_caches:
@@ -1653,6 +1704,7 @@ static void __exit exit_f2fs_fs(void)
 	unregister_shrinker(&f2fs_shrinker_info);
 	unregister_filesystem(&f2fs_fs_type);
 	f2fs_exit_crypto();
+	destroy_dir_index_cache();
 	destroy_extent_cache();
 	destroy_checkpoint_caches();
 	destroy_segment_manager_caches();
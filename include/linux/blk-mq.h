@@ -0,0 +1,114 @@
+#ifndef BLK_MQ_H
+#define BLK_MQ_H
+
+#include <linux/blkdev.h>
+
+struct blk_mq_tags;
+struct blk_mq_ctx;
+
+/*
+ * Hardware dispatch context.  Every per-cpu software queue of a
+ * request_queue is mapped onto exactly one of these, and ->queue_rq is
+ * called with requests pulled from the software queues mapped here.
+ */
+struct blk_mq_hw_ctx {
+	struct {
+		spinlock_t		lock;
+		struct list_head	dispatch;	/* driver said busy */
+	} ____cacheline_aligned_in_smp;
+
+	unsigned long		state;		/* BLK_MQ_S_* flags */
+	struct delayed_work	run_work;
+
+	unsigned long		flags;		/* BLK_MQ_F_* flags */
+
+	struct request_queue	*queue;
+	void			*driver_data;
+
+	unsigned int		nr_ctx;
+	struct blk_mq_ctx	**ctxs;
+	unsigned long		*ctx_map;	/* software queues with work */
+
+	struct blk_mq_tags	*tags;
+
+	unsigned long		queued;
+	unsigned long		run;
+
+	unsigned int		queue_num;
+	unsigned int		queue_depth;
+	int			numa_node;
+};
+
+typedef int (queue_rq_fn)(struct blk_mq_hw_ctx *, struct request *);
+typedef int (init_hctx_fn)(struct blk_mq_hw_ctx *, void *, unsigned int);
+
+struct blk_mq_ops {
+	/*
+	 * Queue request.  Called from process context without any block
+	 * layer lock held, and possibly on several cpus at once for the
+	 * same hardware context.
+	 */
+	queue_rq_fn		*queue_rq;
+
+	/*
+	 * Called by blk_mq_complete_request() on the submitting cpu.  If
+	 * not set, the request is ended with blk_mq_end_io().
+	 */
+	softirq_done_fn		*complete;
+
+	/*
+	 * Called once for every hardware context at queue setup, with the
+	 * driver_data passed to blk_mq_init_queue() and the context index.
+	 */
+	init_hctx_fn		*init_hctx;
+};
+
+struct blk_mq_reg {
+	struct blk_mq_ops	*ops;
+	unsigned int		nr_hw_queues;
+	unsigned int		queue_depth;	/* per hardware context */
+	unsigned int		cmd_size;	/* per-request driver data */
+	int			numa_node;
+	unsigned int		flags;		/* BLK_MQ_F_* */
+};
+
+enum {
+	BLK_MQ_RQ_QUEUE_OK	= 0,	/* queued fine */
+	BLK_MQ_RQ_QUEUE_BUSY	= 1,	/* requeue IO for later */
+	BLK_MQ_RQ_QUEUE_ERROR	= 2,	/* end IO with error */
+
+	BLK_MQ_F_SHOULD_MERGE	= 1 << 0,
+
+	BLK_MQ_S_STOPPED	= 0,
+
+	BLK_MQ_MAX_DEPTH	= 2048,
+};
+
+struct request_queue *blk_mq_init_queue(struct blk_mq_reg *, void *);
+
+void blk_mq_end_io(struct request *rq, int error);
+void blk_mq_complete_request(struct request *rq);
+
+void blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx, bool async);
+void blk_mq_run_queues(struct request_queue *q, bool async);
+void blk_mq_stop_hw_queue(struct blk_mq_hw_ctx *hctx);
+void blk_mq_start_stopped_hw_queues(struct request_queue *q, bool async);
+
+/*
+ * Driver command data is allocated right after the request.
+ */
+static inline void *blk_mq_rq_to_pdu(struct request *rq)
+{
+	return (void *) rq + sizeof(*rq);
+}
+
+static inline struct request *blk_mq_rq_from_pdu(void *pdu)
+{
+	return pdu - sizeof(struct request);
+}
+
+#define queue_for_each_hw_ctx(q, hctx, i)				\
+	for ((i) = 0; (i) < (q)->nr_hw_queues &&			\
+	     ({ hctx = (q)->queue_hw_ctx[i]; 1; }); (i)++)
+
+#endif
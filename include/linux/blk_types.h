@@ -17,6 +17,21 @@ struct block_device;
 typedef void (bio_end_io_t) (struct bio *, int);
 typedef void (bio_destructor_t) (struct bio *);
 
+/*
+ * Expected lifetime of the data written by a bio, as hinted by the
+ * submitter.  Devices that can group data by lifetime (e.g. eMMC
+ * contexts) use it to keep short and long lived data apart.
+ */
+enum rw_hint {
+	WRITE_LIFE_NOT_SET	= 0,
+	WRITE_LIFE_NONE,
+	WRITE_LIFE_SHORT,
+	WRITE_LIFE_MEDIUM,
+	WRITE_LIFE_LONG,
+	WRITE_LIFE_EXTREME,
+	NR_WRITE_HINTS,
+};
+
 /*
  * was unsigned short, but we might as well be ready for > 64kB I/O pages
  */
@@ -42,6 +57,7 @@ struct bio {
 
 	unsigned short		bi_vcnt;	/* how many bio_vec's */
 	unsigned short		bi_idx;		/* current index into bvl_vec */
+	unsigned short		bi_write_hint;	/* enum rw_hint */
 
 	/* Number of segments in this BIO after
 	 * physical address coalescing is performed.
@@ -25,6 +25,7 @@
 
 #define NULL_ADDR		((block_t)0)	/* used as block_t addresses */
 #define NEW_ADDR		((block_t)-1)	/* used as block_t addresses */
+#define COMPRESS_ADDR		((block_t)-2)	/* marks a compressed cluster */
 
 #define F2FS_BYTES_TO_BLK(bytes)	((bytes) >> F2FS_BLKSIZE_BITS)
 #define F2FS_BLK_TO_BYTES(blk)		((blk) << F2FS_BLKSIZE_BITS)
@@ -495,6 +496,24 @@ struct f2fs_inline_dentry {
 	__u8 filename[NR_INLINE_DENTRY][F2FS_SLOT_LEN];
 } __packed;
 
+/*
+ * Compressed cluster layout.
+ *
+ * A cluster of F2FS_CLUSTER_SIZE pages in a file with FS_COMPR_FL is stored
+ * compressed when that saves at least one block.  Its first address slot in
+ * the dnode holds COMPRESS_ADDR, the following slots hold the blocks of the
+ * compressed stream, and the remaining slots are NULL_ADDR.  The stream starts
+ * with the header below.  Clusters that do not compress are stored as usual.
+ */
+#define F2FS_CLUSTER_LOG_SIZE	2
+#define F2FS_CLUSTER_SIZE	(1 << F2FS_CLUSTER_LOG_SIZE)
+#define F2FS_COMPRESS_MAGIC	0xF2F5C0DE
+
+struct f2fs_cluster_header {
+	__le32 magic;		/* F2FS_COMPRESS_MAGIC */
+	__le32 clen;		/* length of the lz4 stream after this header */
+} __packed;
+
 /* file types used in inode_info->flags */
 enum {
 	F2FS_FT_UNKNOWN,
@@ -54,6 +54,9 @@ struct mmc_data;
  * @using_dma: Whether DMA is in use for the current transfer.
  * @sg_dma: Bus address of DMA buffer.
  * @sg_cpu: Virtual address of DMA buffer.
+ * @cur_ring: IDMAC descriptor ring used by the current or last transfer.
+ * @ring_data: Request whose descriptors have been staged in each ring
+ *	by pre_req, or NULL.
  * @dma_ops: Pointer to platform-specific DMA callbacks.
  * @cmd_status: Snapshot of SR taken upon completion of the current
  *	command. Only valid when EVENT_CMD_COMPLETE is pending.
@@ -141,6 +144,8 @@ struct dw_mci {
 	struct dw_mci_dma_ops	*dma_ops;
 #ifdef CONFIG_MMC_DW_IDMAC
 	unsigned int		ring_size;
+	unsigned int		cur_ring;
+	struct mmc_data		*ring_data[2];
 #else
 	struct dw_mci_dma_data	*dma_data;
 #endif
@@ -239,6 +239,9 @@ struct mmc_host {
 #define MMC_CAP2_BROKEN_VOLTAGE	(1 << 7)	/* Use the broken voltage */
 #define MMC_CAP2_DETECT_ON_ERR	(1 << 8)	/* On I/O err check card removal */
 #define MMC_CAP2_HC_ERASE_SZ	(1 << 9)	/* High-capacity erase size */
+#define MMC_CAP2_PACKED_WR	(1 << 10)	/* Allow packed write */
+#define MMC_CAP2_INIT_BKOPS	(1 << 11)	/* Need to set BKOPS_EN */
+#define MMC_CAP2_CONTEXT	(1 << 12)	/* Allow eMMC 4.5 contexts */
 
 	mmc_pm_flag_t		pm_caps;	/* supported pm features */
 	unsigned int        power_notify_type;
@@ -442,6 +445,16 @@ static inline int mmc_host_cmd23(struct mmc_host *host)
 	return host->caps & MMC_CAP_CMD23;
 }
 
+static inline int mmc_host_packed_wr(struct mmc_host *host)
+{
+	return host->caps2 & MMC_CAP2_PACKED_WR;
+}
+
+static inline int mmc_host_context(struct mmc_host *host)
+{
+	return host->caps2 & MMC_CAP2_CONTEXT;
+}
+
 static inline int mmc_boot_partition_access(struct mmc_host *host)
 {
 	return !(host->caps2 & MMC_CAP2_BOOTPART_NOACC);
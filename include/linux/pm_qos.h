@@ -16,6 +16,8 @@ enum {
 	PM_QOS_NETWORK_LATENCY,
 	PM_QOS_MEMORY_THROUGHPUT,
 	PM_QOS_NETWORK_THROUGHPUT,
+	PM_QOS_MIN_ONLINE_CPUS,
+	PM_QOS_MAX_ONLINE_CPUS,
 
 	/* insert new class ID */
 	PM_QOS_NUM_CLASSES,
@@ -27,6 +29,8 @@ enum {
 #define PM_QOS_NETWORK_LAT_DEFAULT_VALUE	(2000 * USEC_PER_SEC)
 #define PM_QOS_MEMORY_THROUGHPUT_DEFAULT_VALUE	0
 #define PM_QOS_NETWORK_THROUGHPUT_DEFAULT_VALUE	0
+#define PM_QOS_MIN_ONLINE_CPUS_DEFAULT_VALUE	0
+#define PM_QOS_MAX_ONLINE_CPUS_DEFAULT_VALUE	INT_MAX
 #define PM_QOS_DEV_LAT_DEFAULT_VALUE		0
 
 struct pm_qos_request {
@@ -141,6 +141,12 @@ extern unsigned long nr_uninterruptible(void);
 extern unsigned long nr_iowait(void);
 extern unsigned long nr_iowait_cpu(int cpu);
 extern unsigned long this_cpu_load(void);
+extern u64 sched_get_nr_running_integral(int cpu, u64 *stamp);
+#ifdef CONFIG_SMP
+extern unsigned long sched_get_cpu_util(int cpu);
+#else
+static inline unsigned long sched_get_cpu_util(int cpu) { return 0; }
+#endif
 
 
 extern void calc_global_load(unsigned long ticks);
@@ -16,6 +16,7 @@
 #include <linux/types.h>
 #ifdef __KERNEL__
 
+#include <linux/atomic.h>
 #include <linux/kref.h>
 #include <linux/ktime.h>
 #include <linux/list.h>
@@ -93,8 +94,8 @@ struct sync_timeline_ops {
  * @name:		name of the sync_timeline. Useful for debugging
  * @destoryed:		set when sync_timeline is destroyed
  * @child_list_head:	list of children sync_pts for this sync_timeline
- * @child_list_lock:	lock protecting @child_list_head, destroyed, and
- *			  sync_pt.status
+ * @child_list_lock:	lock protecting @child_list_head, @active_list_head,
+ *			  destroyed, and sync_pt.status
  * @active_list_head:	list of active (unsignaled/errored) sync_pts
  * @sync_timeline_list:	membership in global sync_timeline_list
  */
@@ -110,7 +111,6 @@ struct sync_timeline {
 	spinlock_t		child_list_lock;
 
 	struct list_head	active_list_head;
-	spinlock_t		active_list_lock;
 
 	struct list_head	sync_timeline_list;
 };
@@ -137,7 +137,7 @@ struct sync_pt {
 	struct sync_fence	*fence;
 	struct list_head	pt_list;
 
-	/* protected by parent->active_list_lock */
+	/* protected by parent->child_list_lock */
 	int			status;
 
 	ktime_t			timestamp;
@@ -148,11 +148,14 @@ struct sync_pt {
  * @file:		file representing this fence
  * @kref:		referenace count on fence.
  * @name:		name of sync_fence.  Useful for debugging
- * @pt_list_head:	list of sync_pts in ths fence.  immutable once fence
- *			  is created
+ * @pt_list_head:	list of sync_pts in ths fence, sorted by parent
+ *			  timeline with at most one pt per timeline.
+ *			  immutable once fence is created
+ * @pending:		number of sync_pts in @pt_list_head yet to signal
  * @waiter_list_head:	list of asynchronous waiters on this fence
- * @waiter_list_lock:	lock protecting @waiter_list_head and @status
- * @status:		1: signaled, 0:active, <0: error
+ * @waiter_list_lock:	lock protecting @waiter_list_head
+ * @status:		1: signaled, 0:active, <0: error.  moves away from 0
+ *			  exactly once, through cmpxchg()
  *
  * @wq:			wait queue for fence signaling
  * @sync_fence_list:	membership in global fence list
@@ -164,9 +167,10 @@ struct sync_fence {
 
 	/* this list is immutable once the fence is created */
 	struct list_head	pt_list_head;
+	atomic_t		pending;
 
 	struct list_head	waiter_list_head;
-	spinlock_t		waiter_list_lock; /* also protects status */
+	spinlock_t		waiter_list_lock;
 	int			status;
 
 	wait_queue_head_t	wq;
@@ -342,6 +346,22 @@ int sync_fence_cancel_async(struct sync_fence *fence,
  */
 int sync_fence_wait(struct sync_fence *fence, long timeout);
 
+/**
+ * sync_fence_wait_multi() - wait on several fences at once
+ * @fences:	fences to wait on
+ * @count:	number of entries in @fences
+ * @any:	return as soon as one fence signals instead of all of them
+ * @timeout:	timeout in ms
+ * @status:	returns the status of each fence when the wait ends
+ *
+ * Waits for all (or, with @any, one) of @fences to be signaled or have an
+ * error, with a single wait queue entry per fence.  Waits indefinitely if
+ * @timeout < 0.  Returns 0, the first fence error found, -ETIME on timeout
+ * or -ERESTARTSYS if interrupted.
+ */
+int sync_fence_wait_multi(struct sync_fence **fences, int count, bool any,
+			  long timeout, __s32 *status);
+
 #endif /* __KERNEL__ */
 
 /**
@@ -356,6 +376,31 @@ struct sync_merge_data {
 	__s32	fence; /* fd on newly created fence */
 };
 
+#define SYNC_WAIT_MULTI_MAX	256
+
+/* struct sync_wait_multi_data flags */
+#define SYNC_WAIT_ANY		(1 << 0)
+
+/**
+ * struct sync_wait_multi_data - data passed to wait multi ioctl
+ * @fds:	user pointer to an array of @count fence fds (__s32)
+ * @status:	user pointer to an array of @count __s32, returns the status
+ *		of each fence: 1: signaled 0:active <0:error
+ * @count:	number of fences, at most SYNC_WAIT_MULTI_MAX
+ * @flags:	SYNC_WAIT_ANY to return when the first fence signals,
+ *		otherwise waits for all of them
+ * @timeout:	timeout in milliseconds.  Waits indefinitely if < 0
+ * @pad:	must be zero
+ */
+struct sync_wait_multi_data {
+	__u64	fds;
+	__u64	status;
+	__u32	count;
+	__u32	flags;
+	__s32	timeout;
+	__u32	pad;
+};
+
 /**
  * struct sync_pt_info - detailed sync_pt information
  * @len:		length of sync_pt_info including any driver_data
@@ -424,4 +469,15 @@ struct sync_fence_info_data {
 #define SYNC_IOC_FENCE_INFO	_IOWR(SYNC_IOC_MAGIC, 2,\
 	struct sync_fence_info_data)
 
+/**
+ * DOC: SYNC_IOC_WAIT_MULTI - wait on several fences in one call
+ *
+ * Takes a struct sync_wait_multi_data.  May be issued on any sync fence fd;
+ * the fences waited on are exactly those listed in fds.  Returns 0 when all
+ * fences (or one, with SYNC_WAIT_ANY) have signaled, the first fence error,
+ * or -ETIME on timeout.  The status array is filled in all cases.
+ */
+#define SYNC_IOC_WAIT_MULTI	_IOWR(SYNC_IOC_MAGIC, 3,\
+	struct sync_wait_multi_data)
+
 #endif /* _LINUX_SYNC_H */
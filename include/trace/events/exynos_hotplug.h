@@ -0,0 +1,62 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM exynos_hotplug
+
+#if !defined(_TRACE_EXYNOS_HOTPLUG_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_EXYNOS_HOTPLUG_H
+
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(exynos_hotplug_eval,
+	    TP_PROTO(unsigned int online, unsigned int nr_avg,
+		     unsigned int max_util, unsigned int total_util,
+		     int decision),
+	    TP_ARGS(online, nr_avg, max_util, total_util, decision),
+
+	    TP_STRUCT__entry(
+		    __field(unsigned int, online     )
+		    __field(unsigned int, nr_avg     )
+		    __field(unsigned int, max_util   )
+		    __field(unsigned int, total_util )
+		    __field(int,          decision   )
+	    ),
+
+	    TP_fast_assign(
+		    __entry->online = online;
+		    __entry->nr_avg = nr_avg;
+		    __entry->max_util = max_util;
+		    __entry->total_util = total_util;
+		    __entry->decision = decision;
+	    ),
+
+	    TP_printk("online=%u nr_avg=%u max_util=%u total_util=%u decision=%d",
+		      __entry->online, __entry->nr_avg, __entry->max_util,
+		      __entry->total_util, __entry->decision)
+);
+
+TRACE_EVENT(exynos_hotplug_cpu,
+	    TP_PROTO(unsigned int cpu, int up, int ret, unsigned long usecs),
+	    TP_ARGS(cpu, up, ret, usecs),
+
+	    TP_STRUCT__entry(
+		    __field(unsigned int,  cpu   )
+		    __field(int,           up    )
+		    __field(int,           ret   )
+		    __field(unsigned long, usecs )
+	    ),
+
+	    TP_fast_assign(
+		    __entry->cpu = cpu;
+		    __entry->up = up;
+		    __entry->ret = ret;
+		    __entry->usecs = usecs;
+	    ),
+
+	    TP_printk("cpu=%u %s ret=%d took=%luus",
+		      __entry->cpu, __entry->up ? "up" : "down",
+		      __entry->ret, __entry->usecs)
+);
+
+#endif /* _TRACE_EXYNOS_HOTPLUG_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
@@ -18,6 +18,7 @@
 		{ INMEM,	"INMEM" },				\
 		{ INMEM_DROP,	"INMEM_DROP" },				\
 		{ INMEM_REVOKE,	"INMEM_REVOKE" },			\
+		{ INMEM_SPILL,	"INMEM_SPILL" },			\
 		{ IPU,		"IN-PLACE" },				\
 		{ OPU,		"OUT-OF-PLACE" })
 
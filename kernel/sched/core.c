@@ -2202,6 +2202,31 @@ unsigned long this_cpu_load(void)
 	return this->cpu_load[0];
 }
 
+/**
+ * sched_get_nr_running_integral - cumulative runqueue depth of a cpu
+ * @cpu: the cpu to sample
+ * @stamp: returns the rq clock at which the sample was taken, in ns
+ *
+ * Returns the time integral of @cpu's nr_running in task-nanoseconds.  The
+ * average runqueue depth over an interval is the difference of two samples
+ * divided by the difference of their @stamp.
+ */
+u64 sched_get_nr_running_integral(int cpu, u64 *stamp)
+{
+	struct rq *rq = cpu_rq(cpu);
+	unsigned long flags;
+	u64 integral;
+
+	raw_spin_lock_irqsave(&rq->lock, flags);
+	update_rq_clock(rq);
+	update_nr_running_integral(rq);
+	integral = rq->nr_running_integral;
+	*stamp = rq->nr_running_stamp;
+	raw_spin_unlock_irqrestore(&rq->lock, flags);
+
+	return integral;
+}
+
 
 /*
  * Global load-average calculations
@@ -882,8 +882,12 @@ static inline void update_cfs_shares(struct cfs_rq *cfs_rq)
 }
 #endif /* CONFIG_FAIR_GROUP_SCHED */
 
-/* Only depends on SMP, FAIR_GROUP_SCHED may be removed when useful in lb */
-#if defined(CONFIG_SMP) && defined(CONFIG_FAIR_GROUP_SCHED)
+/*
+ * The per-rq runnable average only depends on SMP; it is also consumed by cpu
+ * hotplug policy through sched_get_cpu_util().  Per-entity load tracking
+ * additionally requires FAIR_GROUP_SCHED, it may be removed when useful in lb.
+ */
+#ifdef CONFIG_SMP
 /*
  * We choose a half-life close to 1 scheduling period.
  * Note: The tables below are dependent on this value.
@@ -1070,6 +1074,16 @@ static __always_inline int __update_entity_runnable_avg(u64 now,
 	return decayed;
 }
 
+#ifndef CONFIG_FAIR_GROUP_SCHED
+static inline void update_rq_runnable_avg(struct rq *rq, int runnable)
+{
+	__update_entity_runnable_avg(rq->clock_task, &rq->avg, runnable);
+}
+#endif
+#endif /* CONFIG_SMP */
+
+#if defined(CONFIG_SMP) && defined(CONFIG_FAIR_GROUP_SCHED)
+
 /* Synchronize an entity's decay with its parenting cfs_rq.*/
 static inline u64 __synchronize_entity_decay(struct sched_entity *se)
 {
@@ -1339,7 +1353,9 @@ static inline void dequeue_entity_load_avg(struct cfs_rq *cfs_rq,
 #else
 static inline void update_entity_load_avg(struct sched_entity *se,
 					  int update_cfs_rq) {}
+#ifndef CONFIG_SMP
 static inline void update_rq_runnable_avg(struct rq *rq, int runnable) {}
+#endif
 static inline void enqueue_entity_load_avg(struct cfs_rq *cfs_rq,
 					   struct sched_entity *se,
 					   int wakeup) {}
@@ -5596,6 +5612,30 @@ static void rq_offline_fair(struct rq *rq)
 	update_sysctl();
 }
 
+/**
+ * sched_get_cpu_util - decayed runnable ratio of a cpu
+ * @cpu: the cpu to sample
+ *
+ * Brings the runqueue's runnable average up to date, so that a cpu which has
+ * been idle since its last tick does not report stale load, and returns the
+ * fraction of recent time it had runnable CFS tasks scaled to
+ * SCHED_POWER_SCALE.
+ */
+unsigned long sched_get_cpu_util(int cpu)
+{
+	struct rq *rq = cpu_rq(cpu);
+	unsigned long flags, util;
+
+	raw_spin_lock_irqsave(&rq->lock, flags);
+	update_rq_clock(rq);
+	update_rq_runnable_avg(rq, rq->nr_running);
+	util = div_u64((u64)rq->avg.runnable_avg_sum << SCHED_POWER_SHIFT,
+		       rq->avg.runnable_avg_period + 1);
+	raw_spin_unlock_irqrestore(&rq->lock, flags);
+
+	return util;
+}
+
 #endif /* CONFIG_SMP */
 
 /*
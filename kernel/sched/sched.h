@@ -367,6 +367,9 @@ struct rq {
 	 * remote CPUs use both these fields when doing load calculation.
 	 */
 	unsigned long nr_running;
+	/* time integral of nr_running, see sched_get_nr_running_integral() */
+	u64 nr_running_integral;
+	u64 nr_running_stamp;
 	#define CPU_LOAD_IDX_MAX 5
 	unsigned long cpu_load[CPU_LOAD_IDX_MAX];
 	unsigned long last_load_update_tick;
@@ -927,13 +930,30 @@ extern void cpuacct_charge(struct task_struct *tsk, u64 cputime);
 static inline void cpuacct_charge(struct task_struct *tsk, u64 cputime) {}
 #endif
 
+/*
+ * Accumulate the runqueue depth over time, so that callers can derive the
+ * average nr_running of a cpu between two samples.  Called with rq->lock
+ * held and rq->clock freshly updated, right before nr_running changes.
+ */
+static inline void update_nr_running_integral(struct rq *rq)
+{
+	u64 now = rq->clock;
+
+	if (likely(now > rq->nr_running_stamp))
+		rq->nr_running_integral +=
+			(now - rq->nr_running_stamp) * rq->nr_running;
+	rq->nr_running_stamp = now;
+}
+
 static inline void inc_nr_running(struct rq *rq)
 {
+	update_nr_running_integral(rq);
 	rq->nr_running++;
 }
 
 static inline void dec_nr_running(struct rq *rq)
 {
+	update_nr_running_integral(rq);
 	rq->nr_running--;
 }
 
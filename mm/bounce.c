@@ -247,6 +247,7 @@ static void __blk_queue_bounce(struct request_queue *q, struct bio **bio_orig,
 	bio->bi_flags |= (1 << BIO_BOUNCED);
 	bio->bi_sector = (*bio_orig)->bi_sector;
 	bio->bi_rw = (*bio_orig)->bi_rw;
+	bio->bi_write_hint = (*bio_orig)->bi_write_hint;
 
 	bio->bi_vcnt = (*bio_orig)->bi_vcnt;
 	bio->bi_idx = (*bio_orig)->bi_idx;
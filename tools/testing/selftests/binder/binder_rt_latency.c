@@ -0,0 +1,327 @@
+/*
+ * binder_rt_latency:
+ *
+ * Measures the round trip latency of synchronous binder transactions made
+ * by a SCHED_FIFO caller while every CPU is kept busy by SCHED_OTHER
+ * background load, and checks that the thread handling the transaction
+ * runs with the caller's scheduling policy.
+ *
+ * The test registers itself as the binder context manager, so it has to
+ * run as root with no servicemanager running:
+ *
+ *	stop; ./binder_rt_latency [iterations] [handler_us]; start
+ *
+ * It prints the p50, p99 and maximum round trip latency and fails if the
+ * handler was not running SCHED_FIFO while serving a call.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "binder.h"
+
+#define BINDER_DEV		"/dev/binder"
+#define BINDER_MAP_SIZE		(128 * 1024)
+#define CALLER_RT_PRIO		50
+#define DEFAULT_ITERATIONS	10000
+#define DEFAULT_HANDLER_US	50
+
+struct binder_conn {
+	int fd;
+	void *map;
+};
+
+static int binder_conn_open(struct binder_conn *bc)
+{
+	bc->fd = open(BINDER_DEV, O_RDWR);
+	if (bc->fd < 0) {
+		perror("open " BINDER_DEV);
+		return -1;
+	}
+	bc->map = mmap(NULL, BINDER_MAP_SIZE, PROT_READ, MAP_PRIVATE,
+		       bc->fd, 0);
+	if (bc->map == MAP_FAILED) {
+		perror("mmap");
+		close(bc->fd);
+		return -1;
+	}
+	return 0;
+}
+
+static int binder_write(struct binder_conn *bc, void *data, size_t len)
+{
+	struct binder_write_read bwr;
+
+	memset(&bwr, 0, sizeof(bwr));
+	bwr.write_size = len;
+	bwr.write_buffer = (unsigned long)data;
+	if (ioctl(bc->fd, BINDER_WRITE_READ, &bwr) < 0) {
+		perror("BINDER_WRITE_READ write");
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Read from the driver until a command we care about shows up. Stores the
+ * command in @cmdp and copies its transaction data into @txn if it carries
+ * one.
+ */
+static int binder_wait_cmd(struct binder_conn *bc, uint32_t *buf, size_t len,
+			   uint32_t *cmdp, struct binder_transaction_data *txn)
+{
+	struct binder_write_read bwr;
+
+	for (;;) {
+		char *ptr, *end;
+
+		memset(&bwr, 0, sizeof(bwr));
+		bwr.read_size = len;
+		bwr.read_buffer = (unsigned long)buf;
+		if (ioctl(bc->fd, BINDER_WRITE_READ, &bwr) < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("BINDER_WRITE_READ read");
+			return -1;
+		}
+
+		ptr = (char *)buf;
+		end = ptr + bwr.read_consumed;
+		while (ptr < end) {
+			uint32_t cmd = *(uint32_t *)ptr;
+
+			ptr += sizeof(uint32_t);
+			switch (cmd) {
+			case BR_TRANSACTION:
+			case BR_REPLY:
+				memcpy(txn, ptr, sizeof(*txn));
+				*cmdp = cmd;
+				return 0;
+			case BR_DEAD_REPLY:
+			case BR_FAILED_REPLY:
+				*cmdp = cmd;
+				return 0;
+			default:
+				ptr += _IOC_SIZE(cmd);
+				break;
+			}
+		}
+	}
+}
+
+static void spin_us(unsigned int us)
+{
+	struct timespec start, now;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	do {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+	} while ((now.tv_sec - start.tv_sec) * 1000000 +
+		 (now.tv_nsec - start.tv_nsec) / 1000 < (long)us);
+}
+
+/*
+ * Context manager: serve every transaction by spinning for @handler_us and
+ * replying with the scheduling policy the handler ran at.
+ */
+static void run_server(int ready_fd, unsigned int handler_us)
+{
+	struct binder_conn bc;
+	uint32_t rbuf[64];
+	char ok = 1;
+
+	if (binder_conn_open(&bc))
+		exit(1);
+	if (ioctl(bc.fd, BINDER_SET_CONTEXT_MGR, 0) < 0) {
+		perror("BINDER_SET_CONTEXT_MGR (is servicemanager running?)");
+		exit(1);
+	}
+	rbuf[0] = BC_ENTER_LOOPER;
+	if (binder_write(&bc, rbuf, sizeof(uint32_t)))
+		exit(1);
+	if (write(ready_fd, &ok, 1) != 1)
+		exit(1);
+	close(ready_fd);
+
+	for (;;) {
+		struct binder_transaction_data txn;
+		struct {
+			uint32_t free_cmd;
+			void *free_ptr;
+			uint32_t reply_cmd;
+			struct binder_transaction_data reply;
+		} __attribute__((packed)) out;
+		int32_t policy;
+		uint32_t cmd;
+
+		if (binder_wait_cmd(&bc, rbuf, sizeof(rbuf), &cmd, &txn))
+			exit(1);
+		if (cmd != BR_TRANSACTION)
+			continue;
+
+		policy = sched_getscheduler(0);
+		spin_us(handler_us);
+
+		memset(&out, 0, sizeof(out));
+		out.free_cmd = BC_FREE_BUFFER;
+		out.free_ptr = (void *)txn.data.ptr.buffer;
+		out.reply_cmd = BC_REPLY;
+		out.reply.data_size = sizeof(policy);
+		out.reply.data.ptr.buffer = &policy;
+		if (binder_write(&bc, &out, sizeof(out)))
+			exit(1);
+	}
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static int run_client(unsigned int iterations)
+{
+	struct sched_param param = { .sched_priority = CALLER_RT_PRIO };
+	struct binder_conn bc;
+	uint32_t rbuf[64];
+	uint64_t *lat;
+	unsigned int i, non_rt = 0;
+
+	lat = calloc(iterations, sizeof(*lat));
+	if (!lat || binder_conn_open(&bc))
+		return 1;
+	if (sched_setscheduler(0, SCHED_FIFO, &param) < 0) {
+		perror("sched_setscheduler");
+		return 1;
+	}
+
+	for (i = 0; i < iterations; i++) {
+		struct binder_transaction_data txn;
+		struct {
+			uint32_t cmd;
+			struct binder_transaction_data txn;
+		} __attribute__((packed)) out;
+		struct {
+			uint32_t cmd;
+			void *ptr;
+		} __attribute__((packed)) done;
+		struct timespec start, end;
+		uint32_t cmd;
+		int ret;
+
+		memset(&out, 0, sizeof(out));
+		out.cmd = BC_TRANSACTION;
+		out.txn.target.handle = 0;
+		out.txn.code = 1;
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		if (binder_write(&bc, &out, sizeof(out)))
+			return 1;
+		ret = binder_wait_cmd(&bc, rbuf, sizeof(rbuf), &cmd, &txn);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		if (ret)
+			return 1;
+		if (cmd != BR_REPLY) {
+			fprintf(stderr, "transaction %u failed: %x\n", i, cmd);
+			return 1;
+		}
+
+		lat[i] = (end.tv_sec - start.tv_sec) * 1000000000ULL +
+			 end.tv_nsec - start.tv_nsec;
+		if (txn.data_size < sizeof(int32_t) ||
+		    *(const int32_t *)txn.data.ptr.buffer != SCHED_FIFO)
+			non_rt++;
+
+		done.cmd = BC_FREE_BUFFER;
+		done.ptr = (void *)txn.data.ptr.buffer;
+		if (binder_write(&bc, &done, sizeof(done)))
+			return 1;
+	}
+
+	qsort(lat, iterations, sizeof(*lat), cmp_u64);
+	printf("iterations: %u\n", iterations);
+	printf("p50: %llu us\n", (unsigned long long)lat[iterations / 2] / 1000);
+	printf("p99: %llu us\n",
+	       (unsigned long long)lat[iterations * 99 / 100] / 1000);
+	printf("max: %llu us\n",
+	       (unsigned long long)lat[iterations - 1] / 1000);
+	printf("handler not SCHED_FIFO: %u\n", non_rt);
+	free(lat);
+
+	if (non_rt) {
+		printf("[FAIL]\n");
+		return 1;
+	}
+	printf("[PASS]\n");
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int iterations = DEFAULT_ITERATIONS;
+	unsigned int handler_us = DEFAULT_HANDLER_US;
+	long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	pid_t server, *hogs;
+	int pipefd[2];
+	char ok;
+	long i;
+	int ret;
+
+	if (argc > 1)
+		iterations = strtoul(argv[1], NULL, 0);
+	if (argc > 2)
+		handler_us = strtoul(argv[2], NULL, 0);
+	if (iterations == 0 || ncpus < 1)
+		return 1;
+
+	if (pipe(pipefd) < 0) {
+		perror("pipe");
+		return 1;
+	}
+	server = fork();
+	if (server == 0) {
+		close(pipefd[0]);
+		run_server(pipefd[1], handler_us);
+	}
+	close(pipefd[1]);
+	if (read(pipefd[0], &ok, 1) != 1) {
+		fprintf(stderr, "server failed to start\n");
+		waitpid(server, NULL, 0);
+		return 1;
+	}
+
+	/* two SCHED_OTHER hogs per cpu compete with the handler thread */
+	hogs = calloc(ncpus * 2, sizeof(*hogs));
+	if (!hogs)
+		return 1;
+	for (i = 0; i < ncpus * 2; i++) {
+		hogs[i] = fork();
+		if (hogs[i] == 0)
+			for (;;)
+				;
+	}
+
+	ret = run_client(iterations);
+
+	for (i = 0; i < ncpus * 2; i++)
+		kill(hogs[i], SIGKILL);
+	kill(server, SIGKILL);
+	while (wait(NULL) > 0)
+		;
+	free(hogs);
+
+	return ret;
+}
@@ -0,0 +1,353 @@
+/*
+ * f2fs_atomic_spill:
+ *
+ * Runs the same stream of database-style transactions twice: once the way
+ * SQLite does with a rollback journal (copy the old pages to -journal,
+ * fsync, overwrite the database, fsync, unlink the journal), and once with
+ * f2fs atomic writes (START_ATOMIC_WRITE, overwrite, COMMIT_ATOMIC_WRITE).
+ * inmem_budget is lowered for the run so that the larger transactions have
+ * to spill their pages to disk before they commit:
+ *
+ *	./f2fs_atomic_spill <dir on f2fs> [transactions]
+ *
+ * Run it as root, with no other atomic writers on the file system.  It
+ * prints the device kilobytes written per transaction in both modes and the
+ * peak number of in-memory atomic pages.  It fails if the database reads
+ * back wrong after a commit or an aborted transaction, if the atomic run
+ * wrote as much as the journal run, or, when debugfs is mounted, if the
+ * in-memory pages went over the budget or a large transaction did not
+ * spill.
+ */
+
+#include <sys/ioctl.h>
+
+#include "f2fs_test.h"
+
+#define F2FS_IOCTL_MAGIC		0xf5
+#define F2FS_IOC_START_ATOMIC_WRITE	_IO(F2FS_IOCTL_MAGIC, 1)
+#define F2FS_IOC_COMMIT_ATOMIC_WRITE	_IO(F2FS_IOCTL_MAGIC, 2)
+
+#define PAGE_SIZE		4096
+#define DB_PAGES		1024
+#define BUDGET			64
+/* pages of one write() that may sit in memory before spilling catches up */
+#define BUDGET_SLACK		16
+#define SMALL_TXN_PAGES		8
+#define LARGE_TXN_PAGES		(BUDGET * 8)
+#define LARGE_TXN_EVERY		50
+#define DEFAULT_TXNS		500
+
+static struct f2fs_test t;
+static unsigned int gen[DB_PAGES];
+static long long peak_inmem = -1, peak_spilled = -1;
+
+static void stamp(char *buf, unsigned int pgno, unsigned int g)
+{
+	unsigned int *p = (unsigned int *)buf;
+	unsigned int i;
+
+	for (i = 0; i < PAGE_SIZE / sizeof(*p); i += 2) {
+		p[i] = pgno;
+		p[i + 1] = g;
+	}
+}
+
+static void sample_inmem(void)
+{
+	long long inmem = f2fs_status(&t, "- inmem:");
+	long long spilled = f2fs_status(&t, "(spilled:");
+
+	if (inmem > peak_inmem)
+		peak_inmem = inmem;
+	if (spilled > peak_spilled)
+		peak_spilled = spilled;
+}
+
+static int write_page(int fd, unsigned int pgno, unsigned int g)
+{
+	char buf[PAGE_SIZE];
+
+	stamp(buf, pgno, g);
+	if (pwrite(fd, buf, PAGE_SIZE, (off_t)pgno * PAGE_SIZE) != PAGE_SIZE) {
+		perror("pwrite");
+		return -1;
+	}
+	return 0;
+}
+
+static int create_db(const char *path)
+{
+	unsigned int i;
+	int fd;
+
+	unlink(path);
+	fd = open(path, O_CREAT | O_RDWR | O_TRUNC, 0644);
+	if (fd < 0) {
+		perror(path);
+		return -1;
+	}
+	for (i = 0; i < DB_PAGES; i++) {
+		gen[i] = 0;
+		if (write_page(fd, i, 0))
+			goto err;
+	}
+	if (fsync(fd) < 0) {
+		perror("fsync");
+		goto err;
+	}
+	return fd;
+err:
+	close(fd);
+	return -1;
+}
+
+static int verify_db(const char *path)
+{
+	char buf[PAGE_SIZE], expect[PAGE_SIZE];
+	unsigned int i;
+	int fd, ret = 0;
+
+	if (drop_caches())
+		return -1;
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		perror(path);
+		return -1;
+	}
+	for (i = 0; i < DB_PAGES; i++) {
+		if (pread(fd, buf, PAGE_SIZE, (off_t)i * PAGE_SIZE) !=
+								PAGE_SIZE) {
+			perror("pread");
+			ret = -1;
+			break;
+		}
+		stamp(expect, i, gen[i]);
+		if (memcmp(buf, expect, PAGE_SIZE)) {
+			fprintf(stderr, "%s: page %u is not at generation %u\n",
+				path, i, gen[i]);
+			ret = -1;
+			break;
+		}
+	}
+	close(fd);
+	return ret;
+}
+
+static unsigned int txn_pages(unsigned int txn)
+{
+	return txn % LARGE_TXN_EVERY == LARGE_TXN_EVERY - 1 ?
+				LARGE_TXN_PAGES : SMALL_TXN_PAGES;
+}
+
+static int journal_txn(int fd, const char *journal, unsigned int txn,
+		       unsigned int *pages, unsigned int nr)
+{
+	char buf[PAGE_SIZE];
+	unsigned int i;
+	int jfd;
+
+	jfd = open(journal, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+	if (jfd < 0) {
+		perror(journal);
+		return -1;
+	}
+	for (i = 0; i < nr; i++) {
+		stamp(buf, pages[i], gen[pages[i]]);
+		if (write(jfd, buf, PAGE_SIZE) != PAGE_SIZE) {
+			perror("write journal");
+			goto err;
+		}
+	}
+	if (fsync(jfd) < 0) {
+		perror("fsync journal");
+		goto err;
+	}
+	close(jfd);
+
+	for (i = 0; i < nr; i++) {
+		if (write_page(fd, pages[i], txn))
+			return -1;
+		gen[pages[i]] = txn;
+	}
+	if (fsync(fd) < 0) {
+		perror("fsync");
+		return -1;
+	}
+	if (unlink(journal) < 0) {
+		perror(journal);
+		return -1;
+	}
+	return 0;
+err:
+	close(jfd);
+	return -1;
+}
+
+static int atomic_txn(int fd, unsigned int txn, unsigned int *pages,
+		      unsigned int nr)
+{
+	unsigned int i;
+
+	if (ioctl(fd, F2FS_IOC_START_ATOMIC_WRITE) < 0) {
+		perror("F2FS_IOC_START_ATOMIC_WRITE");
+		return -1;
+	}
+	for (i = 0; i < nr; i++) {
+		if (write_page(fd, pages[i], txn))
+			return -1;
+		sample_inmem();
+	}
+	if (ioctl(fd, F2FS_IOC_COMMIT_ATOMIC_WRITE) < 0) {
+		perror("F2FS_IOC_COMMIT_ATOMIC_WRITE");
+		return -1;
+	}
+	for (i = 0; i < nr; i++)
+		gen[pages[i]] = txn;
+	return 0;
+}
+
+/*
+ * Run @nr_txns transactions on a fresh database and return the device
+ * kilobytes they wrote, or -1 on error.  Both modes see the same pages.
+ */
+static long long run(const char *dir, int atomic, unsigned int nr_txns)
+{
+	char path[PATH_MAX], journal[PATH_MAX + 8];
+	unsigned int pages[LARGE_TXN_PAGES];
+	unsigned int txn, i;
+	long long kb = -1;
+	uint64_t start;
+	int fd;
+
+	snprintf(path, sizeof(path), "%s/atomic_spill.db", dir);
+	snprintf(journal, sizeof(journal), "%s-journal", path);
+	fd = create_db(path);
+	if (fd < 0)
+		return -1;
+
+	srand(1);
+	sync();
+	kb = f2fs_write_kbytes(&t);
+	start = now_ns();
+	for (txn = 1; txn <= nr_txns; txn++) {
+		unsigned int nr = txn_pages(txn);
+		int ret;
+
+		for (i = 0; i < nr; i++)
+			pages[i] = rand() % DB_PAGES;
+		if (atomic)
+			ret = atomic_txn(fd, txn, pages, nr);
+		else
+			ret = journal_txn(fd, journal, txn, pages, nr);
+		if (ret) {
+			kb = -1;
+			goto out;
+		}
+	}
+	sync();
+	kb = f2fs_write_kbytes(&t) - kb;
+	printf("%-8s %u transactions in %7.1f ms, %7.1f KB written each\n",
+	       atomic ? "atomic" : "journal", nr_txns,
+	       (now_ns() - start) / 1e6, (double)kb / nr_txns);
+out:
+	close(fd);
+	if (kb >= 0 && verify_db(path))
+		kb = -1;
+	return kb;
+}
+
+/* A transaction that is never committed must leave the file untouched. */
+static int abort_txn(const char *dir)
+{
+	char path[PATH_MAX];
+	unsigned int i;
+	int fd;
+
+	snprintf(path, sizeof(path), "%s/atomic_spill.abort", dir);
+	fd = create_db(path);
+	if (fd < 0)
+		return -1;
+	if (ioctl(fd, F2FS_IOC_START_ATOMIC_WRITE) < 0) {
+		perror("F2FS_IOC_START_ATOMIC_WRITE");
+		goto err;
+	}
+	for (i = 0; i < LARGE_TXN_PAGES; i++) {
+		if (write_page(fd, i % DB_PAGES, 1))
+			goto err;
+		sample_inmem();
+	}
+	close(fd);
+
+	if (verify_db(path))
+		goto err_unlink;
+	if (f2fs_status(&t, "(spilled:") > 0) {
+		fprintf(stderr, "spilled pages left behind by an abort\n");
+		goto err_unlink;
+	}
+	unlink(path);
+	return 0;
+err:
+	close(fd);
+err_unlink:
+	unlink(path);
+	return -1;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int nr_txns = DEFAULT_TXNS;
+	long long budget, journal_kb, atomic_kb;
+	char path[PATH_MAX];
+	int ret = 1;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <dir on f2fs> [transactions]\n",
+			argv[0]);
+		return 1;
+	}
+	if (argc > 2)
+		nr_txns = atoi(argv[2]);
+	if (nr_txns < LARGE_TXN_EVERY)
+		nr_txns = LARGE_TXN_EVERY;
+	if (f2fs_test_init(&t, argv[1]))
+		return 1;
+
+	budget = f2fs_get_knob(&t, "inmem_budget");
+	if (budget < 0 || f2fs_set_knob(&t, "inmem_budget", BUDGET))
+		return 1;
+
+	journal_kb = run(argv[1], 0, nr_txns);
+	if (journal_kb < 0)
+		goto out;
+	atomic_kb = run(argv[1], 1, nr_txns);
+	if (atomic_kb < 0 || abort_txn(argv[1]))
+		goto out;
+
+	if (peak_inmem >= 0)
+		printf("peak in-memory atomic pages %lld (budget %d), "
+		       "peak spilled %lld\n", peak_inmem, BUDGET, peak_spilled);
+	else
+		printf("debugfs status not available, "
+		       "in-memory pages not checked\n");
+
+	if (atomic_kb >= journal_kb) {
+		fprintf(stderr, "atomic writes cost %lld KB, journal %lld KB\n",
+			atomic_kb, journal_kb);
+		goto out;
+	}
+	if (peak_inmem > BUDGET + BUDGET_SLACK) {
+		fprintf(stderr, "in-memory pages went over the budget\n");
+		goto out;
+	}
+	if (peak_inmem >= 0 && peak_spilled <= 0) {
+		fprintf(stderr, "large transactions did not spill\n");
+		goto out;
+	}
+	ret = 0;
+out:
+	f2fs_set_knob(&t, "inmem_budget", budget);
+	snprintf(path, sizeof(path), "%s/atomic_spill.db", argv[1]);
+	unlink(path);
+	printf(ret ? "[FAIL]\n" : "[PASS]\n");
+	return ret;
+}
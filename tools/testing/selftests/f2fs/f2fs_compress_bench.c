@@ -0,0 +1,251 @@
+/*
+ * f2fs_compress_bench:
+ *
+ * Writes the same compressible data to a plain file and to a file marked
+ * +c (FS_COMPR_FL), and compares the kilobytes written to the device, the
+ * sequential read time and the latency of random 4k reads with a cold page
+ * cache.  The file system has to be formatted with the compression feature:
+ *
+ *	./f2fs_compress_bench <dir on f2fs> [megabytes]
+ *
+ * Dropping the page cache needs root.  The test fails if a file reads back
+ * wrong, or if the compressed file did not cost fewer device writes than
+ * the plain one.  It is skipped when the file system cannot compress.
+ */
+
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+
+#include "f2fs_test.h"
+
+#define DEFAULT_MB		64
+#define IO_SIZE			(64 * 1024)
+#define BLK_SIZE		4096
+#define NR_RANDOM		2000
+
+struct result {
+	long long write_kb;
+	uint64_t write_ns;
+	uint64_t read_ns;
+	uint64_t p50_ns, p99_ns;
+};
+
+/* Text that lz4 shrinks well, but that still differs from block to block. */
+static void fill_block(char *buf, unsigned int blk)
+{
+	int off = 0, line = 0;
+
+	while (off < BLK_SIZE) {
+		off += snprintf(buf + off, BLK_SIZE - off,
+				"block %08u line %04d: the quick brown fox\n",
+				blk, line++);
+		if (off >= BLK_SIZE)
+			off = BLK_SIZE;
+	}
+}
+
+static int set_compressed(int fd)
+{
+	int flags;
+
+	if (ioctl(fd, FS_IOC_GETFLAGS, &flags) < 0)
+		return -1;
+	flags |= FS_COMPR_FL;
+	return ioctl(fd, FS_IOC_SETFLAGS, &flags);
+}
+
+static int write_file(struct f2fs_test *t, const char *path, int compress,
+		      unsigned int nr_blocks, struct result *r)
+{
+	char *buf = malloc(IO_SIZE);
+	long long kb;
+	uint64_t start;
+	unsigned int blk;
+	int fd;
+
+	if (!buf)
+		return -1;
+	unlink(path);
+	fd = open(path, O_CREAT | O_RDWR | O_TRUNC, 0644);
+	if (fd < 0) {
+		perror(path);
+		free(buf);
+		return -1;
+	}
+	if (compress && set_compressed(fd) < 0) {
+		int err = errno;
+
+		close(fd);
+		unlink(path);
+		free(buf);
+		if (err == EOPNOTSUPP) {
+			printf("compression is not enabled on this file system\n");
+			return 1;
+		}
+		errno = err;
+		perror("FS_IOC_SETFLAGS");
+		return -1;
+	}
+
+	sync();
+	kb = f2fs_write_kbytes(t);
+	start = now_ns();
+	for (blk = 0; blk < nr_blocks; blk += IO_SIZE / BLK_SIZE) {
+		unsigned int i;
+
+		for (i = 0; i < IO_SIZE / BLK_SIZE; i++)
+			fill_block(buf + i * BLK_SIZE, blk + i);
+		if (write(fd, buf, IO_SIZE) != IO_SIZE) {
+			perror("write");
+			goto err;
+		}
+	}
+	if (fsync(fd) < 0) {
+		perror("fsync");
+		goto err;
+	}
+	r->write_ns = now_ns() - start;
+	sync();
+	r->write_kb = f2fs_write_kbytes(t) - kb;
+	close(fd);
+	free(buf);
+	return 0;
+err:
+	close(fd);
+	free(buf);
+	return -1;
+}
+
+static int read_file(const char *path, unsigned int nr_blocks,
+		     struct result *r)
+{
+	char *buf = malloc(IO_SIZE), expect[BLK_SIZE];
+	uint64_t *lat = calloc(NR_RANDOM, sizeof(*lat));
+	uint64_t start;
+	unsigned int blk, i;
+	int fd, ret = -1;
+
+	if (!buf || !lat)
+		goto out_free;
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		perror(path);
+		goto out_free;
+	}
+
+	if (drop_caches())
+		goto out;
+	start = now_ns();
+	for (blk = 0; blk < nr_blocks; blk += IO_SIZE / BLK_SIZE) {
+		if (read(fd, buf, IO_SIZE) != IO_SIZE) {
+			perror("read");
+			goto out;
+		}
+		for (i = 0; i < IO_SIZE / BLK_SIZE; i++) {
+			fill_block(expect, blk + i);
+			if (memcmp(buf + i * BLK_SIZE, expect, BLK_SIZE)) {
+				fprintf(stderr, "%s: block %u reads back wrong\n",
+					path, blk + i);
+				goto out;
+			}
+		}
+	}
+	r->read_ns = now_ns() - start;
+
+	if (drop_caches())
+		goto out;
+	srand(1);
+	for (i = 0; i < NR_RANDOM; i++) {
+		blk = rand() % nr_blocks;
+		start = now_ns();
+		if (pread(fd, buf, BLK_SIZE, (off_t)blk * BLK_SIZE) !=
+								BLK_SIZE) {
+			perror("pread");
+			goto out;
+		}
+		lat[i] = now_ns() - start;
+		fill_block(expect, blk);
+		if (memcmp(buf, expect, BLK_SIZE)) {
+			fprintf(stderr, "%s: block %u reads back wrong\n",
+				path, blk);
+			goto out;
+		}
+	}
+	qsort(lat, NR_RANDOM, sizeof(*lat), cmp_u64);
+	r->p50_ns = lat[NR_RANDOM / 2];
+	r->p99_ns = lat[NR_RANDOM * 99 / 100];
+	ret = 0;
+out:
+	close(fd);
+out_free:
+	free(lat);
+	free(buf);
+	return ret;
+}
+
+static void report(const char *name, struct result *r, unsigned int mb)
+{
+	printf("%-10s written %7lld KB in %6.1f ms, read %u MB in %6.1f ms, "
+	       "random 4k p50 %6.1f us p99 %6.1f us\n",
+	       name, r->write_kb, r->write_ns / 1e6, mb, r->read_ns / 1e6,
+	       r->p50_ns / 1e3, r->p99_ns / 1e3);
+}
+
+int main(int argc, char **argv)
+{
+	struct result plain = { 0 }, compr = { 0 };
+	char plain_path[PATH_MAX], compr_path[PATH_MAX];
+	struct f2fs_test t;
+	unsigned int mb = DEFAULT_MB, nr_blocks;
+	long long saved;
+	int ret;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <dir on f2fs> [megabytes]\n",
+			argv[0]);
+		return 1;
+	}
+	if (argc > 2)
+		mb = atoi(argv[2]);
+	if (!mb)
+		mb = DEFAULT_MB;
+	nr_blocks = mb * (1024 * 1024 / BLK_SIZE);
+	if (f2fs_test_init(&t, argv[1]))
+		return 1;
+
+	snprintf(plain_path, sizeof(plain_path), "%s/compress_bench.plain",
+		 argv[1]);
+	snprintf(compr_path, sizeof(compr_path), "%s/compress_bench.lz4",
+		 argv[1]);
+
+	ret = write_file(&t, compr_path, 1, nr_blocks, &compr);
+	if (ret > 0) {
+		printf("[SKIP]\n");
+		return 0;
+	}
+	if (ret || write_file(&t, plain_path, 0, nr_blocks, &plain) ||
+	    read_file(plain_path, nr_blocks, &plain) ||
+	    read_file(compr_path, nr_blocks, &compr))
+		goto fail;
+
+	report("plain", &plain, mb);
+	report("compressed", &compr, mb);
+	saved = f2fs_status(&t, "(saved");
+	if (saved >= 0)
+		printf("blocks saved by compression so far: %lld\n", saved);
+
+	if (compr.write_kb >= plain.write_kb) {
+		fprintf(stderr, "compressed file cost %lld KB of writes, "
+			"plain file %lld KB\n", compr.write_kb, plain.write_kb);
+		goto fail;
+	}
+	unlink(plain_path);
+	unlink(compr_path);
+	printf("[PASS]\n");
+	return 0;
+fail:
+	unlink(plain_path);
+	unlink(compr_path);
+	printf("[FAIL]\n");
+	return 1;
+}
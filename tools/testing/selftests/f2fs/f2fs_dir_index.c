@@ -0,0 +1,225 @@
+/*
+ * f2fs_dir_index:
+ *
+ * Fills a directory with enough entries to go well past dir_index_blocks,
+ * then checks lookups, misses and unlinks against it with a cold page
+ * cache, first through the directory index and then with the index turned
+ * off (dir_index_blocks = 0) for comparison:
+ *
+ *	./f2fs_dir_index <dir on f2fs> [entries]
+ *
+ * Run it as root on an otherwise quiet file system; the default is 100000
+ * entries.  It prints the time per create, hit and miss, and the device
+ * reads per lookup.  It fails if a lookup gives the wrong answer, if a miss
+ * has to read the directory while the index is on, or, when debugfs is
+ * mounted, if the index did not serve any lookup.
+ */
+
+#include "f2fs_test.h"
+
+#define DEFAULT_ENTRIES		100000
+#define NR_LOOKUPS		2000
+#define INDEX_BLOCKS		64
+
+static struct f2fs_test t;
+
+static void entry_name(char *name, size_t len, const char *prefix,
+		       unsigned int i)
+{
+	snprintf(name, len, "%s-%08u", prefix, i);
+}
+
+static int create_entries(int dfd, unsigned int from, unsigned int to,
+			  unsigned int step)
+{
+	char name[32];
+	unsigned int i;
+	int fd;
+
+	for (i = from; i < to; i += step) {
+		entry_name(name, sizeof(name), "file", i);
+		fd = openat(dfd, name, O_CREAT | O_EXCL | O_WRONLY, 0644);
+		if (fd < 0) {
+			perror(name);
+			return -1;
+		}
+		close(fd);
+	}
+	return 0;
+}
+
+/*
+ * Empty the dentry cache, so that lookups reach f2fs, and the page cache,
+ * so that any directory block they need has to be read.  The shrinker may
+ * free the index along with the dentries; a first lookup builds it again
+ * before the directory blocks are dropped.
+ */
+static int cold_cache(int dfd)
+{
+	struct stat st;
+
+	if (drop_caches_what(3))
+		return -1;
+	fstatat(dfd, "warmup", &st, AT_SYMLINK_NOFOLLOW);
+	return drop_caches();
+}
+
+/*
+ * Look up @nr names of the form @prefix-<n>, either all existing (@exist)
+ * or all missing, and report the time and device reads per lookup.
+ * Returns the number of reads, or -1 if a lookup gave the wrong answer.
+ */
+static long long lookup_entries(int dfd, const char *what, const char *prefix,
+				unsigned int nr, unsigned int modulo, int exist)
+{
+	long long ios;
+	uint64_t start;
+	struct stat st;
+	char name[32];
+	unsigned int i;
+
+	if (cold_cache(dfd))
+		return -1;
+	ios = f2fs_read_ios(&t);
+	start = now_ns();
+	for (i = 0; i < nr; i++) {
+		unsigned int n = exist ? (i * 7919u) % modulo : modulo + i;
+		int ret;
+
+		entry_name(name, sizeof(name), prefix, n);
+		ret = fstatat(dfd, name, &st, AT_SYMLINK_NOFOLLOW);
+		if (exist ? ret < 0 : ret == 0 || errno != ENOENT) {
+			fprintf(stderr, "%s: lookup %s\n", name,
+				exist ? "failed" : "did not miss");
+			return -1;
+		}
+	}
+	ios = f2fs_read_ios(&t) - ios;
+	printf("%-16s %6.1f us, %5.2f reads per lookup\n", what,
+	       (now_ns() - start) / 1e3 / nr, (double)ios / nr);
+	return ios;
+}
+
+/* Unlink every other entry and check what is left. */
+static int unlink_entries(int dfd, unsigned int nr)
+{
+	struct stat st;
+	char name[32];
+	unsigned int i;
+
+	for (i = 0; i < nr; i += 2) {
+		entry_name(name, sizeof(name), "file", i);
+		if (unlinkat(dfd, name, 0) < 0) {
+			perror(name);
+			return -1;
+		}
+	}
+	if (cold_cache(dfd))
+		return -1;
+	for (i = 0; i < nr; i++) {
+		int ret;
+
+		entry_name(name, sizeof(name), "file", i);
+		ret = fstatat(dfd, name, &st, AT_SYMLINK_NOFOLLOW);
+		if (i & 1 ? ret < 0 : ret == 0 || errno != ENOENT) {
+			fprintf(stderr, "%s: %s after unlink\n", name,
+				i & 1 ? "gone" : "still there");
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static void remove_entries(int dfd, unsigned int nr)
+{
+	char name[32];
+	unsigned int i;
+
+	for (i = 0; i < nr; i++) {
+		entry_name(name, sizeof(name), "file", i);
+		unlinkat(dfd, name, 0);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int nr = DEFAULT_ENTRIES;
+	long long blocks, lookups, ios;
+	char dir[PATH_MAX];
+	uint64_t start;
+	int dfd, ret = 1;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <dir on f2fs> [entries]\n", argv[0]);
+		return 1;
+	}
+	if (argc > 2)
+		nr = atoi(argv[2]);
+	if (nr < NR_LOOKUPS)
+		nr = NR_LOOKUPS;
+	if (f2fs_test_init(&t, argv[1]))
+		return 1;
+
+	blocks = f2fs_get_knob(&t, "dir_index_blocks");
+	if (blocks < 0 || f2fs_set_knob(&t, "dir_index_blocks", INDEX_BLOCKS))
+		return 1;
+
+	snprintf(dir, sizeof(dir), "%s/dir_index.d", argv[1]);
+	if (mkdir(dir, 0755) < 0) {
+		perror(dir);
+		goto out_knob;
+	}
+	/* keeps the directory inode, and with it the index, in memory */
+	dfd = open(dir, O_RDONLY | O_DIRECTORY);
+	if (dfd < 0) {
+		perror(dir);
+		goto out_rmdir;
+	}
+
+	lookups = f2fs_status(&t, "- Lookups:");
+	start = now_ns();
+	if (create_entries(dfd, 0, nr, 1))
+		goto out;
+	printf("%-16s %6.1f us each, %u entries\n", "create",
+	       (now_ns() - start) / 1e3 / nr, nr);
+
+	if (lookup_entries(dfd, "hit", "file", NR_LOOKUPS, nr, 1) < 0)
+		goto out;
+	ios = lookup_entries(dfd, "miss", "miss", NR_LOOKUPS, nr, 0);
+	if (ios < 0)
+		goto out;
+	/* a few reads from background work are not the lookups' fault */
+	if (ios > NR_LOOKUPS / 100) {
+		fprintf(stderr, "misses read the directory (%lld reads)\n",
+			ios);
+		goto out;
+	}
+	if (lookups >= 0 && f2fs_status(&t, "- Lookups:") <= lookups) {
+		fprintf(stderr, "the directory index served no lookup\n");
+		goto out;
+	}
+
+	if (unlink_entries(dfd, nr) || create_entries(dfd, 0, nr, 2))
+		goto out;
+	if (lookup_entries(dfd, "hit after unlink", "file", NR_LOOKUPS, nr,
+			   1) < 0)
+		goto out;
+
+	if (f2fs_set_knob(&t, "dir_index_blocks", 0))
+		goto out;
+	if (lookup_entries(dfd, "hit, no index", "file", NR_LOOKUPS, nr,
+			   1) < 0 ||
+	    lookup_entries(dfd, "miss, no index", "nomiss", NR_LOOKUPS, nr,
+			   0) < 0)
+		goto out;
+	ret = 0;
+out:
+	remove_entries(dfd, nr);
+	close(dfd);
+out_rmdir:
+	rmdir(dir);
+out_knob:
+	f2fs_set_knob(&t, "dir_index_blocks", blocks);
+	printf(ret ? "[FAIL]\n" : "[PASS]\n");
+	return ret;
+}
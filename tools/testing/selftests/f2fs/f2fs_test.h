@@ -0,0 +1,203 @@
+/*
+ * Helpers shared by the f2fs selftests.
+ *
+ * Every test takes a directory on a mounted f2fs file system.  The tunables
+ * and the lifetime write counter of that file system are found under
+ * /sys/fs/f2fs/<dev>, and the I/O counters of its block device under
+ * /sys/dev/block/<major>:<minor>/stat.  The debugfs status file is optional;
+ * counters read from it are reported as -1 when it is not available.
+ */
+
+#ifndef _F2FS_TEST_H
+#define _F2FS_TEST_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/types.h>
+
+#define F2FS_STATUS		"/sys/kernel/debug/f2fs/status"
+#define DROP_CACHES		"/proc/sys/vm/drop_caches"
+
+struct f2fs_test {
+	char dev[64];		/* block device name, as in /sys/fs/f2fs */
+	char sysfs[128];	/* /sys/fs/f2fs/<dev> */
+	char blkstat[128];	/* /sys/dev/block/<maj>:<min>/stat */
+};
+
+static inline int f2fs_test_init(struct f2fs_test *t, const char *dir)
+{
+	char link[64], target[PATH_MAX];
+	struct stat st;
+	ssize_t len;
+	char *name;
+
+	if (stat(dir, &st) < 0) {
+		perror(dir);
+		return -1;
+	}
+	snprintf(link, sizeof(link), "/sys/dev/block/%u:%u",
+		 major(st.st_dev), minor(st.st_dev));
+	len = readlink(link, target, sizeof(target) - 1);
+	if (len < 0) {
+		perror(link);
+		return -1;
+	}
+	target[len] = '\0';
+	name = strrchr(target, '/');
+	name = name ? name + 1 : target;
+	if (strlen(name) >= sizeof(t->dev)) {
+		fprintf(stderr, "%s: device name too long\n", target);
+		return -1;
+	}
+
+	strcpy(t->dev, name);
+	snprintf(t->sysfs, sizeof(t->sysfs), "/sys/fs/f2fs/%s", t->dev);
+	snprintf(t->blkstat, sizeof(t->blkstat), "%s/stat", link);
+	if (access(t->sysfs, F_OK) < 0) {
+		fprintf(stderr, "%s is not on f2fs (no %s)\n", dir, t->sysfs);
+		return -1;
+	}
+	return 0;
+}
+
+static inline long long f2fs_get_knob(struct f2fs_test *t, const char *name)
+{
+	char path[PATH_MAX];
+	long long val;
+	FILE *f;
+
+	snprintf(path, sizeof(path), "%s/%s", t->sysfs, name);
+	f = fopen(path, "r");
+	if (!f) {
+		perror(path);
+		return -1;
+	}
+	if (fscanf(f, "%lld", &val) != 1)
+		val = -1;
+	fclose(f);
+	return val;
+}
+
+static inline int f2fs_set_knob(struct f2fs_test *t, const char *name,
+				long long val)
+{
+	char path[PATH_MAX];
+	FILE *f;
+	int ret;
+
+	snprintf(path, sizeof(path), "%s/%s", t->sysfs, name);
+	f = fopen(path, "w");
+	if (!f) {
+		perror(path);
+		return -1;
+	}
+	ret = fprintf(f, "%lld\n", val) < 0;
+	if (fclose(f) || ret) {
+		perror(path);
+		return -1;
+	}
+	return 0;
+}
+
+/* Kilobytes written to the device over the life of the file system. */
+static inline long long f2fs_write_kbytes(struct f2fs_test *t)
+{
+	return f2fs_get_knob(t, "lifetime_write_kbytes");
+}
+
+/* Read requests completed by the block device holding the file system. */
+static inline long long f2fs_read_ios(struct f2fs_test *t)
+{
+	long long ios;
+	FILE *f;
+
+	f = fopen(t->blkstat, "r");
+	if (!f) {
+		perror(t->blkstat);
+		return -1;
+	}
+	if (fscanf(f, "%lld", &ios) != 1)
+		ios = -1;
+	fclose(f);
+	return ios;
+}
+
+/*
+ * Look up "<key> <value>" in the section of the debugfs status file that
+ * belongs to this file system.
+ */
+static inline long long f2fs_status(struct f2fs_test *t, const char *key)
+{
+	char line[256], section[128];
+	long long val = -1;
+	int mine = 0;
+	FILE *f;
+
+	f = fopen(F2FS_STATUS, "r");
+	if (!f)
+		return -1;
+	snprintf(section, sizeof(section), "partition info(%s)", t->dev);
+	while (fgets(line, sizeof(line), f)) {
+		char *p;
+
+		if (strstr(line, "partition info("))
+			mine = strstr(line, section) != NULL;
+		if (!mine)
+			continue;
+		p = strstr(line, key);
+		if (p && sscanf(p + strlen(key), "%lld", &val) == 1)
+			break;
+	}
+	fclose(f);
+	return val;
+}
+
+/* @what as for /proc/sys/vm/drop_caches: 1 page cache, 2 slab, 3 both */
+static inline int drop_caches_what(int what)
+{
+	char buf[2] = { '0' + what, '\0' };
+	int fd, ret;
+
+	sync();
+	fd = open(DROP_CACHES, O_WRONLY);
+	if (fd < 0) {
+		perror(DROP_CACHES);
+		return -1;
+	}
+	ret = write(fd, buf, 1) == 1 ? 0 : -1;
+	if (ret)
+		perror(DROP_CACHES);
+	close(fd);
+	return ret;
+}
+
+static inline int drop_caches(void)
+{
+	return drop_caches_what(1);
+}
+
+static inline uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+#endif /* _F2FS_TEST_H */